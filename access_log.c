@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "access_log.h"
+
+#define LOG_BUFFER_SIZE 65536 // Formatted bytes collected before a write()
+#define LOG_LINE_MAX 256      // Longest formatted record
+#define LOG_IDLE_MS 10        // Sleep after a sweep that found nothing
+
+const char *const log_level_names[LOG_LEVELS] = {"off", "errors", "all"};
+
+struct AccessLog
+{
+    int fd;
+    int ring_count;
+    LogRing *rings;
+    pthread_t thread;
+    int started;
+    int stopping;
+    char buffer[LOG_BUFFER_SIZE];
+    size_t buffer_length;
+};
+
+AccessLog *access_log_create(int fd, int ring_count, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+
+    AccessLog *log = calloc(1, sizeof(AccessLog));
+    if (!log)
+        return NULL;
+    log->fd = fd;
+    log->ring_count = ring_count;
+    log->rings = aligned_alloc(_Alignof(LogRing), ring_count * sizeof(LogRing));
+    if (!log->rings)
+    {
+        free(log);
+        return NULL;
+    }
+    memset(log->rings, 0, ring_count * sizeof(LogRing));
+    for (int i = 0; i < ring_count; i++)
+    {
+        log->rings[i].mask = size - 1;
+        log->rings[i].records = malloc(size * sizeof(LogRecord));
+        if (!log->rings[i].records)
+        {
+            access_log_destroy(log);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    return log;
+}
+
+LogRing *access_log_ring(AccessLog *log, int index)
+{
+    return &log->rings[index];
+}
+
+// Writes out the collected lines. A failing log loses them rather than
+// holding up the sweep.
+static void flush_buffer(AccessLog *log)
+{
+    size_t offset = 0;
+    while (offset < log->buffer_length)
+    {
+        ssize_t written = write(log->fd, log->buffer + offset, log->buffer_length - offset);
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            break;
+        offset += written;
+    }
+    log->buffer_length = 0;
+}
+
+// Appends one record as
+// 2026-10-17T16:05:28.123Z 0 "GET /hello" 200 142 0.012ms
+// offset_ns turns its monotonic arrival into wall-clock time.
+static void format_record(AccessLog *log, const LogRecord *record, int64_t offset_ns)
+{
+    if (log->buffer_length + LOG_LINE_MAX > sizeof(log->buffer))
+        flush_buffer(log);
+
+    int64_t wall_ns = (int64_t)record->start_ns + offset_ns;
+    time_t seconds = wall_ns / 1000000000;
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+
+    char *line = log->buffer + log->buffer_length;
+    size_t length = strftime(line, LOG_LINE_MAX, "%Y-%m-%dT%H:%M:%S", &tm);
+    length += snprintf(line + length, LOG_LINE_MAX - length,
+                       ".%03dZ %u \"%.*s %.*s%s\" %u %llu %.3fms\n",
+                       (int)(wall_ns / 1000000 % 1000), record->worker,
+                       record->method_length ? (int)record->method_length : 1,
+                       record->method_length ? record->method : "-",
+                       record->path_length ? (int)record->path_length : 1,
+                       record->path_length ? record->path : "-",
+                       record->path_truncated ? "..." : "", record->status,
+                       (unsigned long long)record->bytes, record->latency_ns / 1e6);
+    log->buffer_length += length < LOG_LINE_MAX ? length : LOG_LINE_MAX - 1;
+}
+
+// Formats every record committed to the rings so far. Returns how many.
+static size_t sweep(AccessLog *log)
+{
+    struct timespec wall, monotonic;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    int64_t offset_ns = ((int64_t)wall.tv_sec - monotonic.tv_sec) * 1000000000 +
+                        (wall.tv_nsec - monotonic.tv_nsec);
+
+    size_t count = 0;
+    for (int i = 0; i < log->ring_count; i++)
+    {
+        LogRing *ring = &log->rings[i];
+        size_t head = ring->head;
+        size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        count += tail - head;
+        for (; head != tail; head++)
+            format_record(log, &ring->records[head & ring->mask], offset_ns);
+        // The records are copied out, so their slots are free again
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+    flush_buffer(log);
+    return count;
+}
+
+static void *log_main(void *arg)
+{
+    AccessLog *log = arg;
+    while (!__atomic_load_n(&log->stopping, __ATOMIC_ACQUIRE))
+    {
+        if (sweep(log) == 0)
+        {
+            struct timespec idle = {0, LOG_IDLE_MS * 1000000L};
+            nanosleep(&idle, NULL);
+        }
+    }
+    sweep(log);
+    return NULL;
+}
+
+int access_log_start(AccessLog *log)
+{
+    int error = pthread_create(&log->thread, NULL, log_main, log);
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    log->started = 1;
+    return 0;
+}
+
+void access_log_destroy(AccessLog *log)
+{
+    if (!log)
+        return;
+    if (log->started)
+    {
+        __atomic_store_n(&log->stopping, 1, __ATOMIC_RELEASE);
+        pthread_join(log->thread, NULL);
+    }
+    for (int i = 0; i < log->ring_count; i++)
+        free(log->rings[i].records);
+    free(log->rings);
+    free(log);
+}
@@ -0,0 +1,89 @@
+// Asynchronous access log.
+//
+// Every worker appends fixed-size binary records to a ring of its own: one
+// producer, one consumer, so a push is a few stores and one release of the
+// tail, with no lock, no formatting and no system call. A background thread
+// sweeps all rings, formats the records as text and writes them out in
+// large batches. A full ring never blocks its worker: the record is dropped
+// and the caller counts the drop.
+
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_METHOD_MAX 8
+#define LOG_PATH_MAX 86 // Longer paths are cut and marked with "..."
+
+// What gets logged; config.access_log_level may change while running
+typedef enum
+{
+    LOG_OFF,
+    LOG_ERRORS, // Responses with a 4xx or 5xx status
+    LOG_ALL,
+    LOG_LEVELS
+} LogLevel;
+
+extern const char *const log_level_names[LOG_LEVELS]; // "off", "errors", "all"
+
+// One answered request, 128 bytes
+typedef struct
+{
+    uint64_t start_ns;   // CLOCK_MONOTONIC arrival; the log thread converts it
+    uint64_t latency_ns;
+    uint64_t bytes;      // Response bytes, head and body
+    uint16_t status;
+    uint16_t worker;
+    uint8_t method_length;
+    uint8_t path_length;
+    uint8_t path_truncated;
+    char method[LOG_METHOD_MAX];
+    char path[LOG_PATH_MAX];
+} LogRecord;
+
+// Single-producer, single-consumer ring of capacity records (a power of two)
+typedef struct LogRing
+{
+    LogRecord *records;
+    size_t mask;
+    _Alignas(64) size_t head; // Next record to read; written by the log thread
+    _Alignas(64) size_t tail; // Next record to write; written by the worker
+    size_t cached_head;       // The worker's last look at head
+} LogRing;
+
+typedef struct AccessLog AccessLog;
+
+// Creates ring_count rings of capacity records (rounded up to a power of
+// two) whose records will be written to fd. Returns NULL with errno set.
+AccessLog *access_log_create(int fd, int ring_count, size_t capacity);
+
+// The ring worker index pushes to
+LogRing *access_log_ring(AccessLog *log, int index);
+
+// Starts the background thread. Returns 0, or -1 with errno.
+int access_log_start(AccessLog *log);
+
+// Stops the thread after it has written everything pushed so far, then
+// frees the rings. fd is left open.
+void access_log_destroy(AccessLog *log);
+
+// Returns the slot for the next record, or NULL if the ring is full. Fill
+// it in and call access_log_commit; the worker owning the ring only.
+static inline LogRecord *access_log_reserve(LogRing *ring)
+{
+    if (ring->tail - ring->cached_head > ring->mask)
+    {
+        ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (ring->tail - ring->cached_head > ring->mask)
+            return NULL;
+    }
+    return &ring->records[ring->tail & ring->mask];
+}
+
+static inline void access_log_commit(LogRing *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif
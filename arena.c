@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+
+struct ArenaChunk
+{
+    ArenaChunk *next;
+    size_t size;  // Usable bytes
+    int large;    // Sized for one allocation; freed rather than pooled
+    _Alignas(ARENA_ALIGNMENT) char data[];
+};
+
+void arena_pool_init(ArenaPool *pool, size_t chunk_size, size_t max_free)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->chunk_size = chunk_size;
+    pool->max_free = max_free;
+}
+
+void arena_pool_destroy(ArenaPool *pool)
+{
+    while (pool->free)
+    {
+        ArenaChunk *next = pool->free->next;
+        free(pool->free);
+        pool->free = next;
+    }
+    pool->free_count = 0;
+}
+
+static ArenaChunk *take_chunk(ArenaPool *pool)
+{
+    ArenaChunk *chunk = pool->free;
+    if (chunk)
+    {
+        pool->free = chunk->next;
+        pool->free_count--;
+        pool->stats.chunk_reuses++;
+        return chunk;
+    }
+
+    chunk = malloc(sizeof(ArenaChunk) + pool->chunk_size);
+    if (!chunk)
+        return NULL;
+    chunk->size = pool->chunk_size;
+    chunk->large = 0;
+    pool->stats.chunk_mallocs++;
+    return chunk;
+}
+
+static void give_chunk(ArenaPool *pool, ArenaChunk *chunk)
+{
+    if (chunk->large || pool->free_count >= pool->max_free)
+    {
+        free(chunk);
+        return;
+    }
+    chunk->next = pool->free;
+    pool->free = chunk;
+    pool->free_count++;
+}
+
+void arena_init(Arena *arena, ArenaPool *pool)
+{
+    arena->pool = pool;
+    arena->chunks = NULL;
+    arena->cursor = arena->end = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if ((size_t)(arena->end - arena->cursor) >= size)
+    {
+        void *result = arena->cursor;
+        arena->cursor += size;
+        return result;
+    }
+
+    ArenaPool *pool = arena->pool;
+    if (size > pool->chunk_size / 2)
+    {
+        // Big enough to waste most of a chunk: give it a block of its own and
+        // keep bumping through the current chunk
+        ArenaChunk *large = malloc(sizeof(ArenaChunk) + size);
+        if (!large)
+            return NULL;
+        large->size = size;
+        large->large = 1;
+        pool->stats.large_mallocs++;
+        if (arena->chunks)
+        {
+            large->next = arena->chunks->next;
+            arena->chunks->next = large;
+        }
+        else
+        {
+            large->next = NULL;
+            arena->chunks = large;
+        }
+        return large->data;
+    }
+
+    ArenaChunk *chunk = take_chunk(pool);
+    if (!chunk)
+        return NULL;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->cursor = chunk->data + size;
+    arena->end = chunk->data + chunk->size;
+    return chunk->data;
+}
+
+void *arena_dup(Arena *arena, const void *data, size_t size)
+{
+    void *copy = arena_alloc(arena, size);
+    if (copy)
+        memcpy(copy, data, size);
+    return copy;
+}
+
+void arena_reset(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk)
+    {
+        ArenaChunk *next = chunk->next;
+        give_chunk(arena->pool, chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->cursor = arena->end = NULL;
+}
+
+void object_pool_init(ObjectPool *pool, size_t object_size, size_t max_free, ArenaStats *stats)
+{
+    memset(pool, 0, sizeof(*pool));
+    // Free objects hold the list link in their first bytes
+    pool->object_size = object_size > sizeof(void *) ? object_size : sizeof(void *);
+    pool->max_free = max_free;
+    pool->stats = stats;
+}
+
+void object_pool_destroy(ObjectPool *pool)
+{
+    while (pool->free)
+    {
+        void *next = *(void **)pool->free;
+        free(pool->free);
+        pool->free = next;
+    }
+    pool->free_count = 0;
+}
+
+void *object_pool_get(ObjectPool *pool)
+{
+    void *object = pool->free;
+    if (object)
+    {
+        pool->free = *(void **)object;
+        pool->free_count--;
+        if (pool->stats)
+            pool->stats->object_reuses++;
+    }
+    else
+    {
+        object = malloc(pool->object_size);
+        if (!object)
+            return NULL;
+        if (pool->stats)
+            pool->stats->object_mallocs++;
+    }
+    memset(object, 0, pool->object_size);
+    return object;
+}
+
+void object_pool_put(ObjectPool *pool, void *object)
+{
+    if (pool->free_count >= pool->max_free)
+    {
+        free(object);
+        return;
+    }
+    *(void **)object = pool->free;
+    pool->free = object;
+    pool->free_count++;
+}
@@ -0,0 +1,82 @@
+// Request-lifetime memory.
+//
+// An Arena hands out memory by bumping a pointer through fixed-size chunks
+// and gives it all back at once with arena_reset, so nothing allocated from
+// it is ever freed individually. The chunks come from an ArenaPool that keeps
+// released ones for the next arena, which makes a steady stream of requests
+// run without touching malloc. An ObjectPool does the same for fixed-size
+// objects such as connections.
+//
+// Pools are not thread-safe; each worker owns its own. The counters let a
+// benchmark check how often the pools had to fall back to malloc.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE 16384
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Allocation counters of a pool, since it was created
+typedef struct
+{
+    unsigned long chunk_mallocs; // Chunks obtained from malloc
+    unsigned long chunk_reuses;  // Chunks handed out again from the free list
+    unsigned long large_mallocs; // Allocations too big for a chunk
+    unsigned long object_mallocs;
+    unsigned long object_reuses;
+} ArenaStats;
+
+typedef struct
+{
+    size_t chunk_size;    // Usable bytes per chunk
+    ArenaChunk *free;     // Released chunks, ready for reuse
+    size_t free_count;
+    size_t max_free;      // Chunks beyond this go back to malloc
+    ArenaStats stats;
+} ArenaPool;
+
+typedef struct
+{
+    ArenaPool *pool;
+    ArenaChunk *chunks;   // Current chunk first
+    char *cursor;         // Next free byte in the current chunk
+    char *end;
+} Arena;
+
+void arena_pool_init(ArenaPool *pool, size_t chunk_size, size_t max_free);
+void arena_pool_destroy(ArenaPool *pool);
+
+void arena_init(Arena *arena, ArenaPool *pool);
+
+// Returns size bytes aligned for any type, or NULL if malloc fails. A
+// request that does not fit in the current chunk and is larger than half a
+// chunk gets a block of its own, freed by the reset.
+void *arena_alloc(Arena *arena, size_t size);
+
+// Copies size bytes into the arena
+void *arena_dup(Arena *arena, const void *data, size_t size);
+
+// Releases everything allocated since arena_init or the last reset
+void arena_reset(Arena *arena);
+
+// Recycles fixed-size objects, keeping up to max_free of them
+typedef struct
+{
+    size_t object_size;
+    void *free;
+    size_t free_count;
+    size_t max_free;
+    ArenaStats *stats; // Counters shared with an ArenaPool, or NULL
+} ObjectPool;
+
+void object_pool_init(ObjectPool *pool, size_t object_size, size_t max_free, ArenaStats *stats);
+void object_pool_destroy(ObjectPool *pool);
+
+// Returns a zeroed object, or NULL if memory is exhausted
+void *object_pool_get(ObjectPool *pool);
+void object_pool_put(ObjectPool *pool, void *object);
+
+#endif
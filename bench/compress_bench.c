@@ -0,0 +1,208 @@
+// CPU cost and bandwidth savings of response compression per zlib level.
+//
+// Runs the server's Compressor (compress.c) over sample bodies the way a
+// worker does: one reused stream, reset per body, output in an arena that
+// is reset after each response. For every level it prints the compressed
+// size, the share of bytes saved, throughput in MB/s of input and the CPU
+// time per body, so the extra microseconds per response can be weighed
+// against the bytes kept off the wire. The built-in samples are a JSON
+// API response, a /metrics page and an HTML page; files given on the
+// command line are measured instead.
+//
+// Build: gcc -O2 -I. -o compress_bench bench/compress_bench.c compress.c file_cache.c arena.c http_parser.c -lz
+// Usage: compress_bench [-e gzip|deflate] [-t seconds] [file...]
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "compress.h"
+
+#define DEFAULT_SECONDS 0.3 // Measured per level and sample
+
+typedef struct
+{
+    const char *name;
+    char *data;
+    size_t length;
+} Sample;
+
+static double cpu_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Appends printf output to a growing sample
+static void append(Sample *sample, size_t *capacity, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void append(Sample *sample, size_t *capacity, const char *format, ...)
+{
+    va_list args;
+    while (1)
+    {
+        va_start(args, format);
+        int length = vsnprintf(sample->data + sample->length, *capacity - sample->length, format, args);
+        va_end(args);
+        if (sample->length + length < *capacity)
+        {
+            sample->length += length;
+            return;
+        }
+        *capacity *= 2;
+        sample->data = realloc(sample->data, *capacity);
+    }
+}
+
+// About 64 KB of records like the JSON API returns
+static Sample json_sample(void)
+{
+    Sample sample = {"json 64k", malloc(1024), 0};
+    size_t capacity = 1024;
+    append(&sample, &capacity, "[");
+    for (unsigned i = 0; sample.length < 65536; i++)
+        append(&sample, &capacity,
+               "%s{\"id\":%u,\"name\":\"item %u\",\"price\":%u.%02u,\"active\":%s,\"tags\":[\"a\",\"b\"]}",
+               i ? "," : "", i, i, i * 7 % 1000, i % 100, i % 2 ? "true" : "false");
+    append(&sample, &capacity, "]");
+    return sample;
+}
+
+// A /metrics page for a few dozen routes
+static Sample metrics_sample(void)
+{
+    Sample sample = {"metrics", malloc(1024), 0};
+    size_t capacity = 1024;
+    for (int route = 0; route < 24; route++)
+    {
+        for (int bucket = 0; bucket < 24; bucket++)
+            append(&sample, &capacity,
+                   "http_request_duration_seconds_bucket{method=\"GET\",route=\"/api/v1/r%d\",le=\"%g\"} %d\n",
+                   route, 1e-6 * (1 << bucket), route * 1000 + bucket * 37);
+        append(&sample, &capacity, "http_requests_total{method=\"GET\",route=\"/api/v1/r%d\",class=\"2xx\"} %d\n",
+               route, route * 7919);
+    }
+    return sample;
+}
+
+// A 16 KB HTML page
+static Sample html_sample(void)
+{
+    Sample sample = {"html 16k", malloc(1024), 0};
+    size_t capacity = 1024;
+    append(&sample, &capacity, "<!DOCTYPE html><html><head><title>Items</title></head><body><ul>\n");
+    for (int i = 0; sample.length < 16384; i++)
+        append(&sample, &capacity, "<li class=\"item\"><a href=\"/items/%d\">Item %d</a> <span>%d in stock</span></li>\n",
+               i, i, i * 13 % 97);
+    append(&sample, &capacity, "</ul></body></html>\n");
+    return sample;
+}
+
+static Sample file_sample(const char *path)
+{
+    Sample sample = {path, NULL, 0};
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    sample.length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    sample.data = malloc(sample.length + 1);
+    if (fread(sample.data, 1, sample.length, file) != sample.length)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(file);
+    return sample;
+}
+
+static void measure(const Sample *sample, Encoding encoding, double seconds)
+{
+    ArenaPool pool;
+    Arena arena;
+    arena_pool_init(&pool, ARENA_CHUNK_SIZE, 4);
+    arena_init(&arena, &pool);
+
+    printf("%s: %zu bytes\n", sample->name, sample->length);
+    printf("  level  compressed   saved    MB/s   us/body\n");
+    for (int level = 1; level <= 9; level++)
+    {
+        Compressor *compressor = compressor_create(level);
+        size_t length = 0;
+        unsigned long bodies = 0;
+        double start = cpu_seconds(), elapsed;
+        do
+        {
+            if (compressor_begin(compressor, encoding, sample->length, &arena) != 0)
+            {
+                fprintf(stderr, "compressor_begin failed\n");
+                exit(1);
+            }
+            compressor_write(compressor, sample->data, sample->length);
+            if (!compressor_finish(compressor, &length))
+            {
+                fprintf(stderr, "compressor_finish failed\n");
+                exit(1);
+            }
+            arena_reset(&arena);
+            bodies++;
+            elapsed = cpu_seconds() - start;
+        } while (elapsed < seconds);
+        compressor_free(compressor);
+
+        printf("  %5d  %10zu  %5.1f%%  %6.1f  %8.1f\n", level, length,
+               100.0 * (1 - (double)length / sample->length),
+               sample->length * (double)bodies / elapsed / 1e6, elapsed / bodies * 1e6);
+    }
+    arena_reset(&arena);
+    arena_pool_destroy(&pool);
+}
+
+int main(int argc, char **argv)
+{
+    Encoding encoding = ENCODING_GZIP;
+    double seconds = DEFAULT_SECONDS;
+    int option;
+    while ((option = getopt(argc, argv, "e:t:")) != -1)
+    {
+        switch (option)
+        {
+        case 'e':
+            encoding = strcmp(optarg, "deflate") == 0 ? ENCODING_DEFLATE : ENCODING_GZIP;
+            break;
+        case 't': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-e gzip|deflate] [-t seconds] [file...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%s, CPU time per body at each level\n", encoding_names[encoding]);
+    if (optind < argc)
+    {
+        for (int i = optind; i < argc; i++)
+        {
+            Sample sample = file_sample(argv[i]);
+            measure(&sample, encoding, seconds);
+            free(sample.data);
+        }
+        return 0;
+    }
+    Sample samples[] = {json_sample(), metrics_sample(), html_sample()};
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+    {
+        measure(&samples[i], encoding, seconds);
+        free(samples[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+
+#define SUB_BUCKET_BITS 10
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+// Values below SUB_BUCKETS get a bucket each; every power of two above
+// gets SUB_BUCKETS of them
+#define BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+struct Histogram
+{
+    uint64_t count;
+    uint64_t max;
+    double sum;
+    uint64_t counts[BUCKETS];
+};
+
+static int bucket_index(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return (int)value;
+    int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + (int)((value >> shift) - SUB_BUCKETS);
+}
+
+// Highest value that lands in bucket index
+static uint64_t bucket_highest(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+    int shift = (index >> SUB_BUCKET_BITS) - 1;
+    uint64_t lowest = (uint64_t)((index & (SUB_BUCKETS - 1)) + SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+Histogram *histogram_create(void)
+{
+    return calloc(1, sizeof(Histogram));
+}
+
+void histogram_free(Histogram *histogram)
+{
+    free(histogram);
+}
+
+void histogram_reset(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void histogram_record(Histogram *histogram, uint64_t value)
+{
+    histogram->counts[bucket_index(value)]++;
+    histogram->count++;
+    histogram->sum += (double)value;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+void histogram_merge(Histogram *into, const Histogram *from)
+{
+    for (int i = 0; i < BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+uint64_t histogram_count(const Histogram *histogram)
+{
+    return histogram->count;
+}
+
+uint64_t histogram_max(const Histogram *histogram)
+{
+    return histogram->max;
+}
+
+double histogram_mean(const Histogram *histogram)
+{
+    return histogram->count ? histogram->sum / histogram->count : 0.0;
+}
+
+uint64_t histogram_percentile(const Histogram *histogram, double percentile)
+{
+    if (histogram->count == 0)
+        return 0;
+    // Rank of the value asked for, counting from 1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > histogram->count)
+        rank = histogram->count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t value = bucket_highest(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
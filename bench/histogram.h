@@ -0,0 +1,32 @@
+// Latency histogram in the style of HdrHistogram.
+//
+// Values (nanoseconds, say) are counted in log-linear buckets: every power
+// of two is split into 1024 equal sub-buckets, so any recorded value is
+// known to within 0.1% from 1 up to 2^63, recording is a few shifts and an
+// increment, and the memory use is fixed. Percentiles are read back as the
+// highest value of the bucket they fall in, like HdrHistogram reports them.
+// Histograms of several threads combine with histogram_merge.
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+typedef struct Histogram Histogram;
+
+Histogram *histogram_create(void);
+void histogram_free(Histogram *histogram);
+void histogram_reset(Histogram *histogram);
+
+void histogram_record(Histogram *histogram, uint64_t value);
+void histogram_merge(Histogram *into, const Histogram *from);
+
+uint64_t histogram_count(const Histogram *histogram);
+uint64_t histogram_max(const Histogram *histogram);
+double histogram_mean(const Histogram *histogram);
+
+// Value at or below which the given percentage (0-100) of recorded values
+// fall; 0 for an empty histogram
+uint64_t histogram_percentile(const Histogram *histogram, double percentile);
+
+#endif
@@ -0,0 +1,217 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "http_client.h"
+
+int http_client_connect(HttpClient *client, const struct sockaddr_in *address, int epoll_fd, void *data)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (const struct sockaddr *)address, sizeof(*address)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = data;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+    client->fd = fd;
+    client->out_length = client->out_sent = 0;
+    client->in_length = 0;
+    client->body_remaining = 0;
+    client->closing = 0;
+    client->head_first = client->head_count = 0;
+    return 0;
+}
+
+void http_client_close(HttpClient *client)
+{
+    if (client->fd != -1)
+        close(client->fd);
+    client->fd = -1;
+    client->out_length = client->out_sent = 0;
+    client->in_length = 0;
+    client->body_remaining = 0;
+    client->head_first = client->head_count = 0;
+}
+
+void http_client_free(HttpClient *client)
+{
+    http_client_close(client);
+    free(client->out);
+    free(client->head);
+    client->out = NULL;
+    client->head = NULL;
+    client->out_capacity = client->head_capacity = 0;
+}
+
+void http_client_queue(HttpClient *client, const char *request, size_t length)
+{
+    if (client->out_length + length > client->out_capacity)
+    {
+        client->out_capacity = (client->out_length + length) * 2;
+        client->out = realloc(client->out, client->out_capacity);
+    }
+    memcpy(client->out + client->out_length, request, length);
+    client->out_length += length;
+
+    if (client->head_count == client->head_capacity)
+    {
+        // Unroll the ring into the bigger array
+        size_t capacity = client->head_capacity ? client->head_capacity * 2 : 16;
+        unsigned char *head = malloc(capacity);
+        for (size_t i = 0; i < client->head_count; i++)
+            head[i] = client->head[(client->head_first + i) % client->head_capacity];
+        free(client->head);
+        client->head = head;
+        client->head_first = 0;
+        client->head_capacity = capacity;
+    }
+    client->head[(client->head_first + client->head_count++) % client->head_capacity] =
+        length >= 5 && memcmp(request, "HEAD ", 5) == 0;
+}
+
+int http_client_flush(HttpClient *client)
+{
+    while (client->out_sent < client->out_length)
+    {
+        ssize_t written = send(client->fd, client->out + client->out_sent,
+                               client->out_length - client->out_sent, MSG_NOSIGNAL);
+        if (written > 0)
+            client->out_sent += written;
+        else if (written == -1 && errno == EINTR)
+            continue;
+        else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0; // The next EPOLLOUT edge resumes
+        else
+            return -1;
+    }
+    client->out_length = client->out_sent = 0;
+    return 0;
+}
+
+// Finds a header's value in a response head, case-insensitively. Returns
+// NULL if the header is missing.
+static const char *find_header(const char *head, size_t length, const char *name, size_t *value_length)
+{
+    size_t name_length = strlen(name);
+    const char *end = head + length;
+    const char *line = memchr(head, '\n', length);
+    while (line && ++line < end)
+    {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (!line_end)
+            break;
+        if ((size_t)(line_end - line) > name_length && line[name_length] == ':' &&
+            strncasecmp(line, name, name_length) == 0)
+        {
+            const char *value = line + name_length + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t'))
+                value++;
+            const char *value_end = line_end;
+            while (value_end > value && (value_end[-1] == '\r' || value_end[-1] == ' '))
+                value_end--;
+            *value_length = value_end - value;
+            return value;
+        }
+        line = line_end;
+    }
+    return NULL;
+}
+
+// Consumes the responses in the input buffer. Returns the number
+// completed, or HTTP_CLIENT_BAD.
+static int parse_responses(HttpClient *client, void (*on_response)(void *, int), void *context)
+{
+    size_t offset = 0;
+    int completed = 0;
+    while (offset < client->in_length)
+    {
+        if (client->body_remaining > 0)
+        {
+            size_t available = client->in_length - offset;
+            size_t take = available < client->body_remaining ? available : client->body_remaining;
+            client->body_remaining -= take;
+            offset += take;
+            if (client->body_remaining > 0)
+                break;
+        }
+        else
+        {
+            const char *head = client->in + offset;
+            size_t available = client->in_length - offset;
+            const char *blank = memmem(head, available, "\r\n\r\n", 4);
+            if (!blank)
+            {
+                if (offset == 0 && available == sizeof(client->in))
+                    return HTTP_CLIENT_BAD; // Head larger than the buffer
+                break;
+            }
+            size_t head_length = blank + 4 - head;
+            if (head_length < 12 || memcmp(head, "HTTP/1.", 7) != 0)
+                return HTTP_CLIENT_BAD;
+            client->status = atoi(head + 9);
+            int head_request = 0;
+            if (client->head_count > 0)
+            {
+                head_request = client->head[client->head_first];
+                client->head_first = (client->head_first + 1) % client->head_capacity;
+                client->head_count--;
+            }
+
+            size_t length;
+            const char *value = find_header(head, head_length, "Content-Length", &length);
+            client->body_remaining = value ? strtoull(value, NULL, 10) : 0;
+            if (head_request || client->status == 204 || client->status == 304)
+                client->body_remaining = 0; // Content-Length describes a body not sent
+            value = find_header(head, head_length, "Connection", &length);
+            client->closing = value && length == 5 && strncasecmp(value, "close", 5) == 0;
+            offset += head_length;
+        }
+
+        if (client->body_remaining == 0)
+        {
+            on_response(context, client->status);
+            completed++;
+        }
+    }
+
+    memmove(client->in, client->in + offset, client->in_length - offset);
+    client->in_length -= offset;
+    return completed;
+}
+
+int http_client_receive(HttpClient *client, void (*on_response)(void *context, int status),
+                        void *context, uint64_t *bytes)
+{
+    while (1)
+    {
+        ssize_t received = recv(client->fd, client->in + client->in_length,
+                                sizeof(client->in) - client->in_length, 0);
+        if (received > 0)
+        {
+            *bytes += received;
+            client->in_length += received;
+            return parse_responses(client, on_response, context);
+        }
+        if (received == -1 && errno == EINTR)
+            continue;
+        if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return HTTP_CLIENT_AGAIN;
+        return HTTP_CLIENT_CLOSED;
+    }
+}
@@ -0,0 +1,60 @@
+// Non-blocking HTTP/1.1 client connection for the benchmark tools.
+//
+// Requests are appended to an output buffer and written with as few sends
+// as the socket allows; responses are framed by Content-Length and their
+// bodies counted rather than kept, so a large file costs no memory. The
+// caller owns the event loop: it registers the socket (edge-triggered, both
+// directions) and calls http_client_flush on EPOLLOUT and
+// http_client_receive on EPOLLIN.
+
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define HTTP_CLIENT_BUFFER_SIZE 65536 // Also the largest response head accepted
+
+typedef struct
+{
+    int fd;
+    char *out;  // Requests not written yet
+    size_t out_length, out_sent, out_capacity;
+    char in[HTTP_CLIENT_BUFFER_SIZE];
+    size_t in_length;
+    uint64_t body_remaining; // Of the response being read, after its head
+    int status;              // Of that response
+    int closing;             // It carried "Connection: close"
+    unsigned char *head;     // Ring of in-flight requests: 1 for HEAD, whose
+    size_t head_first, head_count, head_capacity; // responses have no body
+} HttpClient;
+
+// Result of http_client_receive besides a count of responses
+#define HTTP_CLIENT_AGAIN -1  // Nothing more to read for now
+#define HTTP_CLIENT_CLOSED -2 // Connection closed or failed
+#define HTTP_CLIENT_BAD -3    // Malformed response
+
+// Opens a blocking connect()ed, then non-blocking, TCP_NODELAY socket and
+// adds it to epoll_fd with data as its event pointer. Returns 0 or -1.
+int http_client_connect(HttpClient *client, const struct sockaddr_in *address, int epoll_fd, void *data);
+
+// Closes the socket and drops everything buffered. The output buffer's
+// memory is kept for reuse; http_client_free releases it.
+void http_client_close(HttpClient *client);
+void http_client_free(HttpClient *client);
+
+// Queues one complete request
+void http_client_queue(HttpClient *client, const char *request, size_t length);
+
+// Writes as much queued output as the socket takes. Returns 0, or -1 if the
+// connection failed.
+int http_client_flush(HttpClient *client);
+
+// Reads once and hands every response it completes to on_response with its
+// status code. Returns the number completed, or one of the codes above.
+// *bytes is increased by the bytes read.
+int http_client_receive(HttpClient *client, void (*on_response)(void *context, int status),
+                        void *context, uint64_t *bytes);
+
+#endif
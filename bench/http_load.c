@@ -0,0 +1,552 @@
+// HTTP load generator for the server in http_server_test.c.
+//
+// Drives the server over loopback with a fixed set of keep-alive
+// connections, each keeping up to -d requests in flight, and reports
+// throughput and the latency distribution. Two modes:
+//
+//   closed loop (default): every response immediately sends the next
+//   request, so the offered load is whatever the server sustains;
+//
+//   open loop (-R rate): requests are scheduled at a constant total rate,
+//   independent of how fast responses come back. Latency is measured from
+//   when a request was due, not from when it finally went out, so a server
+//   stall shows up in the percentiles as the clients would have seen it
+//   instead of silently holding back the load (coordinated omission). The
+//   time from actual send to response is reported as service time.
+//
+// Paths are drawn per request from a weighted mix (-P). Latencies go to an
+// HDR-style histogram; percentiles are exact to 0.1%. The exit status is
+// non-zero if any request failed or got a non-2xx answer, so scripts can use
+// a run as a gate.
+//
+// A response with "Connection: close", as a draining or restarting server
+// sends, is not a failure: the requests pipelined behind it were never
+// read, so they go out again on a new connection with their original due
+// times and count as a reconnect, not as errors.
+//
+// Build: gcc -O2 -pthread -I. -o http_load bench/http_load.c bench/http_client.c bench/histogram.c
+// Usage: http_load [-c connections] [-d depth] [-t seconds] [-R rate] [-P mix] ...
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include "bench/histogram.h"
+#include "bench/http_client.h"
+
+#define DEFAULT_CONNECTIONS 50
+#define DEFAULT_DEPTH 1
+#define DEFAULT_SECONDS 10
+#define MAX_PATHS 64
+#define MAX_EVENTS 256
+
+typedef struct
+{
+    char *request; // Complete GET request
+    size_t length;
+    unsigned weight;
+} Path;
+
+typedef struct
+{
+    const char *host;
+    int port;
+    int connections;
+    int depth;      // Requests in flight per connection
+    int threads;
+    double seconds;
+    double warmup;  // Seconds run before measuring
+    double rate;    // Requests per second over all connections; 0 = closed loop
+    Path paths[MAX_PATHS];
+    int path_count;
+    unsigned total_weight;
+} Options;
+
+static Options options = {.host = "127.0.0.1", .port = 8080, .connections = DEFAULT_CONNECTIONS,
+                          .depth = DEFAULT_DEPTH, .threads = 1, .seconds = DEFAULT_SECONDS};
+static struct sockaddr_in server_address;
+
+// One connection and the requests it has in flight, oldest first
+typedef struct
+{
+    HttpClient http;
+    uint64_t *due;  // When each request in flight was scheduled (open loop)
+    uint64_t *sent; // When each went out
+    int head, outstanding;
+    int unexpected;    // A response arrived with nothing in flight
+    uint64_t next_due; // Open loop: when the next request is scheduled
+    uint64_t random;
+} Client;
+
+typedef struct
+{
+    int id;
+    pthread_t thread;
+    Client *clients;
+    int client_count;
+    double interval; // Open loop: nanoseconds between two requests of one connection
+    uint64_t start, measure_start, end;
+    Histogram *latency; // From when a request was due (same as sent in closed loop)
+    Histogram *service; // From when it was sent
+    uint64_t completed, non_2xx, bytes, errors, reconnects, unsent, unfinished;
+} LoadThread;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static const Path *pick_path(Client *client)
+{
+    if (options.path_count == 1)
+        return &options.paths[0];
+    unsigned ticket = next_random(&client->random) % options.total_weight;
+    for (int i = 0; i < options.path_count; i++)
+    {
+        if (ticket < options.paths[i].weight)
+            return &options.paths[i];
+        ticket -= options.paths[i].weight;
+    }
+    return &options.paths[options.path_count - 1];
+}
+
+static int client_connect(Client *client, int epoll_fd)
+{
+    client->head = client->outstanding = 0;
+    client->unexpected = 0;
+    return http_client_connect(&client->http, &server_address, epoll_fd, client);
+}
+
+// Appends a request to the output and remembers when it was due and sent
+static void queue_request(Client *client, uint64_t due, uint64_t now)
+{
+    const Path *path = pick_path(client);
+    http_client_queue(&client->http, path->request, path->length);
+
+    int slot = (client->head + client->outstanding) % options.depth;
+    client->due[slot] = due;
+    client->sent[slot] = now;
+    client->outstanding++;
+}
+
+// What on_response needs besides the client
+typedef struct
+{
+    LoadThread *thread;
+    Client *client;
+    uint64_t now;
+} ResponseContext;
+
+static void on_response(void *arg, int status)
+{
+    ResponseContext *context = arg;
+    LoadThread *thread = context->thread;
+    Client *client = context->client;
+    if (context->now == 0)
+        context->now = now_ns(); // Once per recv is close enough
+    if (client->outstanding == 0)
+    {
+        client->unexpected = 1; // A response nobody asked for
+        return;
+    }
+    uint64_t due = client->due[client->head];
+    uint64_t sent = client->sent[client->head];
+    client->head = (client->head + 1) % options.depth;
+    client->outstanding--;
+
+    if (due < thread->measure_start || context->now > thread->end)
+        return; // Warm-up, or past the end
+    thread->completed++;
+    if (status < 200 || status > 299)
+        thread->non_2xx++;
+    histogram_record(thread->latency, context->now - due);
+    histogram_record(thread->service, context->now - sent);
+}
+
+// Drops a failed or finished connection, counting the requests it still
+// had in flight as errors, and opens a new one
+static void reconnect(LoadThread *thread, Client *client, int epoll_fd)
+{
+    http_client_close(&client->http);
+    uint64_t now = now_ns();
+    if (now < thread->end)
+    {
+        thread->errors += client->outstanding;
+        thread->reconnects++;
+    }
+    if (client_connect(client, epoll_fd) == -1)
+    {
+        perror("connect");
+        exit(1);
+    }
+    if (options.rate <= 0 && now < thread->end)
+    {
+        for (int i = 0; i < options.depth; i++)
+            queue_request(client, now, now);
+        http_client_flush(&client->http);
+    }
+}
+
+// The server closes the connection after the response just completed:
+// moves the requests still in flight to a new connection
+static void reopen(LoadThread *thread, Client *client, int epoll_fd)
+{
+    uint64_t due[options.depth];
+    int pending = client->outstanding;
+    for (int i = 0; i < pending; i++)
+        due[i] = client->due[(client->head + i) % options.depth];
+
+    http_client_close(&client->http);
+    uint64_t now = now_ns();
+    if (now < thread->end)
+        thread->reconnects++;
+    if (client_connect(client, epoll_fd) == -1)
+    {
+        perror("connect");
+        exit(1);
+    }
+    for (int i = 0; i < pending; i++)
+        queue_request(client, due[i], now);
+    if (options.rate <= 0)
+    {
+        while (client->outstanding < options.depth && now < thread->end)
+            queue_request(client, now, now);
+    }
+    http_client_flush(&client->http);
+}
+
+static void handle_readable(LoadThread *thread, Client *client, int epoll_fd, int closed_loop)
+{
+    while (1)
+    {
+        ResponseContext context = {thread, client, 0};
+        uint64_t bytes = 0;
+        int completed = http_client_receive(&client->http, on_response, &context, &bytes);
+        if (completed == HTTP_CLIENT_AGAIN)
+            return;
+        if (completed == HTTP_CLIENT_CLOSED)
+        {
+            reconnect(thread, client, epoll_fd);
+            return;
+        }
+        uint64_t now = context.now ? context.now : now_ns();
+        if (now >= thread->measure_start)
+            thread->bytes += bytes;
+        if (completed == HTTP_CLIENT_BAD || client->unexpected)
+        {
+            fprintf(stderr, "malformed response\n");
+            reconnect(thread, client, epoll_fd);
+            return;
+        }
+        if (client->http.closing && client->http.body_remaining == 0)
+        {
+            reopen(thread, client, epoll_fd);
+            return;
+        }
+        if (closed_loop)
+        {
+            for (int i = 0; i < completed && now < thread->end; i++)
+                queue_request(client, now, now);
+        }
+        if (http_client_flush(&client->http) == -1)
+        {
+            reconnect(thread, client, epoll_fd);
+            return;
+        }
+    }
+}
+
+// Open loop: sends every request that is due, as far as the depth allows
+static uint64_t send_due(LoadThread *thread, int epoll_fd, uint64_t now)
+{
+    uint64_t next = thread->end;
+    for (int i = 0; i < thread->client_count; i++)
+    {
+        Client *client = &thread->clients[i];
+        int queued = 0;
+        while (client->next_due <= now && client->next_due < thread->end &&
+               client->outstanding < options.depth)
+        {
+            queue_request(client, client->next_due, now);
+            client->next_due += (uint64_t)thread->interval;
+            queued = 1;
+        }
+        if (queued && http_client_flush(&client->http) == -1)
+            reconnect(thread, client, epoll_fd);
+        if (client->outstanding < options.depth && client->next_due < next)
+            next = client->next_due;
+    }
+    return next;
+}
+
+static void *load_thread_main(void *arg)
+{
+    LoadThread *thread = arg;
+    int closed_loop = options.rate <= 0;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event events[MAX_EVENTS];
+
+    // The default 50 us of timer slack would show up in open-loop latency
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    // Step 1: Connect everything before the clock starts
+    for (int i = 0; i < thread->client_count; i++)
+    {
+        Client *client = &thread->clients[i];
+        client->due = calloc(options.depth, sizeof(uint64_t));
+        client->sent = calloc(options.depth, sizeof(uint64_t));
+        client->random = 0x9E3779B97F4A7C15ULL * (thread->id * 65536 + i + 1);
+        if (client_connect(client, epoll_fd) == -1)
+        {
+            perror("connect");
+            exit(1);
+        }
+    }
+
+    // Step 2: Closed loop fills every pipeline; open loop staggers the
+    // connections' schedules evenly over one interval
+    uint64_t now = now_ns();
+    for (int i = 0; i < thread->client_count; i++)
+    {
+        Client *client = &thread->clients[i];
+        if (closed_loop)
+        {
+            for (int j = 0; j < options.depth; j++)
+                queue_request(client, now, now);
+            http_client_flush(&client->http);
+        }
+        else
+        {
+            client->next_due = now + (uint64_t)(thread->interval * i / thread->client_count);
+        }
+    }
+
+    // Step 3: Run until the end, then stop sending and count what is left
+    while ((now = now_ns()) < thread->end)
+    {
+        uint64_t wake = now + 100000000;
+        if (!closed_loop)
+        {
+            uint64_t next = send_due(thread, epoll_fd, now);
+            if (next < wake)
+                wake = next;
+        }
+        if (thread->end < wake)
+            wake = thread->end;
+        uint64_t wait = wake > now ? wake - now : 0;
+        struct timespec timeout = {wait / 1000000000, wait % 1000000000};
+
+        int count = epoll_pwait2(epoll_fd, events, MAX_EVENTS, &timeout, NULL);
+        for (int i = 0; i < count; i++)
+        {
+            Client *client = events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                handle_readable(thread, client, epoll_fd, closed_loop);
+            if (events[i].events & EPOLLOUT && http_client_flush(&client->http) == -1)
+                reconnect(thread, client, epoll_fd);
+        }
+    }
+
+    for (int i = 0; i < thread->client_count; i++)
+    {
+        Client *client = &thread->clients[i];
+        thread->unfinished += client->outstanding;
+        if (!closed_loop && client->next_due < thread->end)
+            thread->unsent += (thread->end - client->next_due) / (uint64_t)thread->interval + 1;
+        http_client_free(&client->http);
+        free(client->due);
+        free(client->sent);
+    }
+    close(epoll_fd);
+    return NULL;
+}
+
+// Parses "path[=weight],path[=weight],..." into options.paths
+static int parse_mix(char *mix)
+{
+    char *save;
+    for (char *item = strtok_r(mix, ",", &save); item; item = strtok_r(NULL, ",", &save))
+    {
+        if (options.path_count == MAX_PATHS || item[0] != '/')
+            return -1;
+        Path *path = &options.paths[options.path_count++];
+        char *equals = strchr(item, '=');
+        path->weight = 1;
+        if (equals)
+        {
+            *equals = '\0';
+            if (atoi(equals + 1) <= 0)
+                return -1;
+            path->weight = atoi(equals + 1);
+        }
+        options.total_weight += path->weight;
+        path->length = asprintf(&path->request, "GET %s HTTP/1.1\r\nHost: %s:%d\r\n\r\n",
+                                item, options.host, options.port);
+    }
+    return options.path_count > 0 ? 0 : -1;
+}
+
+static void print_latency(const char *label, const Histogram *histogram)
+{
+    printf("  %-12s p50 %.3f ms  p99 %.3f ms  p99.9 %.3f ms  max %.3f ms  (mean %.3f ms)\n", label,
+           histogram_percentile(histogram, 50) / 1e6, histogram_percentile(histogram, 99) / 1e6,
+           histogram_percentile(histogram, 99.9) / 1e6, histogram_max(histogram) / 1e6,
+           histogram_mean(histogram) / 1e6);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-h host] [-p port] [-c connections] [-d depth] [-t seconds]\n"
+            "          [-W seconds] [-R rate] [-P mix] [-j threads]\n"
+            "  -h host         server address (default 127.0.0.1)\n"
+            "  -p port         server port (default 8080)\n"
+            "  -c connections  keep-alive connections (default %d)\n"
+            "  -d depth        requests in flight per connection (default %d)\n"
+            "  -t seconds      measured run time (default %d)\n"
+            "  -W seconds      warm-up before measuring (default 0)\n"
+            "  -R rate         open loop at this many requests/s in total;\n"
+            "                  without it every response sends the next request\n"
+            "  -P mix          paths and weights, e.g. /hello=8,/time=1,/hello/x=1\n"
+            "                  (default /hello)\n"
+            "  -j threads      client threads, sharing connections and rate (default 1)\n",
+            program, DEFAULT_CONNECTIONS, DEFAULT_DEPTH, DEFAULT_SECONDS);
+}
+
+int main(int argc, char **argv)
+{
+    char *mix = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "h:p:c:d:t:W:R:P:j:")) != -1)
+    {
+        switch (option)
+        {
+        case 'h': options.host = optarg; break;
+        case 'p': options.port = atoi(optarg); break;
+        case 'c': options.connections = atoi(optarg); break;
+        case 'd': options.depth = atoi(optarg); break;
+        case 't': options.seconds = atof(optarg); break;
+        case 'W': options.warmup = atof(optarg); break;
+        case 'R': options.rate = atof(optarg); break;
+        case 'P': mix = optarg; break;
+        case 'j': options.threads = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.connections <= 0 || options.depth <= 0 || options.seconds <= 0 ||
+        options.threads <= 0 || options.warmup < 0 || options.rate < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (options.threads > options.connections)
+        options.threads = options.connections;
+
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host, &server_address.sin_addr) != 1)
+    {
+        fprintf(stderr, "%s: not an IPv4 address\n", options.host);
+        return 1;
+    }
+    char default_mix[] = "/hello";
+    if (parse_mix(mix ? mix : default_mix) == -1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Step 1: Split connections and rate over the threads
+    LoadThread *threads = calloc(options.threads, sizeof(LoadThread));
+    uint64_t start = now_ns();
+    uint64_t measure_start = start + (uint64_t)(options.warmup * 1e9);
+    uint64_t end = measure_start + (uint64_t)(options.seconds * 1e9);
+    for (int i = 0; i < options.threads; i++)
+    {
+        LoadThread *thread = &threads[i];
+        thread->id = i;
+        thread->client_count = options.connections / options.threads +
+                               (i < options.connections % options.threads);
+        thread->clients = calloc(thread->client_count, sizeof(Client));
+        if (options.rate > 0)
+            thread->interval = 1e9 * options.connections / options.rate;
+        thread->start = start;
+        thread->measure_start = measure_start;
+        thread->end = end;
+        thread->latency = histogram_create();
+        thread->service = histogram_create();
+        pthread_create(&thread->thread, NULL, load_thread_main, thread);
+    }
+
+    // Step 2: Merge the threads' counts
+    Histogram *latency = histogram_create();
+    Histogram *service = histogram_create();
+    uint64_t completed = 0, non_2xx = 0, bytes = 0, errors = 0, reconnects = 0, unsent = 0, unfinished = 0;
+    for (int i = 0; i < options.threads; i++)
+    {
+        LoadThread *thread = &threads[i];
+        pthread_join(thread->thread, NULL);
+        histogram_merge(latency, thread->latency);
+        histogram_merge(service, thread->service);
+        completed += thread->completed;
+        non_2xx += thread->non_2xx;
+        bytes += thread->bytes;
+        errors += thread->errors;
+        reconnects += thread->reconnects;
+        unsent += thread->unsent;
+        unfinished += thread->unfinished;
+        histogram_free(thread->latency);
+        histogram_free(thread->service);
+        free(thread->clients);
+    }
+
+    // Step 3: Report
+    if (options.rate > 0)
+        printf("Open loop at %.0f requests/s: ", options.rate);
+    else
+        printf("Closed loop: ");
+    printf("%d connections, depth %d, %.1f s, %d thread(s), %d path(s)\n", options.connections,
+           options.depth, options.seconds, options.threads, options.path_count);
+    printf("  requests     %llu  (%.1f requests/s, %.2f MB/s read)\n", (unsigned long long)completed,
+           completed / options.seconds, bytes / options.seconds / 1e6);
+    printf("  errors       %llu failed, %llu non-2xx, %llu reconnects, %llu unfinished\n",
+           (unsigned long long)errors, (unsigned long long)non_2xx, (unsigned long long)reconnects,
+           (unsigned long long)unfinished);
+    print_latency("latency", latency);
+    if (options.rate > 0)
+    {
+        print_latency("service time", service);
+        if (unsent > 0)
+            printf("  behind       %llu requests were due but never sent; the server cannot sustain the rate\n",
+                   (unsigned long long)unsent);
+    }
+
+    histogram_free(latency);
+    histogram_free(service);
+    free(threads);
+    return errors > 0 || non_2xx > 0;
+}
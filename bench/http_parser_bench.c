@@ -0,0 +1,106 @@
+// Microbenchmark for http_parser.c: parses a typical browser request over and
+// over and reports header bytes parsed per second, next to the sscanf/strstr/
+// strncpy code that handle_client used before.
+//
+// Build: gcc -O2 -I. -o http_parser_bench bench/http_parser_bench.c http_parser.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "http_parser.h"
+
+#define ITERATIONS 2000000
+
+static const char request_text[] =
+    "GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg HTTP/1.1\r\n"
+    "Host: www.kittyhell.com\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10_6_3; ja-JP-mac; rv:1.9.2.3) Gecko/20100401 Firefox/3.6.3 Pathtraq/0.9\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+    "Accept-Encoding: gzip,deflate\r\n"
+    "Accept-Charset: Shift_JIS,utf-8;q=0.7,*;q=0.7\r\n"
+    "Keep-Alive: 115\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: wp_ozh_wsa_visits=2; wp_ozh_wsa_visit_lasttime=xxxxxxxxxx; __utma=xxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.x; __utmz=xxxxxxxxx.xxxxxxxxxx.x.x.utmccn=(referral)|utmcsr=reader.livedoor.com|utmcct=/reader/|utmcmd=referral\r\n"
+    "\r\n";
+
+static double seconds_since(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void report(const char *name, double elapsed, size_t bytes)
+{
+    printf("%-28s %8.1f ns/request %8.2f GB/s\n", name,
+           elapsed * 1e9 / ITERATIONS, bytes * (double)ITERATIONS / elapsed / 1e9);
+}
+
+// The pre-parser request handling: sscanf the request line, strstr for the
+// header block and copy it out.
+static size_t legacy_parse(const char *buffer)
+{
+    char method[16], path[256], protocol[16];
+    sscanf(buffer, "%15s %255s %15s", method, path, protocol);
+
+    char *headers_start = strstr(buffer, "\r\n") + 2;
+    char *headers_end = strstr(buffer, "\r\n\r\n");
+    size_t headers_length = headers_end - headers_start;
+
+    char headers[4096];
+    strncpy(headers, headers_start, headers_length);
+    headers[headers_length] = '\0';
+    return strlen(path) + headers_length;
+}
+
+int main()
+{
+    size_t length = strlen(request_text);
+    char *buffer = malloc(length + 1);
+    memcpy(buffer, request_text, length + 1);
+    volatile size_t sink = 0;
+    HttpRequest request;
+    struct timespec start;
+
+    printf("Request head: %zu bytes, scanner: %s\n\n", length, http_parser_isa());
+
+    // Whole head available at once
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        http_request_init(&request);
+        if (http_parse_request(&request, buffer, length) != (int)length)
+        {
+            fprintf(stderr, "parse failed\n");
+            return 1;
+        }
+        sink += request.header_count;
+    }
+    report("http_parse_request", seconds_since(start), length);
+
+    // Head arriving in two segments, parse resumed on the second
+    size_t split = length / 2;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        http_request_init(&request);
+        if (http_parse_request(&request, buffer, split) != HTTP_PARSE_INCOMPLETE ||
+            http_parse_request(&request, buffer, length) != (int)length)
+        {
+            fprintf(stderr, "resumed parse failed\n");
+            return 1;
+        }
+        sink += request.header_count;
+    }
+    report("http_parse_request (split)", seconds_since(start), length);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++)
+        sink += legacy_parse(buffer);
+    report("sscanf + strstr + strncpy", seconds_since(start), length);
+
+    free(buffer);
+    return sink == 0;
+}
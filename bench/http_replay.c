@@ -0,0 +1,547 @@
+// Replays recorded HTTP traffic against the server in http_server_test.c.
+//
+// The input is JSON Lines, one request per line:
+//
+//   {"method": "POST", "path": "/api/items?id=3", "headers": {"Accept": "*/*"},
+//    "body": "...", "timestamp": 12.5, "route": "/api/items"}
+//
+// Only "path" is required. "method" defaults to GET, "timestamp" is in
+// seconds relative to the first record, and "route" names the bucket the
+// request's latency is reported under (by default the method and the path
+// without its query). Lines without a path are skipped and counted, so a
+// file of other JSON records replays as nothing rather than failing.
+//
+// The whole file is parsed with the project's JSON parser and every request
+// serialized before the clock starts, so the run itself only writes
+// prepared bytes. Requests go out over -c keep-alive connections, at most -d
+// in flight on each, either as fast as the server answers (default) or on
+// the recorded schedule (-r speed). On the schedule, latency is measured
+// from when a request was due, so a server that falls behind is charged
+// for the wait it caused; the time from actual send is reported as service
+// time.
+//
+// Build: gcc -O2 -I. -o http_replay bench/http_replay.c bench/http_client.c bench/histogram.c json.c json_index.c json_number.c
+// Usage: http_replay [-c connections] [-d depth] [-r speed] [-n loops] file.jsonl
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include "bench/histogram.h"
+#include "bench/http_client.h"
+#include "json.h"
+
+#define DEFAULT_CONNECTIONS 10
+#define DEFAULT_DEPTH 1
+#define MAX_ROUTES 64 // Further routes are reported together as "(other)"
+#define MAX_EVENTS 256
+
+typedef struct
+{
+    char *request; // Serialized, ready to send
+    size_t length;
+    uint64_t at;   // Nanoseconds after the first record
+    int route;
+} Record;
+
+typedef struct
+{
+    char *name;
+    Histogram *latency;
+    uint64_t completed, non_2xx;
+} Route;
+
+typedef struct
+{
+    const char *host;
+    int port;
+    int connections;
+    int depth;     // Requests in flight per connection
+    double speed;  // Multiple of the recorded pace; 0 = as fast as possible
+    int loops;     // Times through the file
+} Options;
+
+static Options options = {.host = "127.0.0.1", .port = 8080, .connections = DEFAULT_CONNECTIONS,
+                          .depth = DEFAULT_DEPTH, .loops = 1};
+static struct sockaddr_in server_address;
+
+static Record *records;
+static size_t record_count;
+static uint64_t duration; // Timestamp of the last record
+static Route routes[MAX_ROUTES + 1];
+static int route_count;
+
+// One connection and the records it has in flight, oldest first
+typedef struct
+{
+    HttpClient http;
+    size_t *record; // Which record each request in flight replays
+    uint64_t *due;  // When it was scheduled
+    uint64_t *sent; // When it went out
+    int head, outstanding;
+    int unexpected; // A response arrived with nothing in flight
+} Client;
+
+static Client *clients;
+static Histogram *latency, *service;
+static uint64_t completed, non_2xx, bytes, errors, reconnects;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Returns the index of the named route, adding it if there is room
+static int find_route(const char *name)
+{
+    for (int i = 0; i < route_count; i++)
+    {
+        if (strcmp(routes[i].name, name) == 0)
+            return i;
+    }
+    if (route_count == MAX_ROUTES)
+        return MAX_ROUTES;
+    routes[route_count].name = strdup(name);
+    routes[route_count].latency = histogram_create();
+    return route_count++;
+}
+
+// Serializes one parsed line into record. Returns 0, 1 if the line has no
+// path, or -1 if a field has the wrong type.
+static int build_record(const JSONValue *line, Record *record)
+{
+    const JSONValue *method = json_object_get(line, "method");
+    const JSONValue *path = json_object_get(line, "path");
+    const JSONValue *headers = json_object_get(line, "headers");
+    const JSONValue *body = json_object_get(line, "body");
+    const JSONValue *timestamp = json_object_get(line, "timestamp");
+    const JSONValue *route = json_object_get(line, "route");
+    if (!path)
+        return 1;
+    if (path->type != JSON_STRING || path->string[0] != '/' ||
+        (method && method->type != JSON_STRING) || (headers && headers->type != JSON_OBJECT) ||
+        (body && body->type != JSON_STRING) || (timestamp && timestamp->type != JSON_NUMBER) ||
+        (route && route->type != JSON_STRING))
+        return -1;
+
+    const char *method_name = method ? method->string : "GET";
+    FILE *out = open_memstream(&record->request, &record->length);
+    fprintf(out, "%s %s HTTP/1.1\r\n", method_name, path->string);
+    int has_host = 0;
+    for (const JSONObject *header = headers ? headers->object : NULL; header; header = header->next)
+    {
+        if (header->value->type != JSON_STRING)
+        {
+            fclose(out);
+            free(record->request);
+            return -1;
+        }
+        if (strcasecmp(header->key, "Content-Length") == 0)
+            continue; // Recomputed from the body
+        if (strcasecmp(header->key, "Host") == 0)
+            has_host = 1;
+        fprintf(out, "%s: %s\r\n", header->key, header->value->string);
+    }
+    if (!has_host)
+        fprintf(out, "Host: %s:%d\r\n", options.host, options.port);
+    if (body)
+        fprintf(out, "Content-Length: %zu\r\n\r\n%s", strlen(body->string), body->string);
+    else
+        fputs("\r\n", out);
+    fclose(out);
+
+    double seconds = timestamp ? json_value_number(timestamp) : 0;
+    record->at = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+    if (route)
+    {
+        record->route = find_route(route->string);
+    }
+    else
+    {
+        char name[256];
+        size_t length = strcspn(path->string, "?");
+        snprintf(name, sizeof(name), "%s %.*s", method_name, (int)length, path->string);
+        record->route = find_route(name);
+    }
+    return 0;
+}
+
+// Reads and prepares every record of the file. Returns -1 after printing
+// what is wrong with it.
+static int load_records(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        perror(filename);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (fread(text, 1, size, file) != (size_t)size)
+    {
+        perror(filename);
+        fclose(file);
+        free(text);
+        return -1;
+    }
+    fclose(file);
+    text[size] = '\0';
+
+    size_t capacity = 1024, skipped = 0;
+    records = malloc(capacity * sizeof(Record));
+    uint64_t first = UINT64_MAX; // Timestamp of the first timed record
+    uint64_t previous = 0;      // Offset of the last record from it
+    int number = 0;
+    for (char *line = text, *next; line; line = next)
+    {
+        number++;
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0'; // parse_json reads up to the NUL
+        if (line[strspn(line, " \t\r")] == '\0')
+            continue;
+
+        JSONValue *value = parse_json(line);
+        if (!value)
+        {
+            fprintf(stderr, "%s:%d: %s at column %zu\n", filename, number, json_error.message,
+                    json_error.position + 1);
+            free(text);
+            return -1;
+        }
+        if (record_count == capacity)
+        {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(Record));
+        }
+        Record *record = &records[record_count];
+        int result = value->type == JSON_OBJECT ? build_record(value, record) : -1;
+        int has_timestamp = json_object_get(value, "timestamp") != NULL;
+        free_json(value);
+        if (result == -1)
+        {
+            fprintf(stderr, "%s:%d: not a request record\n", filename, number);
+            free(text);
+            return -1;
+        }
+        if (result == 1)
+        {
+            skipped++;
+            continue;
+        }
+
+        // Untimed records follow the one before them immediately, and
+        // records are replayed in file order even if their clocks disagree
+        if (has_timestamp && first == UINT64_MAX)
+            first = record->at;
+        if (has_timestamp && record->at > first + previous)
+            previous = record->at - first;
+        record->at = previous;
+        record_count++;
+    }
+    free(text);
+
+    duration = previous;
+    if (skipped > 0)
+        fprintf(stderr, "%s: skipped %zu line(s) without a path\n", filename, skipped);
+    if (record_count == 0)
+    {
+        fprintf(stderr, "%s: no requests to replay\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+static int client_connect(Client *client, int epoll_fd)
+{
+    client->head = client->outstanding = 0;
+    client->unexpected = 0;
+    return http_client_connect(&client->http, &server_address, epoll_fd, client);
+}
+
+// What on_response needs besides the client
+typedef struct
+{
+    Client *client;
+    uint64_t now;
+} ResponseContext;
+
+static void on_response(void *arg, int status)
+{
+    ResponseContext *context = arg;
+    Client *client = context->client;
+    if (context->now == 0)
+        context->now = now_ns(); // Once per recv is close enough
+    if (client->outstanding == 0)
+    {
+        client->unexpected = 1;
+        return;
+    }
+    Route *route = &routes[records[client->record[client->head]].route];
+    uint64_t due = client->due[client->head];
+    uint64_t sent = client->sent[client->head];
+    client->head = (client->head + 1) % options.depth;
+    client->outstanding--;
+
+    completed++;
+    route->completed++;
+    if (status < 200 || status > 299)
+    {
+        non_2xx++;
+        route->non_2xx++;
+    }
+    histogram_record(latency, context->now - due);
+    histogram_record(service, context->now - sent);
+    histogram_record(route->latency, context->now - due);
+}
+
+// Drops a failed or finished connection, counting the requests it still
+// had in flight as errors, and opens a new one
+static void reconnect(Client *client, int epoll_fd)
+{
+    http_client_close(&client->http);
+    errors += client->outstanding;
+    reconnects++;
+    if (client_connect(client, epoll_fd) == -1)
+    {
+        perror("connect");
+        exit(1);
+    }
+}
+
+static void handle_readable(Client *client, int epoll_fd)
+{
+    while (1)
+    {
+        ResponseContext context = {client, 0};
+        int result = http_client_receive(&client->http, on_response, &context, &bytes);
+        if (result == HTTP_CLIENT_AGAIN)
+            return;
+        if (result == HTTP_CLIENT_BAD || client->unexpected)
+            fprintf(stderr, "malformed response\n");
+        if (result < 0 || client->unexpected || (client->outstanding == 0 && client->http.closing))
+        {
+            reconnect(client, epoll_fd);
+            return;
+        }
+    }
+}
+
+// Hands out the requests that are due, oldest first, to connections with
+// room. *cursor counts requests dispatched over all loops. Returns when
+// the next one is due, or 0 if it is waiting for a connection.
+static uint64_t dispatch(size_t *cursor, size_t total, uint64_t start, uint64_t now, int epoll_fd)
+{
+    static int next_client;
+    uint64_t wake = 0;
+    while (*cursor < total)
+    {
+        const Record *record = &records[*cursor % record_count];
+        uint64_t due = now;
+        if (options.speed > 0)
+        {
+            uint64_t loop = *cursor / record_count;
+            due = start + (uint64_t)((loop * duration + record->at) / options.speed);
+            if (due > now)
+            {
+                wake = due;
+                break;
+            }
+        }
+
+        Client *client = NULL;
+        for (int i = 0; i < options.connections && !client; i++)
+        {
+            Client *candidate = &clients[(next_client + i) % options.connections];
+            if (candidate->outstanding < options.depth)
+                client = candidate;
+        }
+        if (!client)
+            break;
+        next_client = (client - clients + 1) % options.connections;
+
+        int slot = (client->head + client->outstanding) % options.depth;
+        client->record[slot] = *cursor % record_count;
+        client->due[slot] = due;
+        client->sent[slot] = now;
+        client->outstanding++;
+        http_client_queue(&client->http, record->request, record->length);
+        (*cursor)++;
+    }
+
+    for (int i = 0; i < options.connections; i++)
+    {
+        if (clients[i].http.out_length > 0 && http_client_flush(&clients[i].http) == -1)
+            reconnect(&clients[i], epoll_fd);
+    }
+    return wake;
+}
+
+static void print_latency(const char *label, const Histogram *histogram)
+{
+    printf("  %-12s p50 %.3f ms  p99 %.3f ms  p99.9 %.3f ms  max %.3f ms  (mean %.3f ms)\n", label,
+           histogram_percentile(histogram, 50) / 1e6, histogram_percentile(histogram, 99) / 1e6,
+           histogram_percentile(histogram, 99.9) / 1e6, histogram_max(histogram) / 1e6,
+           histogram_mean(histogram) / 1e6);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-h host] [-p port] [-c connections] [-d depth] [-r speed] [-n loops] file.jsonl\n"
+            "  -h host         server address (default 127.0.0.1)\n"
+            "  -p port         server port (default 8080)\n"
+            "  -c connections  keep-alive connections (default %d)\n"
+            "  -d depth        requests in flight per connection (default %d)\n"
+            "  -r speed        follow the recorded timestamps, sped up this many times\n"
+            "                  (1 = as recorded); without it, replay as fast as possible\n"
+            "  -n loops        times through the file (default 1)\n",
+            program, DEFAULT_CONNECTIONS, DEFAULT_DEPTH);
+}
+
+int main(int argc, char **argv)
+{
+    int option;
+    while ((option = getopt(argc, argv, "h:p:c:d:r:n:")) != -1)
+    {
+        switch (option)
+        {
+        case 'h': options.host = optarg; break;
+        case 'p': options.port = atoi(optarg); break;
+        case 'c': options.connections = atoi(optarg); break;
+        case 'd': options.depth = atoi(optarg); break;
+        case 'r': options.speed = atof(optarg); break;
+        case 'n': options.loops = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || options.connections <= 0 || options.depth <= 0 || options.loops <= 0 ||
+        options.speed < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host, &server_address.sin_addr) != 1)
+    {
+        fprintf(stderr, "%s: not an IPv4 address\n", options.host);
+        return 1;
+    }
+    routes[MAX_ROUTES].name = "(other)";
+    routes[MAX_ROUTES].latency = histogram_create();
+
+    // Step 1: Parse and serialize everything before the clock starts
+    if (load_records(argv[optind]) == -1)
+        return 1;
+
+    // Step 2: Connect
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event events[MAX_EVENTS];
+    prctl(PR_SET_TIMERSLACK, 1UL); // Keep paced sends on time
+    clients = calloc(options.connections, sizeof(Client));
+    for (int i = 0; i < options.connections; i++)
+    {
+        Client *client = &clients[i];
+        client->record = calloc(options.depth, sizeof(size_t));
+        client->due = calloc(options.depth, sizeof(uint64_t));
+        client->sent = calloc(options.depth, sizeof(uint64_t));
+        if (client_connect(client, epoll_fd) == -1)
+        {
+            perror("connect");
+            return 1;
+        }
+    }
+    latency = histogram_create();
+    service = histogram_create();
+
+    // Step 3: Replay until every request is answered or has failed
+    size_t cursor = 0, total = record_count * options.loops;
+    uint64_t start = now_ns(), now = start;
+    while (1)
+    {
+        uint64_t wake = dispatch(&cursor, total, start, now, epoll_fd);
+        int outstanding = 0;
+        for (int i = 0; i < options.connections; i++)
+            outstanding += clients[i].outstanding;
+        if (cursor == total && outstanding == 0)
+            break;
+
+        struct timespec timeout = {1, 0};
+        if (wake > 0)
+        {
+            uint64_t wait = wake > now ? wake - now : 0;
+            timeout.tv_sec = wait / 1000000000;
+            timeout.tv_nsec = wait % 1000000000;
+        }
+        int count = epoll_pwait2(epoll_fd, events, MAX_EVENTS, &timeout, NULL);
+        for (int i = 0; i < count; i++)
+        {
+            Client *client = events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                handle_readable(client, epoll_fd);
+            if (events[i].events & EPOLLOUT && http_client_flush(&client->http) == -1)
+                reconnect(client, epoll_fd);
+        }
+        now = now_ns();
+    }
+    double seconds = (now - start) / 1e9;
+
+    // Step 4: Report, overall and per route
+    if (options.speed > 0)
+        printf("Replay at %gx the recorded pace: ", options.speed);
+    else
+        printf("Replay as fast as possible: ");
+    printf("%zu records x %d, %d connections, depth %d, %.2f s\n", record_count, options.loops,
+           options.connections, options.depth, seconds);
+    printf("  requests     %llu  (%.1f requests/s, %.2f MB/s read)\n", (unsigned long long)completed,
+           completed / seconds, bytes / seconds / 1e6);
+    printf("  errors       %llu failed, %llu non-2xx, %llu reconnects\n", (unsigned long long)errors,
+           (unsigned long long)non_2xx, (unsigned long long)reconnects);
+    print_latency("latency", latency);
+    if (options.speed > 0)
+        print_latency("service time", service);
+
+    printf("\n  %-32s %10s %8s %10s %10s %10s\n", "route", "requests", "non-2xx", "p50 ms", "p99 ms", "max ms");
+    for (int i = 0; i <= MAX_ROUTES; i++)
+    {
+        Route *route = &routes[i];
+        if (i >= route_count && i < MAX_ROUTES)
+            continue;
+        if (route->completed == 0 && i == MAX_ROUTES)
+            continue;
+        printf("  %-32.32s %10llu %8llu %10.3f %10.3f %10.3f\n", route->name,
+               (unsigned long long)route->completed, (unsigned long long)route->non_2xx,
+               histogram_percentile(route->latency, 50) / 1e6, histogram_percentile(route->latency, 99) / 1e6,
+               histogram_max(route->latency) / 1e6);
+    }
+
+    for (int i = 0; i < options.connections; i++)
+    {
+        http_client_free(&clients[i].http);
+        free(clients[i].record);
+        free(clients[i].due);
+        free(clients[i].sent);
+    }
+    free(clients);
+    close(epoll_fd);
+    return errors > 0 || non_2xx > 0;
+}
@@ -0,0 +1,264 @@
+// End-to-end benchmark of the JSON API in http_server_test.c.
+//
+// For each payload size (1 KB, 64 KB and 1 MB by default) it generates a
+// document of records mixing strings, escapes, integers, fractions,
+// booleans, nulls and nested arrays, then keeps -c keep-alive connections
+// busy POSTing it to the route for -t seconds, one request in flight on
+// each. Every response is checked for a 2xx status; echo responses are the
+// same size as the payload, so the MB/s column counts both directions'
+// worth of JSON handled by the server.
+//
+// The 1 MB payload stays under the server's default body limit (-B 1m).
+//
+// Build: gcc -O2 -I. -o json_api_bench bench/json_api_bench.c bench/http_client.c bench/histogram.c
+// Usage: json_api_bench [-p port] [-c connections] [-t seconds] [-r route] [size...]
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include "bench/histogram.h"
+#include "bench/http_client.h"
+
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_SECONDS 5
+#define MAX_EVENTS 64
+
+typedef struct
+{
+    HttpClient http;
+    uint64_t sent; // When the request in flight went out, or 0
+} Client;
+
+typedef struct
+{
+    const char *host;
+    int port;
+    int connections;
+    int seconds;
+    const char *route;
+} Options;
+
+static Options options = {.host = "127.0.0.1", .port = 8080, .connections = DEFAULT_CONNECTIONS,
+                          .seconds = DEFAULT_SECONDS, .route = "/api/echo"};
+static struct sockaddr_in server_address;
+
+static Histogram *latency;
+static uint64_t completed, failed, bytes;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Parses "1024", "64k" or "1m" (binary units). Returns 0 if malformed.
+static size_t parse_size(const char *text)
+{
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0)
+        return 0;
+    if (*end == 'k' || *end == 'K')
+        value *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        value *= 1024 * 1024, end++;
+    return *end ? 0 : (size_t)value;
+}
+
+// Returns a JSON array of records about size bytes long, never longer
+static char *generate_document(size_t size, size_t *length)
+{
+    char *document = malloc(size + 1);
+    size_t used = 1;
+    document[0] = '[';
+    for (unsigned i = 0;; i++)
+    {
+        char record[256];
+        int record_length = snprintf(record, sizeof(record),
+                                     "%s{\"id\":%u,\"name\":\"item %u\\twith \\\"quotes\\\"\","
+                                     "\"price\":%u.%02u,\"ratio\":%.6g,\"active\":%s,\"note\":null,"
+                                     "\"tags\":[\"a\",\"b\",[%u,%d]]}",
+                                     i ? "," : "", i, i, i * 7 % 1000, i % 100, i / 3.0,
+                                     i % 2 ? "true" : "false", i * 31, -(int)i);
+        if (used + record_length + 1 > size)
+            break;
+        memcpy(document + used, record, record_length);
+        used += record_length;
+    }
+    document[used++] = ']';
+    document[used] = '\0';
+    *length = used;
+    return document;
+}
+
+static void on_response(void *context, int status)
+{
+    Client *client = context;
+    histogram_record(latency, now_ns() - client->sent);
+    client->sent = 0;
+    if (status >= 200 && status <= 299)
+        completed++;
+    else
+        failed++;
+}
+
+static void send_request(Client *client, const char *request, size_t length)
+{
+    client->sent = now_ns();
+    http_client_queue(&client->http, request, length);
+    if (http_client_flush(&client->http) == -1)
+    {
+        fprintf(stderr, "send failed\n");
+        exit(1);
+    }
+}
+
+// POSTs the document for options.seconds and prints one line of results
+static void run(size_t size)
+{
+    size_t document_length;
+    char *document = generate_document(size, &document_length);
+    char *request;
+    size_t request_length;
+    FILE *out = open_memstream(&request, &request_length);
+    fprintf(out,
+            "POST %s HTTP/1.1\r\n"
+            "Host: %s:%d\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: %zu\r\n\r\n",
+            options.route, options.host, options.port, document_length);
+    fwrite(document, 1, document_length, out);
+    fclose(out);
+    free(document);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    Client *clients = calloc(options.connections, sizeof(Client));
+    for (int i = 0; i < options.connections; i++)
+    {
+        if (http_client_connect(&clients[i].http, &server_address, epoll_fd, &clients[i]) == -1)
+        {
+            perror("connect");
+            exit(1);
+        }
+    }
+    latency = histogram_create();
+    completed = failed = bytes = 0;
+
+    uint64_t start = now_ns(), end = start + (uint64_t)options.seconds * 1000000000, now = start;
+    for (int i = 0; i < options.connections; i++)
+        send_request(&clients[i], request, request_length);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (now < end)
+    {
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        for (int i = 0; i < count; i++)
+        {
+            Client *client = events[i].data.ptr;
+            if (events[i].events & EPOLLOUT && http_client_flush(&client->http) == -1)
+            {
+                fprintf(stderr, "send failed\n");
+                exit(1);
+            }
+            if (!(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)))
+                continue;
+            int result;
+            while ((result = http_client_receive(&client->http, on_response, client, &bytes)) >= 0)
+                ;
+            if (result != HTTP_CLIENT_AGAIN)
+            {
+                fprintf(stderr, "connection %s\n", result == HTTP_CLIENT_BAD ? "got a malformed response" : "closed");
+                exit(1);
+            }
+            if (client->sent == 0)
+                send_request(client, request, request_length);
+        }
+        now = now_ns();
+    }
+    double seconds = (now - start) / 1e9;
+
+    printf("%8zu B  %10.1f req/s  %8.2f MB/s  p50 %8.3f ms  p99 %8.3f ms  %llu failed\n",
+           document_length, completed / seconds, completed * document_length / seconds / 1e6,
+           histogram_percentile(latency, 50) / 1e6, histogram_percentile(latency, 99) / 1e6,
+           (unsigned long long)failed);
+
+    for (int i = 0; i < options.connections; i++)
+    {
+        http_client_close(&clients[i].http);
+        http_client_free(&clients[i].http);
+    }
+    free(clients);
+    histogram_free(latency);
+    close(epoll_fd);
+    free(request);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-h host] [-p port] [-c connections] [-t seconds] [-r route] [size...]\n"
+            "  -h host         server address (default 127.0.0.1)\n"
+            "  -p port         server port (default 8080)\n"
+            "  -c connections  keep-alive connections (default %d)\n"
+            "  -t seconds      duration of each run (default %d)\n"
+            "  -r route        where to POST (default /api/echo)\n"
+            "  size            payload sizes, e.g. 4k or 2m (default 1k 64k 1m)\n",
+            program, DEFAULT_CONNECTIONS, DEFAULT_SECONDS);
+}
+
+int main(int argc, char **argv)
+{
+    int option;
+    while ((option = getopt(argc, argv, "h:p:c:t:r:")) != -1)
+    {
+        switch (option)
+        {
+        case 'h': options.host = optarg; break;
+        case 'p': options.port = atoi(optarg); break;
+        case 'c': options.connections = atoi(optarg); break;
+        case 't': options.seconds = atoi(optarg); break;
+        case 'r': options.route = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.connections <= 0 || options.seconds <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host, &server_address.sin_addr) != 1)
+    {
+        fprintf(stderr, "%s: not an IPv4 address\n", options.host);
+        return 1;
+    }
+
+    static const char *const default_sizes[] = {"1k", "64k", "1m"};
+    const char *const *sizes = optind < argc ? (const char *const *)argv + optind : default_sizes;
+    int size_count = optind < argc ? argc - optind : 3;
+    printf("POST %s, %d connections, %d s per size\n", options.route, options.connections, options.seconds);
+    for (int i = 0; i < size_count; i++)
+    {
+        size_t size = parse_size(sizes[i]);
+        if (size < 2)
+        {
+            fprintf(stderr, "%s: not a size\n", sizes[i]);
+            return 1;
+        }
+        run(size);
+    }
+    return 0;
+}
@@ -0,0 +1,317 @@
+// Linked-list tree (json_parse) against tape document (json_parse_document)
+// on large JSON.
+//
+// For each size it generates an array of records like the JSON API's
+// payloads and reports, for both representations:
+//   parse   MB/s of input parsed and then freed, with malloc;
+//   allocs  allocations and bytes the document takes from an arena;
+//   walk    ns per value to visit every value and sum the numbers;
+//   index   ns to reach a random element of the top-level array.
+// The tree's element lookup walks its list, the tape's is one addition,
+// so the index column grows with the document for the tree only. The
+// "in place" line is the tape again from json_parse_document_in_place,
+// with the copy of the input it overwrites counted in. The last line
+// gives the MB/s of stage 1 alone (json_index.c) with each classifier
+// the CPU has. -l generates log-like records instead: indented, with long
+// messages, where the structural index skips most of the bytes.
+//
+// Build: gcc -O2 -I. -o json_dom_bench bench/json_dom_bench.c json.c json_index.c json_number.c
+// Usage: json_dom_bench [-l] [-t seconds] [size...]
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "json.h"
+#include "json_index.h"
+
+#define DEFAULT_SECONDS 1.0 // Measured per size, column and representation
+#define LOOKUPS 1000
+
+static double now_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Parses "1024", "64k" or "1m" (binary units). Returns 0 if malformed.
+static size_t parse_size(const char *text)
+{
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0)
+        return 0;
+    if (*end == 'k' || *end == 'K')
+        value *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        value *= 1024 * 1024, end++;
+    return *end ? 0 : (size_t)value;
+}
+
+// Returns a JSON array of records about size bytes long
+static char *generate_document(size_t size, int logs, size_t *length)
+{
+    char *document = malloc(size + 512);
+    size_t used = 1;
+    document[0] = '[';
+    for (unsigned i = 0; used < size; i++)
+    {
+        if (logs)
+            used += sprintf(document + used,
+                            "%s\n  {\n    \"time\": \"2024-05-01T12:%02u:%02u.%03uZ\",\n    \"level\": \"%s\",\n"
+                            "    \"message\": \"GET /api/items/%u answered 200 after a cache miss on shard %u\",\n"
+                            "    \"duration_ms\": %u\n  }",
+                            i ? "," : "", i / 60 % 60, i % 60, i % 1000, i % 10 ? "info" : "warn", i, i % 16, i % 250);
+        else
+            used += sprintf(document + used,
+                            "%s{\"id\":%u,\"name\":\"item %u\\twith \\\"quotes\\\"\",\"price\":%u.%02u,"
+                            "\"active\":%s,\"note\":null,\"tags\":[\"a\",\"b\",[%u,%d]]}",
+                            i ? "," : "", i, i, i * 7 % 1000, i % 100, i % 2 ? "true" : "false", i * 31, -(int)i);
+    }
+    document[used++] = ']';
+    document[used] = '\0';
+    *length = used;
+    return document;
+}
+
+// A bump allocator that counts what it hands out
+typedef struct
+{
+    char *memory;
+    size_t used, capacity;
+    size_t allocations;
+} CountingArena;
+
+static void *arena_take(void *context, size_t size)
+{
+    CountingArena *arena = context;
+    size = (size + 15) & ~(size_t)15;
+    if (arena->used + size > arena->capacity)
+        return NULL;
+    arena->allocations++;
+    arena->used += size;
+    return arena->memory + arena->used - size;
+}
+
+static double tree_sum(const JSONValue *value, size_t *values)
+{
+    double sum = 0;
+    (*values)++;
+    if (value->type == JSON_NUMBER)
+        sum = json_value_number(value);
+    else if (value->type == JSON_OBJECT)
+        for (const JSONObject *member = value->object; member; member = member->next)
+            sum += tree_sum(member->value, values);
+    else if (value->type == JSON_ARRAY)
+        for (const JSONArray *element = value->array; element; element = element->next)
+            sum += tree_sum(element->value, values);
+    return sum;
+}
+
+static double tape_sum(const JSONDocument *document, const JSONEntry *entry, size_t *values)
+{
+    double sum = 0;
+    (*values)++;
+    if (entry->type == JSON_NUMBER)
+        sum = json_entry_number(entry);
+    else if (entry->type == JSON_OBJECT)
+        for (uint32_t i = 0; i < entry->length; i++)
+            sum += tape_sum(document, json_entry_value(document, entry, i), values);
+    else if (entry->type == JSON_ARRAY)
+        for (uint32_t i = 0; i < entry->length; i++)
+            sum += tape_sum(document, json_entry_at(document, entry, i), values);
+    return sum;
+}
+
+static const JSONValue *tree_at(const JSONValue *array, size_t index)
+{
+    const JSONArray *element = array->array;
+    while (index-- > 0)
+        element = element->next;
+    return element->value;
+}
+
+static void fail(const char *what, const JSONError *error)
+{
+    fprintf(stderr, "%s: %s at %zu\n", what, error->message, error->position);
+    exit(1);
+}
+
+// MB/s of stage 1 alone: positions collected and dropped
+static double index_rate(const char *json, size_t length, double seconds)
+{
+    static JSONIndex index;
+    unsigned long runs = 0;
+    double start = now_seconds(), elapsed;
+    do
+    {
+        json_index_init(&index, json, length);
+        while (json_index_fill(&index) > 0)
+            ;
+        runs++;
+    } while ((elapsed = now_seconds() - start) < seconds);
+    return length * (double)runs / elapsed / 1e6;
+}
+
+static void run(size_t size, int logs, double seconds)
+{
+    size_t length;
+    char *json = generate_document(size, logs, &length);
+    JSONParser parser = {NULL, 0, {NULL, 0}};
+    volatile double sink = 0;
+
+    // parse: whole runs, malloc and free included
+    double tree_rate, tape_rate, in_place_rate;
+    char *scratch = malloc(length + 1);
+    {
+        unsigned long runs = 0;
+        double start = now_seconds(), elapsed;
+        do
+        {
+            JSONValue *value = json_parse(&parser, json, length);
+            if (!value)
+                fail("json_parse", &parser.error);
+            free_json(value);
+            runs++;
+        } while ((elapsed = now_seconds() - start) < seconds);
+        tree_rate = length * (double)runs / elapsed / 1e6;
+
+        runs = 0;
+        start = now_seconds();
+        do
+        {
+            JSONDocument document;
+            if (json_parse_document(&parser, json, length, &document) != 0)
+                fail("json_parse_document", &parser.error);
+            json_document_free(&document);
+            runs++;
+        } while ((elapsed = now_seconds() - start) < seconds);
+        tape_rate = length * (double)runs / elapsed / 1e6;
+
+        runs = 0;
+        start = now_seconds();
+        do
+        {
+            JSONDocument document;
+            memcpy(scratch, json, length + 1);
+            if (json_parse_document_in_place(&parser, scratch, length, &document) != 0)
+                fail("json_parse_document_in_place", &parser.error);
+            json_document_free(&document);
+            runs++;
+        } while ((elapsed = now_seconds() - start) < seconds);
+        in_place_rate = length * (double)runs / elapsed / 1e6;
+    }
+
+    // allocs: one parse of each into a counting arena
+    CountingArena arena = {malloc(length * 16 + 4096), 0, length * 16 + 4096, 0};
+    JSONAllocator allocator = {arena_take, &arena};
+    JSONParser arena_parser = {&allocator, 0, {NULL, 0}};
+    if (!json_parse(&arena_parser, json, length))
+        fail("json_parse", &arena_parser.error);
+    size_t tree_allocations = arena.allocations, tree_bytes = arena.used;
+    arena.allocations = arena.used = 0;
+    JSONDocument arena_document;
+    if (json_parse_document(&arena_parser, json, length, &arena_document) != 0)
+        fail("json_parse_document", &arena_parser.error);
+    size_t tape_allocations = arena.allocations, tape_bytes = arena.used;
+    arena.allocations = arena.used = 0;
+    memcpy(scratch, json, length + 1);
+    if (json_parse_document_in_place(&arena_parser, scratch, length, &arena_document) != 0)
+        fail("json_parse_document_in_place", &arena_parser.error);
+    size_t in_place_allocations = arena.allocations, in_place_bytes = arena.used;
+    free(arena.memory);
+    free(scratch);
+
+    // walk and index, on documents kept for the purpose
+    JSONValue *tree = json_parse(&parser, json, length);
+    JSONDocument document;
+    if (json_parse_document(&parser, json, length, &document) != 0)
+        fail("json_parse_document", &parser.error);
+    const JSONEntry *root = json_document_root(&document);
+    size_t elements = root->length;
+
+    double walk[2], lookup[2];
+    for (int tape = 0; tape < 2; tape++)
+    {
+        size_t values = 0;
+        double start = now_seconds(), elapsed;
+        do
+            sink += tape ? tape_sum(&document, root, &values) : tree_sum(tree, &values);
+        while ((elapsed = now_seconds() - start) < seconds);
+        walk[tape] = elapsed / values * 1e9;
+
+        uint64_t random = 88172645463325252ULL;
+        size_t lookups = 0;
+        start = now_seconds();
+        do
+        {
+            for (int i = 0; i < LOOKUPS; i++)
+            {
+                random ^= random << 13, random ^= random >> 7, random ^= random << 17;
+                size_t index = random % elements;
+                sink += tape ? json_entry_at(&document, root, index)->length
+                             : (double)tree_at(tree, index)->type;
+            }
+            lookups += LOOKUPS;
+        } while ((elapsed = now_seconds() - start) < seconds);
+        lookup[tape] = elapsed / lookups * 1e9;
+    }
+    free_json(tree);
+    json_document_free(&document);
+
+    static const char *const isas[] = {"avx2", "sse2", "scalar"};
+    const char *isa = json_index_isa();
+    char stage1[128];
+    int used = 0;
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+        if (json_index_select(isas[i]) == 0)
+            used += snprintf(stage1 + used, sizeof(stage1) - used, "  %s %7.1f MB/s", isas[i],
+                             index_rate(json, length, seconds));
+    json_index_select(isa);
+    free(json);
+
+    printf("%9zu B  tree  %7.1f MB/s  %9zu allocs %10zu B  walk %6.2f ns  index %11.1f ns\n",
+           length, tree_rate, tree_allocations, tree_bytes, walk[0], lookup[0]);
+    printf("%9s    tape  %7.1f MB/s  %9zu allocs %10zu B  walk %6.2f ns  index %11.1f ns\n",
+           "", tape_rate, tape_allocations, tape_bytes, walk[1], lookup[1]);
+    printf("%9s    in place%5.1f MB/s  %9zu allocs %10zu B\n", "", in_place_rate, in_place_allocations,
+           in_place_bytes);
+    printf("%9s    stage 1%s\n", "", stage1);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = DEFAULT_SECONDS;
+    int logs = 0;
+    int option;
+    while ((option = getopt(argc, argv, "lt:")) != -1)
+    {
+        switch (option)
+        {
+        case 'l': logs = 1; break;
+        case 't': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-l] [-t seconds] [size...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static const char *const default_sizes[] = {"64k", "1m", "16m"};
+    const char *const *sizes = optind < argc ? (const char *const *)argv + optind : default_sizes;
+    int size_count = optind < argc ? argc - optind : 3;
+    for (int i = 0; i < size_count; i++)
+    {
+        size_t size = parse_size(sizes[i]);
+        if (size < 2)
+        {
+            fprintf(stderr, "%s: not a size\n", sizes[i]);
+            return 1;
+        }
+        run(size, logs, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Number conversion (json_number.c) against strtod, on integer-heavy and
+// float-heavy JSON.
+//
+// Three generated documents, each an array of records:
+//   ints    IDs, 64-bit hashes, counters and timestamps in milliseconds;
+//   floats  prices, coordinates with 15-17 digits and measurements with
+//           exponents;
+//   mixed   half of each.
+// For each it reports:
+//   parse     MB/s of json_parse_document, which now converts with
+//             json_parse_number;
+//   convert   ns per number for json_parse_number and for strtod over the
+//             same tokens;
+//   kinds     how the numbers came out: exact integers or doubles;
+//   mismatch  doubles that differ from strtod's in any bit, which must be 0.
+//
+// Build: gcc -O2 -I. -o json_number_bench bench/json_number_bench.c json.c json_index.c json_number.c
+// Usage: json_number_bench [-t seconds] [-n records]
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "json.h"
+#include "json_number.h"
+
+#define DEFAULT_SECONDS 1.0 // Measured per document and column
+#define DEFAULT_RECORDS 20000
+
+static double now_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static uint64_t random_state = 88172645463325252ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// A double spread over many magnitudes, never NaN or infinite
+static double random_double(void)
+{
+    double mantissa = (double)(next_random() >> 11) / (double)(1ULL << 53);
+    int exponent = (int)(next_random() % 40) - 20;
+    double scale = 1;
+    for (int i = 0; i < (exponent < 0 ? -exponent : exponent); i++)
+        scale *= 10;
+    return exponent < 0 ? mantissa / scale : mantissa * scale;
+}
+
+static int integer_record(char *out, unsigned i)
+{
+    return sprintf(out, "{\"id\":%u,\"hash\":%llu,\"owner\":%lld,\"count\":%u,\"at\":%llu}", i,
+                   (unsigned long long)next_random(), (long long)(next_random() >> 1) * (i % 2 ? -1 : 1),
+                   (unsigned)(next_random() % 100000), 1700000000000ULL + i * 37ULL);
+}
+
+static int float_record(char *out, unsigned i)
+{
+    return sprintf(out, "{\"price\":%u.%02u,\"lat\":%.15f,\"lon\":%.17g,\"value\":%.17g,\"ratio\":%.6e}",
+                   i % 1000, i % 100, (double)(next_random() % 180000000) / 1e6 - 90,
+                   (double)(next_random() % 360000000) / 1e6 - 180, random_double(), random_double());
+}
+
+static char *generate_document(const char *kind, unsigned records, size_t *length)
+{
+    char *document = malloc((size_t)records * 160 + 16);
+    size_t used = 1;
+    document[0] = '[';
+    for (unsigned i = 0; i < records; i++)
+    {
+        if (i)
+            document[used++] = ',';
+        int floats = strcmp(kind, "floats") == 0 || (strcmp(kind, "mixed") == 0 && i % 2);
+        used += floats ? float_record(document + used, i) : integer_record(document + used, i);
+    }
+    document[used++] = ']';
+    document[used] = '\0';
+    *length = used;
+    return document;
+}
+
+// Start of every number token in json
+static const char **find_numbers(const char *json, size_t *count)
+{
+    size_t capacity = 1024;
+    const char **numbers = malloc(capacity * sizeof(*numbers));
+    *count = 0;
+    for (const char *p = json; *p; p++)
+    {
+        if ((*p == '-' || (*p >= '0' && *p <= '9')) && (p[-1] == ':' || p[-1] == ',' || p[-1] == '['))
+        {
+            if (*count == capacity)
+                numbers = realloc(numbers, (capacity *= 2) * sizeof(*numbers));
+            numbers[(*count)++] = p;
+        }
+    }
+    return numbers;
+}
+
+static void run(const char *kind, unsigned records, double seconds)
+{
+    size_t length, count;
+    char *json = generate_document(kind, records, &length);
+    const char **numbers = find_numbers(json, &count);
+    JSONParser parser = {NULL, 0, {NULL, 0}};
+    volatile double sink = 0;
+
+    // parse: whole documents
+    unsigned long runs = 0;
+    double start = now_seconds(), elapsed;
+    do
+    {
+        JSONDocument document;
+        if (json_parse_document(&parser, json, length, &document) != 0)
+        {
+            fprintf(stderr, "%s: %s at %zu\n", kind, parser.error.message, parser.error.position);
+            exit(1);
+        }
+        json_document_free(&document);
+        runs++;
+    } while ((elapsed = now_seconds() - start) < seconds);
+    double parse_rate = length * (double)runs / elapsed / 1e6;
+
+    // convert: the number tokens alone, both ways
+    double convert[2];
+    for (int use_strtod = 0; use_strtod < 2; use_strtod++)
+    {
+        size_t converted = 0;
+        start = now_seconds();
+        do
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                if (use_strtod)
+                {
+                    sink += strtod(numbers[i], NULL);
+                }
+                else
+                {
+                    JSONNumber number;
+                    json_parse_number(numbers[i], &number);
+                    sink += (double)number.unsigned_integer;
+                }
+            }
+            converted += count;
+        } while ((elapsed = now_seconds() - start) < seconds);
+        convert[use_strtod] = elapsed / converted * 1e9;
+    }
+
+    // kinds and mismatches
+    size_t kinds[3] = {0, 0, 0}, mismatches = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        JSONNumber number;
+        json_parse_number(numbers[i], &number);
+        kinds[number.kind]++;
+        double expected = strtod(numbers[i], NULL);
+        if (number.kind == JSON_DOUBLE && memcmp(&number.number, &expected, sizeof(expected)) != 0)
+            mismatches++;
+    }
+    free(numbers);
+    free(json);
+
+    printf("%-6s %9zu B  parse %7.1f MB/s  convert %6.1f ns (strtod %6.1f ns)  "
+           "int64 %6zu uint64 %6zu double %6zu  mismatch %zu\n",
+           kind, length, parse_rate, convert[0], convert[1], kinds[JSON_INT64], kinds[JSON_UINT64],
+           kinds[JSON_DOUBLE], mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = DEFAULT_SECONDS;
+    unsigned records = DEFAULT_RECORDS;
+    int option;
+    while ((option = getopt(argc, argv, "n:t:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n': records = (unsigned)atoi(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-t seconds] [-n records]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static const char *const kinds[] = {"ints", "floats", "mixed"};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+        run(kinds[i], records, seconds);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Compares router_lookup with the strcmp chain handle_client used to route
+// requests, at 10, 100 and 1000 registered routes. Half of the routes are
+// static, half end in a parameter segment; the chain can only test the
+// static ones, so it is given every route path as a plain string.
+//
+// Build: gcc -O2 -I. -o router_bench bench/router_bench.c router.c http_parser.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "router.h"
+
+#define LOOKUPS 4000000
+
+static void dummy_handler(struct Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)conn;
+    (void)request;
+    (void)match;
+}
+
+static double seconds_since(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void run(int route_count)
+{
+    Router *router = router_create();
+    char **chain_paths = malloc(route_count * sizeof(char *));
+    char **paths = malloc(route_count * sizeof(char *));
+    HttpSlice method = {"GET", 3};
+
+    // Step 1: Register routes shaped like a typical REST API
+    for (int i = 0; i < route_count; i++)
+    {
+        char pattern[128], path[128];
+        if (i % 2 == 0)
+        {
+            snprintf(pattern, sizeof(pattern), "/api/v1/resource%d/items", i);
+            snprintf(path, sizeof(path), "/api/v1/resource%d/items", i);
+        }
+        else
+        {
+            snprintf(pattern, sizeof(pattern), "/api/v1/resource%d/:id", i);
+            snprintf(path, sizeof(path), "/api/v1/resource%d/12345", i);
+        }
+        router_add(router, "GET", pattern, dummy_handler);
+        chain_paths[i] = strdup(path);
+        paths[i] = strdup(path);
+    }
+
+    // Step 2: The same random request mix for both approaches
+    int *order = malloc(LOOKUPS * sizeof(int));
+    srand(42);
+    for (int i = 0; i < LOOKUPS; i++)
+        order[i] = rand() % route_count;
+
+    volatile long found = 0;
+    struct timespec start;
+    RouteMatch match;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        HttpSlice path = {paths[order[i]], strlen(paths[order[i]])};
+        found += router_lookup(router, method, path, &match) == ROUTE_FOUND;
+    }
+    double tree = seconds_since(start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        const char *path = paths[order[i]];
+        for (int r = 0; r < route_count; r++)
+        {
+            if (strcmp(path, chain_paths[r]) == 0)
+            {
+                found++;
+                break;
+            }
+        }
+    }
+    double chain = seconds_since(start);
+
+    printf("%5d routes: radix tree %7.1f ns/lookup   strcmp chain %8.1f ns/lookup\n",
+           route_count, tree * 1e9 / LOOKUPS, chain * 1e9 / LOOKUPS);
+
+    for (int i = 0; i < route_count; i++)
+    {
+        free(chain_paths[i]);
+        free(paths[i]);
+    }
+    free(chain_paths);
+    free(paths);
+    free(order);
+    router_free(router);
+}
+
+int main()
+{
+    run(10);
+    run(100);
+    run(1000);
+    return 0;
+}
@@ -0,0 +1,294 @@
+// Checks the parts of file_cache.c that stand between a URL and the disk,
+// against a scratch directory holding a root with a few files and, next to
+// it, a file the root must not reach.
+//
+//   paths       file_cache_open refuses ".", ".." and empty segments
+//               however they are spelled (percent-encoded, in either case,
+//               mixed), a leading '/', NUL and malformed escapes, and paths
+//               too long to decode; it opens the file an escaped name
+//               stands for, and says ENOENT or EISDIR where it should;
+//   etag        the ETag and Last-Modified come from the file's mtime and
+//               size, and change with them once the entry is revalidated
+//               while an entry still referenced keeps its own;
+//   ranges      file_parse_range: first-last, open-ended and suffix ranges,
+//               clamping to the file, unsatisfiable ranges, empty files,
+//               syntax it must ignore, and positions too long for an off_t,
+//               which must saturate rather than wrap.
+//
+// Build: gcc -O2 -I. -o file_cache_check check/file_cache_check.c file_cache.c
+// Usage: file_cache_check
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_cache.h"
+
+static int failures;
+static char directory[] = "/tmp/file_cache_check.XXXXXX";
+
+static void write_file(const char *name, const char *content, time_t mtime)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *file = fopen(path, "w");
+    if (!file || fputs(content, file) < 0 || fclose(file) != 0)
+    {
+        perror(path);
+        exit(2);
+    }
+    struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+static const struct
+{
+    const char *path;
+    int error;           // errno, or 0 if it opens
+    const char *content; // Of the file it opens
+} paths[] = {
+    {"a.txt", 0, "hello"},
+    {"sub/b.css", 0, "b{}"},
+    {"%61.txt", 0, "hello"},
+    {"sub%2fb.css", 0, "b{}"},
+    {"sp%20ace", 0, "space"},
+    {"..a", 0, "dots"},
+    {"...", ENOENT, NULL},
+    {"missing", ENOENT, NULL},
+    {"sub", EISDIR, NULL},
+    {"../secret", EACCES, NULL},
+    {"sub/../../secret", EACCES, NULL},
+    {"sub/../a.txt", EACCES, NULL},
+    {"%2e%2e/secret", EACCES, NULL},
+    {"%2E%2E%2Fsecret", EACCES, NULL},
+    {".%2e/secret", EACCES, NULL},
+    {"sub%2f%2e%2e%2f%2e%2e%2fsecret", EACCES, NULL},
+    {"..", EACCES, NULL},
+    {".", EACCES, NULL},
+    {"./a.txt", EACCES, NULL},
+    {"sub/./b.css", EACCES, NULL},
+    {"sub/.", EACCES, NULL},
+    {"", EACCES, NULL},
+    {"sub//b.css", EACCES, NULL},
+    {"sub/", EACCES, NULL},
+    {"/a.txt", EACCES, NULL},
+    {"%2fetc/passwd", EACCES, NULL},
+    {"a.txt%00.png", EACCES, NULL},
+    {"a%", EACCES, NULL},
+    {"a%6", EACCES, NULL},
+    {"%zz.txt", EACCES, NULL},
+    {"%6g.txt", EACCES, NULL},
+};
+
+static void check_paths(FileCache *cache)
+{
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+    {
+        errno = 0;
+        CachedFile *file = file_cache_open(cache, paths[i].path, strlen(paths[i].path));
+        int error = file ? 0 : errno;
+        char content[64] = "";
+        if (file)
+        {
+            ssize_t got = pread(file->fd, content, sizeof(content) - 1, 0);
+            content[got > 0 ? got : 0] = '\0';
+        }
+        if (error != paths[i].error || (file && strcmp(content, paths[i].content) != 0))
+        {
+            printf("\"%s\": %s \"%s\"; want %s \"%s\"\n", paths[i].path, error ? strerror(error) : "opened",
+                   content, paths[i].error ? strerror(paths[i].error) : "opened",
+                   paths[i].content ? paths[i].content : "");
+            failures++;
+        }
+        if (file)
+            file_cache_release(file);
+    }
+
+    // Longer than the decoded path may be
+    static char long_path[2048];
+    for (size_t i = 0; i + 2 < sizeof(long_path); i += 2)
+        memcpy(long_path + i, "a/", 2);
+    long_path[sizeof(long_path) - 2] = 'a';
+    CachedFile *file = file_cache_open(cache, long_path, sizeof(long_path) - 1);
+    if (file || errno != EACCES)
+    {
+        printf("%zu-byte path: %s\n", sizeof(long_path) - 1, file ? "opened" : strerror(errno));
+        failures++;
+    }
+}
+
+static void expect_validators(const CachedFile *file, const char *what, const char *etag,
+                              const char *last_modified)
+{
+    if (strcmp(file->etag, etag) != 0 || strcmp(file->last_modified, last_modified) != 0)
+    {
+        printf("%s: ETag %s, Last-Modified %s; want %s, %s\n", what, file->etag, file->last_modified, etag,
+               last_modified);
+        failures++;
+    }
+}
+
+static void check_etag(void)
+{
+    // Revalidated on every open
+    char root[64];
+    snprintf(root, sizeof(root), "%s/root", directory);
+    FileCache *cache = file_cache_create(root, 8, 0);
+
+    CachedFile *old = file_cache_open(cache, "a.txt", 5);
+    if (!old)
+    {
+        printf("a.txt: %s\n", strerror(errno));
+        failures++;
+        file_cache_free(cache);
+        return;
+    }
+    expect_validators(old, "a.txt", "\"6553f100-5\"", "Tue, 14 Nov 2023 22:13:20 GMT");
+    if (strcmp(old->content_type, "text/plain; charset=utf-8") != 0)
+    {
+        printf("a.txt: Content-Type %s\n", old->content_type);
+        failures++;
+    }
+
+    write_file("root/a.txt", "goodbye", 1700000001);
+    CachedFile *file = file_cache_open(cache, "a.txt", 5);
+    if (!file || file == old)
+    {
+        printf("a.txt changed: %s\n", file ? "the old entry came back" : strerror(errno));
+        failures++;
+    }
+    else
+    {
+        expect_validators(file, "a.txt changed", "\"6553f101-7\"", "Tue, 14 Nov 2023 22:13:21 GMT");
+        file_cache_release(file);
+    }
+    expect_validators(old, "a.txt still referenced", "\"6553f100-5\"", "Tue, 14 Nov 2023 22:13:20 GMT");
+    file_cache_release(old);
+
+    // The same size but a new mtime is a new version too
+    write_file("root/a.txt", "GOODBYE", 1800000000);
+    file = file_cache_open(cache, "a.txt", 5);
+    if (!file)
+    {
+        printf("a.txt touched: %s\n", strerror(errno));
+        failures++;
+    }
+    else
+    {
+        expect_validators(file, "a.txt touched", "\"6b49d200-7\"", "Fri, 15 Jan 2027 08:00:00 GMT");
+        file_cache_release(file);
+    }
+    write_file("root/a.txt", "hello", 1700000000);
+    file_cache_free(cache);
+}
+
+static const struct
+{
+    const char *value;
+    off_t size;
+    int result;
+    off_t start, length; // When result is 1
+} ranges[] = {
+    {"bytes=0-4", 10, 1, 0, 5},
+    {"bytes=5-", 10, 1, 5, 5},
+    {"bytes=9-9", 10, 1, 9, 1},
+    {"bytes=0-0", 10, 1, 0, 1},
+    {"bytes=3-100", 10, 1, 3, 7},
+    {"bytes=007-008", 10, 1, 7, 2},
+    {"bytes=10-", 10, -1, 0, 0},
+    {"bytes=10-20", 10, -1, 0, 0},
+    {"bytes=5-4", 10, -1, 0, 0},
+    {"bytes=-3", 10, 1, 7, 3},
+    {"bytes=-10", 10, 1, 0, 10},
+    {"bytes=-20", 10, 1, 0, 10},
+    {"bytes=-0", 10, -1, 0, 0},
+    {"bytes=0-", 0, -1, 0, 0},
+    {"bytes=-5", 0, -1, 0, 0},
+    {"bytes=-", 10, 0, 0, 0},
+    {"bytes=", 10, 0, 0, 0},
+    {"bytes", 10, 0, 0, 0},
+    {"bytes=0", 10, 0, 0, 0},
+    {"bytes=0-4,6-7", 10, 0, 0, 0},
+    {"bytes= 0-4", 10, 0, 0, 0},
+    {"bytes=0-4 ", 10, 0, 0, 0},
+    {"bytes=a-b", 10, 0, 0, 0},
+    {"bytes=--4", 10, 0, 0, 0},
+    {"items=0-4", 10, 0, 0, 0},
+    // Past 2^63 and 2^64: wrapping would make these small or negative
+    {"bytes=9223372036854775807-", 10, -1, 0, 0},
+    {"bytes=9223372036854775808-", 10, -1, 0, 0},
+    {"bytes=18446744073709551617-", 10, -1, 0, 0},
+    {"bytes=99999999999999999999999999-", 10, -1, 0, 0},
+    {"bytes=0-9223372036854775807", 10, 1, 0, 10},
+    {"bytes=2-18446744073709551619", 10, 1, 2, 8},
+    {"bytes=0-99999999999999999999999999", 10, 1, 0, 10},
+    {"bytes=-18446744073709551619", 10, 1, 0, 10},
+    {"bytes=-99999999999999999999999999", 10, 1, 0, 10},
+    {"bytes=9223372036854775806-9223372036854775807", 9223372036854775807LL, 1, 9223372036854775806LL, 1},
+};
+
+static void check_ranges(void)
+{
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++)
+    {
+        off_t start = 0, length = 0;
+        int result = file_parse_range(ranges[i].value, strlen(ranges[i].value), ranges[i].size, &start, &length);
+        if (result != ranges[i].result ||
+            (result == 1 && (start != ranges[i].start || length != ranges[i].length)))
+        {
+            printf("%s of %lld bytes: %d, %lld+%lld; want %d, %lld+%lld\n", ranges[i].value,
+                   (long long)ranges[i].size, result, (long long)start, (long long)length, ranges[i].result,
+                   (long long)ranges[i].start, (long long)ranges[i].length);
+            failures++;
+        }
+    }
+}
+
+int main(void)
+{
+    if (!mkdtemp(directory))
+    {
+        perror(directory);
+        return 2;
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "%s/root", directory);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/root/sub", directory);
+    mkdir(path, 0700);
+    write_file("secret", "secret", 1700000000);
+    write_file("root/a.txt", "hello", 1700000000);
+    write_file("root/sub/b.css", "b{}", 1700000000);
+    write_file("root/sp ace", "space", 1700000000);
+    write_file("root/..a", "dots", 1700000000);
+
+    snprintf(path, sizeof(path), "%s/root", directory);
+    FileCache *cache = file_cache_create(path, 4, 3600);
+    if (!cache)
+    {
+        perror(path);
+        return 2;
+    }
+    check_paths(cache);
+    file_cache_free(cache);
+    check_etag();
+    check_ranges();
+
+    static const char *const files[] = {"root/sub/b.css", "root/sp ace", "root/..a", "root/a.txt", "secret",
+                                        "root/sub", "root"};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", directory, files[i]);
+        if (unlink(path) != 0)
+            rmdir(path);
+    }
+    rmdir(directory);
+
+    printf("%zu paths, %zu ranges  %s\n", sizeof(paths) / sizeof(paths[0]) + 1, sizeof(ranges) / sizeof(ranges[0]),
+           failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+// Checks request body framing (http_body_init and http_body_decode in
+// http_parser.c): the framing headers that are refused because a proxy in
+// front could read them differently, and the chunked decoder.
+//
+//   framing     Content-Length alone, repeated with the same value or not,
+//               malformed or past 64 bits; Transfer-Encoding chunked,
+//               repeated, next to a Content-Length, in HTTP/1.0, or with a
+//               coding other than chunked;
+//   chunked     sizes in either case and with leading zeros, extensions,
+//               trailers, sizes that overflow 64 bits or pass the limit,
+//               and every way the CRLFs can go missing;
+//   splits      each body, with the next request's bytes behind it, is
+//               decoded whole, a byte at a time and split in two at every
+//               byte: the bytes handed back, the result and where the body
+//               ends must come out the same every way.
+//
+// Build: gcc -O2 -I. -o http_body_check check/http_body_check.c http_parser.c
+// Usage: http_body_check
+
+#include <stdio.h>
+#include <string.h>
+#include "http_parser.h"
+
+#define LIMIT 1000
+#define NEXT "GET / HTTP/1.1\r\n\r\n" // Pipelined behind each body
+
+static int failures;
+
+// Parses head and returns http_body_init's result for it
+static int init(const char *head, HttpBody *body)
+{
+    static HttpRequest request;
+    http_request_init(&request);
+    if (http_parse_request(&request, head, strlen(head)) <= 0)
+    {
+        printf("%s: the head does not parse\n", head);
+        failures++;
+        return HTTP_PARSE_ERROR;
+    }
+    return http_body_init(body, &request, LIMIT);
+}
+
+static const struct
+{
+    const char *headers;
+    int result;
+} framings[] = {
+    {"", 0},
+    {"Content-Length: 5\r\n", 0},
+    {"Content-Length: 0\r\n", 0},
+    {"Content-Length: 5\r\nContent-Length: 5\r\n", 0},
+    {"Content-Length: 5\r\ncontent-length: 6\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 5\r\nContent-Length: 05\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 5, 5\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: +5\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: -1\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 0x10\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length:\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 9999999999999999999\r\n", HTTP_BODY_TOO_LARGE},
+    {"Content-Length: 18446744073709551616\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 99999999999999999999999\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 1001\r\n", HTTP_BODY_TOO_LARGE},
+    {"Content-Length: 1000\r\n", 0},
+    {"Transfer-Encoding: chunked\r\n", 0},
+    {"transfer-encoding: CHUNKED\r\n", 0},
+    {"Transfer-Encoding: chunked\r\nContent-Length: 5\r\n", HTTP_PARSE_ERROR},
+    {"Content-Length: 5\r\nTransfer-Encoding: chunked\r\n", HTTP_PARSE_ERROR},
+    {"Transfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n", HTTP_PARSE_ERROR},
+    {"Transfer-Encoding: gzip\r\n", HTTP_BODY_UNSUPPORTED},
+    {"Transfer-Encoding: gzip, chunked\r\n", HTTP_BODY_UNSUPPORTED},
+    {"Transfer-Encoding: chunked, gzip\r\n", HTTP_BODY_UNSUPPORTED},
+    {"Transfer-Encoding: chunked\r\nContent-Length: 5\r\nContent-Length: 6\r\n", HTTP_PARSE_ERROR},
+};
+
+static void check_framing(void)
+{
+    char head[256];
+    for (size_t i = 0; i < sizeof(framings) / sizeof(framings[0]); i++)
+    {
+        snprintf(head, sizeof(head), "POST / HTTP/1.1\r\n%s\r\n", framings[i].headers);
+        HttpBody body;
+        int result = init(head, &body);
+        if (result != framings[i].result)
+        {
+            printf("%s: http_body_init gives %d, want %d\n", framings[i].headers, result, framings[i].result);
+            failures++;
+        }
+    }
+
+    // Chunked needs HTTP/1.1: an HTTP/1.0 recipient cannot be relied on to
+    // read it the same way
+    HttpBody body;
+    if (init("POST / HTTP/1.0\r\nTransfer-Encoding: chunked\r\n\r\n", &body) != HTTP_PARSE_ERROR)
+    {
+        printf("chunked in HTTP/1.0: accepted\n");
+        failures++;
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    const char *body;
+    int result;          // Of the whole decode: 0 once complete, or the error
+    const char *decoded; // On success
+} Chunked;
+
+static const Chunked chunked[] = {
+    {"one chunk", "5\r\nhello\r\n0\r\n\r\n", 0, "hello"},
+    {"several", "3\r\nabc\r\n1\r\nd\r\n6\r\nefghij\r\n0\r\n\r\n", 0, "abcdefghij"},
+    {"empty", "0\r\n\r\n", 0, ""},
+    {"upper-case hex", "A\r\n0123456789\r\n0\r\n\r\n", 0, "0123456789"},
+    {"lower-case hex", "a\r\n0123456789\r\n0\r\n\r\n", 0, "0123456789"},
+    {"leading zeros", "0005\r\nhello\r\n000\r\n\r\n", 0, "hello"},
+    {"extension", "5;name=value\r\nhello\r\n0;last\r\n\r\n", 0, "hello"},
+    {"quoted extension", "5;a=\"x;y\"\r\nhello\r\n0\r\n\r\n", 0, "hello"},
+    {"space before extension", "5 ;x\r\nhello\r\n0\r\n\r\n", 0, "hello"},
+    {"trailers", "5\r\nhello\r\n0\r\nChecksum: 1\r\nX: y\r\n\r\n", 0, "hello"},
+    {"CRLF in data", "4\r\n\r\n\r\n\r\n0\r\n\r\n", 0, "\r\n\r\n"},
+    {"at the limit", "3e8\r\n", HTTP_PARSE_INCOMPLETE, NULL}, // Body filled in by main
+    {"past the limit", "3e9\r\n", HTTP_BODY_TOO_LARGE, NULL},
+    {"past the limit in total", "3e8\r\n", HTTP_BODY_TOO_LARGE, NULL}, // Two of them
+    {"largest size", "ffffffffffffffff\r\n", HTTP_BODY_TOO_LARGE, NULL},
+    {"size past 64 bits", "10000000000000000\r\n", HTTP_PARSE_ERROR, NULL},
+    {"very long size", "00000000000000000000000000000000005\r\nhello\r\n0\r\n\r\n", 0, "hello"},
+    {"no size", "\r\nhello\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"not hex", "g\r\n", HTTP_PARSE_ERROR, NULL},
+    {"sign", "+5\r\nhello\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"0x", "0x5\r\nhello\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"bare LF after size", "5\nhello\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"bare CR after size", "5\rhello\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"LF in extension", "5;x\nhello\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"data too long", "5\r\nhello!\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"data too short", "5\r\nhell\r\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"bare LF after data", "5\r\nhello\n0\r\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"bare LF after trailer", "0\r\nX: y\n\r\n", HTTP_PARSE_ERROR, NULL},
+    {"bare LF ends body", "0\r\n\n", HTTP_PARSE_ERROR, NULL},
+    {"CR then junk at end", "0\r\n\rX", HTTP_PARSE_ERROR, NULL},
+    {"trailers too long", "0\r\nX: ", HTTP_PARSE_ERROR, NULL}, // Value filled in by main
+    {"cut short", "5\r\nhel", HTTP_PARSE_INCOMPLETE, NULL},
+};
+
+typedef struct
+{
+    int result;          // 0 complete, HTTP_PARSE_INCOMPLETE, or the error
+    size_t consumed;     // Bytes the body took
+    char decoded[4096];
+    size_t decoded_length;
+} Outcome;
+
+// Decodes data, handing it over in pieces that end at the offsets in
+// splits (and at the end)
+static void decode(const char *data, size_t length, const size_t *splits, int split_count, Outcome *outcome)
+{
+    HttpBody body;
+    init("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", &body);
+    outcome->result = HTTP_PARSE_INCOMPLETE;
+    outcome->consumed = 0;
+    outcome->decoded_length = 0;
+    size_t offset = 0;
+    for (int s = 0; s <= split_count; s++)
+    {
+        size_t end = s < split_count ? splits[s] : length;
+        // Like the server: decode while anything is consumed
+        while (offset < end)
+        {
+            HttpSlice chunk;
+            int n = http_body_decode(&body, data + offset, end - offset, &chunk);
+            if (n < 0)
+            {
+                outcome->result = n;
+                return;
+            }
+            if (outcome->decoded_length + chunk.length <= sizeof(outcome->decoded))
+                memcpy(outcome->decoded + outcome->decoded_length, chunk.data, chunk.length);
+            outcome->decoded_length += chunk.length;
+            offset += n;
+            outcome->consumed = offset;
+            if (http_body_complete(&body))
+            {
+                outcome->result = 0;
+                return;
+            }
+            if (n == 0)
+                break;
+        }
+    }
+}
+
+static int same(const Outcome *a, const Outcome *b)
+{
+    return a->result == b->result && (a->result != 0 || (a->consumed == b->consumed &&
+                                                         a->decoded_length == b->decoded_length &&
+                                                         memcmp(a->decoded, b->decoded, a->decoded_length) == 0));
+}
+
+static void check_chunked(const char *name, const char *data, size_t body_length, int result, const char *decoded)
+{
+    static Outcome whole, piecewise;
+    size_t length = strlen(data);
+    decode(data, length, NULL, 0, &whole);
+    if (whole.result != result || (result == 0 && (whole.consumed != body_length ||
+                                                   whole.decoded_length != strlen(decoded) ||
+                                                   memcmp(whole.decoded, decoded, whole.decoded_length) != 0)))
+    {
+        printf("%s: result %d, %zu bytes consumed, \"%.*s\"; want %d, %zu, \"%s\"\n", name, whole.result,
+               whole.consumed, (int)whole.decoded_length, whole.decoded, result, body_length,
+               decoded ? decoded : "");
+        failures++;
+        return;
+    }
+
+    static size_t splits[8192];
+    for (size_t i = 0; i < length; i++)
+        splits[i] = i + 1;
+    decode(data, length, splits, (int)length, &piecewise);
+    if (!same(&whole, &piecewise))
+    {
+        printf("%s: a byte at a time gives %d, %zu bytes consumed\n", name, piecewise.result, piecewise.consumed);
+        failures++;
+        return;
+    }
+    for (size_t split = 0; split <= length; split++)
+    {
+        decode(data, length, &split, 1, &piecewise);
+        if (!same(&whole, &piecewise))
+        {
+            printf("%s: split at %zu gives %d, %zu bytes consumed\n", name, split, piecewise.result,
+                   piecewise.consumed);
+            failures++;
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    check_framing();
+
+    static char data[8192], decoded[4096];
+    for (size_t i = 0; i < sizeof(chunked) / sizeof(chunked[0]); i++)
+    {
+        const Chunked *c = &chunked[i];
+        size_t length = snprintf(data, sizeof(data), "%s", c->body);
+        const char *expected = c->decoded;
+        int result = c->result;
+        if (strcmp(c->name, "at the limit") == 0 || strcmp(c->name, "past the limit in total") == 0)
+        {
+            // 1000 bytes, the limit; a second chunk of them is one too many
+            memset(data + length, 'x', LIMIT);
+            memset(decoded, 'x', LIMIT);
+            decoded[LIMIT] = '\0';
+            length += LIMIT;
+            length += sprintf(data + length, "\r\n%s", c->result == HTTP_BODY_TOO_LARGE ? "1\r\nx\r\n" : "");
+            length += sprintf(data + length, "0\r\n\r\n");
+            if (result == HTTP_PARSE_INCOMPLETE)
+            {
+                result = 0;
+                expected = decoded;
+            }
+        }
+        else if (strcmp(c->name, "trailers too long") == 0)
+        {
+            memset(data + length, 'y', HTTP_MAX_TRAILERS);
+            length += HTTP_MAX_TRAILERS;
+            length += sprintf(data + length, "\r\n\r\n");
+        }
+        size_t body_length = length;
+        if (result != HTTP_PARSE_INCOMPLETE)
+            length += sprintf(data + length, "%s", NEXT);
+        check_chunked(c->name, data, body_length, result, expected);
+    }
+
+    // Content-Length bodies stop at their length, whatever follows
+    HttpBody body;
+    init("POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\n", &body);
+    HttpSlice chunk;
+    int n = http_body_decode(&body, "hel", 3, &chunk);
+    int m = http_body_decode(&body, "lo" NEXT, 2 + strlen(NEXT), &chunk);
+    if (n != 3 || m != 2 || chunk.length != 2 || memcmp(chunk.data, "lo", 2) != 0 || !http_body_complete(&body))
+    {
+        printf("Content-Length 5 in two pieces: %d then %d bytes consumed\n", n, m);
+        failures++;
+    }
+
+    printf("%zu framings, %zu chunked bodies split at every byte  %s\n", sizeof(framings) / sizeof(framings[0]) + 1,
+           sizeof(chunked) / sizeof(chunked[0]), failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+// Checks the incremental request parser (http_parse_request in
+// http_parser.c) against a table of heads and against itself.
+//
+//   table       each head is parsed whole and must give the method, path,
+//               version, headers and head length listed, or be refused:
+//               bare CR, control bytes and DEL, tabs in the request line,
+//               obsolete line folding, whitespace before the colon, bad
+//               versions, and more than HTTP_MAX_HEADERS fields;
+//   splits      the same heads are fed growing one byte at a time to one
+//               HttpRequest, as a slow client would send them, and split in
+//               two at every byte; every prefix must give what a fresh
+//               parse of it gives, which is HTTP_PARSE_INCOMPLETE until the
+//               head is complete or has gone wrong, and the same fields in
+//               the end;
+//   random      (-n of them) heads of up to a dozen fields built from
+//               well- and badly-formed pieces, with values long enough to
+//               cross the scanner's 16- and 32-byte steps, go through the
+//               same two ways.
+//
+// How long a head may get is the caller's buffer: the parser asks for more
+// bytes until the head ends, and the server closes a connection whose head
+// fills BUFFER_SIZE. What the parser bounds is the number of fields.
+//
+// Build: gcc -O2 -I. -o http_parser_check check/http_parser_check.c http_parser.c
+// Usage: http_parser_check [-n inputs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "http_parser.h"
+
+#define DEFAULT_INPUTS 20000
+#define MAX_LENGTH 4096
+
+static long failures;
+
+static uint64_t random_state = 2463534242ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// What a parse came to, as text: "INCOMPLETE", "ERROR", or the head length
+// and fields, "26 GET / 1 Host=a|"
+static void describe(const HttpRequest *request, int result, char *text, size_t size)
+{
+    if (result == HTTP_PARSE_INCOMPLETE)
+    {
+        snprintf(text, size, "INCOMPLETE");
+        return;
+    }
+    if (result == HTTP_PARSE_ERROR)
+    {
+        snprintf(text, size, "ERROR");
+        return;
+    }
+    size_t length = snprintf(text, size, "%d %.*s %.*s %d ", result, (int)request->method.length,
+                             request->method.data, (int)request->path.length, request->path.data,
+                             request->minor_version);
+    for (int i = 0; i < request->header_count && length < size; i++)
+    {
+        const HttpHeader *header = &request->headers[i];
+        length += snprintf(text + length, size - length, "%.*s=%.*s|", (int)header->name.length,
+                           header->name.data, (int)header->value.length, header->value.data);
+    }
+}
+
+static void parse_fresh(const char *head, size_t length, char *text, size_t size)
+{
+    HttpRequest request;
+    http_request_init(&request);
+    describe(&request, http_parse_request(&request, head, length), text, size);
+}
+
+// Feeds head growing a byte at a time, then split once at every byte, and
+// compares each step with a fresh parse of the same prefix. Returns 1 if
+// they ever differ, after saying where.
+static int check_splits(const char *name, const char *head, size_t length)
+{
+    static char fresh[16384], fed[16384];
+    HttpRequest request;
+    http_request_init(&request);
+    int done = 0;
+    for (size_t k = 0; k <= length && !done; k++)
+    {
+        int result = http_parse_request(&request, head, k);
+        describe(&request, result, fed, sizeof(fed));
+        parse_fresh(head, k, fresh, sizeof(fresh));
+        if (strcmp(fed, fresh) != 0)
+        {
+            printf("%s: byte at a time, %zu bytes in: %s; a fresh parse says %s\n", name, k, fed, fresh);
+            return 1;
+        }
+        done = result != HTTP_PARSE_INCOMPLETE;
+    }
+
+    parse_fresh(head, length, fresh, sizeof(fresh));
+    for (size_t split = 0; split <= length; split++)
+    {
+        http_request_init(&request);
+        int result = http_parse_request(&request, head, split);
+        if (result == HTTP_PARSE_INCOMPLETE)
+            result = http_parse_request(&request, head, length);
+        describe(&request, result, fed, sizeof(fed));
+        if (strcmp(fed, fresh) != 0)
+        {
+            printf("%s: split at %zu: %s; whole: %s\n", name, split, fed, fresh);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct
+{
+    const char *name;
+    const char *head;
+    const char *expected; // As describe() puts it
+} Case;
+
+static const Case cases[] = {
+    {"minimal", "GET / HTTP/1.1\r\n\r\n", "18 GET / 1 "},
+    {"headers", "GET /a?b=c HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\n\r\n",
+     "55 GET /a?b=c 1 Host=example.com|Accept=*/*|"},
+    {"HTTP/1.0", "POST /x HTTP/1.0\r\nContent-Length: 0\r\n\r\n", "39 POST /x 0 Content-Length=0|"},
+    {"bare LF", "GET / HTTP/1.1\nHost: a\n\n", "24 GET / 1 Host=a|"},
+    {"mixed endings", "GET / HTTP/1.1\r\nHost: a\n\r\n", "26 GET / 1 Host=a|"},
+    {"blank lines first", "\r\n\nGET / HTTP/1.1\r\n\r\n", "21 GET / 1 "},
+    {"trimmed value", "GET / HTTP/1.1\r\nX: \t a \t b\t \r\n\r\n", "32 GET / 1 X=a \t b|"},
+    {"empty value", "GET / HTTP/1.1\r\nX:\r\nY: \r\n\r\n", "27 GET / 1 X=|Y=|"},
+    {"UTF-8 value", "GET / HTTP/1.1\r\nX: caf\xc3\xa9\r\n\r\n", "28 GET / 1 X=caf\xc3\xa9|"},
+    {"colon in value", "GET / HTTP/1.1\r\nHost: a:80\r\n\r\n", "30 GET / 1 Host=a:80|"},
+    {"pipelined", "GET /1 HTTP/1.1\r\n\r\nGET /2 HTTP/1.1\r\n\r\n", "19 GET /1 1 "},
+    {"body follows", "POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello",
+     "38 POST / 1 Content-Length=5|"},
+    {"bare CR in request line", "GET / HTTP/1.1\rHost: a\r\n\r\n", "ERROR"},
+    {"bare CR in value", "GET / HTTP/1.1\r\nX: a\rb\r\n\r\n", "ERROR"},
+    {"bare CR ends head", "GET / HTTP/1.1\r\n\r\r\n", "ERROR"},
+    {"control in name", "GET / HTTP/1.1\r\nX\x01Y: a\r\n\r\n", "ERROR"},
+    {"DEL in path", "GET /\x7f HTTP/1.1\r\n\r\n", "ERROR"},
+    {"escape in value", "GET / HTTP/1.1\r\nX: \x1b[0m\r\n\r\n", "ERROR"},
+    {"tab in request line", "GET\t/ HTTP/1.1\r\n\r\n", "ERROR"},
+    {"folded with a space", "GET / HTTP/1.1\r\nX: a\r\n b\r\n\r\n", "ERROR"},
+    {"folded with a tab", "GET / HTTP/1.1\r\nX: a\r\n\tb\r\n\r\n", "ERROR"},
+    {"space before colon", "GET / HTTP/1.1\r\nHost : a\r\n\r\n", "ERROR"},
+    {"tab in name", "GET / HTTP/1.1\r\nHo\tst: a\r\n\r\n", "ERROR"},
+    {"no colon", "GET / HTTP/1.1\r\nHost a\r\n\r\n", "ERROR"},
+    {"empty name", "GET / HTTP/1.1\r\n: a\r\n\r\n", "ERROR"},
+    {"HTTP/2.0", "GET / HTTP/2.0\r\n\r\n", "ERROR"},
+    {"HTTP/1.10", "GET / HTTP/1.10\r\n\r\n", "ERROR"},
+    {"lower-case version", "GET / http/1.1\r\n\r\n", "ERROR"},
+    {"no version", "GET /\r\n\r\n", "ERROR"},
+    {"no path", "GET  HTTP/1.1\r\n\r\n", "ERROR"},
+    {"no method", " / HTTP/1.1\r\n\r\n", "ERROR"},
+    {"extra space", "GET / HTTP/1.1 \r\n\r\n", "ERROR"},
+};
+
+// A head with count fields "H1: v" ... ; count over HTTP_MAX_HEADERS must fail
+static size_t many_headers(char *head, int count)
+{
+    size_t length = sprintf(head, "GET / HTTP/1.1\r\n");
+    for (int i = 0; i < count; i++)
+        length += sprintf(head + length, "H%d: v\r\n", i);
+    length += sprintf(head + length, "\r\n");
+    return length;
+}
+
+// One random head: mostly well formed, with some pieces that are not
+static size_t generate(char *head)
+{
+    static const char *const bad[] = {"\r", "\x01", "\x7f", "\0", "\t", " ", "\n ", ":", "\r\r\n"};
+    size_t length = 0;
+    if (next_random() % 8 == 0)
+        length += sprintf(head, "\r\n");
+    length += sprintf(head + length, "%s /%llx HTTP/1.%d\r\n", next_random() % 2 ? "GET" : "POST",
+                      (unsigned long long)next_random(), (int)(next_random() % 3));
+    for (int fields = (int)(next_random() % 12); fields > 0; fields--)
+    {
+        length += sprintf(head + length, "X-%d:%s", (int)(next_random() % 1000), next_random() % 2 ? " " : "");
+        for (int k = (int)(next_random() % 80); k > 0; k--)
+            head[length++] = (char)('!' + next_random() % 94);
+        if (next_random() % 40 == 0)
+        {
+            const char *piece = bad[next_random() % (sizeof(bad) / sizeof(bad[0]))];
+            size_t piece_length = piece[0] ? strlen(piece) : 1;
+            memcpy(head + length, piece, piece_length);
+            length += piece_length;
+        }
+        length += sprintf(head + length, next_random() % 4 ? "\r\n" : "\n");
+    }
+    length += sprintf(head + length, "\r\n");
+    return length;
+}
+
+int main(int argc, char **argv)
+{
+    long inputs = DEFAULT_INPUTS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (inputs = atol(optarg)) < 0)
+        {
+            fprintf(stderr, "Usage: %s [-n inputs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static char text[16384];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const Case *c = &cases[i];
+        size_t length = strlen(c->head);
+        parse_fresh(c->head, length, text, sizeof(text));
+        if (strcmp(text, c->expected) != 0)
+        {
+            printf("%s: %s; want %s\n", c->name, text, c->expected);
+            failures++;
+        }
+        failures += check_splits(c->name, c->head, length);
+    }
+
+    // A NUL, which strlen would take for the end of the head
+    static const char nul[] = "GET / HTTP/1.1\r\nX: a\0b\r\n\r\n";
+    parse_fresh(nul, sizeof(nul) - 1, text, sizeof(text));
+    if (strcmp(text, "ERROR") != 0)
+    {
+        printf("NUL in value: %s; want ERROR\n", text);
+        failures++;
+    }
+    failures += check_splits("NUL in value", nul, sizeof(nul) - 1);
+
+    static char head[MAX_LENGTH + 256];
+    for (int count = HTTP_MAX_HEADERS; count <= HTTP_MAX_HEADERS + 1; count++)
+    {
+        size_t length = many_headers(head, count);
+        parse_fresh(head, length, text, sizeof(text));
+        int refused = strcmp(text, "ERROR") == 0;
+        if (refused != (count > HTTP_MAX_HEADERS))
+        {
+            printf("%d fields: %s\n", count, refused ? "refused" : "accepted");
+            failures++;
+        }
+        failures += check_splits(count > HTTP_MAX_HEADERS ? "too many fields" : "most fields", head, length);
+    }
+    printf("table   %zu heads, split at every byte  %s\n", sizeof(cases) / sizeof(cases[0]) + 3,
+           failures ? "FAILED" : "ok");
+
+    long table_failures = failures, refused = 0;
+    for (long n = 0; n < inputs && failures - table_failures < 10; n++)
+    {
+        size_t length = generate(head);
+        parse_fresh(head, length, text, sizeof(text));
+        refused += strcmp(text, "ERROR") == 0;
+        failures += check_splits("random", head, length);
+    }
+    printf("random  %ld heads, %ld refused  %s\n", inputs, refused, failures > table_failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+// Checks that the JSON API's parse runs in the connection arena alone.
+//
+// Repeats what http_server_test.c does for each POST /api/echo: the body
+// copied into an arena, json_parse_document_in_place with the arena as its
+// allocator, the document serialized back out, the arena reset. malloc,
+// calloc, realloc and free are wrapped here, so calls that ArenaStats
+// cannot see are counted too. After one warm-up request per document, a
+// steady stream of them must make no call to the global allocator and no
+// arena malloc, chunk or large.
+//
+// The documents keep their tape under half a chunk (a bigger one gets a
+// block of its own, counted as a large malloc), and between them cover a
+// tape and a scratch stack that outgrow their first guess and nesting past
+// the inline frames.
+//
+// Build: gcc -O2 -I. -o json_arena_check check/json_arena_check.c json.c json_index.c json_number.c arena.c
+// Usage: json_arena_check [-n requests]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "arena.h"
+#include "json.h"
+
+#define DEFAULT_REQUESTS 10000
+#define POOLED_CHUNKS 1024 // As the server's workers keep
+
+// glibc's own entry points, under the names it exports for wrappers
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *memory, size_t size);
+extern void __libc_free(void *memory);
+
+static int counting;
+static unsigned long global_calls;
+
+void *malloc(size_t size)
+{
+    global_calls += counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    global_calls += counting;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, size_t size)
+{
+    global_calls += counting;
+    return __libc_realloc(memory, size);
+}
+
+void free(void *memory)
+{
+    global_calls += counting && memory;
+    __libc_free(memory);
+}
+
+typedef struct
+{
+    const char *name;
+    char *json;
+    size_t length;
+} Document;
+
+static void *check_arena_alloc(void *arena, size_t size)
+{
+    return arena_alloc(arena, size);
+}
+
+typedef struct
+{
+    char *data;
+    size_t length;
+} Output;
+
+static void append_output(void *context, const char *data, size_t length)
+{
+    Output *output = context;
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+}
+
+// One echo request in arena; returns the response body's length, or 0 if
+// the document did not parse
+static size_t echo(Arena *arena, const Document *document)
+{
+    char *body = arena_dup(arena, document->json, document->length + 1);
+    if (!body)
+        return 0;
+    JSONAllocator allocator = {check_arena_alloc, arena};
+    JSONParser parser = {&allocator, 0, {NULL, 0}};
+    JSONDocument parsed;
+    if (json_parse_document_in_place(&parser, body, document->length, &parsed) != 0)
+    {
+        fprintf(stderr, "%s: %s at %zu\n", document->name, parser.error.message, parser.error.position);
+        return 0;
+    }
+    const JSONEntry *root = json_document_root(&parsed);
+    Output output = {arena_alloc(arena, json_document_write_length(&parsed, root)), 0};
+    if (!output.data)
+        return 0;
+    json_document_write(&parsed, root, append_output, &output);
+    return output.length;
+}
+
+// A document of records like json_api_bench's, about size bytes
+static char *records(size_t size)
+{
+    char *json = __libc_malloc(size + 1);
+    size_t used = 1;
+    json[0] = '[';
+    for (unsigned i = 0;; i++)
+    {
+        char record[160];
+        int length = snprintf(record, sizeof(record),
+                              "%s{\"id\":%u,\"name\":\"item %u\\twith \\\"quotes\\\"\",\"price\":%u.%02u,"
+                              "\"active\":%s,\"note\":null,\"tags\":[\"a\",\"b\",[%u,%d]]}",
+                              i ? "," : "", i, i, i * 7 % 1000, i % 100, i % 2 ? "true" : "false", i * 31, -(int)i);
+        if (used + length + 1 > size)
+            break;
+        memcpy(json + used, record, length);
+        used += length;
+    }
+    json[used++] = ']';
+    json[used] = '\0';
+    return json;
+}
+
+// count copies of item, comma-separated inside open and close
+static char *repeat(const char *open, const char *item, int count, const char *close)
+{
+    size_t length = strlen(open) + (strlen(item) + 1) * count + strlen(close);
+    char *json = __libc_malloc(length + 1), *p = json;
+    p = stpcpy(p, open);
+    for (int i = 0; i < count; i++)
+        p = stpcpy(stpcpy(p, i ? "," : ""), item);
+    strcpy(p, close);
+    return json;
+}
+
+static char *nested(int depth)
+{
+    char *json = __libc_malloc(2 * depth + 2);
+    memset(json, '[', depth);
+    json[depth] = '1';
+    memset(json + depth + 1, ']', depth);
+    json[2 * depth + 1] = '\0';
+    return json;
+}
+
+int main(int argc, char **argv)
+{
+    long requests = DEFAULT_REQUESTS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (requests = atol(optarg)) <= 0)
+        {
+            fprintf(stderr, "Usage: %s [-n requests]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Document documents[] = {
+        {"records 1k", records(1024), 0},
+        {"records 2k", records(2048), 0},
+        {"small numbers", repeat("[", "1", 200, "]"), 0},       // Outgrows the tape's guess
+        {"wide object", repeat("{", "\"k\":[1]", 100, "}"), 0}, // Outgrows the scratch stack
+        {"nested 100", nested(100), 0},                         // Outgrows the inline frames
+    };
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++)
+    {
+        Document *document = &documents[i];
+        document->length = strlen(document->json);
+
+        ArenaPool pool;
+        Arena arena;
+        arena_pool_init(&pool, ARENA_CHUNK_SIZE, POOLED_CHUNKS);
+        arena_init(&arena, &pool);
+        size_t expected = echo(&arena, document);
+        arena_reset(&arena);
+        memset(&pool.stats, 0, sizeof(pool.stats));
+
+        int ok = expected > 0;
+        counting = 1;
+        for (long n = 0; n < requests && ok; n++)
+        {
+            ok = echo(&arena, document) == expected;
+            arena_reset(&arena);
+        }
+        counting = 0;
+        unsigned long arena_mallocs = pool.stats.chunk_mallocs + pool.stats.large_mallocs;
+        ok = ok && global_calls == 0 && arena_mallocs == 0;
+        printf("%-14s %6zu B  %ld requests  %lu global calls  %lu arena mallocs  %s\n", document->name,
+               document->length, requests, global_calls, arena_mallocs, ok ? "ok" : "FAILED");
+        failures += !ok;
+        global_calls = 0;
+        arena_pool_destroy(&pool);
+    }
+    return failures ? 1 : 0;
+}
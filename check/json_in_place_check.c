@@ -0,0 +1,260 @@
+// Checks that json_parse_document_in_place and json_parse_document agree.
+//
+// Random documents of strings with and without escapes (\uXXXX, surrogate
+// pairs and halves, \u0000), raw UTF-8, long strings and syntax fragments
+// go through both parsers with every classifier the CPU has (scalar, sse2,
+// avx2): both must fail with the same message at the same offset, or both
+// succeed and serialize to the same bytes. Each parse gets its own copy of
+// the input, since the in-place one overwrites it. A list of escapes and
+// encodings then has to decode to exactly the given bytes, or fail
+// exactly as given, both ways.
+//
+// Build: gcc -O2 -I. -o json_in_place_check check/json_in_place_check.c json.c json_index.c json_number.c
+// Usage: json_in_place_check [-n inputs]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "json.h"
+#include "json_index.h"
+
+#define DEFAULT_INPUTS 300000
+#define MAX_LENGTH 8192
+
+static const char *const isas[] = {"scalar", "sse2", "avx2"};
+
+static uint64_t random_state = 7;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+typedef struct
+{
+    char data[2 * MAX_LENGTH];
+    size_t length;
+} Output;
+
+static void append_output(void *context, const char *data, size_t length)
+{
+    Output *output = context;
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+}
+
+typedef struct
+{
+    int result;
+    JSONError error;
+    Output output;
+} Outcome;
+
+static void parse(const char *json, size_t length, int in_place, Outcome *outcome)
+{
+    static char copy[MAX_LENGTH + 1];
+    memcpy(copy, json, length + 1);
+    JSONParser parser = {NULL, 0, {NULL, 0}};
+    JSONDocument document;
+    outcome->result = in_place ? json_parse_document_in_place(&parser, copy, length, &document)
+                               : json_parse_document(&parser, copy, length, &document);
+    outcome->error = parser.error;
+    outcome->output.length = 0;
+    if (outcome->result == 0)
+    {
+        json_document_write(&document, json_document_root(&document), append_output, &outcome->output);
+        json_document_free(&document);
+    }
+}
+
+// Returns 1 if the two parses of json disagree, after saying how
+static int compare(const char *isa, const char *json, size_t length)
+{
+    static Outcome copied, in_place;
+    parse(json, length, 0, &copied);
+    parse(json, length, 1, &in_place);
+    if (copied.result != in_place.result)
+    {
+        printf("%s: %s: %s copying, %s in place\n", isa, json, copied.result ? copied.error.message : "ok",
+               in_place.result ? in_place.error.message : "ok");
+        return 1;
+    }
+    if (copied.result != 0 && (copied.error.position != in_place.error.position ||
+                               strcmp(copied.error.message, in_place.error.message) != 0))
+    {
+        printf("%s: %s: %s at %zu copying, %s at %zu in place\n", isa, json, copied.error.message,
+               copied.error.position, in_place.error.message, in_place.error.position);
+        return 1;
+    }
+    if (copied.result == 0 && (copied.output.length != in_place.output.length ||
+                               memcmp(copied.output.data, in_place.output.data, copied.output.length) != 0))
+    {
+        printf("%s: %s: serializes as %.*s copying, %.*s in place\n", isa, json, (int)copied.output.length,
+               copied.output.data, (int)in_place.output.length, in_place.output.data);
+        return 1;
+    }
+    return 0;
+}
+
+// Random fragments: a quarter of the inputs are arrays of valid strings,
+// the rest anything at all
+static size_t generate(char *json, long n)
+{
+    static const char *const fragments[] = {
+        "{", "}", "[", "]", ":", ",", "\"", "\\", " ", "\n", "a", "1", "-", "true", "null", "\"ab\"",
+        "\\\"", "\\\\", "\\u00e9", "\\ud83d\\ude00", "\\ud83d", "\\ude00", "\\u0000", "\xc3\xa9",
+        "\xf0\x9f\x98\x80", "\"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\"",
+        "\"\\n\\t\\u20ac\xe2\x82\xac\\ud83d\\ude00 tail text\"", "                                        ",
+    };
+    static const char *const contents[] = {
+        "a", "xyz", "\\\"", "\\\\", "\\n", "\\u00e9", "\\ud83d\\ude00", "\\u0000", "\xc3\xa9", "\xe2\x82\xac",
+        "\xf0\x9f\x98\x80", "                                ",
+    };
+    size_t length = 0;
+    if (n % 4 == 0)
+    {
+        json[length++] = '[';
+        for (int s = 1 + (int)(next_random() % 8); s > 0; s--)
+        {
+            json[length++] = '"';
+            for (int k = (int)(next_random() % 12); k > 0; k--)
+            {
+                const char *content = contents[next_random() % (sizeof(contents) / sizeof(contents[0]))];
+                length = stpcpy(json + length, content) - json;
+            }
+            json[length++] = '"';
+            json[length++] = s > 1 ? ',' : ']';
+        }
+    }
+    else
+    {
+        if (n % 2)
+            length = stpcpy(json, "{\"k\":[") - json;
+        for (int k = (int)(next_random() % 60); k > 0; k--)
+        {
+            const char *fragment = fragments[next_random() % (sizeof(fragments) / sizeof(fragments[0]))];
+            length = stpcpy(json + length, fragment) - json;
+        }
+        if (n % 2)
+            length = stpcpy(json + length, "]}") - json;
+    }
+    json[length] = '\0';
+    return length;
+}
+
+typedef struct
+{
+    const char *json;
+    const char *bytes;   // The root string decoded, or NULL for an error
+    size_t length;       // Of bytes
+    const char *message; // The error otherwise, at position
+    size_t position;
+} Case;
+
+static const Case cases[] = {
+    {"\"\\ud83d\\ude00\"", "\xf0\x9f\x98\x80", 4, NULL, 0},
+    {"\"\\uD83D\\uDE00\\u20AC\"", "\xf0\x9f\x98\x80\xe2\x82\xac", 7, NULL, 0},
+    {"\"a\\\"b\\\\c\\/d\"", "a\"b\\c/d", 7, NULL, 0},
+    {"\"\\b\\f\\n\\r\\t\"", "\b\f\n\r\t", 5, NULL, 0},
+    {"\"x\\u0000y\"", "x\0y", 3, NULL, 0},
+    {"\"\\u007f\\u0080\\u07ff\\u0800\\uffff\"", "\x7f\xc2\x80\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf", 11, NULL, 0},
+    {"\"\xf4\x8f\xbf\xbf\"", "\xf4\x8f\xbf\xbf", 4, NULL, 0},
+    {"[\"\\ud800\"]", NULL, 0, "Unpaired surrogate", 2},
+    {"\"\\ud83d\"", NULL, 0, "Unpaired surrogate", 1},
+    {"\"\\ude00\"", NULL, 0, "Unpaired surrogate", 1},
+    {"\"ab\\ud83d\\u0041\"", NULL, 0, "Unpaired surrogate", 3},
+    {"\"\\ud83dx\"", NULL, 0, "Unpaired surrogate", 1},
+    {"\"\\ud83d\\ud83d\"", NULL, 0, "Unpaired surrogate", 1},
+    {"{\"ab\":\"x\\q\"}", NULL, 0, "Invalid escape", 8},
+    {"[\"\\u12\"]", NULL, 0, "Invalid escape", 2},
+    {"\"\\u12g4\"", NULL, 0, "Invalid escape", 1},
+    {"\"\xed\xa0\x80\"", NULL, 0, "Invalid UTF-8", 1},
+    {"\"\xc0\xaf\"", NULL, 0, "Invalid UTF-8", 1},
+    {"\"\xf4\x90\x80\x80\"", NULL, 0, "Invalid UTF-8", 1},
+};
+
+// Returns the number of cases that did not come out as given
+static int check_cases(const char *isa)
+{
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const Case *c = &cases[i];
+        for (int in_place = 0; in_place < 2; in_place++)
+        {
+            char copy[64];
+            size_t length = strlen(c->json);
+            memcpy(copy, c->json, length + 1);
+            JSONParser parser = {NULL, 0, {NULL, 0}};
+            JSONDocument document;
+            int result = in_place ? json_parse_document_in_place(&parser, copy, length, &document)
+                                  : json_parse_document(&parser, copy, length, &document);
+            int ok;
+            if (result == 0)
+            {
+                const JSONEntry *root = json_document_root(&document);
+                ok = c->bytes && root->type == JSON_STRING && root->length == c->length &&
+                     memcmp(root->string, c->bytes, c->length) == 0;
+                json_document_free(&document);
+            }
+            else
+            {
+                ok = !c->bytes && strcmp(parser.error.message, c->message) == 0 &&
+                     parser.error.position == c->position;
+            }
+            if (!ok)
+            {
+                printf("%s: %s %s: ", isa, c->json, in_place ? "in place" : "copying");
+                if (result == 0)
+                    printf("decoded, want %s at %zu\n", c->message ? c->message : "other bytes", c->position);
+                else
+                    printf("%s at %zu, want %s at %zu\n", parser.error.message, parser.error.position,
+                           c->message ? c->message : "success", c->position);
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    long inputs = DEFAULT_INPUTS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (inputs = atol(optarg)) <= 0)
+        {
+            fprintf(stderr, "Usage: %s [-n inputs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failed = 0;
+    static char json[MAX_LENGTH + 1];
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    {
+        if (json_index_select(isas[k]) != 0)
+        {
+            printf("%-6s  not available\n", isas[k]);
+            continue;
+        }
+        random_state = 7;
+        long differences = 0;
+        for (long n = 0; n < inputs && differences < 10; n++)
+        {
+            size_t length = generate(json, n);
+            differences += compare(isas[k], json, length);
+        }
+        int case_failures = check_cases(isas[k]);
+        printf("%-6s  %ld inputs  %ld differences  %d of %zu cases wrong  %s\n", isas[k], inputs, differences,
+               case_failures, sizeof(cases) / sizeof(cases[0]), differences || case_failures ? "FAILED" : "ok");
+        failed |= differences || case_failures;
+    }
+    return failed;
+}
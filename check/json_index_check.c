@@ -0,0 +1,179 @@
+// Checks the stage-1 structural index (json_index.c) against a reference
+// that walks the input a byte at a time.
+//
+// Each classifier the CPU has (scalar, sse2, avx2) indexes the same random
+// inputs: lengths from 0 to 4 KB, so they end at every offset in a block
+// and the padded tail is always exercised; an alphabet heavy in
+// backslashes and quotes, so runs of escapes and strings cross block
+// boundaries and the carries between blocks matter; every structural
+// character, whitespace, token bytes and a control character, which stops
+// indexing inside a string. The positions handed out, and where and
+// whether indexing stopped, must match the reference exactly. Inputs with
+// more positions than a batch check the refills too.
+//
+// Build: gcc -O2 -I. -o json_index_check check/json_index_check.c json_index.c
+// Usage: json_index_check [-n inputs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "json_index.h"
+
+#define DEFAULT_INPUTS 200000
+#define MAX_LENGTH 4096
+
+static const char *const isas[] = {"scalar", "sse2", "avx2"};
+
+static uint64_t random_state = 88172645463325252ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+typedef struct
+{
+    size_t positions[MAX_LENGTH];
+    size_t count;
+    size_t error_position; // (size_t)-1 if indexing ran to the end
+} Expected;
+
+// What the index should hand out. Outside strings a backslash escapes the
+// next byte just as inside them, since stage 1 works out escapes before it
+// knows where strings are; the backslash itself starts a garbage token.
+static void reference(const char *json, size_t length, Expected *expected)
+{
+    int in_string = 0, escaped = 0, in_token = 0;
+    expected->count = 0;
+    expected->error_position = (size_t)-1;
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)json[i];
+        if (in_string)
+        {
+            if (c < 0x20)
+            {
+                expected->error_position = i;
+                return;
+            }
+            if (escaped)
+                escaped = 0;
+            else if (c == '\\')
+                escaped = 1;
+            else if (c == '"')
+            {
+                expected->positions[expected->count++] = i;
+                in_string = 0;
+            }
+            continue;
+        }
+
+        int was_escaped = escaped;
+        escaped = !was_escaped && c == '\\';
+        if (!was_escaped && c == '"')
+        {
+            expected->positions[expected->count++] = i;
+            in_string = 1;
+            in_token = 0;
+        }
+        else if (strchr("{}[]:,", c) && c)
+        {
+            expected->positions[expected->count++] = i;
+            in_token = 0;
+        }
+        else if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            in_token = 0;
+        }
+        else
+        {
+            // An escaped quote or any other byte is part of a token
+            if (!in_token)
+                expected->positions[expected->count++] = i;
+            in_token = 1;
+        }
+    }
+}
+
+// Indexes json with the classifier in use and compares. Returns 0 if it
+// matches.
+static int check(const char *isa, const char *json, size_t length, const Expected *expected)
+{
+    static size_t positions[MAX_LENGTH];
+    JSONIndex index;
+    json_index_init(&index, json, length);
+    size_t count = 0, position;
+    while (count < MAX_LENGTH && json_index_next(&index, &position))
+        positions[count++] = position;
+    size_t error_position = index.error ? index.error_position : (size_t)-1;
+    if (count == expected->count && error_position == expected->error_position &&
+        memcmp(positions, expected->positions, count * sizeof(size_t)) == 0)
+        return 0;
+
+    size_t first = 0;
+    while (first < count && first < expected->count && positions[first] == expected->positions[first])
+        first++;
+    printf("%s: %zu bytes: %zu positions, stopped at %zd; want %zu, stopped at %zd; first difference at "
+           "position %zu (%zd, want %zd)\n",
+           isa, length, count, (ssize_t)error_position, expected->count, (ssize_t)expected->error_position,
+           first, first < count ? (ssize_t)positions[first] : -1,
+           first < expected->count ? (ssize_t)expected->positions[first] : -1);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    long inputs = DEFAULT_INPUTS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (inputs = atol(optarg)) <= 0)
+        {
+            fprintf(stderr, "Usage: %s [-n inputs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // Half the inputs leave out the control character, so more of them
+    // run to the end
+    static const char alphabet[] = "\\\\\\\"\"a ,[]{}:1\t\n\x01";
+    static char json[MAX_LENGTH + 1];
+    static Expected expected;
+    int selected[sizeof(isas) / sizeof(isas[0])];
+    long failures[sizeof(isas) / sizeof(isas[0])] = {0};
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+        selected[k] = json_index_select(isas[k]) == 0;
+
+    for (long n = 0; n < inputs; n++)
+    {
+        size_t length = next_random() % (n % 10 == 0 ? MAX_LENGTH : 1024);
+        size_t letters = sizeof(alphabet) - 1 - (n % 2);
+        for (size_t i = 0; i < length; i++)
+            json[i] = alphabet[next_random() % letters];
+        json[length] = '\0';
+        reference(json, length, &expected);
+        for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+        {
+            if (selected[k] && failures[k] < 10)
+            {
+                json_index_select(isas[k]);
+                failures[k] += check(isas[k], json, length, &expected);
+            }
+        }
+    }
+
+    int failed = 0;
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    {
+        if (selected[k])
+            printf("%-6s  %ld inputs  %s\n", isas[k], inputs, failures[k] ? "FAILED" : "ok");
+        else
+            printf("%-6s  not available\n", isas[k]);
+        failed |= failures[k] != 0;
+    }
+    return failed;
+}
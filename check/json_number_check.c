@@ -0,0 +1,286 @@
+// Checks json_parse_number (json_number.c) against strtod and strtoll.
+//
+// Every number must come out as the same double as glibc's strtod, bit for
+// bit, or as the exact integer when it is written without a fraction or
+// exponent and fits 64 bits. Inputs:
+//   edge cases  the int64 and uint64 limits and one past them, the
+//               DBL_MIN and DBL_MAX boundaries, subnormals down to the
+//               smallest and the halfway point below it, the 2^53 edge,
+//               Clinger's fast-path limits, overflow, underflow and huge
+//               exponents, and inputs the grammar rejects;
+//   random      (-n of them) doubles printed with 1 to 17 digits, random
+//               bit patterns, 64-bit integers of every length, digit
+//               strings up to 30 long with exponents up to +-350, and
+//               decimals that lie exactly halfway between two doubles or
+//               just either side of it, where Eisel-Lemire must defer to
+//               strtod.
+//
+// Build: gcc -O2 -I. -o json_number_check check/json_number_check.c json_number.c -lm
+// Usage: json_number_check [-n inputs]
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "json_number.h"
+
+#define DEFAULT_INPUTS 3000000
+#define MAX_REPORTED 20
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static long checked, wrong;
+
+static void report(const char *text, const char *problem)
+{
+    if (++wrong <= MAX_REPORTED)
+        printf("%s: %s\n", text, problem);
+}
+
+// Checks one number the grammar accepts
+static void check(const char *text)
+{
+    checked++;
+    JSONNumber number;
+    size_t length = strlen(text);
+    if (json_parse_number(text, &number) != length)
+    {
+        report(text, "rejected or cut short");
+        return;
+    }
+
+    char expected[32], got[32];
+    if (!strpbrk(text, ".eE"))
+    {
+        // Integer syntax: exact if it fits 64 bits, which strtoll and
+        // strtoull decide, except -0, which stays a double to keep its sign
+        errno = 0;
+        long long integer = strtoll(text, NULL, 10);
+        if (integer == 0 && text[0] == '-')
+        {
+            expected[0] = '\0';
+        }
+        else if (errno == 0)
+        {
+            snprintf(expected, sizeof(expected), "int64 %lld", integer);
+        }
+        else if (text[0] != '-' && (errno = 0, strtoull(text, NULL, 10), errno == 0))
+        {
+            snprintf(expected, sizeof(expected), "uint64 %s", text);
+        }
+        else
+        {
+            expected[0] = '\0';
+        }
+        if (expected[0])
+        {
+            if (number.kind == JSON_INT64)
+                snprintf(got, sizeof(got), "int64 %" PRId64, number.integer);
+            else if (number.kind == JSON_UINT64)
+                snprintf(got, sizeof(got), "uint64 %" PRIu64, number.unsigned_integer);
+            else
+                snprintf(got, sizeof(got), "double %.17g", number.number);
+            if (strcmp(expected, got) != 0)
+            {
+                char problem[80];
+                snprintf(problem, sizeof(problem), "got %s, want %s", got, expected);
+                report(text, problem);
+            }
+            return;
+        }
+    }
+
+    double reference = strtod(text, NULL);
+    if (number.kind != JSON_DOUBLE)
+    {
+        report(text, "not a double");
+    }
+    else if (memcmp(&reference, &number.number, sizeof(double)) != 0)
+    {
+        char problem[80];
+        snprintf(problem, sizeof(problem), "got %a, want %a", number.number, reference);
+        report(text, problem);
+    }
+}
+
+static void check_rejected(const char *text)
+{
+    checked++;
+    JSONNumber number;
+    size_t length = strlen(text);
+    if (length > 0 && json_parse_number(text, &number) == length)
+        report(text, "accepted");
+}
+
+static const char *const edge_cases[] = {
+    // Integers at and past the 64-bit limits
+    "0", "-0", "1", "-1",
+    "9223372036854775807", "9223372036854775808", "-9223372036854775807",
+    "-9223372036854775808", "-9223372036854775809",
+    "18446744073709551614", "18446744073709551615", "18446744073709551616",
+    "-18446744073709551615", "-18446744073709551616",
+    "99999999999999999999", "100000000000000000000", "123456789012345678901234567890",
+    // 2^53 and its neighbours, where integers stop being exact doubles
+    "9007199254740991", "9007199254740992", "9007199254740993",
+    "9007199254740993.0", "9007199254740992.5", "9007199254740993e0",
+    // Clinger's fast path at its limits
+    "1e22", "1e23", "9007199254740991e22", "9007199254740992e22", "1e-22", "9007199254740991e-22",
+    "1.0", "0.1", "1e0", "3.0000000000000004", "7.2057594037927933e16",
+    // DBL_MAX and past it
+    "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308",
+    "179769313486231580793728971405301e276", "1e308", "1e309", "-1e309",
+    "8.98846567431158e307",
+    // DBL_MIN and the normal/subnormal boundary
+    "2.2250738585072014e-308", "2.2250738585072013e-308", "2.2250738585072012e-308",
+    "2.2250738585072011e-308", "2.225073858507201136057409796709131975934819546351645648e-308",
+    // Subnormals, the smallest, and the halfway point below it
+    "4.9406564584124654e-324", "4.9e-324", "5e-324", "1e-323", "2.4703282292062328e-324",
+    "2.4703282292062327e-324", "2.4703282292062327208828439643411068618252990130716238221279284125033775363510437593264991818081799618989828234772285886546332835517796989819938739800539093906315035659515570226392290858392449105184435931802849936536152500319370457678249219365623669863658480757001585769269903706311928279558551332927834338409351978015531246597263579574622766465272827220056374006485499977096599470454020828166226237857393450736339007967761930577506740176324673600968951340535537458516661134223766678604162159680461914467291840300530057530849048765391711386591646239524912623653881879636239373280423891018672348497668235089863388587925628302755995657524455507255189313690836254779186948667994968324049705821028513185451396213837722826145437693412532098591327667236328125e-324",
+    "1e-324", "1e-400", "-1e-400",
+    // Long mantissas that straddle a halfway point by one digit
+    "1.00000000000000011102230246251565404236316680908203125",
+    "1.00000000000000011102230246251565404236316680908203124",
+    "1.00000000000000011102230246251565404236316680908203126",
+    "9007199254740993.00000000000000000000000000001",
+    "0.000000000000000000000000000000000001",
+    // Exponents far out of range, and zero with one
+    "0e999999999999999999", "0.1e-999999999999999", "1e99999999999999999999", "1e-99999999999999999999",
+    "-0.0e-5",
+};
+
+static const char *const rejected[] = {
+    "-", "01", "-01", "00", "1.", "1.e5", ".5", "+1", "1e", "1e+", "1E-", "-a", "0x10", "1_000",
+};
+
+// A double that lies exactly halfway between two neighbours, written out
+// in full, or just above or below it (direction 1 or -1); 0 if long double
+// cannot hold the midpoint exactly
+static int halfway(char *text, size_t size, int direction)
+{
+    if (LDBL_MANT_DIG < DBL_MANT_DIG + 1)
+        return 0;
+    double low;
+    do
+    {
+        uint64_t bits = next_random() & ~(1ULL << 63);
+        memcpy(&low, &bits, sizeof(low));
+    } while (!isfinite(low) || !isfinite(nextafter(low, INFINITY)));
+    long double middle = ((long double)low + nextafter(low, INFINITY)) / 2;
+
+    // Exact: every binary fraction has a finite decimal expansion
+    int length = snprintf(text, size, "%.780Le", middle);
+    char *exponent = strchr(text, 'e');
+    char *end = exponent;
+    while (end[-1] == '0')
+        end--;
+    if (end[-1] == '.')
+        end--;
+    if (direction > 0)
+        *end++ = '1'; // A hair above
+    else if (direction < 0 && end - text > 26)
+        end = text + 26; // Truncated, so a hair below
+    memmove(end, exponent, text + length + 1 - exponent);
+    return 1;
+}
+
+// One random input the grammar accepts
+static int random_number(char *text, size_t size)
+{
+    double value;
+    uint64_t bits;
+    switch (next_random() % 7)
+    {
+    case 0:
+        bits = next_random();
+        memcpy(&value, &bits, sizeof(value));
+        if (!isfinite(value))
+            return 0;
+        snprintf(text, size, "%.17g", value);
+        return 1;
+    case 1:
+        bits = next_random();
+        memcpy(&value, &bits, sizeof(value));
+        if (!isfinite(value))
+            return 0;
+        snprintf(text, size, "%.*g", (int)(next_random() % 17) + 1, value);
+        return 1;
+    case 2:
+        snprintf(text, size, "%s%" PRIu64, next_random() & 1 ? "-" : "", next_random() >> (next_random() % 64));
+        return 1;
+    case 3:
+    {
+        // Up to 30 digits with an optional point and exponent, no leading zero
+        int digits = (int)(next_random() % 30) + 1, point = (int)(next_random() % digits);
+        char *p = text;
+        if (next_random() & 1)
+            *p++ = '-';
+        for (int i = 0; i < digits; i++)
+        {
+            if (i == point && i > 0)
+                *p++ = '.';
+            *p++ = (char)('0' + (i == 0 && point != 1 ? 1 + next_random() % 9 : next_random() % 10));
+        }
+        *p = '\0';
+        if (next_random() & 1)
+            snprintf(p, size - (p - text), "e%d", (int)(next_random() % 701) - 350);
+        return 1;
+    }
+    case 4:
+        snprintf(text, size, "%" PRIu64 ".%" PRIu64 "e%d", next_random() % 1000, next_random(),
+                 (int)(next_random() % 61) - 30);
+        return 1;
+    default:
+        return halfway(text, size, (int)(next_random() % 3) - 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long inputs = DEFAULT_INPUTS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (inputs = atol(optarg)) < 0)
+        {
+            fprintf(stderr, "Usage: %s [-n inputs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(edge_cases) / sizeof(edge_cases[0]); i++)
+    {
+        check(edge_cases[i]);
+        if (edge_cases[i][0] != '-' && edge_cases[i][0] != '0')
+        {
+            char negative[2048];
+            snprintf(negative, sizeof(negative), "-%s", edge_cases[i]);
+            check(negative);
+        }
+    }
+    for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++)
+        check_rejected(rejected[i]);
+    printf("edge cases  %6ld checked  %ld wrong\n", checked, wrong);
+
+    long edge_checked = checked, edge_wrong = wrong;
+    char text[1024];
+    for (long i = 0; i < inputs; i++)
+    {
+        if (random_number(text, sizeof(text)))
+            check(text);
+    }
+    printf("random      %6ld checked  %ld wrong\n", checked - edge_checked, wrong - edge_wrong);
+    return wrong ? 1 : 0;
+}
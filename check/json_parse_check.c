@@ -0,0 +1,336 @@
+// Checks both JSON parsers in json.c, the tree (json_parse) and the tape
+// (json_parse_document), for results and memory safety. Meant to be built
+// with AddressSanitizer and UndefinedBehaviorSanitizer, so that a leak, an
+// overrun or undefined arithmetic fails the run as much as a wrong answer.
+//
+//   documents   12 valid ones must serialize as given and 25 invalid ones
+//               must fail with the given message at the given offset,
+//               through both parsers;
+//   nesting     a million nested arrays and a million nested objects
+//               parse and are freed with max_depth at 2M, without using
+//               the C stack for depth; the default limit refuses them, and
+//               an unclosed one fails at its end;
+//   arena       an allocator that runs dry after n bytes, for every n up
+//               to what a document needs: each parse either succeeds or
+//               fails with "Out of memory", never anything worse;
+//   threads     four threads parse at once, each with its own JSONParser.
+//
+// Build: gcc -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all -pthread -I. -o json_parse_check check/json_parse_check.c json.c json_index.c json_number.c
+// Usage: json_parse_check
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+#define DEEP 1000000
+#define THREADS 4
+#define THREAD_PARSES 20000
+
+static int failures;
+
+static void fail(const char *format, const char *json, const char *detail)
+{
+    if (failures++ < 20)
+    {
+        printf(format, json, detail);
+        printf("\n");
+    }
+}
+
+typedef struct
+{
+    char *data;
+    size_t length, capacity;
+} Output;
+
+static void append_output(void *context, const char *data, size_t length)
+{
+    Output *output = context;
+    if (output->length + length > output->capacity)
+    {
+        output->capacity = (output->length + length) * 2;
+        output->data = realloc(output->data, output->capacity);
+    }
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+}
+
+static const struct
+{
+    const char *json, *written;
+} valid[] = {
+    {"0", "0"},
+    {"-0", "-0"},
+    {"1.5e10", "15000000000"},
+    {"-1E-2", "-0.01"},
+    {"[]", "[]"},
+    {"{}", "{}"},
+    {"[1,[2,[3]]]", "[1,[2,[3]]]"},
+    {"{\"a\":{\"b\":[]},\"c\":null}", "{\"a\":{\"b\":[]},\"c\":null}"},
+    {" \t\n[true , false ,null]\r\n", "[true,false,null]"},
+    {"\"a\\\"b\"", "\"a\\\"b\""},
+    {"[\"\\u00e9\"]", "[\"\xc3\xa9\"]"},
+    {"{\"a\":1,\"a\":2}", "{\"a\":1,\"a\":2}"},
+};
+
+static const struct
+{
+    const char *json, *message;
+    size_t position;
+} invalid[] = {
+    {"01", "Unexpected character", 1},
+    {"1.", "Invalid number", 0},
+    {"-", "Invalid number", 0},
+    {".5", "Unexpected character", 0},
+    {"1e", "Invalid number", 0},
+    {"1e+", "Invalid number", 0},
+    {"+1", "Unexpected character", 0},
+    {"[1,]", "Unexpected token", 4},
+    {"{\"a\":1,}", "Expected string key", 8},
+    {"[1 2]", "Expected comma or closing bracket", 4},
+    {"{\"a\" 1}", "Expected colon", 6},
+    {"{1:2}", "Expected string key", 2},
+    {"\"a\x01\"", "Control character in string", 2},
+    {"[", "Unexpected end of input", 1},
+    {"]", "Unexpected token", 1},
+    {"{\"a\":}", "Unexpected token", 6},
+    {"\"abc", "Unterminated string", 4},
+    {"tru", "Unexpected character", 0},
+    {"[1]x", "Unexpected character", 3},
+    {"\v1", "Unexpected character", 0},
+    {"[1]]", "Unexpected data after the value", 4},
+    {"{\"a\":[}", "Unexpected token", 7},
+    {"", "Unexpected end of input", 0},
+    {"nul", "Unexpected character", 0},
+    {"[-]", "Invalid number", 1},
+};
+
+// Parses json both ways; both must succeed and serialize as written
+static void check_valid(const char *json, const char *written)
+{
+    JSONParser parser = {NULL, 0, {NULL, 0}};
+    Output tree = {NULL, 0, 0}, tape = {NULL, 0, 0};
+    JSONValue *value = json_parse(&parser, json, strlen(json));
+    if (!value)
+        fail("%s: tree: %s", json, parser.error.message);
+    json_write(value, append_output, &tree);
+    free_json(value);
+
+    JSONDocument document;
+    if (json_parse_document(&parser, json, strlen(json), &document) != 0)
+    {
+        fail("%s: tape: %s", json, parser.error.message);
+    }
+    else
+    {
+        json_document_write(&document, json_document_root(&document), append_output, &tape);
+        if (json_document_write_length(&document, json_document_root(&document)) != tape.length)
+            fail("%s: %s", json, "json_document_write_length is off");
+        json_document_free(&document);
+    }
+
+    size_t length = strlen(written);
+    if (value && (tree.length != length || memcmp(tree.data, written, length) != 0))
+        fail("%s: tree writes something else, want %s", json, written);
+    if (tape.length != length || memcmp(tape.data, written, length) != 0)
+        fail("%s: tape writes something else, want %s", json, written);
+    free(tree.data);
+    free(tape.data);
+}
+
+static void check_invalid(const char *json, const char *message, size_t position)
+{
+    char want[80];
+    snprintf(want, sizeof(want), "want %s at %zu", message, position);
+    JSONParser parser = {NULL, 0, {NULL, 0}};
+    JSONValue *value = json_parse(&parser, json, strlen(json));
+    if (value)
+        fail("%s: tree accepts it, %s", json, want);
+    else if (strcmp(parser.error.message, message) != 0 || parser.error.position != position)
+        fail("%s: tree fails differently, %s", json, want);
+    free_json(value);
+
+    JSONDocument document;
+    if (json_parse_document(&parser, json, strlen(json), &document) == 0)
+    {
+        fail("%s: tape accepts it, %s", json, want);
+        json_document_free(&document);
+    }
+    else if (strcmp(parser.error.message, message) != 0 || parser.error.position != position)
+    {
+        fail("%s: tape fails differently, %s", json, want);
+    }
+}
+
+static void check_nesting(void)
+{
+    // DEEP arrays, then DEEP objects each holding the next under "a"
+    char *arrays = malloc(2 * DEEP + 1);
+    memset(arrays, '[', DEEP);
+    memset(arrays + DEEP, ']', DEEP);
+    arrays[2 * DEEP] = '\0';
+    char *objects = malloc(6 * DEEP + 2);
+    size_t length = 0;
+    for (int i = 0; i < DEEP; i++)
+    {
+        memcpy(objects + length, "{\"a\":", 5);
+        length += 5;
+    }
+    objects[length++] = '1';
+    memset(objects + length, '}', DEEP);
+    length += DEEP;
+    objects[length] = '\0';
+
+    const char *documents[] = {arrays, objects};
+    const char *names[] = {"deep arrays", "deep objects"};
+    for (int i = 0; i < 2; i++)
+    {
+        size_t size = strlen(documents[i]);
+        JSONParser parser = {NULL, 2 * DEEP, {NULL, 0}};
+        JSONValue *value = json_parse(&parser, documents[i], size);
+        if (!value)
+            fail("%s: tree: %s", names[i], parser.error.message);
+        free_json(value);
+        JSONDocument document;
+        if (json_parse_document(&parser, documents[i], size, &document) != 0)
+            fail("%s: tape: %s", names[i], parser.error.message);
+        else if (document.count != (i == 0 ? DEEP : 2 * DEEP + 1))
+            fail("%s: %s", names[i], "tape has the wrong number of entries");
+        json_document_free(&document);
+
+        JSONParser limited = {NULL, 0, {NULL, 0}};
+        value = json_parse(&limited, documents[i], size);
+        if (value || strcmp(limited.error.message, "Too deeply nested") != 0)
+            fail("%s: %s", names[i], "the default depth limit lets it through");
+        free_json(value);
+        if (json_parse_document(&limited, documents[i], size, &document) == 0 ||
+            strcmp(limited.error.message, "Too deeply nested") != 0)
+            fail("%s: %s", names[i], "the default depth limit lets the tape through");
+    }
+
+    // One bracket short: fails at the end, with every frame still open
+    JSONParser parser = {NULL, 2 * DEEP, {NULL, 0}};
+    JSONValue *value = json_parse(&parser, arrays, 2 * DEEP - 1);
+    if (value || parser.error.position != 2 * DEEP - 1)
+        fail("%s: %s", "unclosed deep arrays", value ? "accepted" : parser.error.message);
+    free_json(value);
+    JSONDocument document;
+    if (json_parse_document(&parser, arrays, 2 * DEEP - 1, &document) == 0 ||
+        parser.error.position != 2 * DEEP - 1)
+        fail("%s: %s", "unclosed deep arrays", "tape fails elsewhere");
+    free(arrays);
+    free(objects);
+}
+
+// An allocator with a fixed budget
+typedef struct
+{
+    char *memory;
+    size_t used, size;
+} Budget;
+
+static void *budget_alloc(void *context, size_t size)
+{
+    Budget *budget = context;
+    size = (size + 15) & ~(size_t)15;
+    if (size > budget->size - budget->used)
+        return NULL;
+    void *memory = budget->memory + budget->used;
+    budget->used += size;
+    return memory;
+}
+
+static void check_exhaustion(void)
+{
+    // Deeper than the inline frames, with strings, numbers and escapes
+    char json[4096];
+    size_t length = 0;
+    for (int i = 0; i < 40; i++)
+        length += sprintf(json + length, "{\"k%d\":[%d,\"s\\u00e9%d\",", i, i, i);
+    length += sprintf(json + length, "null");
+    for (int i = 0; i < 40; i++)
+        length += sprintf(json + length, "]}");
+
+    // What each parse takes when nothing runs out
+    Budget budget = {malloc(1 << 20), 0, 1 << 20};
+    JSONAllocator allocator = {budget_alloc, &budget};
+    JSONParser parser = {&allocator, 0, {NULL, 0}};
+    if (!json_parse(&parser, json, length))
+        fail("%s: %s", "exhaustion document", parser.error.message);
+    size_t tree_need = budget.used;
+    budget.used = 0;
+    JSONDocument document;
+    if (json_parse_document(&parser, json, length, &document) != 0)
+        fail("%s: %s", "exhaustion document", parser.error.message);
+    size_t tape_need = budget.used;
+
+    for (int tape = 0; tape < 2; tape++)
+    {
+        size_t need = tape ? tape_need : tree_need;
+        for (size_t size = 0; size <= need; size += 16)
+        {
+            budget.used = 0;
+            budget.size = size;
+            int result = tape ? json_parse_document(&parser, json, length, &document)
+                              : (json_parse(&parser, json, length) ? 0 : -1);
+            if (result != 0 && strcmp(parser.error.message, "Out of memory") != 0)
+                fail("%s: %s", tape ? "exhausted tape" : "exhausted tree", parser.error.message);
+            if (result == 0 && size < need)
+                fail("%s: %s", tape ? "exhausted tape" : "exhausted tree", "succeeded with less than it needs");
+        }
+    }
+    free(budget.memory);
+}
+
+static void *parse_in_thread(void *argument)
+{
+    (void)argument;
+    static const char json[] = "{\"a\":[1,2,{\"b\":\"\\u00e9\"}]}";
+    for (int i = 0; i < THREAD_PARSES; i++)
+    {
+        JSONParser parser = {NULL, 0, {NULL, 0}};
+        JSONValue *value = json_parse(&parser, json, sizeof(json) - 1);
+        JSONDocument document;
+        int result = json_parse_document(&parser, json, sizeof(json) - 1, &document);
+        if (!value || result != 0)
+            return "a parse failed";
+        free_json(value);
+        json_document_free(&document);
+        if (json_parse(&parser, "[1,]", 4) || strcmp(parser.error.message, "Unexpected token") != 0 ||
+            parser.error.position != 4)
+            return "an error came out wrong";
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+        check_valid(valid[i].json, valid[i].written);
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+        check_invalid(invalid[i].json, invalid[i].message, invalid[i].position);
+    printf("documents  %zu valid, %zu invalid\n", sizeof(valid) / sizeof(valid[0]),
+           sizeof(invalid) / sizeof(invalid[0]));
+
+    check_nesting();
+    printf("nesting    %d arrays, %d objects\n", DEEP, DEEP);
+    check_exhaustion();
+    printf("arena      every budget up to what the tree and the tape need\n");
+
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, parse_in_thread, NULL);
+    for (int i = 0; i < THREADS; i++)
+    {
+        void *problem;
+        pthread_join(threads[i], &problem);
+        if (problem)
+            fail("%s: %s", "threads", problem);
+    }
+    printf("threads    %d, %d parses each\n", THREADS, THREAD_PARSES);
+
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+// Checks the UTF-8 validation in stage 1 (json_index.c) against a
+// reference validator that follows the table in RFC 3629.
+//
+// Each input is a JSON array holding one string of random text: ASCII and
+// characters of two, three and four bytes, so they straddle the 64-byte
+// blocks. Most are then broken one way: a random high byte, a byte that
+// can never appear (C0, C1, F5-FF) or one that bounds its successor (E0,
+// ED, F0, F4), or a character cut short. A third are padded to end on a
+// block boundary, some of those with a lead byte as the very last byte.
+// Every classifier the CPU has (scalar, sse2 with SSSE3, avx2) must stop
+// with "Invalid UTF-8" at the same byte as the reference, or not at all.
+//
+// Build: gcc -O2 -I. -o json_utf8_check check/json_utf8_check.c json_index.c
+// Usage: json_utf8_check [-n inputs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "json_index.h"
+
+#define DEFAULT_INPUTS 400000
+#define MAX_LENGTH 400 // Of the text; the input gets a few bytes more
+
+static const char *const isas[] = {"scalar", "sse2", "avx2"};
+
+static uint64_t random_state = 12345;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// Start of the first invalid character in text, or -1 if it is all valid
+static long first_invalid(const unsigned char *text, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        unsigned c = text[i];
+        if (c < 0x80)
+        {
+            i++;
+            continue;
+        }
+        size_t bytes;
+        unsigned low = 0x80, high = 0xBF; // Range of the second byte
+        if (c >= 0xC2 && c <= 0xDF)
+        {
+            bytes = 2;
+        }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            bytes = 3;
+            if (c == 0xE0)
+                low = 0xA0; // Overlong
+            if (c == 0xED)
+                high = 0x9F; // Surrogate
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            bytes = 4;
+            if (c == 0xF0)
+                low = 0x90; // Overlong
+            if (c == 0xF4)
+                high = 0x8F; // Past U+10FFFF
+        }
+        else
+        {
+            return (long)i;
+        }
+        if (i + 1 >= length || text[i + 1] < low || text[i + 1] > high)
+            return (long)i;
+        for (size_t k = 2; k < bytes; k++)
+        {
+            if (i + k >= length || (text[i + k] & 0xC0) != 0x80)
+                return (long)i;
+        }
+        i += bytes;
+    }
+    return -1;
+}
+
+static size_t encode(unsigned char *p, unsigned code_point)
+{
+    if (code_point < 0x80)
+    {
+        p[0] = (unsigned char)code_point;
+        return 1;
+    }
+    if (code_point < 0x800)
+    {
+        p[0] = (unsigned char)(0xC0 | code_point >> 6);
+        p[1] = (unsigned char)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000)
+    {
+        p[0] = (unsigned char)(0xE0 | code_point >> 12);
+        p[1] = (unsigned char)(0x80 | (code_point >> 6 & 0x3F));
+        p[2] = (unsigned char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    p[0] = (unsigned char)(0xF0 | code_point >> 18);
+    p[1] = (unsigned char)(0x80 | (code_point >> 12 & 0x3F));
+    p[2] = (unsigned char)(0x80 | (code_point >> 6 & 0x3F));
+    p[3] = (unsigned char)(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+// Builds one input in json; returns its length
+static size_t generate(unsigned char *json)
+{
+    size_t length = 0, text_length = next_random() % (MAX_LENGTH - 4);
+    json[length++] = '[';
+    json[length++] = '"';
+    while (length < text_length)
+    {
+        unsigned pick = next_random() % 10;
+        unsigned code_point = pick < 4   ? 'a' + next_random() % 26
+                              : pick < 6 ? 0x80 + next_random() % 0x780
+                              : pick < 8 ? 0x800 + next_random() % 0xF800
+                                         : 0x10000 + next_random() % 0x100000;
+        if (code_point >= 0xD800 && code_point <= 0xDFFF)
+            code_point = 'x';
+        length += encode(json + length, code_point);
+    }
+
+    if (length > 2)
+    {
+        switch (next_random() % 4)
+        {
+        case 0: json[2 + next_random() % (length - 2)] = (unsigned char)(next_random() | 0x80); break;
+        case 1: length -= next_random() % 3; break; // May cut a character short
+        case 2: json[2 + next_random() % (length - 2)] = "\xC0\xC1\xF5\xFF\xED\xE0\xF0\xF4"[next_random() % 8]; break;
+        default: break; // Left valid
+        }
+    }
+    json[length++] = '"';
+    json[length++] = ']';
+    if (next_random() % 3 == 0)
+    {
+        while (length % JSON_INDEX_BLOCK)
+            json[length++] = ' ';
+        if (next_random() % 2)
+            json[length - 1] = 0xC3;
+    }
+    json[length] = '\0';
+    return length;
+}
+
+int main(int argc, char **argv)
+{
+    long inputs = DEFAULT_INPUTS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (inputs = atol(optarg)) <= 0)
+        {
+            fprintf(stderr, "Usage: %s [-n inputs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int selected[sizeof(isas) / sizeof(isas[0])];
+    long failures[sizeof(isas) / sizeof(isas[0])] = {0};
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+        selected[k] = json_index_select(isas[k]) == 0;
+
+    long invalid = 0;
+    static unsigned char json[MAX_LENGTH + JSON_INDEX_BLOCK];
+    for (long n = 0; n < inputs; n++)
+    {
+        size_t length = generate(json);
+        long expected = first_invalid(json, length);
+        invalid += expected >= 0;
+        for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+        {
+            if (!selected[k])
+                continue;
+            json_index_select(isas[k]);
+            JSONIndex index;
+            json_index_init(&index, (const char *)json, length);
+            while (json_index_fill(&index))
+                ;
+            long got = index.error && strcmp(index.error, "Invalid UTF-8") == 0 ? (long)index.error_position : -1;
+            if (got != expected && failures[k]++ < 10)
+                printf("%s: %zu bytes: invalid at %ld, want %ld (%s)\n", isas[k], length, got, expected,
+                       index.error ? index.error : "no error");
+        }
+    }
+
+    int failed = 0;
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    {
+        if (selected[k])
+            printf("%-6s  %ld inputs, %ld invalid  %s\n", isas[k], inputs, invalid,
+                   failures[k] ? "FAILED" : "ok");
+        else
+            printf("%-6s  not available\n", isas[k]);
+        failed |= failures[k] != 0;
+    }
+    return failed;
+}
@@ -0,0 +1,322 @@
+// Checks that response_builder.c gets a batch onto the socket byte for byte
+// however little the socket takes at a time. Each batch mixes the four ways
+// of queueing bytes and is drained through a socketpair whose send buffer
+// holds only a few kilobytes, read from the other end a random amount at a
+// time, so nearly every sendmsg() and sendfile() stops part way.
+//
+//   pieces      referenced, copied and formatted bytes, formatted output
+//               too long for a chunk, and file ranges, empty ones included;
+//   runs        batches of more than IOV_MAX pieces, which take several
+//               sendmsg() calls with MSG_MORE on all but the last;
+//   flush       response_flush called again after every RESPONSE_PENDING,
+//               resuming inside an iovec or a file range;
+//   prepare     the io_uring way: response_prepare_send, a sendmsg() of
+//               its own, response_advance with what went out, and
+//               response_flush for file ranges. The run must end at the
+//               first file range and at IOV_MAX pieces, and *more must say
+//               whether anything is queued behind it;
+//   reuse       batches follow each other through response_reset, with and
+//               without an Arena, and every file range is released once.
+//
+// Build: gcc -O2 -I. -o response_builder_check check/response_builder_check.c response_builder.c arena.c
+// Usage: response_builder_check [-n batches]
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "response_builder.h"
+
+#define DEFAULT_BATCHES 300
+#define TEXT_SIZE 65536
+#define FILE_SIZE 262144
+#define MAX_BATCH (4 << 20) // Bytes queued per batch, give or take a piece
+
+static long failures;
+
+static uint64_t random_state = 2463534242ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static char text[TEXT_SIZE];      // Referenced and copied from
+static char file_data[FILE_SIZE]; // What the file holds
+static int file_fd;
+static char expected[MAX_BATCH + 2 * FILE_SIZE];
+static char received[MAX_BATCH + 2 * FILE_SIZE];
+static int releases;
+
+static void release_range(void *context)
+{
+    (*(int *)context)++;
+}
+
+static size_t random_length(size_t limit)
+{
+    size_t length = next_random() % 16 == 0 ? next_random() % limit : next_random() % 200;
+    return length < limit ? length : limit;
+}
+
+// Queues a random batch and returns its length; *files counts the file ranges
+static size_t queue_batch(ResponseBuilder *builder, int *files)
+{
+    size_t length = 0;
+    int pieces = next_random() % 8 == 0 ? IOV_MAX + (int)(next_random() % (2 * IOV_MAX)) : 1 + next_random() % 40;
+    int no_files = pieces > IOV_MAX && next_random() % 2; // So a run reaches IOV_MAX pieces
+    *files = 0;
+    for (int i = 0; i < pieces && length < MAX_BATCH; i++)
+    {
+        size_t size;
+        switch (next_random() % 5)
+        {
+        case 0:
+        {
+            size_t offset = next_random() % TEXT_SIZE;
+            size = random_length(TEXT_SIZE - offset);
+            response_add(builder, text + offset, size);
+            memcpy(expected + length, text + offset, size);
+            break;
+        }
+        case 1:
+        {
+            size_t offset = next_random() % TEXT_SIZE;
+            size = random_length(TEXT_SIZE - offset);
+            response_add_copy(builder, text + offset, size);
+            memcpy(expected + length, text + offset, size);
+            break;
+        }
+        case 2:
+        {
+            // Past CHUNK_SIZE at times, which response_addf has to format twice
+            int width = (int)random_length(3 * 4096);
+            int offset = (int)(next_random() % (TEXT_SIZE - width));
+            size = sprintf(expected + length, "%d:%.*s;", i, width, text + offset);
+            response_addf(builder, "%d:%.*s;", i, width, text + offset);
+            break;
+        }
+        default:
+        {
+            if (no_files || next_random() % 2)
+                continue;
+            size_t offset = next_random() % FILE_SIZE;
+            size = next_random() % 4 == 0 ? random_length(FILE_SIZE - offset) : next_random() % (FILE_SIZE - offset);
+            response_add_file(builder, file_fd, offset, size, release_range, &releases);
+            memcpy(expected + length, file_data + offset, size);
+            (*files)++;
+            break;
+        }
+        }
+        length += size;
+    }
+    return length;
+}
+
+// Reads what has arrived, up to limit bytes, into received at *length
+static void receive(int fd, size_t *length, size_t limit)
+{
+    while (limit > 0)
+    {
+        ssize_t got = read(fd, received + *length, limit);
+        if (got <= 0)
+            break;
+        *length += got;
+        limit -= got;
+    }
+}
+
+// Drains the batch with response_flush. Returns how many flushes stopped part way.
+static long drain_flush(ResponseBuilder *builder, int writer, int reader, size_t *length)
+{
+    long partial = 0;
+    for (;;)
+    {
+        int result = response_flush(builder, writer);
+        if (result == RESPONSE_ERROR)
+        {
+            printf("response_flush: %s\n", strerror(errno));
+            failures++;
+            return partial;
+        }
+        if (result == RESPONSE_DONE)
+            return partial;
+        partial++;
+        receive(reader, length, 1 + next_random() % 12000);
+    }
+}
+
+// Drains the batch as the io_uring backend does
+static long drain_prepare(ResponseBuilder *builder, int writer, int reader, size_t *length)
+{
+    long partial = 0;
+    while (response_pending(builder) > 0)
+    {
+        struct msghdr message;
+        int more;
+        size_t run = response_prepare_send(builder, &message, &more);
+        if (run == 0)
+        {
+            // A file range at the front
+            if (builder->iov[builder->iov_sent].iov_base != NULL)
+            {
+                printf("response_prepare_send: nothing to send with an iovec at the front\n");
+                failures++;
+                return partial;
+            }
+            int result = response_flush(builder, writer);
+            if (result == RESPONSE_ERROR)
+            {
+                printf("response_flush: %s\n", strerror(errno));
+                failures++;
+                return partial;
+            }
+            if (result == RESPONSE_PENDING)
+                partial++;
+        }
+        else
+        {
+            int ends_at_file = builder->iov_sent + (int)message.msg_iovlen < builder->iov_count &&
+                               builder->iov[builder->iov_sent + message.msg_iovlen].iov_base == NULL;
+            if (message.msg_iovlen > IOV_MAX || (message.msg_iovlen < IOV_MAX && more && !ends_at_file) ||
+                more != (response_pending(builder) > run))
+            {
+                printf("response_prepare_send: %zu iovecs, %zu bytes, more %d, %zu pending\n",
+                       (size_t)message.msg_iovlen, run, more, response_pending(builder));
+                failures++;
+                return partial;
+            }
+            ssize_t sent = sendmsg(writer, &message, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+            if (sent < 0 && errno != EAGAIN)
+            {
+                printf("sendmsg: %s\n", strerror(errno));
+                failures++;
+                return partial;
+            }
+            if (sent > 0)
+                response_advance(builder, sent);
+            if (sent < (ssize_t)run)
+                partial++;
+        }
+        receive(reader, length, 1 + next_random() % 12000);
+    }
+    return partial;
+}
+
+static void check_batches(long batches, Arena *arena, int writer, int reader)
+{
+    ResponseBuilder builder;
+    response_init(&builder, arena);
+    long partial = 0, syscalls = 0;
+    size_t total = 0;
+    for (long batch = 0; batch < batches && failures < 10; batch++)
+    {
+        int files;
+        releases = 0;
+        size_t length = queue_batch(&builder, &files);
+        if (response_pending(&builder) != length)
+        {
+            printf("batch %ld: %zu bytes pending, %zu queued\n", batch, response_pending(&builder), length);
+            failures++;
+        }
+
+        int prepare = batch % 2;
+        size_t got = 0;
+        partial += prepare ? drain_prepare(&builder, writer, reader, &got) : drain_flush(&builder, writer, reader, &got);
+        syscalls += response_take_syscalls(&builder);
+        receive(reader, &got, sizeof(received) - got);
+
+        if (got != length || memcmp(received, expected, length) != 0)
+        {
+            size_t at = 0;
+            while (at < got && at < length && received[at] == expected[at])
+                at++;
+            printf("batch %ld (%s, %s): %zu of %zu bytes received, first difference at %zu\n", batch,
+                   prepare ? "prepare" : "flush", arena ? "arena" : "malloc", got, length, at);
+            failures++;
+        }
+        total += length;
+
+        if (batch % 16 == 15)
+        {
+            response_release(&builder);
+            if (arena)
+                arena_reset(arena);
+        }
+        else
+        {
+            response_reset(&builder);
+        }
+        if (releases != files)
+        {
+            printf("batch %ld: %d file ranges released, %d queued\n", batch, releases, files);
+            failures++;
+        }
+    }
+    response_release(&builder);
+    if (arena)
+        arena_reset(arena);
+    printf("%s: %ld batches, %zu bytes, %ld syscalls, %ld stopped part way\n", arena ? "arena" : "malloc",
+           batches, total, syscalls, partial);
+    if (batches > 0 && partial == 0)
+    {
+        printf("no send stopped part way: the socket buffer is too big for this check\n");
+        failures++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long batches = DEFAULT_BATCHES;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (batches = atol(optarg)) < 0)
+        {
+            fprintf(stderr, "Usage: %s [-n batches]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0; i < TEXT_SIZE; i++)
+        text[i] = (char)('a' + next_random() % 26);
+    for (size_t i = 0; i < FILE_SIZE; i++)
+        file_data[i] = (char)('A' + next_random() % 26);
+    FILE *file = tmpfile();
+    if (!file || fwrite(file_data, 1, FILE_SIZE, file) != FILE_SIZE || fflush(file) != 0)
+    {
+        perror("tmpfile");
+        return 2;
+    }
+    file_fd = fileno(file);
+
+    int fds[2];
+    int buffer = 4096;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0 ||
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer)) != 0)
+    {
+        perror("socketpair");
+        return 2;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    check_batches(batches, NULL, fds[0], fds[1]);
+    ArenaPool pool;
+    Arena arena;
+    arena_pool_init(&pool, ARENA_CHUNK_SIZE, 4);
+    arena_init(&arena, &pool);
+    check_batches(batches, &arena, fds[0], fds[1]);
+    arena_pool_destroy(&pool);
+
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+// Checks router_add and router_lookup (router.c) against a table of
+// requests with the route, parameters and Allow list each must get.
+//
+//   fallback    a static segment registered for some methods leaves the
+//               others to the :param or catch-all beside it, and HEAD goes
+//               to the GET handler when it has none of its own;
+//   404, 405    a path no pattern matches is not found; one that some
+//               pattern matches for other methods is not allowed, with
+//               those methods (HEAD wherever GET is) in the Allow list;
+//   catch-all   takes the rest of the path, slashes included, and never
+//               an empty one; a query string is ignored;
+//   router_add  refuses unknown methods, empty names, a catch-all before
+//               the end, two parameter names at one position and more than
+//               ROUTER_MAX_PARAMS parameters, and a refused pattern leaves
+//               nothing behind that could clash with a later one.
+//
+// Build: gcc -O1 -g -fsanitize=address,undefined -I. -o router_check check/router_check.c router.c http_parser.c
+// Usage: router_check
+
+#include <stdio.h>
+#include <string.h>
+#include "router.h"
+
+static int failures;
+
+static void handler(struct Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)conn;
+    (void)request;
+    (void)match;
+}
+
+static HttpSlice slice(const char *text)
+{
+    HttpSlice s = {text, strlen(text)};
+    return s;
+}
+
+// Registrations, numbered from 0 in this order
+static const struct
+{
+    const char *method, *pattern;
+} routes[] = {
+    {"GET", "/users/new"},        // 0
+    {"POST", "/users/:id"},       // 1
+    {"GET", "/users/:id/posts"},  // 2
+    {"DELETE", "/users/:id"},     // 3
+    {"*", "/any"},                // 4
+    {"GET", "/static/*path"},     // 5
+    {"HEAD", "/static/special"},  // 6
+    {"GET", "/"},                 // 7
+    {"PUT", "/files/:name"},      // 8
+    {"GET", "/files/readme"},     // 9
+    {"GET", "/a/:b/:c/:d/:e/:f/:g/:h/*i"}, // 10: ROUTER_MAX_PARAMS of them
+};
+
+static const struct
+{
+    const char *method, *path;
+    RouteResult result;
+    int route;          // On ROUTE_FOUND
+    const char *params; // "name=value ..." on ROUTE_FOUND, the Allow list on ROUTE_METHOD_NOT_ALLOWED
+} lookups[] = {
+    {"GET", "/users/new", ROUTE_FOUND, 0, ""},
+    {"POST", "/users/new", ROUTE_FOUND, 1, "id=new"},
+    {"DELETE", "/users/new", ROUTE_FOUND, 3, "id=new"},
+    {"HEAD", "/users/new", ROUTE_FOUND, 0, ""},
+    {"POST", "/users/42", ROUTE_FOUND, 1, "id=42"},
+    {"GET", "/users/42", ROUTE_METHOD_NOT_ALLOWED, -1, "POST, DELETE"},
+    {"PUT", "/users/new", ROUTE_METHOD_NOT_ALLOWED, -1, "GET, HEAD, POST, DELETE"},
+    {"GET", "/users/42/posts", ROUTE_FOUND, 2, "id=42"},
+    {"HEAD", "/users/42/posts", ROUTE_FOUND, 2, "id=42"},
+    {"POST", "/users/42/posts", ROUTE_METHOD_NOT_ALLOWED, -1, "GET, HEAD"},
+    {"GET", "/users/new/posts", ROUTE_FOUND, 2, "id=new"},
+    {"GET", "/users/", ROUTE_NOT_FOUND, -1, ""},
+    {"GET", "/users", ROUTE_NOT_FOUND, -1, ""},
+    {"GET", "/users/42/other", ROUTE_NOT_FOUND, -1, ""},
+    {"PATCH", "/any", ROUTE_FOUND, 4, ""},
+    {"OPTIONS", "/any?x=1", ROUTE_FOUND, 4, ""},
+    {"BREW", "/any", ROUTE_METHOD_NOT_ALLOWED, -1, "GET, HEAD, POST, PUT, DELETE, PATCH, OPTIONS"},
+    {"BREW", "/nowhere", ROUTE_NOT_FOUND, -1, ""},
+    {"GET", "/static/a.txt", ROUTE_FOUND, 5, "path=a.txt"},
+    {"GET", "/static/css/site.css?v=3", ROUTE_FOUND, 5, "path=css/site.css"},
+    {"GET", "/static/", ROUTE_NOT_FOUND, -1, ""},
+    {"GET", "/static/special", ROUTE_FOUND, 5, "path=special"},
+    {"HEAD", "/static/special", ROUTE_FOUND, 6, ""},
+    {"HEAD", "/static/other", ROUTE_FOUND, 5, "path=other"},
+    {"POST", "/static/special", ROUTE_METHOD_NOT_ALLOWED, -1, "GET, HEAD"},
+    {"GET", "/", ROUTE_FOUND, 7, ""},
+    {"GET", "/?q", ROUTE_FOUND, 7, ""},
+    {"GET", "", ROUTE_NOT_FOUND, -1, ""},
+    {"PUT", "/files/readme", ROUTE_FOUND, 8, "name=readme"},
+    {"GET", "/files/readme", ROUTE_FOUND, 9, ""},
+    {"GET", "/files/other", ROUTE_METHOD_NOT_ALLOWED, -1, "PUT"},
+    {"GET", "/a/1/2/3/4/5/6/7/8/9", ROUTE_FOUND, 10, "b=1 c=2 d=3 e=4 f=5 g=6 h=7 i=8/9"},
+    {"get", "/", ROUTE_METHOD_NOT_ALLOWED, -1, "GET, HEAD"},
+};
+
+// Patterns router_add must refuse once the routes above are in
+static const struct
+{
+    const char *method, *pattern;
+} refused[] = {
+    {"BREW", "/coffee"},
+    {"GET", "/users/:name"},            // :id is already there
+    {"GET", "/static/:file"},           // *path is already there
+    {"GET", "/files/*name"},            // A catch-all where :name is
+    {"GET", "/x/*rest/more"},
+    {"GET", "/x/:/y"},
+    {"GET", "/x/*"},
+    {"GET", "/p/:a/:b/:c/:d/:e/:f/:g/:h/:i"},
+    {"GET", "/q/:a/:b/:c/:d/:e/:f/:g/:h/*i"},
+    {"GET", "/left/:over/*rest/z"},     // Leaves :over behind if checked too late
+};
+
+// Format "name=value ..." for comparing with the table
+static void format_params(const RouteMatch *match, char *buffer, size_t size)
+{
+    size_t length = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < match->param_count && length < size; i++)
+    {
+        length += snprintf(buffer + length, size - length, "%s%.*s=%.*s", i ? " " : "",
+                           (int)match->params[i].name.length, match->params[i].name.data,
+                           (int)match->params[i].value.length, match->params[i].value.data);
+    }
+}
+
+int main(void)
+{
+    Router *router = router_create();
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++)
+    {
+        if (router_add(router, routes[i].method, routes[i].pattern, handler) != 0)
+        {
+            printf("router_add %s %s: refused\n", routes[i].method, routes[i].pattern);
+            failures++;
+        }
+    }
+    for (size_t i = 0; i < sizeof(refused) / sizeof(refused[0]); i++)
+    {
+        if (router_add(router, refused[i].method, refused[i].pattern, handler) == 0)
+        {
+            printf("router_add %s %s: accepted\n", refused[i].method, refused[i].pattern);
+            failures++;
+        }
+    }
+    if (router_route_count(router) != (int)(sizeof(routes) / sizeof(routes[0])))
+    {
+        printf("router_route_count: %d\n", router_route_count(router));
+        failures++;
+    }
+    // Nothing of /left/:over may remain to clash with this
+    if (router_add(router, "GET", "/left/:other", handler) != 0)
+    {
+        printf("router_add GET /left/:other: refused after a rejected /left/:over/...\n");
+        failures++;
+    }
+
+    static const char *const results[] = {"found", "not found", "method not allowed"};
+    for (size_t i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++)
+    {
+        RouteMatch match;
+        RouteResult result = router_lookup(router, slice(lookups[i].method), slice(lookups[i].path), &match);
+        char got[256];
+        if (result == ROUTE_FOUND)
+            format_params(&match, got, sizeof(got));
+        else if (result == ROUTE_METHOD_NOT_ALLOWED)
+            route_allow(&match, got, sizeof(got));
+        else
+            got[0] = '\0';
+        int route = result == ROUTE_FOUND ? match.route : -1;
+        if (result != lookups[i].result || route != lookups[i].route || strcmp(got, lookups[i].params) != 0 ||
+            (result == ROUTE_FOUND && match.handler != handler))
+        {
+            printf("%s %s: %s, route %d, \"%s\"; want %s, route %d, \"%s\"\n", lookups[i].method,
+                   lookups[i].path, results[result], route, got, results[lookups[i].result], lookups[i].route,
+                   lookups[i].params);
+            failures++;
+        }
+    }
+
+    // route_allow cuts the list at whole methods when the buffer is short
+    RouteMatch match;
+    router_lookup(router, slice("BREW"), slice("/any"), &match);
+    char small[12];
+    size_t length = route_allow(&match, small, sizeof(small));
+    if (length != strlen(small) || strcmp(small, "GET, HEAD") != 0)
+    {
+        printf("route_allow into %zu bytes: \"%s\"\n", sizeof(small), small);
+        failures++;
+    }
+    router_free(router);
+
+    printf("%zu routes, %zu refused, %zu lookups  %s\n", sizeof(routes) / sizeof(routes[0]),
+           sizeof(refused) / sizeof(refused[0]), sizeof(lookups) / sizeof(lookups[0]), failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
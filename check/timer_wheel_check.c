@@ -0,0 +1,313 @@
+// Checks the timing wheel (timer_wheel.c): every timer must come out of
+// timer_wheel_advance on the tick it is due, not a tick early or late, and
+// only while it is armed.
+//
+//   boundaries  from bases on and off slot boundaries, timers due at and one
+//               either side of 64^k ticks ahead for every level, at the end
+//               of the wheel's range, in the past and past the range; each
+//               is re-armed from somewhere else first, and cancelled ones
+//               beside them must never fire;
+//   random      timers armed, re-armed and cancelled at random delays
+//               against a list of when each is due, with the wheel advanced
+//               by random steps from a base that is not on a slot, and
+//               handlers cancelling or re-arming timers still on the
+//               expired list. Each advance must hand out exactly the timers
+//               due since the one before, in the order they are due, and
+//               the wheel's count must match.
+//
+// Build: gcc -O2 -I. -o timer_wheel_check check/timer_wheel_check.c timer_wheel.c
+// Usage: timer_wheel_check [-n operations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "timer_wheel.h"
+
+#define DEFAULT_OPERATIONS 200000
+#define RANGE (1ULL << (TIMER_LEVELS * TIMER_SLOT_BITS)) // Ticks the wheel reaches
+#define NOT_ARMED UINT64_MAX
+
+static long failures;
+
+static uint64_t random_state = 2463534242ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// A timer and the tick it must fire on: NOT_ARMED if it must not fire
+typedef struct
+{
+    Timer timer;
+    uint64_t due;
+    int late; // Due past the range: it may fire on any tick from due on
+} Entry;
+
+static int compare_ticks(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static const uint64_t bases[] = {0, 1, 37, 63, 64, 4095, 4097, 262143, 262150, 16777215, 123456789};
+
+// Arms timers at and around every level's boundary from base, then advances
+// to the tick before and the tick of each one, so each timer has to fire in
+// exactly one advance
+static void check_boundaries(uint64_t base)
+{
+    enum
+    {
+        COUNT = 64
+    };
+    static Entry entries[COUNT];
+    static Timer cancelled[COUNT];
+    static uint64_t ticks[2 * COUNT];
+    TimerWheel wheel;
+    timer_wheel_init(&wheel, base);
+
+    int count = 0;
+    for (int level = 0; level <= TIMER_LEVELS; level++)
+    {
+        uint64_t span = 1ULL << (level * TIMER_SLOT_BITS);
+        for (uint64_t delay = span - 1; delay <= span + 1; delay++)
+            entries[count++].due = base + delay;
+    }
+    entries[count++].due = base + 2;
+    entries[count++].due = base + 65 - base % 64;    // Next level 0 wrap, plus one
+    entries[count++].due = base + 4096 - base % 4096; // Next level 1 wrap
+    entries[count++].due = base + RANGE - 2;
+    entries[count++].due = base + RANGE + 1000; // Past the range
+    if (base > 0)
+        entries[count++].due = base - 1; // In the past
+    if (base > 1000)
+        entries[count++].due = base - 1000;
+
+    for (int i = 0; i < count; i++)
+    {
+        Entry *e = &entries[i];
+        timer_init(&e->timer);
+        e->late = e->due >= base + RANGE;
+        // From a different level first, so re-arming has to move it
+        timer_arm(&wheel, &e->timer, e->due + (i % 2 ? 70000 : 3));
+        timer_arm(&wheel, &e->timer, e->due);
+        if (e->due < base)
+            e->due = base;
+
+        timer_init(&cancelled[i]);
+        timer_arm(&wheel, &cancelled[i], e->due);
+        if (i % 2)
+            timer_arm(&wheel, &cancelled[i], e->due + 1);
+        timer_cancel(&wheel, &cancelled[i]);
+        timer_cancel(&wheel, &cancelled[i]);
+    }
+    if (wheel.count != (size_t)count)
+    {
+        printf("base %llu: count %zu after arming %d\n", (unsigned long long)base, wheel.count, count);
+        failures++;
+    }
+
+    int tick_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (entries[i].due > base)
+            ticks[tick_count++] = entries[i].due - 1;
+        ticks[tick_count++] = entries[i].due;
+    }
+    qsort(ticks, tick_count, sizeof(ticks[0]), compare_ticks);
+
+    Timer expired;
+    timer_list_init(&expired);
+    uint64_t previous = 0; // Tick of the advance before, from the second on
+    for (int t = 0; t < tick_count; t++)
+    {
+        uint64_t now = ticks[t];
+        timer_wheel_advance(&wheel, now, &expired);
+        Timer *timer;
+        while ((timer = timer_list_pop(&wheel, &expired)) != NULL)
+        {
+            Entry *e = (Entry *)timer;
+            if (e < entries || e >= entries + count)
+            {
+                printf("base %llu: a cancelled timer fired at %llu\n", (unsigned long long)base,
+                       (unsigned long long)now);
+                failures++;
+                continue;
+            }
+            int on_time = e->late ? now >= e->due : e->due <= now && (t == 0 || previous < e->due);
+            if (!on_time)
+            {
+                printf("base %llu: timer due %llu (%+lld from base) fired between %llu and %llu\n",
+                       (unsigned long long)base, (unsigned long long)e->due, (long long)(e->due - base),
+                       (unsigned long long)previous + 1, (unsigned long long)now);
+                failures++;
+            }
+            e->due = NOT_ARMED;
+        }
+        previous = now;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (entries[i].due != NOT_ARMED && !entries[i].late)
+        {
+            printf("base %llu: timer due %llu (%+lld from base) never fired\n", (unsigned long long)base,
+                   (unsigned long long)entries[i].due, (long long)(entries[i].due - base));
+            failures++;
+        }
+    }
+}
+
+// A random delay: within one level, on or beside a level boundary, or in the past
+static uint64_t random_expiry(uint64_t base)
+{
+    int level = (int)(next_random() % TIMER_LEVELS) + 1;
+    uint64_t span = 1ULL << (level * TIMER_SLOT_BITS);
+    switch (next_random() % 8)
+    {
+    case 0:
+        return base + span - 1 + next_random() % 3 - (level == TIMER_LEVELS ? 2 : 0);
+    case 1:
+        return base - next_random() % 100; // The wheel starts far enough along
+    default:
+        return base + next_random() % span;
+    }
+}
+
+enum
+{
+    TIMERS = 512
+};
+static Entry timers[TIMERS];
+static TimerWheel wheel;
+
+static void arm(Entry *e)
+{
+    uint64_t expires = random_expiry(wheel.base);
+    timer_arm(&wheel, &e->timer, expires);
+    e->due = expires < wheel.base ? wheel.base : expires;
+}
+
+static void cancel(Entry *e)
+{
+    timer_cancel(&wheel, &e->timer);
+    e->due = NOT_ARMED;
+}
+
+static size_t armed_count(void)
+{
+    size_t count = 0;
+    for (int i = 0; i < TIMERS; i++)
+        count += timers[i].due != NOT_ARMED;
+    return count;
+}
+
+static void check_random(long operations)
+{
+    uint64_t start = RANGE - 12345; // Off any slot, and soon across the top level's wrap
+    timer_wheel_init(&wheel, start);
+    for (int i = 0; i < TIMERS; i++)
+    {
+        timer_init(&timers[i].timer);
+        timers[i].due = NOT_ARMED;
+    }
+
+    Timer expired;
+    timer_list_init(&expired);
+    long fired = 0;
+    for (long op = 0; op < operations && failures < 20; op++)
+    {
+        Entry *e = &timers[next_random() % TIMERS];
+        uint64_t r = next_random() % 16;
+        if (r < 8)
+        {
+            arm(e);
+            continue;
+        }
+        if (r < 10)
+        {
+            cancel(e);
+            continue;
+        }
+
+        uint64_t step = next_random() % 64;
+        if (r == 14)
+            step = next_random() % 5000;
+        else if (r == 15 && next_random() % 8 == 0)
+            step = next_random() % 300000;
+        uint64_t previous = wheel.base - 1, now = previous + step;
+        timer_wheel_advance(&wheel, now, &expired);
+
+        uint64_t last = 0;
+        Timer *timer;
+        while ((timer = timer_list_pop(&wheel, &expired)) != NULL)
+        {
+            e = (Entry *)timer;
+            fired++;
+            if (e->due == NOT_ARMED || e->due <= previous || e->due > now || e->due < last)
+            {
+                printf("operation %ld: timer %d due %llu fired between %llu and %llu%s\n", op,
+                       (int)(e - timers), (unsigned long long)e->due, (unsigned long long)previous + 1,
+                       (unsigned long long)now, e->due < last ? ", out of order" : "");
+                failures++;
+            }
+            last = e->due;
+            e->due = NOT_ARMED;
+            // What a handler might do, to this timer or any other
+            Entry *other = &timers[next_random() % TIMERS];
+            switch (next_random() % 4)
+            {
+            case 0:
+                arm(e);
+                break;
+            case 1:
+                cancel(other);
+                break;
+            case 2:
+                arm(other);
+                break;
+            }
+        }
+        for (int i = 0; i < TIMERS; i++)
+        {
+            if (timers[i].due <= now)
+            {
+                printf("operation %ld: timer %d due %llu did not fire by %llu\n", op, i,
+                       (unsigned long long)timers[i].due, (unsigned long long)now);
+                failures++;
+                timers[i].due = NOT_ARMED;
+            }
+        }
+        if (wheel.count != armed_count())
+        {
+            printf("operation %ld: count %zu, want %zu\n", op, wheel.count, armed_count());
+            failures++;
+        }
+    }
+    printf("%ld operations over %llu ticks, %ld timers fired  ", operations,
+           (unsigned long long)(wheel.base - start), fired);
+}
+
+int main(int argc, char **argv)
+{
+    long operations = DEFAULT_OPERATIONS;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (operations = atol(optarg)) < 0)
+        {
+            fprintf(stderr, "Usage: %s [-n operations]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); i++)
+        check_boundaries(bases[i]);
+    printf("%zu bases, ", sizeof(bases) / sizeof(bases[0]));
+    check_random(operations);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
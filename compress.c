@@ -0,0 +1,474 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "compress.h"
+
+#define MAX_PATH_LENGTH 1024
+#define MAX_STATIC_FILE (8 << 20) // Larger files are always sent as they are
+
+const char *const encoding_names[ENCODINGS] = {"identity", "gzip", "deflate"};
+
+struct Compressor
+{
+    int level;
+    z_stream streams[ENCODINGS]; // Set up on first use; identity's is never used
+    int ready[ENCODINGS];
+    z_stream *active;            // Of the body in progress
+    int failed;                  // The body outgrew its buffer
+    char *output;
+    size_t staged;
+    char stage[COMPRESS_STAGE_SIZE];
+};
+
+// zlib windowBits for each encoding: 16 + 15 asks for the gzip wrapper
+static const int window_bits[ENCODINGS] = {0, 16 + MAX_WBITS, MAX_WBITS};
+
+// Parses a q-value ("1", "0.5", "0.125") at the front of p; -1 if malformed
+static double parse_qvalue(const char *p, const char *end)
+{
+    if (p == end || (*p != '0' && *p != '1'))
+        return -1;
+    double value = *p++ - '0';
+    if (p < end && *p == '.')
+    {
+        double scale = 0.1;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10)
+            value += (*p - '0') * scale;
+    }
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p == end && value <= 1 ? value : -1;
+}
+
+Encoding compress_negotiate(HttpSlice accept_encoding)
+{
+    double q[ENCODINGS] = {-1, -1, -1};
+    double any = -1; // From "*"
+    const char *p = accept_encoding.data;
+    const char *end = p + accept_encoding.length;
+
+    while (p < end)
+    {
+        // One element: coding *( ";" parameter ), up to the next comma
+        const char *element_end = memchr(p, ',', end - p);
+        if (!element_end)
+            element_end = end;
+        while (p < element_end && (*p == ' ' || *p == '\t'))
+            p++;
+        const char *coding = p;
+        while (p < element_end && *p != ';' && *p != ' ' && *p != '\t')
+            p++;
+        HttpSlice name = {coding, (size_t)(p - coding)};
+
+        double value = 1;
+        while (p < element_end)
+        {
+            while (p < element_end && (*p == ';' || *p == ' ' || *p == '\t'))
+                p++;
+            if (element_end - p >= 2 && (*p == 'q' || *p == 'Q') && p[1] == '=')
+            {
+                const char *stop = memchr(p, ';', element_end - p);
+                value = parse_qvalue(p + 2, stop ? stop : element_end);
+                break;
+            }
+            while (p < element_end && *p != ';')
+                p++;
+        }
+
+        if (value >= 0)
+        {
+            if (http_slice_equals_nocase(name, "gzip") || http_slice_equals_nocase(name, "x-gzip"))
+                q[ENCODING_GZIP] = value;
+            else if (http_slice_equals_nocase(name, "deflate"))
+                q[ENCODING_DEFLATE] = value;
+            else if (http_slice_equals(name, "*"))
+                any = value;
+        }
+        p = element_end + 1;
+    }
+
+    for (int encoding = ENCODING_GZIP; encoding < ENCODINGS; encoding++)
+    {
+        if (q[encoding] < 0)
+            q[encoding] = any;
+    }
+    if (q[ENCODING_GZIP] > 0 && q[ENCODING_GZIP] >= q[ENCODING_DEFLATE])
+        return ENCODING_GZIP;
+    if (q[ENCODING_DEFLATE] > 0)
+        return ENCODING_DEFLATE;
+    return ENCODING_IDENTITY;
+}
+
+int compress_type_allowed(const char *content_type)
+{
+    static const char *const types[] = {"application/json", "application/javascript",
+                                        "application/xml", "image/svg+xml"};
+    if (strncmp(content_type, "text/", 5) == 0)
+        return 1;
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        size_t length = strlen(types[i]);
+        if (strncmp(content_type, types[i], length) == 0 &&
+            (content_type[length] == '\0' || content_type[length] == ';'))
+            return 1;
+    }
+    return 0;
+}
+
+Compressor *compressor_create(int level)
+{
+    Compressor *compressor = calloc(1, sizeof(Compressor));
+    if (compressor)
+        compressor->level = level;
+    return compressor;
+}
+
+void compressor_free(Compressor *compressor)
+{
+    if (!compressor)
+        return;
+    for (int encoding = 0; encoding < ENCODINGS; encoding++)
+    {
+        if (compressor->ready[encoding])
+            deflateEnd(&compressor->streams[encoding]);
+    }
+    free(compressor);
+}
+
+int compressor_begin(Compressor *compressor, Encoding encoding, size_t length, Arena *arena)
+{
+    z_stream *stream = &compressor->streams[encoding];
+    if (encoding == ENCODING_IDENTITY)
+        return -1;
+    if (!compressor->ready[encoding])
+    {
+        if (deflateInit2(stream, compressor->level, Z_DEFLATED, window_bits[encoding], 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            return -1;
+        compressor->ready[encoding] = 1;
+    }
+    else
+    {
+        deflateReset(stream);
+    }
+
+    size_t capacity = deflateBound(stream, length);
+    compressor->output = arena_alloc(arena, capacity);
+    if (!compressor->output)
+        return -1;
+    stream->next_out = (Bytef *)compressor->output;
+    stream->avail_out = capacity;
+    compressor->active = stream;
+    compressor->failed = 0;
+    compressor->staged = 0;
+    return 0;
+}
+
+// Runs deflate over data. The output buffer holds the whole bound, so
+// running out of it means the caller wrote more than it announced.
+static void deflate_data(Compressor *compressor, const char *data, size_t length, int flush)
+{
+    z_stream *stream = compressor->active;
+    stream->next_in = (Bytef *)data;
+    stream->avail_in = length;
+    int result = deflate(stream, flush);
+    if (stream->avail_in != 0 || (flush == Z_FINISH && result != Z_STREAM_END))
+        compressor->failed = 1;
+}
+
+void compressor_write(void *context, const char *data, size_t length)
+{
+    Compressor *compressor = context;
+    if (compressor->staged + length <= sizeof(compressor->stage))
+    {
+        memcpy(compressor->stage + compressor->staged, data, length);
+        compressor->staged += length;
+        return;
+    }
+    if (compressor->staged > 0)
+    {
+        deflate_data(compressor, compressor->stage, compressor->staged, Z_NO_FLUSH);
+        compressor->staged = 0;
+    }
+    if (length < sizeof(compressor->stage))
+    {
+        memcpy(compressor->stage, data, length);
+        compressor->staged = length;
+    }
+    else
+    {
+        deflate_data(compressor, data, length, Z_NO_FLUSH);
+    }
+}
+
+const char *compressor_finish(Compressor *compressor, size_t *length)
+{
+    deflate_data(compressor, compressor->stage, compressor->staged, Z_FINISH);
+    *length = compressor->active->total_out;
+    compressor->staged = 0;
+    compressor->active = NULL;
+    return compressor->failed ? NULL : compressor->output;
+}
+
+char *compress_buffer(Encoding encoding, int level, const void *data, size_t length,
+                      size_t *compressed_length)
+{
+    if (encoding == ENCODING_IDENTITY)
+        return NULL;
+    z_stream stream = {0};
+    if (deflateInit2(&stream, level, Z_DEFLATED, window_bits[encoding], 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+    size_t capacity = deflateBound(&stream, length);
+    char *output = malloc(capacity);
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = length;
+    stream.next_out = (Bytef *)output;
+    stream.avail_out = capacity;
+    int result = output ? deflate(&stream, Z_FINISH) : Z_MEM_ERROR;
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END || stream.total_out >= length)
+    {
+        free(output);
+        return NULL;
+    }
+    *compressed_length = stream.total_out;
+    return output;
+}
+
+typedef struct StaticVariant
+{
+    char *path;          // Relative to the root, as CachedFile.path has it
+    size_t path_length;
+    uint64_t hash;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    time_t mtime;
+    CompressedBody bodies[ENCODINGS];
+    struct StaticVariant *next;
+} StaticVariant;
+
+struct StaticVariants
+{
+    StaticVariant **buckets;
+    size_t bucket_mask;
+    size_t count;
+    size_t original_bytes;
+    size_t compressed_bytes;
+    size_t max_bytes;
+    int level;
+};
+
+// FNV-1a, as the file cache hashes its paths
+static uint64_t hash_path(const char *path, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)path[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Reads a whole file; NULL on failure
+static char *read_file(int fd, size_t size)
+{
+    char *data = malloc(size ? size : 1);
+    size_t done = 0;
+    while (data && done < size)
+    {
+        ssize_t got = read(fd, data + done, size - done);
+        if (got == -1 && errno == EINTR)
+            continue;
+        if (got <= 0)
+        {
+            free(data);
+            return NULL;
+        }
+        done += got;
+    }
+    return data;
+}
+
+// Doubles the hash table, keeping chains about one entry long
+static void grow_buckets(StaticVariants *variants)
+{
+    size_t mask = variants->bucket_mask * 2 + 1;
+    StaticVariant **buckets = calloc(mask + 1, sizeof(StaticVariant *));
+    for (size_t i = 0; i <= variants->bucket_mask; i++)
+    {
+        StaticVariant *variant = variants->buckets[i];
+        while (variant)
+        {
+            StaticVariant *next = variant->next;
+            variant->next = buckets[variant->hash & mask];
+            buckets[variant->hash & mask] = variant;
+            variant = next;
+        }
+    }
+    free(variants->buckets);
+    variants->buckets = buckets;
+    variants->bucket_mask = mask;
+}
+
+static void add_file(StaticVariants *variants, int directory_fd, const char *name, const char *path,
+                     size_t path_length)
+{
+    int fd = openat(directory_fd, name, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1)
+        return;
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= COMPRESS_MIN_LENGTH &&
+        st.st_size <= MAX_STATIC_FILE)
+        data = read_file(fd, st.st_size);
+    close(fd);
+    if (!data)
+        return;
+
+    StaticVariant *variant = calloc(1, sizeof(StaticVariant));
+    for (int encoding = ENCODING_GZIP; encoding < ENCODINGS; encoding++)
+    {
+        CompressedBody *body = &variant->bodies[encoding];
+        body->data = compress_buffer(encoding, variants->level, data, st.st_size, &body->length);
+        if (body->data && variants->compressed_bytes + body->length <= variants->max_bytes)
+        {
+            variants->compressed_bytes += body->length;
+        }
+        else
+        {
+            free(body->data);
+            body->data = NULL;
+        }
+    }
+    free(data);
+    if (!variant->bodies[ENCODING_GZIP].data && !variant->bodies[ENCODING_DEFLATE].data)
+    {
+        free(variant);
+        return;
+    }
+
+    variant->path = strndup(path, path_length);
+    variant->path_length = path_length;
+    variant->hash = hash_path(path, path_length);
+    variant->device = st.st_dev;
+    variant->inode = st.st_ino;
+    variant->size = st.st_size;
+    variant->mtime = st.st_mtime;
+    if (variants->count > variants->bucket_mask)
+        grow_buckets(variants);
+    StaticVariant **bucket = &variants->buckets[variant->hash & variants->bucket_mask];
+    variant->next = *bucket;
+    *bucket = variant;
+    variants->count++;
+    variants->original_bytes += st.st_size;
+}
+
+// Adds the files below the directory open as directory_fd, whose path
+// relative to the root is path[0..length). Hidden entries are skipped, as
+// the file cache refuses "." segments anyway.
+static void add_directory(StaticVariants *variants, int directory_fd, char *path, size_t length)
+{
+    DIR *directory = fdopendir(directory_fd);
+    if (!directory)
+    {
+        close(directory_fd);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(directory)) && variants->compressed_bytes < variants->max_bytes)
+    {
+        size_t name_length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || length + name_length + 2 > MAX_PATH_LENGTH)
+            continue;
+        size_t entry_length = length;
+        if (length > 0)
+            path[entry_length++] = '/';
+        memcpy(path + entry_length, entry->d_name, name_length + 1);
+        entry_length += name_length;
+
+        if (entry->d_type == DT_DIR)
+        {
+            int fd = openat(dirfd(directory), entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+            if (fd != -1)
+                add_directory(variants, fd, path, entry_length);
+        }
+        else if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) &&
+                 compress_type_allowed(file_content_type(entry->d_name)))
+        {
+            add_file(variants, dirfd(directory), entry->d_name, path, entry_length);
+        }
+    }
+    closedir(directory);
+}
+
+StaticVariants *static_variants_build(const char *root, int level, size_t max_bytes)
+{
+    int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd == -1)
+        return NULL;
+    StaticVariants *variants = calloc(1, sizeof(StaticVariants));
+    variants->bucket_mask = 63;
+    variants->buckets = calloc(variants->bucket_mask + 1, sizeof(StaticVariant *));
+    variants->max_bytes = max_bytes;
+    variants->level = level;
+
+    char path[MAX_PATH_LENGTH];
+    add_directory(variants, root_fd, path, 0);
+    return variants;
+}
+
+void static_variants_free(StaticVariants *variants)
+{
+    if (!variants)
+        return;
+    for (size_t i = 0; i <= variants->bucket_mask; i++)
+    {
+        StaticVariant *variant = variants->buckets[i];
+        while (variant)
+        {
+            StaticVariant *next = variant->next;
+            for (int encoding = 0; encoding < ENCODINGS; encoding++)
+                free(variant->bodies[encoding].data);
+            free(variant->path);
+            free(variant);
+            variant = next;
+        }
+    }
+    free(variants->buckets);
+    free(variants);
+}
+
+void static_variants_stats(const StaticVariants *variants, size_t *files, size_t *original, size_t *compressed)
+{
+    *files = variants->count;
+    *original = variants->original_bytes;
+    *compressed = variants->compressed_bytes;
+}
+
+const CompressedBody *static_variants_find(const StaticVariants *variants, const CachedFile *file)
+{
+    if (!variants)
+        return NULL;
+    uint64_t hash = hash_path(file->path, file->path_length);
+    const StaticVariant *variant = variants->buckets[hash & variants->bucket_mask];
+    while (variant && (variant->hash != hash || variant->path_length != file->path_length ||
+                       memcmp(variant->path, file->path, file->path_length) != 0))
+        variant = variant->next;
+
+    // The file must still be the one that was compressed
+    if (!variant || variant->inode != file->inode || variant->device != file->device ||
+        variant->size != file->size || variant->mtime != file->mtime)
+        return NULL;
+    return variant->bodies;
+}
@@ -0,0 +1,89 @@
+// Response compression.
+//
+// compress_negotiate picks a Content-Encoding from a request's
+// Accept-Encoding header. A Compressor encodes one response body at a time
+// as gzip or deflate (the zlib format): its zlib streams are set up once
+// per worker and only reset between bodies, which spares every response
+// the quarter megabyte deflateInit allocates and clears. Output goes into
+// a buffer of deflateBound's size taken from the caller's arena, so the
+// compressed body can be queued on a ResponseBuilder by reference.
+//
+// Bodies that never change are compressed once instead: compress_buffer
+// for prebuilt responses, StaticVariants for the files below the static
+// root. Both are built at startup and shared read-only by all workers.
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "file_cache.h"
+#include "http_parser.h"
+
+#define COMPRESS_MIN_LENGTH 256 // Smaller bodies are sent as they are
+#define COMPRESS_STAGE_SIZE 4096 // Small writes are collected up to this before deflate()
+#define COMPRESS_BEST 9 // zlib level for bodies compressed once, at startup
+
+typedef enum
+{
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_DEFLATE,
+    ENCODINGS
+} Encoding;
+
+extern const char *const encoding_names[ENCODINGS]; // "identity", "gzip", "deflate"
+
+// The coding to answer with, given the value of Accept-Encoding. gzip wins
+// ties; identity is the answer when nothing else has a nonzero q-value.
+Encoding compress_negotiate(HttpSlice accept_encoding);
+
+// True for text-like Content-Types worth compressing
+int compress_type_allowed(const char *content_type);
+
+typedef struct Compressor Compressor;
+
+// level is zlib's, 1 (fastest) to 9 (smallest). Returns NULL without memory.
+Compressor *compressor_create(int level);
+void compressor_free(Compressor *compressor);
+
+// Starts a body that will be at most length bytes. Returns 0, or -1 if the
+// encoder or the output buffer cannot be allocated.
+int compressor_begin(Compressor *compressor, Encoding encoding, size_t length, Arena *arena);
+
+// Adds body bytes. Has the signature of a JSONWriter.
+void compressor_write(void *compressor, const char *data, size_t length);
+
+// Ends the body. Returns the encoded bytes, which live in the arena, and
+// sets *length; NULL if more was written than compressor_begin allowed.
+const char *compressor_finish(Compressor *compressor, size_t *length);
+
+// Compresses data in one call into malloc'd memory. Returns NULL if the
+// result would not be smaller.
+char *compress_buffer(Encoding encoding, int level, const void *data, size_t length,
+                      size_t *compressed_length);
+
+// An encoded form of a file
+typedef struct
+{
+    char *data;
+    size_t length;
+} CompressedBody;
+
+typedef struct StaticVariants StaticVariants;
+
+// Compresses every regular file below root whose type compress_type_allowed
+// takes, until max_bytes of output are held. Files that do not shrink are
+// left out. Returns NULL if root cannot be read.
+StaticVariants *static_variants_build(const char *root, int level, size_t max_bytes);
+void static_variants_free(StaticVariants *variants);
+
+// Files and bytes (before, after, over all encodings) held
+void static_variants_stats(const StaticVariants *variants, size_t *files, size_t *original, size_t *compressed);
+
+// The encoded forms of file, indexed by Encoding with a NULL data where
+// that coding did not pay. NULL if there are none or the file has changed
+// since the variants were built.
+const CompressedBody *static_variants_find(const StaticVariants *variants, const CachedFile *file);
+
+#endif
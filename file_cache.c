@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_cache.h"
+
+#define MAX_PATH_LENGTH 1024
+
+struct FileCache
+{
+    int root_fd;
+    int capacity;
+    int count;
+    int revalidate_seconds;
+    CachedFile **buckets;
+    size_t bucket_mask;
+    CachedFile *lru_head, *lru_tail; // Most recently used first
+};
+
+static const struct
+{
+    const char *extension;
+    const char *type;
+} content_types[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css"},
+    {"js", "application/javascript"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"ico", "image/x-icon"},
+    {"webp", "image/webp"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+};
+
+const char *file_content_type(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    if (dot && !strchr(dot, '/'))
+    {
+        for (size_t i = 0; i < sizeof(content_types) / sizeof(content_types[0]); i++)
+        {
+            if (strcasecmp(dot + 1, content_types[i].extension) == 0)
+                return content_types[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Largest off_t, which a position too long to represent saturates to
+#define OFF_LIMIT ((off_t)((1ULL << (sizeof(off_t) * 8 - 1)) - 1))
+
+// Reads the digits at p into *value and returns the first byte after them
+static const char *parse_position(const char *p, const char *end, off_t *value)
+{
+    off_t v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        v = v > (OFF_LIMIT - (*p - '0')) / 10 ? OFF_LIMIT : v * 10 + (*p - '0');
+    *value = v;
+    return p;
+}
+
+int file_parse_range(const char *value, size_t value_length, off_t size, off_t *start, off_t *length)
+{
+    const char *p = value;
+    const char *end = value + value_length;
+    if (value_length < 7 || memcmp(p, "bytes=", 6) != 0 || memchr(p, ',', value_length))
+        return 0;
+    p += 6;
+
+    // A position past OFF_LIMIT stays there: a first one is beyond any
+    // file, a last one or a suffix takes the rest of it
+    off_t first = -1, last = -1;
+    if (p < end && *p >= '0' && *p <= '9')
+        p = parse_position(p, end, &first);
+    if (p == end || *p++ != '-')
+        return 0;
+    if (p < end)
+    {
+        p = parse_position(p, end, &last);
+        if (p != end)
+            return 0;
+    }
+
+    if (first < 0)
+    {
+        // Suffix range: the final last bytes
+        if (last <= 0)
+            return last == 0 ? -1 : 0;
+        *length = last < size ? last : size;
+        *start = size - *length;
+        return size > 0 ? 1 : -1;
+    }
+    if (first >= size || (last >= 0 && last < first))
+        return -1;
+    if (last < 0 || last >= size)
+        last = size - 1;
+    *start = first;
+    *length = last - first + 1;
+    return 1;
+}
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec;
+}
+
+// FNV-1a
+static uint64_t hash_path(const char *path, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)path[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Percent-decodes a URL path into out and rejects anything that could leave
+// the root: empty or "."/".." segments, a leading '/', NUL bytes.
+static int decode_path(const char *path, size_t length, char *out, size_t *out_length)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = path[i];
+        if (c == '%')
+        {
+            int high = i + 2 < length ? hex_value(path[i + 1]) : -1;
+            int low = i + 2 < length ? hex_value(path[i + 2]) : -1;
+            if (high < 0 || low < 0)
+                return -1;
+            c = (char)(high * 16 + low);
+            i += 2;
+        }
+        if (c == '\0' || n + 1 >= MAX_PATH_LENGTH)
+            return -1;
+        out[n++] = c;
+    }
+    out[n] = '\0';
+
+    const char *segment = out;
+    while (1)
+    {
+        const char *slash = strchr(segment, '/');
+        size_t segment_length = slash ? (size_t)(slash - segment) : strlen(segment);
+        if (segment_length == 0 ||
+            (segment_length == 1 && segment[0] == '.') ||
+            (segment_length == 2 && segment[0] == '.' && segment[1] == '.'))
+            return -1;
+        if (!slash)
+            break;
+        segment = slash + 1;
+    }
+
+    *out_length = n;
+    return 0;
+}
+
+static void lru_unlink(FileCache *cache, CachedFile *file)
+{
+    if (file->lru_prev)
+        file->lru_prev->lru_next = file->lru_next;
+    else
+        cache->lru_head = file->lru_next;
+    if (file->lru_next)
+        file->lru_next->lru_prev = file->lru_prev;
+    else
+        cache->lru_tail = file->lru_prev;
+    file->lru_prev = file->lru_next = NULL;
+}
+
+static void lru_push_front(FileCache *cache, CachedFile *file)
+{
+    file->lru_prev = NULL;
+    file->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = file;
+    else
+        cache->lru_tail = file;
+    cache->lru_head = file;
+}
+
+static void destroy_file(CachedFile *file)
+{
+    close(file->fd);
+    free(file->path);
+    free(file);
+}
+
+// Takes a file out of the cache. It is closed now, or by the last
+// file_cache_release if a response is still sending from it.
+static void evict(FileCache *cache, CachedFile *file)
+{
+    CachedFile **link = &cache->buckets[file->hash & cache->bucket_mask];
+    while (*link != file)
+        link = &(*link)->hash_next;
+    *link = file->hash_next;
+    lru_unlink(cache, file);
+    cache->count--;
+
+    file->cached = 0;
+    if (file->references == 0)
+        destroy_file(file);
+}
+
+FileCache *file_cache_create(const char *root, int capacity, int revalidate_seconds)
+{
+    int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd == -1)
+        return NULL;
+
+    FileCache *cache = calloc(1, sizeof(FileCache));
+    cache->root_fd = root_fd;
+    cache->capacity = capacity > 0 ? capacity : 1;
+    cache->revalidate_seconds = revalidate_seconds;
+
+    size_t buckets = 16;
+    while (buckets < (size_t)cache->capacity * 2)
+        buckets *= 2;
+    cache->buckets = calloc(buckets, sizeof(CachedFile *));
+    cache->bucket_mask = buckets - 1;
+    return cache;
+}
+
+void file_cache_free(FileCache *cache)
+{
+    if (!cache)
+        return;
+    while (cache->lru_head)
+        evict(cache, cache->lru_head);
+    free(cache->buckets);
+    close(cache->root_fd);
+    free(cache);
+}
+
+// Opens and stats a file that is not cached yet
+static CachedFile *load_file(FileCache *cache, const char *path, size_t length, uint64_t hash)
+{
+    // O_NONBLOCK keeps a FIFO in the asset tree from blocking the worker
+    int fd = openat(cache->root_fd, path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        close(fd);
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+        return NULL;
+    }
+
+    CachedFile *file = calloc(1, sizeof(CachedFile));
+    file->fd = fd;
+    file->size = st.st_size;
+    file->mtime = st.st_mtime;
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    snprintf(file->etag, sizeof(file->etag), "\"%lx-%lx\"",
+             (unsigned long)st.st_mtime, (unsigned long)st.st_size);
+    struct tm tm;
+    gmtime_r(&file->mtime, &tm);
+    strftime(file->last_modified, sizeof(file->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    file->content_type = file_content_type(path);
+    file->path = strndup(path, length);
+    file->path_length = length;
+    file->hash = hash;
+    file->checked_at = monotonic_seconds();
+    file->cached = 1;
+
+    if (cache->count == cache->capacity)
+        evict(cache, cache->lru_tail);
+    CachedFile **bucket = &cache->buckets[hash & cache->bucket_mask];
+    file->hash_next = *bucket;
+    *bucket = file;
+    lru_push_front(cache, file);
+    cache->count++;
+    return file;
+}
+
+CachedFile *file_cache_open(FileCache *cache, const char *url_path, size_t url_length)
+{
+    char path[MAX_PATH_LENGTH];
+    size_t length;
+    if (decode_path(url_path, url_length, path, &length) != 0)
+    {
+        errno = EACCES;
+        return NULL;
+    }
+
+    uint64_t hash = hash_path(path, length);
+    CachedFile *file = cache->buckets[hash & cache->bucket_mask];
+    while (file && (file->hash != hash || file->path_length != length || memcmp(file->path, path, length) != 0))
+        file = file->hash_next;
+
+    if (file)
+    {
+        // Step 1: Hit. Trust the metadata until it is due for a recheck.
+        time_t now = monotonic_seconds();
+        if (now - file->checked_at >= cache->revalidate_seconds)
+        {
+            struct stat st;
+            if (fstatat(cache->root_fd, path, &st, 0) == 0 && st.st_ino == file->inode &&
+                st.st_dev == file->device && st.st_size == file->size && st.st_mtime == file->mtime)
+            {
+                file->checked_at = now;
+            }
+            else
+            {
+                evict(cache, file); // Replaced, changed or gone: load it afresh
+                file = NULL;
+            }
+        }
+    }
+
+    if (file)
+    {
+        lru_unlink(cache, file);
+        lru_push_front(cache, file);
+    }
+    else
+    {
+        // Step 2: Miss. Open it and make room if the cache is full.
+        file = load_file(cache, path, length, hash);
+        if (!file)
+            return NULL;
+    }
+
+    file->references++;
+    return file;
+}
+
+void file_cache_release(CachedFile *file)
+{
+    if (--file->references == 0 && !file->cached)
+        destroy_file(file);
+}
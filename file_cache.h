@@ -0,0 +1,63 @@
+// Cache of open static files.
+//
+// Keeps up to capacity files open together with their stat metadata (size,
+// modification time, ETag, Last-Modified, Content-Type), evicting the least
+// recently used one when full. A hit costs a hash lookup: no open(), no
+// fstat(), no disk access at all until the entry is older than the
+// revalidation interval, when one stat() checks whether the file changed.
+//
+// A cache is not thread-safe; each worker owns one.
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef struct CachedFile
+{
+    int fd;
+    off_t size;
+    time_t mtime;
+    char etag[48];          // Quoted strong validator built from mtime and size
+    char last_modified[40]; // HTTP-date of mtime
+    const char *content_type;
+
+    // Bookkeeping, private to the cache
+    char *path;
+    size_t path_length;
+    uint64_t hash;
+    dev_t device;
+    ino_t inode;
+    time_t checked_at;
+    int references;
+    int cached; // Cleared on eviction; the last release then closes the file
+    struct CachedFile *hash_next;
+    struct CachedFile *lru_prev, *lru_next;
+} CachedFile;
+
+typedef struct FileCache FileCache;
+
+// Serves files below root. Returns NULL if root cannot be opened.
+FileCache *file_cache_create(const char *root, int capacity, int revalidate_seconds);
+void file_cache_free(FileCache *cache);
+
+// Looks up a URL path relative to root (percent-encoded, no leading '/').
+// Paths with "." or ".." segments are refused. Returns a referenced entry
+// for a regular file, or NULL with errno set (ENOENT, EACCES, EISDIR, ...).
+CachedFile *file_cache_open(FileCache *cache, const char *path, size_t length);
+
+// Drops a reference taken by file_cache_open
+void file_cache_release(CachedFile *file);
+
+// Content-Type for a path, from its extension
+const char *file_content_type(const char *path);
+
+// Parses a Range header value for a file of size bytes: a single
+// "bytes=first-last", "bytes=first-" or "bytes=-suffix" range. Returns 1
+// with the range filled in, 0 to ignore the header (syntax not understood,
+// or several ranges) and -1 if it cannot be satisfied.
+int file_parse_range(const char *value, size_t value_length, off_t size, off_t *start, off_t *length);
+
+#endif
@@ -0,0 +1,478 @@
+#include <string.h>
+#include <strings.h>
+#include "http_parser.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_PARSER_X86 1
+#endif
+
+enum
+{
+    PARSE_REQUEST_LINE,
+    PARSE_HEADERS
+};
+
+// HttpBody.state
+enum
+{
+    BODY_DONE,
+    BODY_LENGTH,      // Content-Length bytes
+    CHUNK_SIZE,       // Hex digits of a chunk size
+    CHUNK_EXTENSION,  // ";name=value" after the size, skipped
+    CHUNK_SIZE_LF,
+    CHUNK_DATA,
+    CHUNK_DATA_CR,    // CRLF after the chunk data
+    CHUNK_DATA_LF,
+    TRAILER_START,    // Start of a trailer field or the final CRLF
+    TRAILER_LINE,
+    TRAILER_LF,
+    FINAL_LF
+};
+
+// Bytes that end a scan: every control character (CR and LF among them) and
+// DEL. Printable text in a request line or header is skipped in bulk.
+static int is_special(unsigned char c)
+{
+    return c < 0x20 || c == 0x7f;
+}
+
+static const char *scan_scalar(const char *p, const char *end)
+{
+    while (p < end && !is_special((unsigned char)*p))
+        p++;
+    return p;
+}
+
+#ifdef HTTP_PARSER_X86
+// 16 bytes per step: c <= 0x1f is min(c, 0x1f) == c in unsigned arithmetic
+__attribute__((target("sse2"))) static const char *scan_sse2(const char *p, const char *end)
+{
+    const __m128i control = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+
+    while (end - p >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(bytes, control), bytes);
+        __m128i hit = _mm_or_si128(low, _mm_cmpeq_epi8(bytes, del));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scan_scalar(p, end);
+}
+
+// Same test, 32 bytes per step. The 16-byte tail stays inside this function
+// so it is VEX-encoded too; calling the legacy-SSE scanner from here would pay
+// an AVX/SSE transition on every line.
+__attribute__((target("avx2"))) static const char *scan_avx2(const char *p, const char *end)
+{
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+
+    while (end - p >= 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+        __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, control), bytes);
+        __m256i hit = _mm256_or_si256(low, _mm256_cmpeq_epi8(bytes, del));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    if (end - p >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm256_castsi256_si128(control)), bytes);
+        __m128i hit = _mm_or_si128(low, _mm_cmpeq_epi8(bytes, _mm256_castsi256_si128(del)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scan_scalar(p, end);
+}
+#endif
+
+static const char *(*scan_special)(const char *, const char *) = scan_scalar;
+static const char *scan_isa = "scalar";
+
+// Picks the widest scanner the CPU supports before main() runs
+__attribute__((constructor)) static void select_scanner(void)
+{
+#ifdef HTTP_PARSER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_special = scan_avx2;
+        scan_isa = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        scan_special = scan_sse2;
+        scan_isa = "sse2";
+    }
+#endif
+}
+
+const char *http_parser_isa(void)
+{
+    return scan_isa;
+}
+
+void http_request_init(HttpRequest *request)
+{
+    request->header_count = 0;
+    request->minor_version = -1;
+    request->state = PARSE_REQUEST_LINE;
+    request->line_start = 0;
+    request->scanned = 0;
+}
+
+// Finds the end of the line starting at request->line_start. Returns the
+// offset of its LF, -1 if the line is not complete yet, -2 on a byte that is
+// not allowed in a request head. Header values may contain tabs.
+static long find_line_end(HttpRequest *request, const char *buffer, size_t length)
+{
+    const char *end = buffer + length;
+    const char *p = buffer + request->scanned;
+
+    while (1)
+    {
+        p = scan_special(p, end);
+        if (p == end)
+        {
+            request->scanned = length;
+            return -1;
+        }
+        if (*p == '\n')
+            return p - buffer;
+        if (*p == '\r')
+        {
+            if (p + 1 == end)
+            {
+                request->scanned = p - buffer; // Look at the CR again once the LF arrives
+                return -1;
+            }
+            if (p[1] != '\n')
+                return -2;
+            return p + 1 - buffer;
+        }
+        if (*p != '\t' || request->state == PARSE_REQUEST_LINE)
+            return -2;
+        p++;
+    }
+}
+
+static int parse_request_line(HttpRequest *request, const char *line, size_t length)
+{
+    const char *end = line + length;
+
+    const char *space = memchr(line, ' ', length);
+    if (!space || space == line)
+        return -1;
+    request->method.data = line;
+    request->method.length = space - line;
+
+    const char *path = space + 1;
+    space = memchr(path, ' ', end - path);
+    if (!space || space == path)
+        return -1;
+    request->path.data = path;
+    request->path.length = space - path;
+
+    const char *version = space + 1;
+    if (end - version != 8 || memcmp(version, "HTTP/1.", 7) != 0 ||
+        (version[7] != '0' && version[7] != '1'))
+        return -1;
+    request->version.data = version;
+    request->version.length = 8;
+    request->minor_version = version[7] - '0';
+    return 0;
+}
+
+static int parse_header_line(HttpRequest *request, const char *line, size_t length)
+{
+    // Folded continuation lines are obsolete; reject instead of guessing
+    if (line[0] == ' ' || line[0] == '\t')
+        return -1;
+    if (request->header_count == HTTP_MAX_HEADERS)
+        return -1;
+
+    const char *colon = memchr(line, ':', length);
+    if (!colon || colon == line)
+        return -1;
+    for (const char *p = line; p < colon; p++)
+    {
+        if (*p == ' ' || *p == '\t')
+            return -1; // No whitespace allowed between the name and the colon
+    }
+
+    const char *value = colon + 1;
+    const char *end = line + length;
+    while (value < end && (*value == ' ' || *value == '\t'))
+        value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+    HttpHeader *header = &request->headers[request->header_count++];
+    header->name.data = line;
+    header->name.length = colon - line;
+    header->value.data = value;
+    header->value.length = end - value;
+    return 0;
+}
+
+int http_parse_request(HttpRequest *request, const char *buffer, size_t length)
+{
+    while (1)
+    {
+        long newline = find_line_end(request, buffer, length);
+        if (newline == -1)
+            return HTTP_PARSE_INCOMPLETE;
+        if (newline == -2)
+            return HTTP_PARSE_ERROR;
+
+        const char *line = buffer + request->line_start;
+        size_t line_length = buffer + newline - line;
+        if (line_length > 0 && line[line_length - 1] == '\r')
+            line_length--;
+
+        request->line_start = newline + 1;
+        request->scanned = newline + 1;
+
+        if (request->state == PARSE_REQUEST_LINE)
+        {
+            // Tolerate stray blank lines before the request line (RFC 9112, 2.2)
+            if (line_length == 0)
+                continue;
+            if (parse_request_line(request, line, line_length) != 0)
+                return HTTP_PARSE_ERROR;
+            request->state = PARSE_HEADERS;
+        }
+        else if (line_length == 0)
+        {
+            return (int)request->line_start; // Blank line: the head is complete
+        }
+        else if (parse_header_line(request, line, line_length) != 0)
+        {
+            return HTTP_PARSE_ERROR;
+        }
+    }
+}
+
+int http_slice_equals(HttpSlice slice, const char *text)
+{
+    size_t length = strlen(text);
+    return slice.length == length && memcmp(slice.data, text, length) == 0;
+}
+
+int http_slice_equals_nocase(HttpSlice slice, const char *text)
+{
+    size_t length = strlen(text);
+    return slice.length == length && strncasecmp(slice.data, text, length) == 0;
+}
+
+const HttpHeader *http_find_header(const HttpRequest *request, const char *name)
+{
+    for (int i = 0; i < request->header_count; i++)
+    {
+        if (http_slice_equals_nocase(request->headers[i].name, name))
+            return &request->headers[i];
+    }
+    return NULL;
+}
+
+// Parses a Content-Length value: decimal digits only, no sign or spaces
+static int parse_content_length(HttpSlice value, uint64_t *length)
+{
+    if (value.length == 0)
+        return -1;
+    uint64_t result = 0;
+    for (size_t i = 0; i < value.length; i++)
+    {
+        char c = value.data[i];
+        if (c < '0' || c > '9' || result > (UINT64_MAX - 9) / 10)
+            return -1;
+        result = result * 10 + (c - '0');
+    }
+    *length = result;
+    return 0;
+}
+
+int http_body_init(HttpBody *body, const HttpRequest *request, uint64_t limit)
+{
+    body->state = BODY_DONE;
+    body->remaining = 0;
+    body->received = 0;
+    body->limit = limit;
+    body->digits = 0;
+
+    // Every framing header counts: a request that carries two of them is
+    // read one way by us and maybe another way by a proxy in front
+    const HttpHeader *content_length = NULL, *transfer_encoding = NULL;
+    for (int i = 0; i < request->header_count; i++)
+    {
+        const HttpHeader *header = &request->headers[i];
+        if (http_slice_equals_nocase(header->name, "Content-Length"))
+        {
+            if (content_length && !(content_length->value.length == header->value.length &&
+                                    memcmp(content_length->value.data, header->value.data,
+                                           header->value.length) == 0))
+                return HTTP_PARSE_ERROR;
+            content_length = header;
+        }
+        else if (http_slice_equals_nocase(header->name, "Transfer-Encoding"))
+        {
+            if (transfer_encoding)
+                return HTTP_PARSE_ERROR;
+            transfer_encoding = header;
+        }
+    }
+
+    if (transfer_encoding)
+    {
+        if (content_length || request->minor_version == 0)
+            return HTTP_PARSE_ERROR;
+        if (!http_slice_equals_nocase(transfer_encoding->value, "chunked"))
+            return HTTP_BODY_UNSUPPORTED;
+        body->state = CHUNK_SIZE;
+        return 0;
+    }
+    if (content_length)
+    {
+        if (parse_content_length(content_length->value, &body->remaining) != 0)
+            return HTTP_PARSE_ERROR;
+        if (body->remaining > limit)
+            return HTTP_BODY_TOO_LARGE;
+        if (body->remaining > 0)
+            body->state = BODY_LENGTH;
+    }
+    return 0;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+int http_body_decode(HttpBody *body, const char *data, size_t length, HttpSlice *chunk)
+{
+    const char *p = data;
+    const char *end = data + length;
+    chunk->data = data;
+    chunk->length = 0;
+
+    // Framing bytes go one at a time; data runs are handed back whole
+    while (p < end && body->state != BODY_DONE)
+    {
+        if (body->state == BODY_LENGTH || body->state == CHUNK_DATA)
+        {
+            size_t available = (size_t)(end - p);
+            size_t run = body->remaining < available ? (size_t)body->remaining : available;
+            chunk->data = p;
+            chunk->length = run;
+            body->remaining -= run;
+            body->received += run;
+            p += run;
+            if (body->remaining == 0)
+                body->state = body->state == BODY_LENGTH ? BODY_DONE : CHUNK_DATA_CR;
+            break;
+        }
+
+        char c = *p++;
+        switch (body->state)
+        {
+        case CHUNK_SIZE:
+        {
+            int digit = hex_value(c);
+            if (digit >= 0)
+            {
+                if (body->remaining > (UINT64_MAX >> 4))
+                    return HTTP_PARSE_ERROR;
+                body->remaining = body->remaining * 16 + digit;
+                body->digits++;
+                break;
+            }
+            if (body->digits == 0)
+                return HTTP_PARSE_ERROR;
+            if (c == ';' || c == ' ' || c == '\t')
+                body->state = CHUNK_EXTENSION;
+            else if (c == '\r')
+                body->state = CHUNK_SIZE_LF;
+            else
+                return HTTP_PARSE_ERROR;
+            break;
+        }
+        case CHUNK_EXTENSION:
+            if (c == '\r')
+                body->state = CHUNK_SIZE_LF;
+            else if (c == '\n')
+                return HTTP_PARSE_ERROR;
+            break;
+        case CHUNK_SIZE_LF:
+            if (c != '\n')
+                return HTTP_PARSE_ERROR;
+            if (body->remaining == 0)
+            {
+                body->state = TRAILER_START;
+                body->remaining = HTTP_MAX_TRAILERS;
+            }
+            else if (body->remaining > body->limit - body->received)
+            {
+                return HTTP_BODY_TOO_LARGE;
+            }
+            else
+            {
+                body->state = CHUNK_DATA;
+            }
+            break;
+        case CHUNK_DATA_CR:
+            if (c != '\r')
+                return HTTP_PARSE_ERROR;
+            body->state = CHUNK_DATA_LF;
+            break;
+        case CHUNK_DATA_LF:
+            if (c != '\n')
+                return HTTP_PARSE_ERROR;
+            body->state = CHUNK_SIZE;
+            body->digits = 0;
+            break;
+        case TRAILER_START:
+            body->state = c == '\r' ? FINAL_LF : TRAILER_LINE;
+            if (c == '\n')
+                return HTTP_PARSE_ERROR;
+            break;
+        case TRAILER_LINE:
+            if (--body->remaining == 0 || c == '\n')
+                return HTTP_PARSE_ERROR;
+            if (c == '\r')
+                body->state = TRAILER_LF;
+            break;
+        case TRAILER_LF:
+            if (c != '\n')
+                return HTTP_PARSE_ERROR;
+            body->state = TRAILER_START;
+            break;
+        case FINAL_LF:
+            if (c != '\n')
+                return HTTP_PARSE_ERROR;
+            body->state = BODY_DONE;
+            break;
+        }
+    }
+    return (int)(p - data);
+}
+
+int http_body_complete(const HttpBody *body)
+{
+    return body->state == BODY_DONE;
+}
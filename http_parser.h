@@ -0,0 +1,97 @@
+// Incremental, zero-copy HTTP/1.x request parser.
+//
+// The parser is fed the receive buffer every time more bytes arrive and
+// picks up where it stopped, so a request split across TCP segments costs
+// one pass over its bytes. Method, path, version and headers come back as
+// (pointer, length) views into that buffer; nothing is copied, so the buffer
+// must stay put until the request has been handled.
+
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_MAX_HEADERS 32
+#define HTTP_MAX_TRAILERS 4096 // Bytes of chunked trailer fields, which are skipped
+
+// Return values of http_parse_request besides a positive head length
+#define HTTP_PARSE_ERROR -1      // Malformed request (answer 400 and close)
+#define HTTP_PARSE_INCOMPLETE -2 // Need more bytes; call again with the longer buffer
+#define HTTP_BODY_TOO_LARGE -3   // Body over the limit (answer 413 and close)
+#define HTTP_BODY_UNSUPPORTED -4 // Transfer-Encoding other than chunked (answer 501)
+
+// A view into the receive buffer (not NUL-terminated)
+typedef struct
+{
+    const char *data;
+    size_t length;
+} HttpSlice;
+
+typedef struct
+{
+    HttpSlice name;
+    HttpSlice value; // Leading and trailing whitespace stripped
+} HttpHeader;
+
+typedef struct
+{
+    HttpSlice method;
+    HttpSlice path;
+    HttpSlice version; // "HTTP/1.0" or "HTTP/1.1"
+    int minor_version;
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    int header_count;
+
+    // Resume state, private to the parser
+    int state;
+    size_t line_start; // Offset of the first line not parsed yet
+    size_t scanned;    // Offset up to which that line has been searched for its end
+} HttpRequest;
+
+// Prepares a request for a fresh parse. Call again before reusing it, and
+// whenever the bytes it was fed have moved.
+void http_request_init(HttpRequest *request);
+
+// Parses the request head at the start of buffer. Returns the length of the
+// head (request line through the blank line) once it is complete, otherwise
+// HTTP_PARSE_INCOMPLETE or HTTP_PARSE_ERROR. Between INCOMPLETE calls the
+// buffer may only grow at the end.
+int http_parse_request(HttpRequest *request, const char *buffer, size_t length);
+
+// Returns the first header with this name (case-insensitive), or NULL
+const HttpHeader *http_find_header(const HttpRequest *request, const char *name);
+
+int http_slice_equals(HttpSlice slice, const char *text);
+int http_slice_equals_nocase(HttpSlice slice, const char *text);
+
+// Framing of a request body, decoded as its bytes arrive
+typedef struct
+{
+    int state;
+    uint64_t remaining; // Of the Content-Length body or current chunk; trailer bytes left
+    uint64_t received;  // Body bytes decoded so far
+    uint64_t limit;
+    int digits;         // Of the chunk size being read
+} HttpBody;
+
+// Works out how the body of a parsed request is framed: Content-Length,
+// chunked Transfer-Encoding, or none. Returns 0, HTTP_PARSE_ERROR for
+// malformed, repeated or conflicting framing headers, HTTP_BODY_UNSUPPORTED,
+// or HTTP_BODY_TOO_LARGE when the Content-Length is over limit bytes.
+int http_body_init(HttpBody *body, const HttpRequest *request, uint64_t limit);
+
+// Decodes the body bytes at the front of data and returns how many it
+// consumed, with *chunk set to the body bytes among them (a view into data,
+// possibly empty). Call again with the rest while it consumes anything and
+// the body is not complete. Returns HTTP_PARSE_ERROR for broken chunk
+// framing and HTTP_BODY_TOO_LARGE once a chunked body passes the limit.
+int http_body_decode(HttpBody *body, const char *data, size_t length, HttpSlice *chunk);
+
+// True once the whole body (and any chunked trailer) has been decoded
+int http_body_complete(const HttpBody *body);
+
+// Name of the delimiter scanner picked for this CPU ("avx2", "sse2", "scalar")
+const char *http_parser_isa(void);
+
+#endif
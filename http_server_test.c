@@ -1,101 +1,2278 @@
+// A small HTTP server driven by non-blocking, edge-triggered epoll reactors.
+// Each worker thread owns a SO_REUSEPORT listener and an event loop that
+// multiplexes its connections: every client is a little state machine (see
+// handle_client) that advances whenever epoll reports its socket readable or
+// writable, so a slow client never stalls the others. Connections are
+// persistent (HTTP/1.1 keep-alive) and pipelined requests are answered in
+// order with one batched write. With -e io_uring the same connection logic
+// runs from io_uring completions instead (uring_backend.c).
+//
+// SIGTERM and SIGINT drain the server: listeners close, responses say
+// "Connection: close" and the process exits once its connections are done
+// (or -D seconds pass). SIGHUP restarts it without dropping a connection:
+// a new copy of the binary is started, takes over the listening sockets
+// and serves new clients while this one drains.
+//
+// Build: gcc -O2 -pthread -o http_server_test http_server_test.c http_parser.c
+//        router.c response_builder.c file_cache.c uring_backend.c arena.c
+//        timer_wheel.c thread_pool.c metrics.c access_log.c json.c json_index.c
+//        json_number.c compress.c -lz
+
+#define _GNU_SOURCE
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <winsock2.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
-
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "access_log.h"
+#include "compress.h"
+#include "http_parser.h"
+#include "json.h"
+#include "router.h"
+#include "response_builder.h"
+#include "file_cache.h"
+#include "metrics.h"
+#include "server.h"
+#include "uring_backend.h"
 
 #define PORT 8080
-#define BUFFER_SIZE 4096
-
-void handle_client(SOCKET client_socket)
-{
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-
-    // Step 1: Receive the request
-    recv(client_socket, buffer, BUFFER_SIZE - 1, 0);
-    printf("Received request:\n%s\n", buffer);
-
-    // Step 2: Parse the request line
-    char method[16], path[256], protocol[16];
-    sscanf(buffer, "%s %s %s", method, path, protocol);
-    printf("Method: %s, Path: %s, Protocol: %s\n", method, path, protocol);
-
-    // Step 3: Extract headers
-    char *headers_start = strstr(buffer, "\r\n") + 2; // Start after request line
-    char *headers_end = strstr(buffer, "\r\n\r\n");   // End of headers
-    size_t headers_length = headers_end - headers_start;
-
-    char headers[BUFFER_SIZE];
-    strncpy(headers, headers_start, headers_length);
-    headers[headers_length] = '\0';
-    printf("Headers:\n%s\n", headers);
-
-    // Step 4: Respond dynamically based on path
-    if (strcmp(path, "/hello") == 0)
-    {
-        const char *response =
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/plain\r\n"
-            "\r\n"
-            "Hello, World!";
-        send(client_socket, response, strlen(response), 0);
-    }
-    else if (strcmp(path, "/time") == 0)
-    {
-        char response[BUFFER_SIZE];
-        time_t now = time(NULL);
-        snprintf(response, sizeof(response),
-                 "HTTP/1.1 200 OK\r\n"
-                 "Content-Type: text/plain\r\n"
-                 "\r\n"
-                 "Current time: %s",
-                 ctime(&now));
-        send(client_socket, response, strlen(response), 0);
+#define MAX_EVENTS 1024
+#define DEFAULT_BACKLOG SOMAXCONN
+#define DEFAULT_HEADER_TIMEOUT 10
+#define DEFAULT_BODY_TIMEOUT 30
+#define DEFAULT_KEEPALIVE_TIMEOUT 5
+#define DEFAULT_WRITE_TIMEOUT 30
+#define DEFAULT_OPEN_FILE_CACHE 1024
+#define FILE_REVALIDATE_SECONDS 2
+#define POOLED_CHUNKS 1024      // Idle arena chunks each worker keeps (16 MB)
+#define POOLED_CONNECTIONS 4096 // Closed connection structs each worker keeps
+#define DEFAULT_POOL_THREADS 4
+#define DEFAULT_POOL_QUEUE 1024
+#define CHECKSUM_READ_SIZE 65536
+#define DEFAULT_MAX_BODY (1024 * 1024)
+#define DEFAULT_COMPRESSION_LEVEL 6
+#define STATIC_VARIANTS_MAX (64 << 20) // Compressed static file bytes kept in memory
+#define ACCESS_LOG_RING 16384 // Records each worker can have waiting for the log thread
+#define DEFAULT_DRAIN_SECONDS 30
+#define HANDOFF_ENV "HTTP_SERVER_HANDOFF_FD" // Hot restart: the new process's end of the channel
+#define HANDOFF_TIMEOUT_MS 30000 // For the new process to get its workers running
+#define MAX_HANDOFF_SOCKETS 253  // File descriptors one SCM_RIGHTS message can carry
+
+ServerConfig config = {PORT, 0, DEFAULT_BACKLOG, 1,
+                       {DEFAULT_HEADER_TIMEOUT, DEFAULT_BODY_TIMEOUT, DEFAULT_KEEPALIVE_TIMEOUT,
+                        DEFAULT_WRITE_TIMEOUT},
+                       NULL, DEFAULT_OPEN_FILE_CACHE, BACKEND_EPOLL, 0,
+                       DEFAULT_POOL_THREADS, DEFAULT_POOL_QUEUE, LOG_ALL, NULL, DEFAULT_MAX_BODY,
+                       DEFAULT_COMPRESSION_LEVEL, DEFAULT_DRAIN_SECONDS};
+
+const char *const timeout_names[TIMEOUT_KINDS] = {"header", "body", "idle", "write"};
+
+// Built in main() before the workers start, read-only afterwards
+static Router *router;
+
+// Every worker's metrics block, for /metrics; set up in main() like router
+static Metrics **metrics_blocks;
+static int metrics_count;
+
+// Runs offloaded handlers for every worker; NULL runs them inline
+static ThreadPool *thread_pool;
+
+// The worker whose loop runs on this thread, for handlers that offload
+static __thread Worker *current_worker;
+
+// Set by main() when the drain begins; drain_deadline (monotonic ns) is
+// written first and only read once draining is seen
+static int draining;
+static uint64_t drain_deadline;
+
+// What a hot restart executes: this binary, with the same arguments
+static char restart_path[PATH_MAX];
+static char **restart_argv;
+
+static uint64_t monotonic_ticks(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return ((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000) / TIMER_TICK_MS;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void arm_timer(Worker *worker, Connection *conn, TimeoutKind kind)
+{
+    conn->timer_kind = kind;
+    timer_arm(&worker->timers, &conn->timer,
+              monotonic_ticks() + (uint64_t)config.timeouts[kind] * 1000 / TIMER_TICK_MS);
+}
+
+void connection_update_timer(Worker *worker, Connection *conn, int sent)
+{
+    TimeoutKind kind;
+    if (conn->state == CONN_WAITING)
+    {
+        // The pool's latency is ours to answer for, not the client's
+        timer_cancel(&worker->timers, &conn->timer);
+        conn->timer_kind = TIMEOUT_NONE;
+        return;
     }
+    if (conn->state == CONN_WRITING)
+        kind = TIMEOUT_WRITE;
+    else if (conn->body_pending)
+        kind = TIMEOUT_BODY;
+    else if (conn->buffer_length > 0 || conn->timer_kind == TIMEOUT_HEADER)
+        kind = TIMEOUT_HEADER; // Only a finished request ends a header deadline
     else
+        kind = TIMEOUT_IDLE;
+
+    if (kind != conn->timer_kind || (sent && kind == TIMEOUT_WRITE) ||
+        (conn->body_progress && kind == TIMEOUT_BODY))
+        arm_timer(worker, conn, kind);
+    conn->body_progress = 0;
+}
+
+Connection *connection_open(Worker *worker, int fd)
+{
+    Connection *conn = object_pool_get(&worker->connections);
+    if (!conn)
+        return NULL;
+    arena_init(&conn->arena, &worker->arena_pool);
+    response_init(&conn->output, &conn->arena);
+    conn->fd = fd;
+    conn->state = CONN_READING;
+    conn->keep_alive = 1;
+    metrics_add(&worker->metrics->accepts, 1);
+    // The first request head is due within the header timeout, even if no
+    // byte of it ever arrives
+    timer_init(&conn->timer);
+    arm_timer(worker, conn, TIMEOUT_HEADER);
+    return conn;
+}
+
+void connection_close(Worker *worker, Connection *conn)
+{
+    BodyReader *reader = conn->body_reader;
+    if (reader)
+    {
+        // Closed with the body still arriving
+        conn->state = CONN_CLOSING;
+        conn->body_reader = NULL;
+        reader->end(reader, conn, 0);
+    }
+    timer_cancel(&worker->timers, &conn->timer);
+    connection_park(conn);
+    metrics_add(&worker->metrics->closes, 1);
+    object_pool_put(&worker->connections, conn);
+}
+
+int connection_prepare_read(Connection *conn)
+{
+    if (!conn->buffer)
     {
-        const char *response =
-            "HTTP/1.1 404 Not Found\r\n"
-            "Content-Type: text/plain\r\n"
-            "\r\n"
-            "Resource not found.";
-        send(client_socket, response, strlen(response), 0);
+        char *buffer = arena_alloc(&conn->arena, BUFFER_SIZE);
+        HttpRequest *request = arena_alloc(&conn->arena, sizeof(HttpRequest));
+        if (!buffer || !request)
+            return -1;
+        conn->buffer = buffer;
+        conn->buffer_length = 0;
+        conn->request = request;
+        http_request_init(conn->request);
     }
+    return 0;
+}
 
-    // Step 5: Close the client socket
-    closesocket(client_socket);
+void connection_park(Connection *conn)
+{
+    response_release(&conn->output);
+    conn->buffer = NULL;
+    conn->buffer_length = 0;
+    conn->request = NULL;
+    arena_reset(&conn->arena);
+}
+
+static void close_client(Worker *worker, Connection *conn)
+{
+    // Closing the descriptor also removes it from the epoll set
+    if (conn->fd != -1)
+    {
+        close(conn->fd);
+        worker->syscalls++;
+        conn->fd = -1;
+    }
+    if (conn->task)
+    {
+        // The pool still holds the request; the task's completion frees it
+        conn->state = CONN_CLOSING;
+        timer_cancel(&worker->timers, &conn->timer);
+        return;
+    }
+    connection_close(worker, conn);
 }
 
-int main()
+// A response serialized once: status line and fixed headers in head, then
+// for each connection disposition the rest of the bytes after the Date
+// header. Sending it queues three iovecs and formats nothing; the answer to
+// a HEAD request leaves off the last body_length bytes of the tail. Bodies
+// worth compressing also get an encoded twin per Content-Encoding.
+typedef struct PreparedResponse
 {
-    WSADATA wsa;
-    SOCKET server_socket, client_socket;
-    struct sockaddr_in server_addr, client_addr;
-    int addr_len = sizeof(client_addr);
+    char *head;
+    size_t head_length;
+    char *tail[2]; // [0]: "Connection: close", blank line, body; [1]: blank line, body
+    size_t tail_length[2];
+    size_t body_length; // Of the body that ends each tail
+    int status;         // Status code, for the metrics
+    struct PreparedResponse *encoded[ENCODINGS]; // NULL where the coding would not pay
+} PreparedResponse;
 
-    WSAStartup(MAKEWORD(2, 2), &wsa);
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+// Per-thread clock cache. The Date header and the /time response only change
+// once a second, so they are rebuilt when the worker loop sees a new second
+// rather than formatted for every request.
+typedef struct
+{
+    time_t second;
+    char date_header[64]; // "Date: Sat, 17 Oct 2026 15:31:59 GMT\r\n"
+    size_t date_header_length;
+    PreparedResponse time_response;
+} ClockCache;
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
-    bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr));
-    listen(server_socket, 3);
+static __thread ClockCache clock_cache;
 
-    printf("Server listening on port %d...\n", PORT);
+// This worker's open files under config.static_root
+static __thread FileCache *file_cache;
 
-    while (1)
+// This worker's zlib streams for dynamic bodies
+static __thread Compressor *compressor;
+
+// Compressed forms of the files under config.static_root, built in main()
+static StaticVariants *static_variants;
+
+// Responses that never change, built in main() and shared by all workers
+static PreparedResponse bad_request_response;
+static PreparedResponse hello_response;
+static PreparedResponse not_found_response;
+static PreparedResponse payload_too_large_response;
+static PreparedResponse not_implemented_response;
+static PreparedResponse out_of_memory_response;
+
+static void prepare_variant(PreparedResponse *response, const char *status, const char *headers,
+                            const char *body, size_t body_length)
+{
+    char head[256];
+    response->head_length = snprintf(head, sizeof(head),
+                                     "HTTP/1.1 %s\r\n"
+                                     "Content-Type: text/plain\r\n"
+                                     "Content-Length: %zu\r\n"
+                                     "%s",
+                                     status, body_length, headers);
+    response->status = atoi(status);
+    response->body_length = body_length;
+    response->head = malloc(response->head_length);
+    memcpy(response->head, head, response->head_length);
+
+    static const char *endings[2] = {"Connection: close\r\n\r\n", "\r\n"};
+    for (int keep_alive = 0; keep_alive < 2; keep_alive++)
+    {
+        size_t ending_length = strlen(endings[keep_alive]);
+        response->tail_length[keep_alive] = ending_length + body_length;
+        response->tail[keep_alive] = malloc(ending_length + body_length);
+        memcpy(response->tail[keep_alive], endings[keep_alive], ending_length);
+        memcpy(response->tail[keep_alive] + ending_length, body, body_length);
+    }
+}
+
+// Builds a response of body_length bytes of text, and its compressed forms
+// if compression is on and they come out smaller
+static void prepare_response(PreparedResponse *response, const char *status,
+                             const char *body, size_t body_length)
+{
+    memset(response->encoded, 0, sizeof(response->encoded));
+    int varies = 0;
+    for (int encoding = ENCODING_GZIP; encoding < ENCODINGS; encoding++)
+    {
+        size_t length;
+        char *compressed = config.compression_level > 0 && body_length >= COMPRESS_MIN_LENGTH
+                               ? compress_buffer(encoding, COMPRESS_BEST, body, body_length, &length)
+                               : NULL;
+        if (!compressed)
+            continue;
+        char headers[64];
+        snprintf(headers, sizeof(headers), "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n",
+                 encoding_names[encoding]);
+        response->encoded[encoding] = calloc(1, sizeof(PreparedResponse));
+        prepare_variant(response->encoded[encoding], status, headers, compressed, length);
+        free(compressed);
+        varies = 1;
+    }
+    prepare_variant(response, status, varies ? "Vary: Accept-Encoding\r\n" : "", body, body_length);
+}
+
+static void release_response(PreparedResponse *response)
+{
+    for (int encoding = 0; encoding < ENCODINGS; encoding++)
+    {
+        if (response->encoded[encoding])
+        {
+            release_response(response->encoded[encoding]);
+            free(response->encoded[encoding]);
+        }
+    }
+    free(response->head);
+    free(response->tail[0]);
+    free(response->tail[1]);
+    memset(response, 0, sizeof(*response));
+}
+
+// Rebuilds this thread's Date header and /time response if the wall-clock
+// second has moved on. Called once per loop iteration, not per request.
+static void refresh_clock(void)
+{
+    time_t now = time(NULL);
+    if (now == clock_cache.second)
+        return;
+    clock_cache.second = now;
+
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    clock_cache.date_header_length =
+        strftime(clock_cache.date_header, sizeof(clock_cache.date_header),
+                 "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+
+    char body[64], text[32];
+    int length = snprintf(body, sizeof(body), "Current time: %s", ctime_r(&now, text));
+    release_response(&clock_cache.time_response);
+    prepare_response(&clock_cache.time_response, "200 OK", body, length);
+}
+
+// Queues a prepared response, without its body if the request is HEAD. The
+// head and tail are referenced in place, so the response must outlive the
+// flush; the Date header is copied because the clock cache rewrites it every
+// second.
+static void send_prepared(Connection *conn, const PreparedResponse *response)
+{
+    if (response->encoded[conn->encoding])
+        response = response->encoded[conn->encoding];
+    int keep_alive = conn->keep_alive != 0;
+    size_t tail_length = response->tail_length[keep_alive] - (conn->head_only ? response->body_length : 0);
+    conn->status = response->status;
+    response_add(&conn->output, response->head, response->head_length);
+    response_add_copy(&conn->output, clock_cache.date_header, clock_cache.date_header_length);
+    response_add(&conn->output, response->tail[keep_alive], tail_length);
+}
+
+// Same as send_prepared, copying everything, for responses that may be
+// rebuilt before a partial write resumes
+static void send_prepared_copy(Connection *conn, const PreparedResponse *response)
+{
+    if (response->encoded[conn->encoding])
+        response = response->encoded[conn->encoding];
+    int keep_alive = conn->keep_alive != 0;
+    size_t tail_length = response->tail_length[keep_alive] - (conn->head_only ? response->body_length : 0);
+    conn->status = response->status;
+    response_add_copy(&conn->output, response->head, response->head_length);
+    response_add_copy(&conn->output, clock_cache.date_header, clock_cache.date_header_length);
+    response_add_copy(&conn->output, response->tail[keep_alive], tail_length);
+}
+
+// Answers a request its handler found no memory for and ends the
+// connection, which gives the arena back
+static void send_out_of_memory(Connection *conn)
+{
+    conn->keep_alive = 0;
+    send_prepared(conn, &out_of_memory_response);
+}
+
+// The coding for a dynamic body of up to length bytes of content_type:
+// what the client negotiated, if the body is worth compressing
+static Encoding body_encoding(const Connection *conn, const char *content_type, size_t length)
+{
+    if (conn->encoding == ENCODING_IDENTITY || length < COMPRESS_MIN_LENGTH ||
+        !compress_type_allowed(content_type))
+        return ENCODING_IDENTITY;
+    return conn->encoding;
+}
+
+// Queues the head of a response with a body of body_length bytes
+static void append_head(Connection *conn, const char *status, const char *content_type,
+                        size_t body_length, Encoding encoding)
+{
+    conn->status = atoi(status);
+    response_addf(&conn->output,
+                  "HTTP/1.1 %s\r\n"
+                  "Content-Type: %s\r\n"
+                  "Content-Length: %zu\r\n"
+                  "%s%s%s"
+                  "%.*s"
+                  "%s"
+                  "\r\n",
+                  status, content_type, body_length,
+                  encoding != ENCODING_IDENTITY ? "Content-Encoding: " : "",
+                  encoding != ENCODING_IDENTITY ? encoding_names[encoding] : "",
+                  encoding != ENCODING_IDENTITY ? "\r\nVary: Accept-Encoding\r\n" : "",
+                  (int)clock_cache.date_header_length, clock_cache.date_header,
+                  conn->keep_alive ? "" : "Connection: close\r\n");
+}
+
+// Queues a response whose body is only known now, compressed in the
+// connection's arena if the client takes it. The body is copied either way,
+// and left off for a HEAD request once its length is known.
+static void append_body(Connection *conn, const char *status, const char *content_type,
+                        const char *body, size_t body_length)
+{
+    Encoding encoding = body_encoding(conn, content_type, body_length);
+    if (encoding != ENCODING_IDENTITY && compressor_begin(compressor, encoding, body_length, &conn->arena) == 0)
+    {
+        size_t length;
+        compressor_write(compressor, body, body_length);
+        const char *compressed = compressor_finish(compressor, &length);
+        if (compressed)
+        {
+            append_head(conn, status, content_type, length, encoding);
+            if (!conn->head_only)
+                response_add(&conn->output, compressed, length);
+            return;
+        }
+    }
+    append_head(conn, status, content_type, body_length, ENCODING_IDENTITY);
+    if (!conn->head_only)
+        response_add_copy(&conn->output, body, body_length);
+}
+
+// Queues a text response whose body is only known now, such as one echoing
+// a route parameter. Constant responses should use send_prepared instead.
+static void append_response(Connection *conn, const char *status, const char *body, size_t body_length)
+{
+    append_body(conn, status, "text/plain", body, body_length);
+}
+
+// Answers a request for a path that takes other methods. The Allow header
+// differs from path to path, so this response is formatted, not prepared.
+static void send_method_not_allowed(Connection *conn, const RouteMatch *match)
+{
+    char allow[ROUTER_ALLOW_MAX];
+    route_allow(match, allow, sizeof(allow));
+    conn->status = 405;
+    response_addf(&conn->output,
+                  "HTTP/1.1 405 Method Not Allowed\r\n"
+                  "Content-Type: text/plain\r\n"
+                  "Content-Length: 19\r\n"
+                  "Allow: %s\r\n"
+                  "%.*s"
+                  "%s"
+                  "\r\n"
+                  "%s",
+                  allow, (int)clock_cache.date_header_length, clock_cache.date_header,
+                  conn->keep_alive ? "" : "Connection: close\r\n", conn->head_only ? "" : "Method not allowed.");
+}
+
+static void hello_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    (void)match;
+    send_prepared(conn, &hello_response);
+}
+
+static void hello_name_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    char body[256];
+    HttpSlice name = route_param(match, "name");
+    int length = snprintf(body, sizeof(body), "Hello, %.*s!", (int)name.length, name.data);
+    if (length >= (int)sizeof(body))
+        length = sizeof(body) - 1;
+    append_response(conn, "200 OK", body, length);
+}
+
+static void time_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    (void)match;
+    send_prepared_copy(conn, &clock_cache.time_response);
+}
+
+static void release_cached_file(void *file)
+{
+    file_cache_release(file);
+}
+
+// True if an If-None-Match list names etag (or is "*")
+static int etag_matches(HttpSlice list, const char *etag)
+{
+    size_t etag_length = strlen(etag);
+    const char *p = list.data;
+    const char *end = list.data + list.length;
+
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *start = p;
+        while (p < end && *p != ',')
+            p++;
+        const char *stop = p;
+        while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t'))
+            stop--;
+        if (stop - start >= 2 && start[0] == 'W' && start[1] == '/')
+            start += 2; // Weak comparison is what If-None-Match asks for
+        if ((stop - start == 1 && *start == '*') ||
+            ((size_t)(stop - start) == etag_length && memcmp(start, etag, etag_length) == 0))
+            return 1;
+    }
+    return 0;
+}
+
+// GET /static/*path: files under config.static_root, sent with
+// sendfile() from the worker's open-file cache
+static void static_file_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    HttpSlice path = route_param(match, "path");
+    CachedFile *file = file_cache_open(file_cache, path.data, path.length);
+    if (!file)
+    {
+        send_prepared(conn, &not_found_response);
+        return;
+    }
+
+    const char *connection = conn->keep_alive ? "" : "Connection: close\r\n";
+    const char *date = clock_cache.date_header;
+    int date_length = (int)clock_cache.date_header_length;
+
+    // Step 1: The compressed form built at startup, if the client takes
+    // it; a range is served from the file itself. The encoded body is
+    // another representation, so it gets an ETag of its own.
+    const HttpHeader *range = http_find_header(request, "Range");
+    const CompressedBody *bodies = static_variants_find(static_variants, file);
+    const CompressedBody *variant = bodies && !range && bodies[conn->encoding].data ? &bodies[conn->encoding] : NULL;
+    const char *vary = bodies ? "Vary: Accept-Encoding\r\n" : "";
+    char etag[sizeof(file->etag) + 16];
+    if (variant)
+        snprintf(etag, sizeof(etag), "%.*s-%s\"", (int)strlen(file->etag) - 1, file->etag,
+                 encoding_names[conn->encoding]);
+    else
+        strcpy(etag, file->etag);
+
+    // Step 2: Revalidation is answered from cached metadata alone
+    const HttpHeader *if_none_match = http_find_header(request, "If-None-Match");
+    if (if_none_match && etag_matches(if_none_match->value, etag))
     {
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
-        if (client_socket != INVALID_SOCKET)
+        response_addf(&conn->output,
+                      "HTTP/1.1 304 Not Modified\r\n"
+                      "ETag: %s\r\n"
+                      "%s%.*s%s\r\n",
+                      etag, vary, date_length, date, connection);
+        conn->status = 304;
+        file_cache_release(file);
+        return;
+    }
+
+    // Step 3: Byte ranges, unless If-Range names another version
+    off_t start = 0, length = file->size;
+    int partial = 0;
+    const HttpHeader *if_range = http_find_header(request, "If-Range");
+    if (range && (!if_range || http_slice_equals(if_range->value, file->etag)))
+    {
+        partial = file_parse_range(range->value.data, range->value.length, file->size, &start, &length);
+        if (partial < 0)
+        {
+            response_addf(&conn->output,
+                          "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                          "Content-Range: bytes */%lld\r\n"
+                          "Content-Length: 0\r\n"
+                          "%.*s%s\r\n",
+                          (long long)file->size, date_length, date, connection);
+            conn->status = 416;
+            file_cache_release(file);
+            return;
+        }
+    }
+
+    // Step 4: Headers from the cache entry, body straight from the page
+    // cache or from the shared compressed copy
+    response_addf(&conn->output,
+                  "HTTP/1.1 %s\r\n"
+                  "Content-Type: %s\r\n"
+                  "Content-Length: %lld\r\n",
+                  partial ? "206 Partial Content" : "200 OK",
+                  file->content_type, variant ? (long long)variant->length : (long long)length);
+    conn->status = partial ? 206 : 200;
+    if (partial)
+        response_addf(&conn->output, "Content-Range: bytes %lld-%lld/%lld\r\n",
+                      (long long)start, (long long)(start + length - 1), (long long)file->size);
+    if (variant)
+        response_addf(&conn->output, "Content-Encoding: %s\r\n", encoding_names[conn->encoding]);
+    response_addf(&conn->output,
+                  "ETag: %s\r\n"
+                  "Last-Modified: %s\r\n"
+                  "%s%s%.*s%s\r\n",
+                  etag, file->last_modified, variant ? "" : "Accept-Ranges: bytes\r\n", vary,
+                  date_length, date, connection);
+
+    if (conn->head_only)
+    {
+        file_cache_release(file);
+    }
+    else if (variant)
+    {
+        response_add(&conn->output, variant->data, variant->length);
+        file_cache_release(file);
+    }
+    else
+    {
+        response_add_file(&conn->output, file->fd, start, length, release_cached_file, file);
+    }
+}
+
+// GET /checksum/*path: FNV-1a hash of a file under config.static_root.
+// Reading a whole file blocks on the disk, so it runs on the thread pool.
+typedef struct
+{
+    OffloadTask base;
+    CachedFile *file; // Referenced until finish, which releases it
+    int fd;
+    off_t size;
+    HttpSlice path;
+    uint64_t hash;
+    int error;
+} ChecksumTask;
+
+static void checksum_run(PoolTask *pool_task)
+{
+    // The cache entry belongs to the worker; only the copied fd and size
+    // are used here, and pread() does not move a shared file offset
+    ChecksumTask *task = (ChecksumTask *)pool_task;
+    char data[CHECKSUM_READ_SIZE];
+    uint64_t hash = 14695981039346656037ULL;
+    off_t offset = 0;
+    while (offset < task->size)
+    {
+        ssize_t length = pread(task->fd, data, sizeof(data), offset);
+        if (length == -1 && errno == EINTR)
+            continue;
+        if (length <= 0)
+        {
+            task->error = 1;
+            return;
+        }
+        for (ssize_t i = 0; i < length; i++)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ULL;
+        }
+        offset += length;
+    }
+    task->hash = hash;
+}
+
+static void checksum_finish(OffloadTask *base, Connection *conn)
+{
+    ChecksumTask *task = (ChecksumTask *)base;
+    if (conn->state != CONN_CLOSING)
+    {
+        char body[256];
+        int length = snprintf(body, sizeof(body), "%016llx  %.*s\n", (unsigned long long)task->hash,
+                              (int)task->path.length, task->path.data);
+        if (length >= (int)sizeof(body))
+            length = sizeof(body) - 1;
+        if (task->error)
+            append_response(conn, "500 Internal Server Error", "Read error.", 11);
+        else
+            append_response(conn, "200 OK", body, length);
+    }
+    file_cache_release(task->file);
+}
+
+static void checksum_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    HttpSlice path = route_param(match, "path");
+    CachedFile *file = file_cache_open(file_cache, path.data, path.length);
+    if (!file)
+    {
+        send_prepared(conn, &not_found_response);
+        return;
+    }
+
+    ChecksumTask *task = arena_alloc(&conn->arena, sizeof(ChecksumTask));
+    if (!task)
+    {
+        file_cache_release(file);
+        send_out_of_memory(conn);
+        return;
+    }
+    memset(task, 0, sizeof(*task));
+    task->base.pool.run = checksum_run;
+    task->base.finish = checksum_finish;
+    task->file = file;
+    task->fd = file->fd;
+    task->size = file->size;
+    task->path = path;
+    offload_request(conn, &task->base);
+}
+
+// POST /upload: length and FNV-1a hash of the request body, computed as
+// it streams in, so a body of any size up to -B needs no more memory than
+// the receive buffer
+typedef struct
+{
+    BodyReader base;
+    uint64_t hash;
+    uint64_t length;
+} UploadReader;
+
+static void upload_data(BodyReader *base, Connection *conn, const char *data, size_t length)
+{
+    (void)conn;
+    UploadReader *reader = (UploadReader *)base;
+    uint64_t hash = reader->hash;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    reader->hash = hash;
+    reader->length += length;
+}
+
+static void upload_end(BodyReader *base, Connection *conn, int complete)
+{
+    UploadReader *reader = (UploadReader *)base;
+    if (!complete)
+        return;
+    char body[128];
+    int length = snprintf(body, sizeof(body), "%llu bytes, %016llx\n", (unsigned long long)reader->length,
+                          (unsigned long long)reader->hash);
+    append_response(conn, "200 OK", body, length);
+}
+
+static void upload_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    (void)match;
+    UploadReader *reader = arena_alloc(&conn->arena, sizeof(UploadReader));
+    if (!reader)
+    {
+        send_out_of_memory(conn);
+        return;
+    }
+    reader->base.data = upload_data;
+    reader->base.end = upload_end;
+    reader->hash = 14695981039346656037ULL;
+    reader->length = 0;
+    read_body(conn, &reader->base);
+}
+
+// JSON API: the body is collected in the connection's arena, parsed into a
+// tape document in the same arena and handed to the route's JsonApi, which
+// queues the response with send_json or send_document; either serializes
+// straight into conn->output. Nothing is freed; the arena reset after the
+// response takes it all.
+typedef void (*JsonApi)(Connection *conn, const JSONDocument *document);
+
+typedef struct
+{
+    BodyReader base;
+    JsonApi api;
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed; // The body outgrew what the arena could give; the rest is dropped
+} JsonReader;
+
+static void *json_arena_alloc(void *arena, size_t size)
+{
+    return arena_alloc(arena, size);
+}
+
+static void json_output(void *output, const char *data, size_t length)
+{
+    response_add_copy(output, data, length);
+}
+
+// A JSON response body: a tape document, or else a tree
+typedef struct
+{
+    const JSONDocument *document;
+    const JSONValue *value;
+} JsonBody;
+
+static void write_json_body(const JsonBody *body, JSONWriter write, void *context)
+{
+    if (body->document)
+        json_document_write(body->document, json_document_root(body->document), write, context);
+    else
+        json_write(body->value, write, context);
+}
+
+// Queues body as a JSON response with the given status. A compressed one
+// streams through the worker's compressor into an arena buffer whose size
+// the uncompressed length bounds.
+static void send_json_body(Connection *conn, const char *status, const JsonBody *body)
+{
+    size_t length = body->document ? json_document_write_length(body->document, json_document_root(body->document))
+                                   : json_write_length(body->value);
+    Encoding encoding = body_encoding(conn, "application/json", length);
+    if (encoding != ENCODING_IDENTITY && compressor_begin(compressor, encoding, length, &conn->arena) == 0)
+    {
+        size_t compressed_length;
+        write_json_body(body, compressor_write, compressor);
+        const char *compressed = compressor_finish(compressor, &compressed_length);
+        if (compressed)
+        {
+            append_head(conn, status, "application/json", compressed_length, encoding);
+            response_add(&conn->output, compressed, compressed_length);
+            return;
+        }
+    }
+    append_head(conn, status, "application/json", length, ENCODING_IDENTITY);
+    write_json_body(body, json_output, &conn->output);
+}
+
+static void send_json(Connection *conn, const char *status, const JSONValue *value)
+{
+    JsonBody body = {NULL, value};
+    send_json_body(conn, status, &body);
+}
+
+static void send_document(Connection *conn, const char *status, const JSONDocument *document)
+{
+    JsonBody body = {document, NULL};
+    send_json_body(conn, status, &body);
+}
+
+static void json_data(BodyReader *base, Connection *conn, const char *data, size_t length)
+{
+    JsonReader *reader = (JsonReader *)base;
+    if (reader->failed)
+        return;
+    if (reader->length + length + 1 > reader->capacity)
+    {
+        // Only a chunked body gets here more than once; a Content-Length
+        // one was given its full size up front
+        size_t capacity = reader->capacity ? reader->capacity : 4096;
+        while (capacity < reader->length + length + 1)
+            capacity *= 2;
+        char *grown = arena_alloc(&conn->arena, capacity);
+        if (!grown)
+        {
+            reader->failed = 1;
+            return;
+        }
+        memcpy(grown, reader->data, reader->length);
+        reader->data = grown;
+        reader->capacity = capacity;
+    }
+    memcpy(reader->data + reader->length, data, length);
+    reader->length += length;
+}
+
+static void json_end(BodyReader *base, Connection *conn, int complete)
+{
+    JsonReader *reader = (JsonReader *)base;
+    if (!complete)
+        return;
+    if (!reader->data)
+        json_data(base, conn, "", 0);
+    if (reader->failed)
+    {
+        send_out_of_memory(conn);
+        return;
+    }
+    reader->data[reader->length] = '\0';
+
+    JSONAllocator allocator = {json_arena_alloc, &conn->arena};
+    JSONParser parser = {&allocator, 0, {NULL, 0}};
+    JSONDocument document;
+    // The body is ours to overwrite: strings are decoded where they lie and
+    // the document points into it
+    if (json_parse_document_in_place(&parser, reader->data, reader->length, &document) != 0)
+    {
+        if (strcmp(parser.error.message, "Out of memory") == 0)
         {
-            handle_client(client_socket);
+            send_out_of_memory(conn);
+            return;
         }
+        JSONValue message = {.type = JSON_STRING, .string = (char *)parser.error.message};
+        JSONValue position = {.type = JSON_NUMBER, .kind = JSON_INT64, .integer = (int64_t)parser.error.position};
+        JSONObject second = {"position", &position, NULL};
+        JSONObject first = {"error", &message, &second};
+        JSONValue body = {.type = JSON_OBJECT, .object = &first};
+        send_json(conn, "400 Bad Request", &body);
+        return;
     }
+    reader->api(conn, &document);
+}
+
+static void json_api(Connection *conn, JsonApi api)
+{
+    JsonReader *reader = arena_alloc(&conn->arena, sizeof(JsonReader));
+    if (!reader)
+    {
+        send_out_of_memory(conn);
+        return;
+    }
+    reader->base.data = json_data;
+    reader->base.end = json_end;
+    reader->api = api;
+    reader->length = 0;
+    reader->failed = 0;
+    // A Content-Length body is collected in one allocation of exactly its size
+    reader->capacity = conn->body.remaining ? conn->body.remaining + 1 : 0;
+    reader->data = reader->capacity ? arena_alloc(&conn->arena, reader->capacity) : NULL;
+    if (reader->capacity && !reader->data)
+    {
+        send_out_of_memory(conn);
+        return;
+    }
+    read_body(conn, &reader->base);
+}
+
+// POST /api/echo: the document, reserialized
+static void echo_api(Connection *conn, const JSONDocument *document)
+{
+    send_document(conn, "200 OK", document);
+}
+
+typedef struct
+{
+    int64_t counts[JSON_NULL + 1];
+    double sum;
+    int64_t depth;
+} JsonStats;
+
+static void collect_stats(const JSONDocument *document, const JSONEntry *entry, JsonStats *stats, int depth)
+{
+    stats->counts[entry->type]++;
+    if (depth > stats->depth)
+        stats->depth = depth;
+    if (entry->type == JSON_NUMBER)
+        stats->sum += json_entry_number(entry);
+    else if (entry->type == JSON_OBJECT)
+        for (uint32_t i = 0; i < entry->length; i++)
+            collect_stats(document, json_entry_value(document, entry, i), stats, depth + 1);
+    else if (entry->type == JSON_ARRAY)
+        for (uint32_t i = 0; i < entry->length; i++)
+            collect_stats(document, json_entry_at(document, entry, i), stats, depth + 1);
+}
 
-    closesocket(server_socket);
-    WSACleanup();
+// POST /api/stats: how many values of each type the document holds, the
+// sum of its numbers and its nesting depth
+static void stats_api(Connection *conn, const JSONDocument *document)
+{
+    static const char *const names[] = {"objects", "arrays", "strings", "numbers", "booleans", "nulls", "sum", "depth"};
+    enum { FIELDS = sizeof(names) / sizeof(names[0]) };
+
+    JsonStats stats = {0};
+    collect_stats(document, json_document_root(document), &stats, 1);
+
+    JSONValue values[FIELDS];
+    JSONObject members[FIELDS];
+    JSONValue result = {.type = JSON_OBJECT, .object = members};
+    for (int i = 0; i < FIELDS; i++)
+    {
+        values[i].type = JSON_NUMBER;
+        values[i].kind = i == FIELDS - 2 ? JSON_DOUBLE : JSON_INT64;
+        if (i == FIELDS - 2)
+            values[i].number = stats.sum;
+        else
+            values[i].integer = i <= JSON_NULL ? stats.counts[i] : stats.depth;
+        members[i].key = (char *)names[i];
+        members[i].value = &values[i];
+        members[i].next = i + 1 < FIELDS ? &members[i + 1] : NULL;
+    }
+    send_json(conn, "200 OK", &result);
+}
+
+static void echo_api_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    (void)match;
+    json_api(conn, echo_api);
+}
+
+static void stats_api_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    (void)match;
+    json_api(conn, stats_api);
+}
+
+// GET /metrics: every worker's counters summed, in the Prometheus text
+// format. Only the scrape reads other workers' blocks; no lock is taken.
+static void metrics_handler(Connection *conn, const HttpRequest *request, const RouteMatch *match)
+{
+    (void)request;
+    (void)match;
+    size_t length;
+    char *text = metrics_format(metrics_blocks, metrics_count, router, &length);
+    if (!text)
+    {
+        append_response(conn, "500 Internal Server Error", "Out of memory.", 14);
+        return;
+    }
+    append_body(conn, "200 OK", "text/plain; version=0.0.4", text, length);
+    free(text);
+}
+
+// Queues the response to one parsed request behind any earlier pipelined ones.
+static void build_response(Connection *conn, const HttpRequest *request)
+{
+    // Step 1: Connection handling. HTTP/1.1 connections persist unless the
+    // client says otherwise; HTTP/1.0 ones only when the client asks.
+    // A draining server closes every connection after its next response.
+    const HttpHeader *connection = http_find_header(request, "Connection");
+    if (server_draining())
+        conn->keep_alive = 0;
+    else if (request->minor_version == 1)
+        conn->keep_alive = !connection || !http_slice_equals_nocase(connection->value, "close");
+    else
+        conn->keep_alive = connection && http_slice_equals_nocase(connection->value, "keep-alive");
+
+    // Step 2: The Content-Encoding the client takes, for handlers whose
+    // bodies are worth compressing
+    const HttpHeader *accept_encoding = http_find_header(request, "Accept-Encoding");
+    conn->encoding = config.compression_level > 0 && accept_encoding
+                         ? compress_negotiate(accept_encoding->value)
+                         : ENCODING_IDENTITY;
+
+    // Step 3: Dispatch on method and path. A HEAD request is answered with
+    // the headers its GET would get and no body.
+    conn->head_only = http_slice_equals(request->method, "HEAD");
+    RouteMatch match;
+    RouteResult result = router_lookup(router, request->method, request->path, &match);
+    conn->route = match.route;
+    if (result == ROUTE_FOUND)
+    {
+        match.handler(conn, request, &match);
+    }
+    else if (result == ROUTE_METHOD_NOT_ALLOWED)
+    {
+        send_method_not_allowed(conn, &match);
+    }
+    else
+    {
+        send_prepared(conn, &not_found_response);
+    }
+}
+
+// Copies as much of slice as fits into field; returns the length copied
+static uint8_t copy_field(char *field, size_t size, HttpSlice slice)
+{
+    size_t length = slice.length < size ? slice.length : size;
+    memcpy(field, slice.data, length);
+    return (uint8_t)length;
+}
+
+// Counts the request whose response conn just queued and, if the log level
+// asks for it, pushes its access log record. request is NULL when the
+// request could not be parsed.
+static void record_request(Worker *worker, Connection *conn, const HttpRequest *request, uint64_t now)
+{
+    uint64_t latency = now - conn->request_start;
+    metrics_record_request(worker->metrics, conn->route, conn->status, latency);
+
+    int level = __atomic_load_n(&config.access_log_level, __ATOMIC_RELAXED);
+    if (level == LOG_OFF || (level == LOG_ERRORS && conn->status < 400))
+        return;
+    LogRecord *record = access_log_reserve(worker->access_log);
+    if (!record)
+    {
+        metrics_add(&worker->metrics->log_drops, 1);
+        return;
+    }
+    record->start_ns = conn->request_start;
+    record->latency_ns = latency;
+    record->bytes = response_pending(&conn->output) - conn->response_start;
+    record->status = conn->status;
+    record->worker = worker->id;
+    record->method_length = 0;
+    record->path_length = 0;
+    record->path_truncated = 0;
+    if (request)
+    {
+        record->method_length = copy_field(record->method, LOG_METHOD_MAX, request->method);
+        record->path_length = copy_field(record->path, LOG_PATH_MAX, request->path);
+        record->path_truncated = request->path.length > LOG_PATH_MAX;
+    }
+    access_log_commit(worker->access_log);
+}
+
+void read_body(Connection *conn, BodyReader *reader)
+{
+    conn->body_reader = reader;
+}
+
+// Works out the framing of a parsed request's body. Returns 0, or the
+// parser's verdict on a body that cannot be read.
+static int start_body(Connection *conn, const HttpRequest *request)
+{
+    int result = http_body_init(&conn->body, request, config.max_body);
+    if (result != 0)
+        return result;
+    conn->body_pending = !http_body_complete(&conn->body);
+
+    // A client that waits for permission gets it before the handler runs,
+    // so the interim response stays ahead of the final one
+    const HttpHeader *expect = http_find_header(request, "Expect");
+    if (conn->body_pending && expect && http_slice_equals_nocase(expect->value, "100-continue"))
+        response_add(&conn->output, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+    return 0;
+}
+
+// Decodes the body bytes from *offset on, handing them to the request's
+// reader or dropping them. Returns 0 once the body is complete,
+// HTTP_PARSE_INCOMPLETE when it needs more bytes, or the decoder's error.
+static int receive_body(Connection *conn, size_t *offset)
+{
+    while (*offset < conn->buffer_length)
+    {
+        HttpSlice chunk;
+        int used = http_body_decode(&conn->body, conn->buffer + *offset, conn->buffer_length - *offset, &chunk);
+        if (used < 0)
+            return used;
+        *offset += used;
+        conn->body_progress = 1;
+        if (chunk.length > 0 && conn->body_reader)
+            conn->body_reader->data(conn->body_reader, conn, chunk.data, chunk.length);
+        if (http_body_complete(&conn->body))
+        {
+            conn->body_pending = 0;
+            return 0;
+        }
+    }
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+// Answers a request whose body cannot be read, unless its handler already
+// has, and ends the connection: where the next request starts is unknown.
+static void reject_body(Worker *worker, Connection *conn, int result)
+{
+    BodyReader *reader = conn->body_reader;
+    conn->body_pending = 0;
+    conn->keep_alive = 0;
+    if (reader)
+    {
+        conn->body_reader = NULL;
+        reader->end(reader, conn, 0);
+    }
+    if (result == HTTP_PARSE_ERROR)
+        metrics_add(&worker->metrics->parse_errors, 1);
+    if (conn->status != 0)
+        return;
+    if (result == HTTP_BODY_TOO_LARGE)
+        send_prepared(conn, &payload_too_large_response);
+    else if (result == HTTP_BODY_UNSUPPORTED)
+        send_prepared(conn, &not_implemented_response);
+    else
+        send_prepared(conn, &bad_request_response);
+}
+
+// Answers every complete request already in the buffer, in order, and keeps
+// whatever partial request follows them for the next read. While a body is
+// arriving, the bytes its reader has seen are dropped but its request's
+// head stays where it is, so the views into it stay valid.
+void process_requests(Worker *worker, Connection *conn)
+{
+    // Pipelined requests arrived together, so they share one timestamp
+    uint64_t now = monotonic_ns();
+
+    // Requests answered before an offloaded one, or the head of the request
+    // whose body is arriving, are still in the buffer
+    size_t offset = conn->consumed;
+    size_t head_end = offset;
+    if (offset > 0 && !conn->body_pending)
+    {
+        conn->consumed = 0;
+        http_request_init(conn->request);
+    }
+
+    while (connection_wants_input(conn))
+    {
+        if (!conn->body_pending)
+        {
+            int head_length = http_parse_request(conn->request, conn->buffer + offset,
+                                                 conn->buffer_length - offset);
+            if (head_length == HTTP_PARSE_INCOMPLETE)
+                break;
+            conn->request_start = now;
+            conn->route = -1;
+            conn->status = 0;
+            conn->encoding = ENCODING_IDENTITY;
+            conn->head_only = 0;
+            conn->response_start = response_pending(&conn->output);
+            if (head_length == HTTP_PARSE_ERROR)
+            {
+                conn->keep_alive = 0;
+                send_prepared(conn, &bad_request_response);
+                metrics_add(&worker->metrics->parse_errors, 1);
+                record_request(worker, conn, NULL, now);
+                break;
+            }
+
+            offset += head_length;
+            head_end = offset;
+            worker->requests++;
+            conn->timer_kind = TIMEOUT_NONE; // The next request gets a deadline of its own
+            int result = start_body(conn, conn->request);
+            if (result != 0)
+            {
+                reject_body(worker, conn, result);
+                record_request(worker, conn, conn->request, now);
+                break;
+            }
+            build_response(conn, conn->request);
+            if (conn->state == CONN_WAITING)
+            {
+                // The task reads the request in place, so the buffer stays as it
+                // is until offload_complete comes back here
+                conn->consumed = offset;
+                return;
+            }
+        }
+
+        if (conn->body_pending)
+        {
+            int result = receive_body(conn, &offset);
+            if (result == HTTP_PARSE_INCOMPLETE)
+                break;
+            conn->consumed = 0; // The head is answered along with its body
+            if (result != 0)
+            {
+                reject_body(worker, conn, result);
+                record_request(worker, conn, conn->request, monotonic_ns());
+                break;
+            }
+        }
+
+        // The whole request is in; a reader answers it now
+        BodyReader *reader = conn->body_reader;
+        if (reader)
+        {
+            conn->body_reader = NULL;
+            reader->end(reader, conn, 1);
+            if (conn->state == CONN_WAITING)
+            {
+                conn->consumed = offset;
+                return;
+            }
+        }
+        record_request(worker, conn, conn->request, monotonic_ns());
+        http_request_init(conn->request);
+    }
+
+    if (conn->body_pending)
+    {
+        // Only the part of the body not decoded yet moves, to just behind
+        // the head
+        memmove(conn->buffer + head_end, conn->buffer + offset, conn->buffer_length - offset);
+        conn->buffer_length -= offset - head_end;
+        conn->consumed = head_end;
+        offset = 0;
+    }
+    else if (!conn->keep_alive)
+    {
+        offset = conn->buffer_length; // Anything after "Connection: close" is ignored
+    }
+    if (offset > 0)
+    {
+        // The partial request moves to the front, so its parse starts over
+        memmove(conn->buffer, conn->buffer + offset, conn->buffer_length - offset);
+        conn->buffer_length -= offset;
+        http_request_init(conn->request);
+    }
+
+    // A batch missing a piece there was no memory for cannot go out
+    if (conn->output.failed)
+        conn->state = CONN_CLOSING;
+    else if (response_pending(&conn->output) > 0)
+        conn->state = CONN_WRITING;
+}
+
+static void offload_complete(PoolTask *pool_task)
+{
+    OffloadTask *task = (OffloadTask *)pool_task;
+    Connection *conn = task->conn;
+    Worker *worker = task->worker;
+
+    conn->task = NULL;
+    task->finish(task, conn);
+    if (conn->state != CONN_CLOSING)
+    {
+        if (!conn->body_pending)
+            record_request(worker, conn, conn->request, monotonic_ns());
+        // Answer the requests pipelined behind the offloaded one
+        conn->state = CONN_READING;
+        process_requests(worker, conn);
+    }
+    worker->resume(worker, conn);
+}
+
+void offload_request(Connection *conn, OffloadTask *task)
+{
+    Worker *worker = current_worker;
+    task->pool.complete = offload_complete;
+    task->worker = worker;
+    task->conn = conn;
+    if (!thread_pool)
+    {
+        task->pool.run(&task->pool);
+        task->finish(task, conn);
+        return;
+    }
+
+    conn->task = task;
+    conn->state = CONN_WAITING;
+    worker->offloaded++;
+    // Queue behind connections already blocked, so none of them starves
+    if (!worker->blocked && thread_pool_submit(thread_pool, &task->pool, &worker->completions) == 0)
+        return;
+
+    worker->blocked_requests++;
+    conn->blocked_next = NULL;
+    if (worker->blocked_tail)
+        worker->blocked_tail->blocked_next = conn;
+    else
+        worker->blocked = conn;
+    worker->blocked_tail = conn;
+}
+
+void worker_submit_blocked(Worker *worker)
+{
+    Connection *conn;
+    while ((conn = worker->blocked) != NULL)
+    {
+        if (conn->state != CONN_CLOSING &&
+            thread_pool_submit(thread_pool, &conn->task->pool, &worker->completions) == -1)
+            return; // Still full
+        worker->blocked = conn->blocked_next;
+        if (!worker->blocked)
+            worker->blocked_tail = NULL;
+        if (conn->state == CONN_CLOSING)
+            offload_complete(&conn->task->pool); // Never ran; finish cleans up
+    }
+}
+
+void worker_complete_tasks(Worker *worker)
+{
+    worker->syscalls++; // The eventfd read
+    completion_queue_drain(&worker->completions);
+    worker_submit_blocked(worker);
+}
+
+// Step 1: Receive requests. Edge-triggered epoll only reports new data once,
+// so keep reading until the socket would block or responses are waiting to go
+// out (handle_client comes back here once they are sent).
+static void read_request(Worker *worker, Connection *conn)
+{
+    if (connection_prepare_read(conn) != 0)
+    {
+        conn->state = CONN_CLOSING;
+        return;
+    }
+
+    while (conn->state == CONN_READING)
+    {
+        size_t space = BUFFER_SIZE - conn->buffer_length;
+        if (space == 0)
+        {
+            // Headers do not fit in the buffer; give up on this client
+            conn->state = CONN_CLOSING;
+            metrics_add(&worker->metrics->parse_errors, 1);
+            return;
+        }
+
+        ssize_t received = recv(conn->fd, conn->buffer + conn->buffer_length, space, 0);
+        worker->syscalls++;
+        if (received > 0)
+        {
+            conn->buffer_length += received;
+            metrics_add(&worker->metrics->bytes_in, received);
+            process_requests(worker, conn);
+        }
+        else if (received == 0)
+        {
+            conn->state = CONN_CLOSING; // Client hung up
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return; // Wait for the next EPOLLIN edge
+        }
+        else if (errno != EINTR)
+        {
+            conn->state = CONN_CLOSING;
+        }
+    }
+}
+
+// Sends the queued batch of responses, normally with a single sendmsg().
+// Returns whether any bytes went out.
+static int write_response(Worker *worker, Connection *conn)
+{
+    size_t pending = response_pending(&conn->output);
+    int result = response_flush(&conn->output, conn->fd);
+    worker->syscalls += response_take_syscalls(&conn->output);
+    metrics_add(&worker->metrics->bytes_out, pending - response_pending(&conn->output));
+    int sent = response_pending(&conn->output) < pending;
+
+    if (result == RESPONSE_ERROR)
+    {
+        conn->state = CONN_CLOSING;
+        return sent;
+    }
+    if (result == RESPONSE_PENDING)
+        return sent; // Resume from the same spot on the next EPOLLOUT edge
+
+    // Step 5: Batch fully sent; keep the connection for more requests or close it
+    response_reset(&conn->output);
+    conn->state = connection_wants_input(conn) ? CONN_READING : CONN_CLOSING;
+    return sent;
+}
+
+// Advances a connection's state machine for one batch of readiness events.
+static void handle_client(Worker *worker, Connection *conn, uint32_t events)
+{
+    if (events & (EPOLLERR | EPOLLHUP))
+        conn->state = CONN_CLOSING;
+
+    int readable = (events & (EPOLLIN | EPOLLRDHUP)) != 0;
+    int sent = 0;
+    while (1)
+    {
+        if (conn->state == CONN_READING && readable)
+            read_request(worker, conn);
+
+        if (conn->state != CONN_WRITING)
+            break;
+        sent |= write_response(worker, conn);
+        if (conn->state != CONN_READING)
+            break;
+
+        // Reading stopped while responses were pending, so requests that
+        // arrived meanwhile will not raise a new edge: look for them now.
+        readable = 1;
+    }
+
+    if (conn->state == CONN_CLOSING)
+    {
+        close_client(worker, conn);
+        return;
+    }
+    connection_update_timer(worker, conn, sent);
+    if (conn->state == CONN_READING && conn->buffer_length == 0)
+        connection_park(conn);
+}
+
+// Carries on after an offloaded request completed. Requests that arrived
+// meanwhile raised their EPOLLIN edge while the connection was not reading.
+static void resume_client(Worker *worker, Connection *conn)
+{
+    handle_client(worker, conn, EPOLLIN);
+}
+
+// Closes the connections whose deadlines have passed, all in one batch per
+// loop iteration
+void expire_connections(Worker *worker, void (*close_connection)(Worker *, Connection *))
+{
+    Timer expired;
+    timer_list_init(&expired);
+    timer_wheel_advance(&worker->timers, monotonic_ticks(), &expired);
+
+    Timer *timer;
+    while ((timer = timer_list_pop(&worker->timers, &expired)) != NULL)
+    {
+        Connection *conn = (Connection *)((char *)timer - offsetof(Connection, timer));
+        if (conn->timer_kind != TIMEOUT_NONE)
+            metrics_add(&worker->metrics->timeouts[conn->timer_kind], 1);
+        close_connection(worker, conn);
+    }
+}
+
+int worker_wait_ms(const Worker *worker)
+{
+    // Wake every tick while deadlines are pending, connections wait for
+    // room in the pool's queue or the server drains, else once a second
+    // for the clock
+    return worker->timers.count > 0 || worker->blocked || server_draining() ? TIMER_TICK_MS : 1000;
+}
+
+int server_draining(void)
+{
+    return __atomic_load_n(&draining, __ATOMIC_ACQUIRE);
+}
+
+int worker_drained(const Worker *worker)
+{
+    if (!server_draining())
+        return 0;
+    // Connections still open, counted in the worker's own metrics block
+    uint64_t open = worker->metrics->accepts - worker->metrics->closes;
+    return open == 0 || monotonic_ns() >= drain_deadline;
+}
+
+// Takes the listener out of the epoll set and closes this process's
+// descriptor for it. Clients still in its accept queue go to a process the
+// listeners were handed to; without one they are reset by the last close.
+static void stop_accepting(Worker *worker)
+{
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, worker->server_socket, NULL);
+    close(worker->server_socket);
+    worker->server_socket = -1;
+}
+
+static void accept_clients(Worker *worker)
+{
+    while (1)
+    {
+        int client_socket = accept4(worker->server_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        worker->syscalls++;
+        if (client_socket == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept");
+            return;
+        }
+
+        Connection *conn = connection_open(worker, client_socket);
+        if (!conn)
+        {
+            close(client_socket);
+            continue;
+        }
+
+        // Register for both directions once; with EPOLLET each direction only
+        // fires on a transition, so no epoll_ctl(MOD) is needed per request.
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        worker->syscalls++;
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1)
+        {
+            perror("epoll_ctl");
+            close_client(worker, conn);
+        }
+    }
+}
+
+// Lifts the open-file limit to its hard maximum so tens of thousands of
+// idle connections do not run into the default of 1024 descriptors.
+static void raise_file_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Creates one worker's listening socket. Every worker binds the same port
+// with SO_REUSEPORT and the kernel hashes incoming connections across them,
+// so there is no shared accept queue to contend on.
+static int open_listener(int port, int backlog)
+{
+    struct sockaddr_in server_addr;
+    int reuse = 1;
+
+    int server_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_socket == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1)
+    {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(server_socket);
+        return -1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1 ||
+        listen(server_socket, backlog) == -1)
+    {
+        perror("bind/listen");
+        close(server_socket);
+        return -1;
+    }
+    return server_socket;
+}
+
+void worker_start(Worker *worker, size_t connection_size)
+{
+    current_worker = worker;
+    timer_wheel_init(&worker->timers, monotonic_ticks());
+    arena_pool_init(&worker->arena_pool, ARENA_CHUNK_SIZE, POOLED_CHUNKS);
+    object_pool_init(&worker->connections, connection_size, POOLED_CONNECTIONS,
+                     &worker->arena_pool.stats);
+    if (worker->cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    refresh_clock();
+    if (config.static_root)
+        file_cache = file_cache_create(config.static_root, config.open_file_cache, FILE_REVALIDATE_SECONDS);
+    if (config.compression_level > 0)
+        compressor = compressor_create(config.compression_level);
+}
+
+void worker_tick(Worker *worker)
+{
+    time_t second = clock_cache.second;
+    refresh_clock();
+    if (config.print_stats && clock_cache.second != second)
+    {
+        ArenaStats *stats = &worker->arena_pool.stats;
+        unsigned long mallocs = stats->chunk_mallocs + stats->large_mallocs + stats->object_mallocs;
+        if (worker->requests > 0)
+            fprintf(stderr, "worker %d: %lu requests, %lu syscalls, %.2f syscalls/request, "
+                            "%lu mallocs, %lu chunks reused, %lu offloaded, %lu blocked\n",
+                    worker->id, worker->requests, worker->syscalls,
+                    (double)worker->syscalls / worker->requests, mallocs, stats->chunk_reuses,
+                    worker->offloaded, worker->blocked_requests);
+        worker->requests = 0;
+        worker->syscalls = 0;
+        worker->offloaded = 0;
+        worker->blocked_requests = 0;
+        memset(stats, 0, sizeof(*stats));
+
+        // The pool is shared, so one worker reports it
+        ThreadPoolStats pool;
+        if (thread_pool && worker->id == 0)
+        {
+            thread_pool_take_stats(thread_pool, &pool);
+            if (pool.submitted > 0 || pool.depth > 0)
+                fprintf(stderr, "pool: %zu queued, %lu submitted, %lu completed, "
+                                "wait %.2f ms average, %.2f ms max\n",
+                        pool.depth, pool.submitted, pool.completed,
+                        pool.started ? pool.wait_ns_total / 1e6 / pool.started : 0.0,
+                        pool.wait_ns_max / 1e6);
+        }
+    }
+}
+
+void worker_stop(Worker *worker)
+{
+    file_cache_free(file_cache);
+    file_cache = NULL;
+    compressor_free(compressor);
+    compressor = NULL;
+    object_pool_destroy(&worker->connections);
+    arena_pool_destroy(&worker->arena_pool);
+}
+
+// Event loop of one worker thread: its own listener, its own epoll set, and
+// only the connections that listener accepted.
+static void *worker_main(void *arg)
+{
+    Worker *worker = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    worker_start(worker, sizeof(Connection));
+    worker->resume = resume_client;
+    while (!worker_drained(worker))
+    {
+        if (worker->server_socket != -1 && server_draining())
+            stop_accepting(worker);
+
+        int count = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, worker_wait_ms(worker));
+        worker->syscalls++;
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        worker_tick(worker);
+
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.ptr == NULL)
+                accept_clients(worker);
+            else if (events[i].data.ptr == &worker->completions)
+                worker_complete_tasks(worker);
+            else
+                handle_client(worker, events[i].data.ptr, events[i].events);
+        }
+        if (worker->blocked)
+            worker_submit_blocked(worker);
+        expire_connections(worker, close_client);
+    }
+    worker_stop(worker);
+    return NULL;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-p port] [-w workers] [-b backlog] [-k seconds] [-t kind=seconds]\n"
+            "          [-d dir] [-c files] [-e epoll|io_uring] [-T threads] [-Q tasks]\n"
+            "          [-B bytes] [-z level] [-L off|errors|all] [-l file] [-D seconds] [-n] [-S]\n"
+            "  -p port     TCP port to listen on (default %d)\n"
+            "  -w workers  event loop threads, one listener each (default: online CPUs)\n"
+            "  -b backlog  listen() backlog per worker (default %d)\n"
+            "  -k seconds  keep-alive idle timeout (default %d)\n"
+            "  -t kind=seconds\n"
+            "              other deadlines: header (request head, default %d),\n"
+            "              body (request body, default %d), write (between two\n"
+            "              sends that make progress, default %d), idle (same as -k)\n"
+            "  -d dir      serve the files in dir under /static/\n"
+            "  -c files    open files cached per worker (default %d)\n"
+            "  -e backend  event loop: epoll (default) or io_uring, which falls back\n"
+            "              to epoll when the kernel does not support it\n"
+            "  -T threads  thread pool for blocking handlers such as /checksum/ (default %d,\n"
+            "              0 runs them on the event loops)\n"
+            "  -Q tasks    requests queued for the pool before connections that need it\n"
+            "              stop being read (default %d)\n"
+            "  -B bytes    largest request body accepted (default %d)\n"
+            "  -z level    gzip/deflate level for dynamic bodies, 1-9 (default %d); 0 turns\n"
+            "              compression off. Fixed bodies and the files under -d are\n"
+            "              compressed once at startup at level 9\n"
+            "  -L level    access log: off, errors (4xx and 5xx only) or all (default);\n"
+            "              SIGUSR1 switches to the next level while running\n"
+            "  -l file     append the access log to file instead of stdout\n"
+            "  -D seconds  on SIGTERM, SIGINT or SIGHUP, how long open connections may\n"
+            "              take to finish before the process exits (default %d)\n"
+            "  -n          do not pin workers to CPUs\n"
+            "  -S          print requests and syscalls per second for each worker\n",
+            program, PORT, DEFAULT_BACKLOG, DEFAULT_KEEPALIVE_TIMEOUT, DEFAULT_HEADER_TIMEOUT,
+            DEFAULT_BODY_TIMEOUT, DEFAULT_WRITE_TIMEOUT, DEFAULT_OPEN_FILE_CACHE,
+            DEFAULT_POOL_THREADS, DEFAULT_POOL_QUEUE, DEFAULT_MAX_BODY, DEFAULT_COMPRESSION_LEVEL,
+            DEFAULT_DRAIN_SECONDS);
+}
+
+// SIGUSR1: off -> errors -> all -> off. Workers read the level with a
+// relaxed load for every request, so the change shows up at once.
+static void cycle_log_level(int signal_number)
+{
+    (void)signal_number;
+    int level = __atomic_load_n(&config.access_log_level, __ATOMIC_RELAXED);
+    __atomic_store_n(&config.access_log_level, (level + 1) % LOG_LEVELS, __ATOMIC_RELAXED);
+}
+
+// Parses an access log level name into config.access_log_level. Returns 0,
+// or -1 if there is no such level.
+static int parse_log_level(const char *name)
+{
+    for (int level = 0; level < LOG_LEVELS; level++)
+    {
+        if (strcmp(name, log_level_names[level]) == 0)
+        {
+            config.access_log_level = level;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Parses "kind=seconds" into config.timeouts. Returns 0, or -1 if malformed.
+static int parse_timeout(const char *option)
+{
+    const char *equals = strchr(option, '=');
+    if (!equals || atoi(equals + 1) <= 0)
+        return -1;
+    for (int kind = 0; kind < TIMEOUT_KINDS; kind++)
+    {
+        if (strlen(timeout_names[kind]) == (size_t)(equals - option) &&
+            strncmp(option, timeout_names[kind], equals - option) == 0)
+        {
+            config.timeouts[kind] = atoi(equals + 1);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Space for the SCM_RIGHTS message of a hot restart, aligned for cmsghdr
+typedef union
+{
+    char buffer[CMSG_SPACE(MAX_HANDOFF_SOCKETS * sizeof(int))];
+    struct cmsghdr align;
+} HandoffControl;
+
+// Sends count listening sockets over channel, with their count as the data
+static int send_listeners(int channel, const int *sockets, int count)
+{
+    HandoffControl control;
+    memset(&control, 0, sizeof(control));
+    struct iovec data = {&count, sizeof(count)};
+    struct msghdr message = {0};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(count * sizeof(int));
+    memcpy(CMSG_DATA(header), sockets, count * sizeof(int));
+    if (sendmsg(channel, &message, MSG_NOSIGNAL) == -1)
+    {
+        perror("hot restart: sendmsg");
+        return -1;
+    }
+    return 0;
+}
+
+// Hot restart, new process: takes the listeners the old one sends. Returns
+// their number, or -1.
+static int receive_listeners(int channel, int *sockets)
+{
+    HandoffControl control;
+    int count = 0;
+    struct iovec data = {&count, sizeof(count)};
+    struct msghdr message = {0};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    ssize_t received;
+    do
+        received = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+    while (received == -1 && errno == EINTR);
+
+    struct cmsghdr *header = received == sizeof(count) ? CMSG_FIRSTHDR(&message) : NULL;
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+        (message.msg_flags & MSG_CTRUNC) || count <= 0 || count > MAX_HANDOFF_SOCKETS ||
+        header->cmsg_len != CMSG_LEN(count * sizeof(int)))
+    {
+        fprintf(stderr, "hot restart: no listening sockets received\n");
+        return -1;
+    }
+    memcpy(sockets, CMSG_DATA(header), count * sizeof(int));
+    return count;
+}
+
+// Waits for the new process to report its workers running. Returns 0, or
+// -1 if it exited or took longer than HANDOFF_TIMEOUT_MS.
+static int wait_for_successor(int channel)
+{
+    struct pollfd ready = {channel, POLLIN, 0};
+    char byte;
+    int result;
+    do
+        result = poll(&ready, 1, HANDOFF_TIMEOUT_MS);
+    while (result == -1 && errno == EINTR);
+    if (result == 1 && read(channel, &byte, 1) == 1)
+        return 0;
+    fprintf(stderr, "hot restart: the new process %s\n", result == 0 ? "did not start in time" : "exited");
+    return -1;
+}
+
+// Hot restart, old process: starts this binary again with the same
+// arguments and passes it the listening sockets over a Unix socket pair.
+// They are the very same sockets, so clients in their accept queues are
+// taken by whichever process accepts next and none is refused. Returns 0
+// once the new process serves, or -1, with it killed, if it never did.
+static int hand_off(const Worker *workers, int count)
+{
+    if (count > MAX_HANDOFF_SOCKETS)
+    {
+        fprintf(stderr, "hot restart: %d listeners, at most %d can be passed\n", count, MAX_HANDOFF_SOCKETS);
+        return -1;
+    }
+    int channel[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) == -1)
+    {
+        perror("hot restart: socketpair");
+        return -1;
+    }
+
+    // Step 1: Build the child's environment before fork(); between fork and
+    // exec a threaded process may only make async-signal-safe calls
+    char variable[64];
+    snprintf(variable, sizeof(variable), HANDOFF_ENV "=%d", channel[1]);
+    size_t variables = 0;
+    while (environ[variables])
+        variables++;
+    char **envp = malloc((variables + 2) * sizeof(char *));
+    memcpy(envp, environ, variables * sizeof(char *));
+    envp[variables] = variable;
+    envp[variables + 1] = NULL;
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+
+    // Step 2: The child keeps its end of the channel across exec and gets
+    // the signals main() blocks back
+    pid_t child = fork();
+    if (child == 0)
+    {
+        fcntl(channel[1], F_SETFD, 0);
+        pthread_sigmask(SIG_SETMASK, &no_signals, NULL);
+        execve(restart_path, restart_argv, envp);
+        _exit(127);
+    }
+    free(envp);
+    close(channel[1]);
+    if (child == -1)
+    {
+        perror("hot restart: fork");
+        close(channel[0]);
+        return -1;
+    }
+
+    // Step 3: Pass the listeners and wait until the new workers run
+    int sockets[MAX_HANDOFF_SOCKETS];
+    for (int i = 0; i < count; i++)
+        sockets[i] = workers[i].server_socket;
+    int result = send_listeners(channel[0], sockets, count);
+    if (result == 0)
+        result = wait_for_successor(channel[0]);
+    close(channel[0]);
+    if (result == -1)
+    {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+        return -1;
+    }
+    printf("Handed %d listener(s) to process %d\n", count, (int)child);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int cpu_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int option;
+
+    // A hot restart runs the binary this process was started from; a bare
+    // name was found on PATH, which /proc/self/exe resolves
+    restart_argv = argv;
+    if (!(strchr(argv[0], '/') ? realpath(argv[0], restart_path)
+                               : realpath("/proc/self/exe", restart_path)))
+        snprintf(restart_path, sizeof(restart_path), "%s", argv[0]);
+
+    while ((option = getopt(argc, argv, "p:w:b:k:t:d:c:e:T:Q:B:z:L:l:D:nSh")) != -1)
+    {
+        switch (option)
+        {
+        case 'p': config.port = atoi(optarg); break;
+        case 'w': config.workers = atoi(optarg); break;
+        case 'b': config.backlog = atoi(optarg); break;
+        case 'k': config.timeouts[TIMEOUT_IDLE] = atoi(optarg); break;
+        case 't':
+            if (parse_timeout(optarg) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'd': config.static_root = optarg; break;
+        case 'c': config.open_file_cache = atoi(optarg); break;
+        case 'T': config.pool_threads = atoi(optarg); break;
+        case 'Q': config.pool_queue = atoi(optarg); break;
+        case 'B': config.max_body = strtoull(optarg, NULL, 10); break;
+        case 'z': config.compression_level = atoi(optarg); break;
+        case 'l': config.access_log_path = optarg; break;
+        case 'D': config.drain_seconds = atoi(optarg); break;
+        case 'L':
+            if (parse_log_level(optarg) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n': config.pin_workers = 0; break;
+        case 'S': config.print_stats = 1; break;
+        case 'e':
+            if (strcmp(optarg, "epoll") == 0)
+                config.backend = BACKEND_EPOLL;
+            else if (strcmp(optarg, "io_uring") == 0)
+                config.backend = BACKEND_IO_URING;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 1;
+        }
+    }
+    if (config.workers <= 0)
+        config.workers = cpu_count > 0 ? cpu_count : 1;
+    if (config.backlog <= 0)
+        config.backlog = DEFAULT_BACKLOG;
+    if (config.pool_queue <= 0)
+        config.pool_queue = DEFAULT_POOL_QUEUE;
+    if (config.compression_level < 0 || config.compression_level > 9 || config.drain_seconds < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Started by a hot restart: the old process sends its listeners, and
+    // there is one worker per listener whatever -w says
+    int inherited[MAX_HANDOFF_SOCKETS];
+    int handoff_channel = -1;
+    const char *handoff = getenv(HANDOFF_ENV);
+    if (handoff)
+    {
+        handoff_channel = atoi(handoff);
+        unsetenv(HANDOFF_ENV);
+        config.workers = receive_listeners(handoff_channel, inherited);
+        if (config.workers == -1)
+            return 1;
+        struct sockaddr_in address;
+        socklen_t address_length = sizeof(address);
+        if (getsockname(inherited[0], (struct sockaddr *)&address, &address_length) == 0)
+            config.port = ntohs(address.sin_port);
+    }
+
+    // SIGTERM, SIGINT and SIGHUP are taken with sigwait() at the end of
+    // main(); blocking them before any thread starts keeps them off the
+    // workers, which inherit the mask
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, cycle_log_level);
+    raise_file_limit();
+
+    prepare_response(&bad_request_response, "400 Bad Request", "Bad request.", 12);
+    prepare_response(&hello_response, "200 OK", "Hello, World!", 13);
+    prepare_response(&not_found_response, "404 Not Found", "Resource not found.", 19);
+    prepare_response(&payload_too_large_response, "413 Payload Too Large", "Request body too large.", 23);
+    prepare_response(&not_implemented_response, "501 Not Implemented", "Transfer-Encoding not supported.", 32);
+    prepare_response(&out_of_memory_response, "500 Internal Server Error", "Out of memory.", 14);
+
+    router = router_create();
+    router_add(router, "GET", "/hello", hello_handler);
+    router_add(router, "GET", "/hello/:name", hello_name_handler);
+    router_add(router, "GET", "/time", time_handler);
+    router_add(router, "GET", "/metrics", metrics_handler);
+    router_add(router, "POST", "/upload", upload_handler);
+    router_add(router, "POST", "/api/echo", echo_api_handler);
+    router_add(router, "POST", "/api/stats", stats_api_handler);
+    if (config.static_root)
+    {
+        router_add(router, "GET", "/static/*path", static_file_handler);
+        router_add(router, "GET", "/checksum/*path", checksum_handler);
+    }
+
+    if (config.static_root && access(config.static_root, R_OK | X_OK) != 0)
+    {
+        perror(config.static_root);
+        return 1;
+    }
+    if (config.static_root && config.compression_level > 0)
+    {
+        size_t files, original, compressed;
+        static_variants = static_variants_build(config.static_root, COMPRESS_BEST, STATIC_VARIANTS_MAX);
+        if (static_variants)
+        {
+            static_variants_stats(static_variants, &files, &original, &compressed);
+            printf("Precompressed %zu static file(s): %zu bytes -> %zu bytes over all encodings\n",
+                   files, original, compressed);
+        }
+    }
+
+    char reason[128];
+    if (config.backend == BACKEND_IO_URING && !uring_supported(reason, sizeof(reason)))
+    {
+        fprintf(stderr, "io_uring unavailable (%s), using epoll\n", reason);
+        config.backend = BACKEND_EPOLL;
+    }
+
+    // Step 1: Open every listener up front so a bind failure aborts startup
+    // instead of leaving the server running with fewer workers than asked for.
+    Worker *workers = calloc(config.workers, sizeof(Worker));
+    for (int i = 0; i < config.workers; i++)
+    {
+        Worker *worker = &workers[i];
+        worker->id = i;
+        worker->cpu = config.pin_workers && cpu_count > 0 ? i % cpu_count : -1;
+        worker->epoll_fd = -1;
+        worker->completions.event_fd = -1;
+        worker->metrics = metrics_create();
+        if (!worker->metrics)
+        {
+            perror("metrics");
+            return 1;
+        }
+        worker->server_socket = handoff ? inherited[i] : open_listener(config.port, config.backlog);
+        if (worker->server_socket == -1)
+            return 1;
+    }
+
+    metrics_blocks = calloc(config.workers, sizeof(Metrics *));
+    for (int i = 0; i < config.workers; i++)
+        metrics_blocks[i] = workers[i].metrics;
+    metrics_count = config.workers;
+
+    // The access log gets a ring per worker even while it is off, so
+    // SIGUSR1 can turn it on
+    int log_fd = STDOUT_FILENO;
+    if (config.access_log_path)
+    {
+        log_fd = open(config.access_log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (log_fd == -1)
+        {
+            perror(config.access_log_path);
+            return 1;
+        }
+    }
+    AccessLog *access_log = access_log_create(log_fd, config.workers, ACCESS_LOG_RING);
+    if (!access_log || access_log_start(access_log) == -1)
+    {
+        perror("access log");
+        return 1;
+    }
+    for (int i = 0; i < config.workers; i++)
+        workers[i].access_log = access_log_ring(access_log, i);
+
+    // Step 2: One pool for blocking handlers; each worker gets its
+    // completions back on its own queue, big enough for the whole pool
+    if (config.pool_threads > 0)
+    {
+        thread_pool = thread_pool_create(config.pool_threads, config.pool_queue);
+        if (!thread_pool)
+        {
+            perror("thread pool");
+            return 1;
+        }
+        for (int i = 0; i < config.workers; i++)
+        {
+            if (completion_queue_init(&workers[i].completions, thread_pool_capacity(thread_pool)) == -1)
+            {
+                perror("eventfd");
+                return 1;
+            }
+        }
+    }
+
+    // Step 3: Set up each worker's event loop. A ring that cannot be created
+    // (memory limits, say) sends every worker back to epoll.
+    if (config.backend == BACKEND_IO_URING)
+    {
+        for (int i = 0; i < config.workers; i++)
+        {
+            if (uring_worker_init(&workers[i]) == -1)
+            {
+                fprintf(stderr, "io_uring setup failed (%s), using epoll\n", strerror(errno));
+                for (int j = 0; j < i; j++)
+                    uring_worker_free(&workers[j]);
+                config.backend = BACKEND_EPOLL;
+                break;
+            }
+        }
+    }
+    for (int i = 0; config.backend == BACKEND_EPOLL && i < config.workers; i++)
+    {
+        Worker *worker = &workers[i];
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epoll_fd == -1)
+            return 1;
+
+        // The listening socket stays level-triggered: if accept fails with EMFILE
+        // the pending connections are reported again on the next wait instead of
+        // being forgotten until another client arrives. data.ptr == NULL marks it.
+        struct epoll_event listen_event;
+        listen_event.events = EPOLLIN;
+        listen_event.data.ptr = NULL;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->server_socket, &listen_event);
+
+        // Completed tasks; worker_complete_tasks reads the eventfd, so
+        // level-triggered is fine here too
+        if (thread_pool)
+        {
+            struct epoll_event completion_event;
+            completion_event.events = EPOLLIN;
+            completion_event.data.ptr = &worker->completions;
+            epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->completions.event_fd, &completion_event);
+        }
+    }
+
+    // Step 4: Start one event loop per worker
+    void *(*loop)(void *) = config.backend == BACKEND_IO_URING ? uring_worker_main : worker_main;
+    for (int i = 0; i < config.workers; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, loop, &workers[i]) != 0)
+        {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    printf("Server listening on port %d with %d %s worker(s), backlog %d...\n",
+           config.port, config.workers,
+           config.backend == BACKEND_IO_URING ? "io_uring" : "epoll", config.backlog);
+    fflush(stdout); // The access log writes to the same descriptor
+
+    // The old process stops accepting once it hears the workers are up
+    if (handoff_channel != -1)
+    {
+        if (write(handoff_channel, "", 1) != 1)
+            perror("hot restart");
+        close(handoff_channel);
+    }
+
+    // Step 5: Serve until a signal. SIGHUP first hands the listeners to a
+    // new process and is ignored if that fails; then, as for SIGTERM and
+    // SIGINT, the workers close their listeners and exit once their
+    // connections are done or the drain deadline passes. A second SIGTERM
+    // or SIGINT ends the process at once.
+    int signal_number;
+    while (sigwait(&stop_signals, &signal_number) != 0 ||
+           (signal_number == SIGHUP && hand_off(workers, config.workers) == -1))
+        ;
+    drain_deadline = monotonic_ns() + (uint64_t)config.drain_seconds * 1000000000;
+    __atomic_store_n(&draining, 1, __ATOMIC_RELEASE);
+    printf("Draining connections for up to %d s...\n", config.drain_seconds);
+    fflush(stdout);
+    sigdelset(&stop_signals, SIGHUP);
+    pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+
+    for (int i = 0; i < config.workers; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].epoll_fd != -1)
+            close(workers[i].epoll_fd);
+        uring_worker_free(&workers[i]);
+        if (workers[i].server_socket != -1)
+            close(workers[i].server_socket);
+        metrics_free(workers[i].metrics);
+    }
+    if (thread_pool)
+    {
+        thread_pool_destroy(thread_pool);
+        for (int i = 0; i < config.workers; i++)
+            completion_queue_destroy(&workers[i].completions);
+    }
+    access_log_destroy(access_log);
+    if (log_fd != STDOUT_FILENO)
+        close(log_fd);
+    free(workers);
+    free(metrics_blocks);
+    static_variants_free(static_variants);
+    router_free(router);
     return 0;
 }
@@ -1,32 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-
-
-
-
-// JSON value types
-typedef enum {
-    JSON_OBJECT,
-    JSON_ARRAY,
-    JSON_STRING,
-    JSON_NUMBER,
-    JSON_BOOLEAN,
-    JSON_NULL
-} JSONType;
-
-// JSON value structure
-typedef struct JSONValue {
-    JSONType type;
-    union {
-        struct JSONObject *object;
-        struct JSONArray *array;
-        char *string;
-        double number;
-        int boolean;
-    };
-} JSONValue;
+#include <math.h>
+#include "json.h"
+#include "json_index.h"
+#include "json_number.h"
 
 // Token types
 typedef enum {
@@ -41,105 +19,161 @@ typedef enum {
     TOKEN_TRUE,
     TOKEN_FALSE,
     TOKEN_NULL,
-    TOKEN_EOF
+    TOKEN_EOF,
+    TOKEN_ERROR
 } TokenType;
 
-// Represents a JSON object (key-value pair)
-typedef struct JSONObject {
-    char *key;               // Key (string)
-    JSONValue *value;        // Associated value
-    struct JSONObject *next; // Linked list for multiple key-value pairs
-} JSONObject;
-
-// Represents a JSON array (list of values)
-typedef struct JSONArray {
-    JSONValue *value;        // Array element
-    struct JSONArray *next;  // Linked list for multiple elements
-} JSONArray;
-
 // Token structure
 typedef struct {
     TokenType type;
     const char *start;
     size_t length;
+    JSONNumber number; // TOKEN_NUMBER: its value
 } Token;
 
-// Error structure
-typedef struct {
-    const char *message;
-    size_t position;
-} JSONError;
-
 // Global error variable
 JSONError json_error = {NULL, 0};
 
-// Function prototypes
-JSONValue *parse_json(const char *json);
-void free_json(JSONValue *value);
+#define JSON_INLINE_FRAMES 32 // Containers tracked before the parser's stack is allocated
 
+// An object or array still being filled in
+typedef struct {
+    JSONType type;
+    union {
+        JSONObject **members;  // Tree: where the next member is linked in
+        JSONArray **elements;  // Tree: where the next element is linked in
+        size_t children;       // Tape: where its entries start on the scratch stack
+    } tail;
+} JSONFrame;
 
+// Tokenizer structure: stage 2, reading tokens where the index points
 typedef struct {
     const char *json;
-    size_t position;
+    size_t length;
+    size_t position;                // Just past the last token
+    JSONParser *parser;
+    JSONFrame *frames;              // Open containers, outermost first
+    int depth;                      // Entries used in frames
+    int capacity;
+    int max_depth;
+    JSONFrame inline_frames[JSON_INLINE_FRAMES];
+    JSONIndex index;
 } JSONTokenizer;
 
-Token next_token(JSONTokenizer *tokenizer) {
-    const char *json = tokenizer->json;
-    size_t pos = tokenizer->position;
+static void set_error(JSONTokenizer *tokenizer, const char *message, size_t position) {
+    JSONError *error = &tokenizer->parser->error;
+    if (!error->message) {
+        error->message = message;
+        error->position = position;
+    }
+}
+
+static void *json_alloc(JSONTokenizer *tokenizer, size_t size) {
+    const JSONAllocator *allocator = tokenizer->parser->allocator;
+    void *memory = allocator ? allocator->alloc(allocator->context, size) : malloc(size);
+    if (!memory) set_error(tokenizer, "Out of memory", tokenizer->position);
+    return memory;
+}
+
+// Releases memory json_alloc or grow_array returned; an allocator's goes
+// all at once later
+static void json_release(JSONTokenizer *tokenizer, void *memory) {
+    if (!tokenizer->parser->allocator) free(memory);
+}
+
+// Moves an array that has run out of room to size bytes, keeping its first
+// used: realloc without an allocator, else a new block and a copy, the old
+// one staying with the rest of the allocator's memory until it goes
+static void *grow_array(JSONTokenizer *tokenizer, void *array, size_t used, size_t size) {
+    const JSONAllocator *allocator = tokenizer->parser->allocator;
+    void *grown = allocator ? allocator->alloc(allocator->context, size) : realloc(array, size);
+    if (!grown) set_error(tokenizer, "Out of memory", tokenizer->position);
+    else if (allocator && used) memcpy(grown, array, used);
+    return grown;
+}
 
-    // Skip whitespace
-    while (isspace(json[pos])) pos++;
+static int is_json_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// True for a byte that may follow a number or literal
+static int ends_token(char c) {
+    return is_json_space(c) || c == ',' || c == ']' || c == '}' || c == ':' ||
+           c == '[' || c == '{' || c == '"';
+}
+
+// Reads the token at the next indexed position. Whitespace has no position,
+// and a string's closing quote is the position after its opening one.
+static Token next_token(JSONTokenizer *tokenizer) {
+    const char *json = tokenizer->json;
+    JSONIndex *index = &tokenizer->index;
+    size_t pos;
+
+    if (!json_index_next(index, &pos)) {
+        Token token = {.type = TOKEN_EOF, .start = &json[tokenizer->length], .length = 0};
+        if (index->error) {
+            set_error(tokenizer, index->error, index->error_position);
+            token.type = TOKEN_ERROR;
+        }
+        tokenizer->position = tokenizer->length;
+        return token;
+    }
 
-    Token token = {TOKEN_EOF, &json[pos], 1};
+    Token token = {.type = TOKEN_ERROR, .start = &json[pos], .length = 1};
 
     switch (json[pos]) {
-        case '{': token.type = TOKEN_LBRACE; break;
-        case '}': token.type = TOKEN_RBRACE; break;
-        case '[': token.type = TOKEN_LBRACKET; break;
-        case ']': token.type = TOKEN_RBRACKET; break;
-        case ':': token.type = TOKEN_COLON; break;
-        case ',': token.type = TOKEN_COMMA; break;
-        case '"': // Handle string token
+        case '{': token.type = TOKEN_LBRACE; pos++; break;
+        case '}': token.type = TOKEN_RBRACE; pos++; break;
+        case '[': token.type = TOKEN_LBRACKET; pos++; break;
+        case ']': token.type = TOKEN_RBRACKET; pos++; break;
+        case ':': token.type = TOKEN_COLON; pos++; break;
+        case ',': token.type = TOKEN_COMMA; pos++; break;
+        case '"': { // Escapes are decoded by parse_string
+            size_t end;
+            if (!json_index_next(index, &end)) {
+                if (index->error) set_error(tokenizer, index->error, index->error_position);
+                else set_error(tokenizer, "Unterminated string", tokenizer->length);
+                pos = tokenizer->length;
+                break;
+            }
             token.type = TOKEN_STRING;
             token.start = &json[pos + 1]; // Skip opening quote
-            pos++;
-            while (json[pos] != '"' && json[pos] != '\0') pos++;
-            if (json[pos] == '\0') {
-                json_error.message = "Unterminated string";
-                json_error.position = pos;
-                token.type = TOKEN_EOF;
-            }
-            token.length = &json[pos] - token.start;
-            pos++; // Skip closing quote
-            break;
-        case '\0': // End of input
-            token.type = TOKEN_EOF;
+            token.length = end - pos - 1;
+            pos = end + 1; // Skip closing quote
             break;
+        }
         default:
-            if (isdigit(json[pos]) || json[pos] == '-') {
-                // Handle number token
+            if (is_digit(json[pos]) || json[pos] == '-') {
+                // Handle number token, converted as it is checked
                 token.type = TOKEN_NUMBER;
-                token.start = &json[pos];
-                while (isdigit(json[pos]) || json[pos] == '.' || json[pos] == 'e' || json[pos] == 'E' || json[pos] == '+' || json[pos] == '-') {
-                    pos++;
+                token.length = json_parse_number(&json[pos], &token.number);
+                if (token.length == 0) {
+                    set_error(tokenizer, "Invalid number", pos);
+                    token.type = TOKEN_ERROR;
+                    break;
                 }
-                token.length = &json[pos] - token.start;
             } else if (strncmp(&json[pos], "true", 4) == 0) {
                 token.type = TOKEN_TRUE;
                 token.length = 4;
-                pos += 4;
             } else if (strncmp(&json[pos], "false", 5) == 0) {
                 token.type = TOKEN_FALSE;
                 token.length = 5;
-                pos += 5;
             } else if (strncmp(&json[pos], "null", 4) == 0) {
                 token.type = TOKEN_NULL;
                 token.length = 4;
-                pos += 4;
             } else {
-                json_error.message = "Unexpected character";
-                json_error.position = pos;
-                token.type = TOKEN_EOF;
+                set_error(tokenizer, "Unexpected character", pos);
+                break;
+            }
+            // The index only marks where a token starts: "truex" is one
+            pos += token.length;
+            if (pos < tokenizer->length && !ends_token(json[pos])) {
+                set_error(tokenizer, "Unexpected character", pos);
+                token.type = TOKEN_ERROR;
             }
             break;
     }
@@ -148,126 +182,786 @@ Token next_token(JSONTokenizer *tokenizer) {
     return token;
 }
 
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-JSONValue *parse_value(JSONTokenizer *tokenizer);
-
-JSONValue *parse_object(JSONTokenizer *tokenizer) {
-    Token token = next_token(tokenizer);
-    if (token.type != TOKEN_LBRACE) return NULL;
+// Reads the four hex digits of a \u escape at p, before end. Returns -1 if
+// there are not four.
+static long read_hex4(const char *p, const char *end) {
+    if (end - p < 4) return -1;
+    long code = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_value(p[i]);
+        if (digit < 0) return -1;
+        code = code * 16 + digit;
+    }
+    return code;
+}
 
-    // TODO: Parse key-value pairs
+// Copies a string token to out, which has room for its length plus a NUL,
+// decoding its escapes. out may be the token itself: nothing decodes to
+// more bytes than its escape, so the copy never overtakes what it reads.
+// Runs without a backslash go over in one memmove, or stay put. \uXXXX
+// becomes UTF-8, a surrogate pair one four-byte character; a surrogate
+// without its other half has no UTF-8 and is refused. Returns where the
+// NUL went, or NULL on a bad escape, reported at its backslash.
+static char *decode_string(JSONTokenizer *tokenizer, const Token *token, char *out) {
+    const char *p = token->start;
+    const char *end = token->start + token->length;
+    while (p < end) {
+        // Most strings are keys and short words, cheaper to scan here than
+        // to hand to memchr
+        const char *escape = p;
+        if (end - p < 32) {
+            while (escape < end && *escape != '\\') escape++;
+            if (escape == end) escape = NULL;
+        } else {
+            escape = memchr(p, '\\', end - p);
+        }
+        size_t run = (escape ? escape : end) - p;
+        if (out != p) memmove(out, p, run);
+        out += run;
+        p += run;
+        if (!escape) break;
+
+        p++;
+        switch (*p++) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                long code = read_hex4(p, end);
+                if (code < 0) {
+                    set_error(tokenizer, "Invalid escape", (size_t)(escape - tokenizer->json));
+                    return NULL;
+                }
+                p += 4;
+                if (code >= 0xD800 && code <= 0xDFFF) {
+                    // A high surrogate, then \u and a low one
+                    long low = code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u'
+                                   ? read_hex4(p + 2, end) : -1;
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        set_error(tokenizer, "Unpaired surrogate", (size_t)(escape - tokenizer->json));
+                        return NULL;
+                    }
+                    p += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                // "\uXXXX" is six bytes and its UTF-8 at most three; a pair
+                // is twelve and four
+                if (code < 0x80) {
+                    *out++ = (char)code;
+                } else if (code < 0x800) {
+                    *out++ = (char)(0xC0 | code >> 6);
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    *out++ = (char)(0xE0 | code >> 12);
+                    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                } else {
+                    *out++ = (char)(0xF0 | code >> 18);
+                    *out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+                    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                set_error(tokenizer, "Invalid escape", (size_t)(escape - tokenizer->json));
+                return NULL;
+        }
+    }
+    *out = '\0';
+    return out;
+}
 
-    token = next_token(tokenizer);
-    if (token.type != TOKEN_RBRACE) {
-        json_error.message = "Expected closing brace";
-        json_error.position = tokenizer->position;
+// Copies a string token into memory of its own. Returns NULL on a bad
+// escape or when memory runs out.
+static char *parse_string(JSONTokenizer *tokenizer, const Token *token) {
+    char *string = json_alloc(tokenizer, token->length + 1);
+    if (string && !decode_string(tokenizer, token, string)) {
+        json_release(tokenizer, string);
         return NULL;
     }
-
-    JSONValue *object = malloc(sizeof(JSONValue));
-    object->type = JSON_OBJECT;
-    object->object = NULL; // Placeholder
-    return object;
+    return string;
 }
 
-JSONValue *parse_array(JSONTokenizer *tokenizer) {
-    Token token = next_token(tokenizer);
-    if (token.type != TOKEN_LBRACKET) return NULL;
+static JSONValue *new_value(JSONTokenizer *tokenizer, JSONType type) {
+    JSONValue *value = json_alloc(tokenizer, sizeof(JSONValue));
+    if (value) value->type = type;
+    return value;
+}
 
-    // TODO: Parse array elements
+// Parses a value that is not a container, starting with token
+static JSONValue *parse_scalar(JSONTokenizer *tokenizer, const Token *token) {
+    JSONValue *value;
+
+    switch (token->type) {
+        case TOKEN_STRING: {
+            char *string = parse_string(tokenizer, token);
+            if (!string) return NULL;
+            value = new_value(tokenizer, JSON_STRING);
+            if (!value) {
+                json_release(tokenizer, string);
+                return NULL;
+            }
+            value->string = string;
+            return value;
+        }
+        case TOKEN_NUMBER:
+            value = new_value(tokenizer, JSON_NUMBER);
+            if (value) {
+                value->kind = token->number.kind;
+                value->unsigned_integer = token->number.unsigned_integer;
+            }
+            return value;
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+            value = new_value(tokenizer, JSON_BOOLEAN);
+            if (value) value->boolean = token->type == TOKEN_TRUE;
+            return value;
+        case TOKEN_NULL:
+            return new_value(tokenizer, JSON_NULL);
+        case TOKEN_EOF:
+            set_error(tokenizer, "Unexpected end of input", tokenizer->position);
+            return NULL;
+        default: // For TOKEN_ERROR, next_token has set the error already
+            set_error(tokenizer, "Unexpected token", tokenizer->position);
+            return NULL;
+    }
+}
 
-    token = next_token(tokenizer);
-    if (token.type != TOKEN_RBRACKET) {
-        json_error.message = "Expected closing bracket";
-        json_error.position = tokenizer->position;
+// Pushes a frame for the container starting with token. Returns NULL past
+// the parser's depth limit or out of memory.
+static JSONFrame *push_frame(JSONTokenizer *tokenizer, const Token *token) {
+    if (tokenizer->depth >= tokenizer->max_depth) {
+        set_error(tokenizer, "Too deeply nested", tokenizer->position);
         return NULL;
     }
+    if (tokenizer->depth == tokenizer->capacity) {
+        int capacity = tokenizer->capacity * 2;
+        int was_inline = tokenizer->frames == tokenizer->inline_frames;
+        JSONFrame *frames = grow_array(tokenizer, was_inline ? NULL : tokenizer->frames,
+                                       was_inline ? 0 : tokenizer->depth * sizeof(JSONFrame),
+                                       capacity * sizeof(JSONFrame));
+        if (!frames) return NULL;
+        if (was_inline) memcpy(frames, tokenizer->inline_frames, sizeof(tokenizer->inline_frames));
+        tokenizer->frames = frames;
+        tokenizer->capacity = capacity;
+    }
+    JSONFrame *frame = &tokenizer->frames[tokenizer->depth++];
+    frame->type = token->type == TOKEN_LBRACE ? JSON_OBJECT : JSON_ARRAY;
+    return frame;
+}
+
+// Opens a container for the value starting with token and pushes it on the
+// stack. Returns NULL past the parser's depth limit or out of memory.
+static JSONValue *open_container(JSONTokenizer *tokenizer, const Token *token) {
+    JSONFrame *frame = push_frame(tokenizer, token);
+    if (!frame) return NULL;
+    JSONValue *container = new_value(tokenizer, frame->type);
+    if (!container) return NULL;
+    if (container->type == JSON_OBJECT) {
+        container->object = NULL;
+        frame->tail.members = &container->object;
+    } else {
+        container->array = NULL;
+        frame->tail.elements = &container->array;
+    }
+    return container;
+}
+
+// Links a new member or element into the innermost container and reads up
+// to the first token of its value, left in *token. Returns where the value
+// goes, or NULL on error.
+static JSONValue **add_entry(JSONTokenizer *tokenizer, Token *token) {
+    JSONFrame *frame = &tokenizer->frames[tokenizer->depth - 1];
+    if (frame->type == JSON_ARRAY) {
+        JSONArray *element = json_alloc(tokenizer, sizeof(JSONArray));
+        if (!element) return NULL;
+        element->value = NULL;
+        element->next = NULL;
+        *frame->tail.elements = element;
+        frame->tail.elements = &element->next;
+        return &element->value;
+    }
 
-    JSONValue *array = malloc(sizeof(JSONValue));
-    array->type = JSON_ARRAY;
-    array->array = NULL; // Placeholder
-    return array;
+    if (token->type != TOKEN_STRING) {
+        set_error(tokenizer, "Expected string key", tokenizer->position);
+        return NULL;
+    }
+    char *key = parse_string(tokenizer, token);
+    if (!key) return NULL;
+    JSONObject *member = json_alloc(tokenizer, sizeof(JSONObject));
+    if (!member) {
+        json_release(tokenizer, key);
+        return NULL;
+    }
+    member->key = key;
+    member->value = NULL;
+    member->next = NULL;
+    *frame->tail.members = member;
+    frame->tail.members = &member->next;
+
+    // Expect colon
+    if (next_token(tokenizer).type != TOKEN_COLON) {
+        set_error(tokenizer, "Expected colon", tokenizer->position);
+        return NULL;
+    }
+    *token = next_token(tokenizer);
+    return &member->value;
 }
 
-JSONValue *parse_value(JSONTokenizer *tokenizer) {
+// Parses one document without recursion: open containers live on the
+// tokenizer's stack, and every value is linked into its parent (through
+// slot) as soon as it is created, so on error the whole partial tree is
+// freed from the root.
+static JSONValue *parse_document(JSONTokenizer *tokenizer) {
+    JSONValue *root = NULL;
+    JSONValue **slot = &root;
     Token token = next_token(tokenizer);
 
-    switch (token.type) {
-        case TOKEN_LBRACE: return parse_object(tokenizer);
-        case TOKEN_LBRACKET: return parse_array(tokenizer);
-        case TOKEN_STRING:
-            // TODO: Handle string
-            break;
-        case TOKEN_NUMBER:
-            // TODO: Handle number
-            break;
-        case TOKEN_TRUE:
-        case TOKEN_FALSE:
-        case TOKEN_NULL:
-            // TODO: Handle boolean/null
-            break;
-        default:
-            json_error.message = "Unexpected token";
-            json_error.position = tokenizer->position;
-            return NULL;
+    while (1) {
+        // Step 1: The value starting with token. An empty container is
+        // closed right away; otherwise its first entry is parsed next.
+        if (token.type == TOKEN_LBRACE || token.type == TOKEN_LBRACKET) {
+            JSONValue *container = open_container(tokenizer, &token);
+            if (!container) goto fail;
+            *slot = container;
+            token = next_token(tokenizer);
+            if (token.type != (container->type == JSON_OBJECT ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+                if (!(slot = add_entry(tokenizer, &token))) goto fail;
+                continue;
+            }
+            tokenizer->depth--;
+        } else {
+            if (!(*slot = parse_scalar(tokenizer, &token))) goto fail;
+        }
+
+        // Step 2: A value is complete. Close the containers it ends, up to
+        // the one that continues after a comma.
+        while (tokenizer->depth > 0) {
+            JSONType type = tokenizer->frames[tokenizer->depth - 1].type;
+            token = next_token(tokenizer);
+            if (token.type == TOKEN_COMMA) break;
+            if (token.type != (type == JSON_OBJECT ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+                set_error(tokenizer, type == JSON_OBJECT ? "Expected comma or closing brace"
+                                                         : "Expected comma or closing bracket",
+                          tokenizer->position);
+                goto fail;
+            }
+            tokenizer->depth--;
+        }
+        if (tokenizer->depth == 0) break;
+
+        // Step 3: The next entry of the innermost container
+        token = next_token(tokenizer);
+        if (!(slot = add_entry(tokenizer, &token))) goto fail;
+    }
+
+    if (next_token(tokenizer).type != TOKEN_EOF) {
+        set_error(tokenizer, "Unexpected data after the value", tokenizer->position);
+        goto fail;
     }
+    return root;
 
+fail:
+    if (!tokenizer->parser->allocator) free_json(root);
     return NULL;
 }
 
+// Sets up a tokenizer for one parse. A NUL in json is found by the index
+// like any other byte that starts no valid token.
+static void start_parse(JSONTokenizer *tokenizer, JSONParser *parser, const char *json, size_t length) {
+    tokenizer->json = json;
+    tokenizer->length = length;
+    tokenizer->position = 0;
+    tokenizer->parser = parser;
+    tokenizer->frames = tokenizer->inline_frames;
+    tokenizer->depth = 0;
+    tokenizer->capacity = JSON_INLINE_FRAMES;
+    tokenizer->max_depth = parser->max_depth > 0 ? parser->max_depth : JSON_MAX_DEPTH;
+    json_index_init(&tokenizer->index, json, length);
+    parser->error.message = NULL;
+    parser->error.position = 0;
+}
+
+JSONValue *json_parse(JSONParser *parser, const char *json, size_t length) {
+    JSONTokenizer tokenizer;
+    start_parse(&tokenizer, parser, json, length);
+    JSONValue *value = parse_document(&tokenizer);
+    if (tokenizer.frames != tokenizer.inline_frames) json_release(&tokenizer, tokenizer.frames);
+    return value;
+}
+
 JSONValue *parse_json(const char *json) {
-    JSONTokenizer tokenizer = {json, 0};
-    return parse_value(&tokenizer);
+    JSONParser parser = {NULL, 0, {NULL, 0}};
+    JSONValue *value = json_parse(&parser, json, strlen(json));
+    json_error = parser.error;
+    return value;
+}
+
+JSONValue *parse_json_with(const char *json, size_t length, const JSONAllocator *allocator, JSONError *error) {
+    JSONParser parser = {allocator, 0, {NULL, 0}};
+    JSONValue *value = json_parse(&parser, json, length);
+    *error = parser.error;
+    return value;
 }
 
+// Prepends a container's members to a list, keeping their order
+static JSONObject *splice_members(JSONObject *members, JSONObject *list) {
+    if (!members) return list;
+    JSONObject *last = members;
+    while (last->next) last = last->next;
+    last->next = list;
+    return members;
+}
+
+static JSONArray *splice_elements(JSONArray *elements, JSONArray *list) {
+    if (!elements) return list;
+    JSONArray *last = elements;
+    while (last->next) last = last->next;
+    last->next = list;
+    return elements;
+}
+
+// Frees without recursion, however deep the document: the members and
+// elements of every container freed join one of two work lists, and their
+// values are freed from there. A NULL value (a member of a partly parsed
+// document) is skipped.
 void free_json(JSONValue *value) {
-    if (!value) return;
+    JSONObject *members = NULL;
+    JSONArray *elements = NULL;
+
+    while (1) {
+        if (value) {
+            switch (value->type) {
+                case JSON_STRING: free(value->string); break;
+                case JSON_OBJECT: members = splice_members(value->object, members); break;
+                case JSON_ARRAY: elements = splice_elements(value->array, elements); break;
+                default:
+                    // For numbers, booleans, and null, no additional memory allocation is needed.
+                    break;
+            }
+            free(value);
+        }
+
+        if (members) {
+            JSONObject *member = members;
+            members = member->next;
+            value = member->value;
+            free(member->key);
+            free(member);
+        } else if (elements) {
+            JSONArray *element = elements;
+            elements = element->next;
+            value = element->value;
+            free(element);
+        } else {
+            return;
+        }
+    }
+}
+
+JSONValue *json_object_get(const JSONValue *value, const char *key) {
+    if (!value || value->type != JSON_OBJECT) return NULL;
+    for (const JSONObject *member = value->object; member; member = member->next) {
+        if (strcmp(member->key, key) == 0) return member->value;
+    }
+    return NULL;
+}
+
+// Writes the length bytes of text as a JSON string literal. Runs that need
+// no escaping go to write in one piece, straight from the value.
+static void write_string(const char *text, size_t length, JSONWriter write, void *context) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = text, *end = text + length;
+    write(context, "\"", 1);
+    for (const char *p = text; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        if (p > run) write(context, run, p - run);
+        run = p + 1;
+
+        char escape[6] = {'\\', (char)c};
+        size_t escape_length = 2;
+        switch (c) {
+            case '"': case '\\': break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xF];
+                escape_length = 6;
+                break;
+        }
+        write(context, escape, escape_length);
+    }
+    if (end > run) write(context, run, end - run);
+    write(context, "\"", 1);
+}
 
+// Prints an exact integer digit by digit: the bits of an int64_t, or of a
+// uint64_t if kind is JSON_UINT64
+static void write_integer(JSONNumberKind kind, uint64_t bits, JSONWriter write, void *context) {
+    char text[24];
+    int negative = kind == JSON_INT64 && (int64_t)bits < 0;
+    uint64_t magnitude = negative ? 0 - bits : bits;
+    char *end = text + sizeof(text), *digit = end;
+    do {
+        *--digit = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (negative) *--digit = '-';
+    write(context, digit, end - digit);
+}
+
+// Integers up to 2^53 are exact in a double and printed digit by digit;
+// anything else gets the shorter of %.15g and %.17g that reads back as the
+// same double
+static void write_number(double number, JSONWriter write, void *context) {
+    char text[32];
+    int length;
+    if (number > -9007199254740992.0 && number < 9007199254740992.0 &&
+        number == (double)(long long)number && (number != 0 || !signbit(number))) {
+        write_integer(JSON_INT64, (uint64_t)(int64_t)number, write, context);
+        return;
+    }
+    if (number != number || number - number != 0) {
+        length = snprintf(text, sizeof(text), "null"); // NaN and infinities have no JSON form
+    } else {
+        JSONNumber back;
+        length = snprintf(text, sizeof(text), "%.15g", number);
+        json_parse_number(text, &back);
+        if (back.kind != JSON_DOUBLE || back.number != number)
+            length = snprintf(text, sizeof(text), "%.17g", number);
+    }
+    write(context, text, length);
+}
+
+void json_write(const JSONValue *value, JSONWriter write, void *context) {
     switch (value->type) {
-        case JSON_STRING:
-            free(value->string);
-            break;
         case JSON_OBJECT: {
-            struct JSONObject *current = value->object;
-            while (current) {
-                struct JSONObject *next = current->next;
-                free(current->key);
-                free_json(current->value); // Free the value recursively
-                free(current);
-                current = next;
+            write(context, "{", 1);
+            for (const JSONObject *member = value->object; member; member = member->next) {
+                write_string(member->key, strlen(member->key), write, context);
+                write(context, ":", 1);
+                json_write(member->value, write, context);
+                if (member->next) write(context, ",", 1);
             }
+            write(context, "}", 1);
             break;
         }
         case JSON_ARRAY: {
-            struct JSONArray *current = value->array;
-            while (current) {
-                struct JSONArray *next = current->next;
-                free_json(current->value); // Free the value recursively
-                free(current);
-                current = next;
+            write(context, "[", 1);
+            for (const JSONArray *element = value->array; element; element = element->next) {
+                json_write(element->value, write, context);
+                if (element->next) write(context, ",", 1);
             }
+            write(context, "]", 1);
             break;
         }
-        default:
-            // For numbers, booleans, and null, no additional memory allocation is needed.
+        case JSON_STRING: write_string(value->string, strlen(value->string), write, context); break;
+        case JSON_NUMBER:
+            if (value->kind == JSON_DOUBLE) write_number(value->number, write, context);
+            else write_integer(value->kind, value->unsigned_integer, write, context);
             break;
+        case JSON_BOOLEAN:
+            if (value->boolean) write(context, "true", 4);
+            else write(context, "false", 5);
+            break;
+        case JSON_NULL: write(context, "null", 4); break;
     }
+}
+
+static void count_bytes(void *context, const char *data, size_t length) {
+    (void)data;
+    *(size_t *)context += length;
+}
 
-    free(value);
+size_t json_write_length(const JSONValue *value) {
+    size_t length = 0;
+    json_write(value, count_bytes, &length);
+    return length;
 }
 
+// Tape documents. Values are collected on a scratch stack while their
+// container is open; when it closes, its entries move to the end of the
+// tape in one block, so siblings end up next to each other.
 
-int main() {
-    const char *json = "{\"key\": [1, 2, 3]}";
-    JSONValue *value = parse_json(json);
+typedef struct {
+    JSONEntry *entries;    // The tape while it grows, from the parser's allocator or malloc
+    size_t count, capacity;
+    JSONEntry *scratch;    // Entries of the open containers, from the same
+    size_t scratch_count, scratch_capacity;
+    char *strings_end;     // Where the next string goes in the document's buffer;
+                           // NULL to decode each over its own token
+} JSONTape;
+
+// Pushes a new entry of the given type on the scratch stack
+static JSONEntry *push_entry(JSONTokenizer *tokenizer, JSONTape *tape, JSONType type) {
+    if (tape->scratch_count == tape->scratch_capacity) {
+        size_t capacity = tape->scratch_capacity * 2;
+        JSONEntry *scratch = grow_array(tokenizer, tape->scratch, tape->scratch_count * sizeof(JSONEntry),
+                                        capacity * sizeof(JSONEntry));
+        if (!scratch) return NULL;
+        tape->scratch = scratch;
+        tape->scratch_capacity = capacity;
+    }
+    JSONEntry *entry = &tape->scratch[tape->scratch_count++];
+    entry->type = type;
+    entry->length = 0;
+    return entry;
+}
 
-    if (value) {
-        printf("Parsed JSON successfully!\n");
-        free_json(value);
-    } else {
-        printf("Error: %s at position %zu\n", json_error.message, json_error.position);
+// Pushes the value (or key) a scalar token stands for
+static int push_scalar(JSONTokenizer *tokenizer, JSONTape *tape, const Token *token) {
+    JSONEntry *entry;
+    switch (token->type) {
+        case TOKEN_STRING: {
+            if (!(entry = push_entry(tokenizer, tape, JSON_STRING))) return -1;
+            // In place the token is writable: json_parse_document_in_place
+            // was handed it as such
+            char *string = tape->strings_end ? tape->strings_end : (char *)token->start;
+            char *end = decode_string(tokenizer, token, string);
+            if (!end) return -1;
+            entry->string = string;
+            entry->length = (uint32_t)(end - string);
+            if (tape->strings_end) tape->strings_end = end + 1;
+            return 0;
+        }
+        case TOKEN_NUMBER:
+            if (!(entry = push_entry(tokenizer, tape, JSON_NUMBER))) return -1;
+            entry->kind = token->number.kind;
+            entry->unsigned_integer = token->number.unsigned_integer;
+            return 0;
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+            if (!(entry = push_entry(tokenizer, tape, JSON_BOOLEAN))) return -1;
+            entry->boolean = token->type == TOKEN_TRUE;
+            return 0;
+        case TOKEN_NULL:
+            return push_entry(tokenizer, tape, JSON_NULL) ? 0 : -1;
+        case TOKEN_EOF:
+            set_error(tokenizer, "Unexpected end of input", tokenizer->position);
+            return -1;
+        default: // For TOKEN_ERROR, next_token has set the error already
+            set_error(tokenizer, "Unexpected token", tokenizer->position);
+            return -1;
     }
+}
 
+// Moves the entries of the innermost container from the scratch stack to
+// the end of the tape and pops its frame
+static int close_entries(JSONTokenizer *tokenizer, JSONTape *tape) {
+    size_t start = tokenizer->frames[--tokenizer->depth].tail.children;
+    size_t count = tape->scratch_count - start;
+    if (tape->count + count > tape->capacity) {
+        size_t capacity = tape->capacity * 2;
+        while (capacity < tape->count + count) capacity *= 2;
+        JSONEntry *entries = grow_array(tokenizer, tape->entries, tape->count * sizeof(JSONEntry),
+                                        capacity * sizeof(JSONEntry));
+        if (!entries) return -1;
+        tape->entries = entries;
+        tape->capacity = capacity;
+    }
+    JSONEntry *container = &tape->scratch[start - 1];
+    container->first = tape->count;
+    container->length = (uint32_t)(container->type == JSON_OBJECT ? count / 2 : count);
+    memcpy(&tape->entries[tape->count], &tape->scratch[start], count * sizeof(JSONEntry));
+    tape->count += count;
+    tape->scratch_count = start;
     return 0;
 }
 
+// Reads an object's key and colon up to the first token of the member's
+// value, left in *token; an array entry needs nothing before its value
+static int begin_entry(JSONTokenizer *tokenizer, JSONTape *tape, Token *token) {
+    if (tokenizer->frames[tokenizer->depth - 1].type == JSON_ARRAY) return 0;
+    if (token->type != TOKEN_STRING) {
+        set_error(tokenizer, "Expected string key", tokenizer->position);
+        return -1;
+    }
+    if (push_scalar(tokenizer, tape, token) != 0) return -1;
+    if (next_token(tokenizer).type != TOKEN_COLON) {
+        set_error(tokenizer, "Expected colon", tokenizer->position);
+        return -1;
+    }
+    *token = next_token(tokenizer);
+    return 0;
+}
+
+// The same walk as parse_document, building a tape instead of a tree
+static int parse_tape(JSONTokenizer *tokenizer, JSONTape *tape) {
+    Token token = next_token(tokenizer);
+
+    while (1) {
+        // Step 1: The value starting with token
+        if (token.type == TOKEN_LBRACE || token.type == TOKEN_LBRACKET) {
+            JSONFrame *frame = push_frame(tokenizer, &token);
+            if (!frame || !push_entry(tokenizer, tape, frame->type)) return -1;
+            frame->tail.children = tape->scratch_count;
+            token = next_token(tokenizer);
+            if (token.type != (frame->type == JSON_OBJECT ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+                if (begin_entry(tokenizer, tape, &token) != 0) return -1;
+                continue;
+            }
+            if (close_entries(tokenizer, tape) != 0) return -1;
+        } else if (push_scalar(tokenizer, tape, &token) != 0) {
+            return -1;
+        }
+
+        // Step 2: Close the containers the value ends
+        while (tokenizer->depth > 0) {
+            JSONType type = tokenizer->frames[tokenizer->depth - 1].type;
+            token = next_token(tokenizer);
+            if (token.type == TOKEN_COMMA) break;
+            if (token.type != (type == JSON_OBJECT ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+                set_error(tokenizer, type == JSON_OBJECT ? "Expected comma or closing brace"
+                                                         : "Expected comma or closing bracket",
+                          tokenizer->position);
+                return -1;
+            }
+            if (close_entries(tokenizer, tape) != 0) return -1;
+        }
+        if (tokenizer->depth == 0) break;
+
+        // Step 3: The next entry of the innermost container
+        token = next_token(tokenizer);
+        if (begin_entry(tokenizer, tape, &token) != 0) return -1;
+    }
+
+    if (next_token(tokenizer).type != TOKEN_EOF) {
+        set_error(tokenizer, "Unexpected data after the value", tokenizer->position);
+        return -1;
+    }
+    tape->entries[0] = tape->scratch[0];
+    return 0;
+}
+
+// Parses json into *document, decoding the strings into a buffer of the
+// document's own, or over their tokens if in_place (json itself) is given
+static int parse_into(JSONParser *parser, const char *json, size_t length, char *in_place,
+                      JSONDocument *document) {
+    JSONTokenizer tokenizer;
+    memset(document, 0, sizeof(*document));
+    document->allocator = parser->allocator;
+    start_parse(&tokenizer, parser, json, length);
+    if (length > UINT32_MAX) {
+        set_error(&tokenizer, "Document too large", 0);
+        return -1;
+    }
+
+    // Decoded strings never outgrow their quoted tokens, so one buffer of
+    // the input's size holds them all. The tape starts at a guess of one
+    // entry per 8 bytes (the root is entry 0) and doubles as needed. With
+    // an allocator the tape, scratch stack and frames all come from it and
+    // grow there, the blocks they leave behind bounded by twice the final
+    // sizes, and the tape is the document's as it stands.
+    JSONTape tape = {NULL, 1, length / 8 + 16, NULL, 0, 64, NULL};
+    if (!in_place) document->strings = json_alloc(&tokenizer, length + 1);
+    tape.entries = json_alloc(&tokenizer, tape.capacity * sizeof(JSONEntry));
+    tape.scratch = json_alloc(&tokenizer, tape.scratch_capacity * sizeof(JSONEntry));
+    int result = -1;
+    if (tape.entries && tape.scratch && (in_place || document->strings)) {
+        tape.strings_end = document->strings;
+        result = parse_tape(&tokenizer, &tape);
+    }
+    json_release(&tokenizer, tape.scratch);
+    if (tokenizer.frames != tokenizer.inline_frames) json_release(&tokenizer, tokenizer.frames);
+
+    if (result == 0 && !parser->allocator) {
+        JSONEntry *entries = realloc(tape.entries, tape.count * sizeof(JSONEntry));
+        document->entries = entries ? entries : tape.entries;
+    } else if (result == 0) {
+        document->entries = tape.entries;
+    } else {
+        json_release(&tokenizer, tape.entries);
+    }
+    document->count = tape.count;
+    if (result != 0) json_document_free(document);
+    return result;
+}
+
+int json_parse_document(JSONParser *parser, const char *json, size_t length, JSONDocument *document) {
+    return parse_into(parser, json, length, NULL, document);
+}
+
+int json_parse_document_in_place(JSONParser *parser, char *json, size_t length, JSONDocument *document) {
+    return parse_into(parser, json, length, json, document);
+}
+
+void json_document_free(JSONDocument *document) {
+    if (!document->allocator) {
+        free(document->entries);
+        free(document->strings);
+    }
+    document->entries = NULL;
+    document->strings = NULL;
+    document->count = 0;
+}
+
+const JSONEntry *json_entry_get(const JSONDocument *document, const JSONEntry *object, const char *key) {
+    if (object->type != JSON_OBJECT) return NULL;
+    size_t length = strlen(key);
+    const JSONEntry *member = &document->entries[object->first];
+    for (uint32_t i = 0; i < object->length; i++, member += 2) {
+        if (member->length == length && memcmp(member->string, key, length) == 0) return member + 1;
+    }
+    return NULL;
+}
+
+void json_document_write(const JSONDocument *document, const JSONEntry *entry, JSONWriter write, void *context) {
+    const JSONEntry *child;
+    switch (entry->type) {
+        case JSON_OBJECT:
+            child = &document->entries[entry->first];
+            write(context, "{", 1);
+            for (uint32_t i = 0; i < entry->length; i++, child += 2) {
+                if (i) write(context, ",", 1);
+                write_string(child->string, child->length, write, context);
+                write(context, ":", 1);
+                json_document_write(document, child + 1, write, context);
+            }
+            write(context, "}", 1);
+            break;
+        case JSON_ARRAY:
+            child = &document->entries[entry->first];
+            write(context, "[", 1);
+            for (uint32_t i = 0; i < entry->length; i++, child++) {
+                if (i) write(context, ",", 1);
+                json_document_write(document, child, write, context);
+            }
+            write(context, "]", 1);
+            break;
+        case JSON_STRING: write_string(entry->string, entry->length, write, context); break;
+        case JSON_NUMBER:
+            if (entry->kind == JSON_DOUBLE) write_number(entry->number, write, context);
+            else write_integer(entry->kind, entry->unsigned_integer, write, context);
+            break;
+        case JSON_BOOLEAN:
+            if (entry->boolean) write(context, "true", 4);
+            else write(context, "false", 5);
+            break;
+        case JSON_NULL: write(context, "null", 4); break;
+    }
+}
+
+size_t json_document_write_length(const JSONDocument *document, const JSONEntry *entry) {
+    size_t length = 0;
+    json_document_write(document, entry, count_bytes, &length);
+    return length;
+}
@@ -0,0 +1,213 @@
+// Minimal JSON parser and writer.
+//
+// The parser builds a tree of JSONValue nodes: objects and arrays are
+// linked lists in document order, strings are NUL-terminated copies with
+// their escapes decoded, numbers are exact 64-bit integers where they were
+// written as such and fit, doubles otherwise. It takes RFC 8259 JSON only
+// (no trailing commas, leading zeros, bare control characters, ...) and
+// valid UTF-8 only, so a decoded string is always UTF-8: surrogate pairs
+// are joined and a lone surrogate escape is an error.
+// Parsing runs in two stages: a SIMD pass (json_index.h) lists where the
+// tokens start and validates the UTF-8, and the tokenizer reads tokens
+// there only, never walking whitespace or string contents byte by byte.
+//
+// json_parse keeps everything about one parse in a JSONParser the caller
+// owns: where memory comes from, the nesting limit and the error, so any
+// number of threads can parse at once. Open containers are kept on an
+// explicit stack instead of the C stack, so the depth limit is a policy,
+// not a guard against stack overflow. parse_json is the old interface: it
+// reports errors in the global json_error and is not thread-safe.
+//
+// json_parse_document builds the same values as a JSONDocument instead: a
+// flat tape of fixed-size JSONEntry values with the children of every
+// container side by side, and the strings in one buffer. It takes a few
+// allocations where the tree needs one to three per value, indexes arrays
+// in O(1) and walks in memory order; use it unless the tree is to be edited.
+// json_parse_document_in_place goes further and decodes the strings inside
+// a writable input, with no copy at all of those that have no escapes.
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_MAX_DEPTH 512 // Default nesting limit of json_parse
+
+// JSON value types
+typedef enum {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOLEAN,
+    JSON_NULL
+} JSONType;
+
+// Which member holds a number. Numbers without a fraction or exponent that
+// fit 64 bits are kept exact; JSON_DOUBLE is 0, so a value set up with only
+// .number is a double.
+typedef enum {
+    JSON_DOUBLE,  // number
+    JSON_INT64,   // integer
+    JSON_UINT64   // unsigned_integer, above INT64_MAX
+} JSONNumberKind;
+
+// JSON value structure
+typedef struct JSONValue {
+    JSONType type;
+    JSONNumberKind kind; // JSON_NUMBER only
+    union {
+        struct JSONObject *object;
+        struct JSONArray *array;
+        char *string;
+        double number;
+        int64_t integer;
+        uint64_t unsigned_integer;
+        int boolean;
+    };
+} JSONValue;
+
+// A JSON_NUMBER as a double, rounded if it is an integer beyond 2^53
+static inline double json_value_number(const JSONValue *value) {
+    return value->kind == JSON_INT64 ? (double)value->integer
+         : value->kind == JSON_UINT64 ? (double)value->unsigned_integer : value->number;
+}
+
+// Represents a JSON object (key-value pair)
+typedef struct JSONObject {
+    char *key;               // Key (string)
+    JSONValue *value;        // Associated value
+    struct JSONObject *next; // Linked list for multiple key-value pairs
+} JSONObject;
+
+// Represents a JSON array (list of values)
+typedef struct JSONArray {
+    JSONValue *value;        // Array element
+    struct JSONArray *next;  // Linked list for multiple elements
+} JSONArray;
+
+// Error structure
+typedef struct {
+    const char *message;
+    size_t position;
+} JSONError;
+
+// Set when parse_json fails
+extern JSONError json_error;
+
+// Where parse_json_with gets its memory; alloc returns NULL when exhausted
+typedef struct {
+    void *(*alloc)(void *context, size_t size);
+    void *context;
+} JSONAllocator;
+
+// Receives json_write's output, piece by piece
+typedef void (*JSONWriter)(void *context, const char *data, size_t length);
+
+// One parse. Zero it, or set what differs from the defaults.
+typedef struct {
+    const JSONAllocator *allocator; // Where nodes and strings come from; NULL means malloc
+    int max_depth;                  // Containers that may nest; 0 means JSON_MAX_DEPTH
+    JSONError error;                // Why json_parse returned NULL
+} JSONParser;
+
+// Parses the length bytes at json, which must be followed by a NUL (and
+// must not contain one). Returns NULL on error. With an allocator the
+// document is released with the allocator's memory, else with free_json.
+JSONValue *json_parse(JSONParser *parser, const char *json, size_t length);
+
+// json_parse with malloc and the default depth limit. Returns NULL on error
+// and sets json_error.
+JSONValue *parse_json(const char *json);
+
+// Frees a document from malloc, iteratively, whatever its depth
+void free_json(JSONValue *value);
+
+// json_parse with the default depth limit, reporting errors in *error
+JSONValue *parse_json_with(const char *json, size_t length, const JSONAllocator *allocator, JSONError *error);
+
+// Serializes value as compact JSON. Strings are passed to write in place
+// wherever they need no escaping. Recurses once per level of nesting, which
+// json_parse's max_depth bounds.
+void json_write(const JSONValue *value, JSONWriter write, void *context);
+
+// Number of bytes json_write produces for value
+size_t json_write_length(const JSONValue *value);
+
+// Returns the value of the first member named key, or NULL if value is not
+// an object or has no such member
+JSONValue *json_object_get(const JSONValue *value, const char *key);
+
+// One value of a JSONDocument
+typedef struct {
+    JSONType type;
+    union {
+        uint32_t length;     // Bytes of a string, elements of an array, members of an object
+        JSONNumberKind kind; // Number: which member holds it
+    };
+    union {
+        const char *string; // UTF-8, NUL-terminated, but may hold NULs of its own (\u0000)
+        double number;
+        int64_t integer;
+        uint64_t unsigned_integer;
+        int boolean;
+        size_t first; // Container: index of its first element, or of its first member's key
+    };
+} JSONEntry;
+
+// A parsed document. An array's elements are entries[first] onwards; an
+// object's members are pairs of entries, a string key followed by its
+// value. entries[0] is the root.
+typedef struct {
+    JSONEntry *entries;
+    size_t count;
+    char *strings;                  // Every string and key, decoded; NULL if in place
+    const JSONAllocator *allocator; // The parser's; NULL means json_document_free releases it
+} JSONDocument;
+
+// Parses like json_parse into *document. Returns 0, or -1 with
+// parser->error set; documents over 4 GB are refused.
+int json_parse_document(JSONParser *parser, const char *json, size_t length, JSONDocument *document);
+
+// json_parse_document without the string buffer: each string is decoded
+// over its own token in json, which must be writable, and NUL-terminated at
+// or before its closing quote. A string without escapes stays where it is.
+// The document points into json, so json must outlive it, and json is no
+// longer the same JSON afterwards.
+int json_parse_document_in_place(JSONParser *parser, char *json, size_t length, JSONDocument *document);
+void json_document_free(JSONDocument *document);
+
+static inline const JSONEntry *json_document_root(const JSONDocument *document) {
+    return &document->entries[0];
+}
+
+// Element i of an array, i < array->length
+static inline const JSONEntry *json_entry_at(const JSONDocument *document, const JSONEntry *array, size_t i) {
+    return &document->entries[array->first + i];
+}
+
+// Key and value of member i of an object, i < object->length
+static inline const JSONEntry *json_entry_key(const JSONDocument *document, const JSONEntry *object, size_t i) {
+    return &document->entries[object->first + 2 * i];
+}
+
+static inline const JSONEntry *json_entry_value(const JSONDocument *document, const JSONEntry *object, size_t i) {
+    return &document->entries[object->first + 2 * i + 1];
+}
+
+// A number entry as a double, rounded if it is an integer beyond 2^53
+static inline double json_entry_number(const JSONEntry *entry) {
+    return entry->kind == JSON_INT64 ? (double)entry->integer
+         : entry->kind == JSON_UINT64 ? (double)entry->unsigned_integer : entry->number;
+}
+
+// Returns the value of the first member named key, or NULL if entry is not
+// an object or has no such member
+const JSONEntry *json_entry_get(const JSONDocument *document, const JSONEntry *object, const char *key);
+
+// json_write and json_write_length for entry and what it contains
+void json_document_write(const JSONDocument *document, const JSONEntry *entry, JSONWriter write, void *context);
+size_t json_document_write_length(const JSONDocument *document, const JSONEntry *entry);
+
+#endif
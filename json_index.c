@@ -0,0 +1,467 @@
+#include <string.h>
+#include "json_index.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_INDEX_X86 1
+#endif
+
+// One block's bytes by class, bit i standing for byte i
+typedef struct {
+    uint64_t structural;  // { } [ ] : ,
+    uint64_t whitespace;  // Space, tab, line feed, carriage return
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t control;     // Below 0x20, which no string may hold unescaped
+    uint64_t non_ascii;   // 0x80 and up: UTF-8 to check
+} JSONBlock;
+
+enum {
+    CLASS_STRUCTURAL = 1,
+    CLASS_WHITESPACE = 2,
+    CLASS_QUOTE = 4,
+    CLASS_BACKSLASH = 8,
+    CLASS_CONTROL = 16
+};
+
+static unsigned char byte_class[256];
+
+static void classify_scalar(const char *block, JSONBlock *masks) {
+    uint64_t structural = 0, whitespace = 0, quote = 0, backslash = 0, control = 0, non_ascii = 0;
+    for (int i = 0; i < JSON_INDEX_BLOCK; i++) {
+        unsigned c = byte_class[(unsigned char)block[i]];
+        uint64_t bit = (uint64_t)1 << i;
+        if ((unsigned char)block[i] >= 0x80) non_ascii |= bit;
+        if (c & CLASS_STRUCTURAL) structural |= bit;
+        if (c & CLASS_WHITESPACE) whitespace |= bit;
+        if (c & CLASS_QUOTE) quote |= bit;
+        if (c & CLASS_BACKSLASH) backslash |= bit;
+        if (c & CLASS_CONTROL) control |= bit;
+    }
+    masks->structural = structural;
+    masks->whitespace = whitespace;
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->control = control;
+    masks->non_ascii = non_ascii;
+}
+
+#ifdef JSON_INDEX_X86
+// Brackets and braces differ from each other in bit 0x20 only ('[' | 0x20
+// is '{'), so they take two compares; c <= 0x1f is min(c, 0x1f) == c.
+__attribute__((target("sse2"))) static void classify_sse2(const char *block, JSONBlock *masks) {
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    uint64_t structural = 0, whitespace = 0, quote = 0, backslash = 0, control = 0, non_ascii = 0;
+    for (int i = 0; i < JSON_INDEX_BLOCK; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + i));
+        __m128i folded = _mm_or_si128(bytes, case_bit);
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                                                _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+                                   _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(':')),
+                                                _mm_cmpeq_epi8(bytes, _mm_set1_epi8(','))));
+        structural |= (uint64_t)(unsigned)_mm_movemask_epi8(hit) << i;
+        hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                        _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))),
+                           _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                                        _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+        whitespace |= (uint64_t)(unsigned)_mm_movemask_epi8(hit) << i;
+        hit = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'));
+        quote |= (uint64_t)(unsigned)_mm_movemask_epi8(hit) << i;
+        hit = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'));
+        backslash |= (uint64_t)(unsigned)_mm_movemask_epi8(hit) << i;
+        hit = _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm_set1_epi8(0x1f)), bytes);
+        control |= (uint64_t)(unsigned)_mm_movemask_epi8(hit) << i;
+        non_ascii |= (uint64_t)(unsigned)_mm_movemask_epi8(bytes) << i;
+    }
+    masks->structural = structural;
+    masks->whitespace = whitespace;
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->control = control;
+    masks->non_ascii = non_ascii;
+}
+
+// The same compares on two halves of 32 bytes
+__attribute__((target("avx2"))) static void classify_avx2(const char *block, JSONBlock *masks) {
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    uint64_t structural = 0, whitespace = 0, quote = 0, backslash = 0, control = 0, non_ascii = 0;
+    for (int i = 0; i < JSON_INDEX_BLOCK; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(block + i));
+        __m256i folded = _mm256_or_si256(bytes, case_bit);
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                                                      _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(':')),
+                                                      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(','))));
+        structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+        hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                              _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))),
+                              _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                              _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+        whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+        hit = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"'));
+        quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+        hit = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\'));
+        backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+        hit = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, _mm256_set1_epi8(0x1f)), bytes);
+        control |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+        non_ascii |= (uint64_t)(uint32_t)_mm256_movemask_epi8(bytes) << i;
+    }
+    masks->structural = structural;
+    masks->whitespace = whitespace;
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->control = control;
+    masks->non_ascii = non_ascii;
+}
+
+// Keiser and Lemire's UTF-8 check, "Validating UTF-8 in less than one
+// instruction per byte" (2021). Each byte is judged with the one before by
+// three 16-entry lookups, on the high nibble of both and the low nibble of
+// the first, ANDed together; a bit left standing is an error:
+#define TOO_SHORT  (1 << 0) // 11______ 0_______, 11______ 11______
+#define TOO_LONG   (1 << 1) // 0_______ 10______
+#define OVERLONG_3 (1 << 2) // 11100000 100_____
+#define TOO_LARGE  (1 << 3) // 11110100 1001____, 11110100 101_____, 11110101+ 1001____ or 101_____
+#define SURROGATE  (1 << 4) // 11101101 101_____
+#define OVERLONG_2 (1 << 5) // 1100000_ 10______
+#define TOO_LARGE_1000 (1 << 6) // 11110101+ 1000____
+#define OVERLONG_4 (1 << 6) // 11110000 1000____
+#define TWO_CONTS  (1 << 7) // 10______ 10______
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS) // Whatever the first byte's low nibble
+#define LARGE (CARRY | TOO_LARGE | TOO_LARGE_1000)
+// Two continuation bytes in a row are no error as the third or fourth byte
+// of a character: those are found from the bytes two and three back, and
+// their TWO_CONTS bit flipped.
+static const unsigned char utf8_tables[3][16] = {
+    { // First byte's high nibble
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, // 0_______
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,                                     // 10______
+        TOO_SHORT | OVERLONG_2,                                                         // 1100____
+        TOO_SHORT,                                                                      // 1101____
+        TOO_SHORT | OVERLONG_3 | SURROGATE,                                             // 1110____
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,                            // 1111____
+    },
+    { // First byte's low nibble
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, // ____0000
+        CARRY | OVERLONG_2,                           // ____0001
+        CARRY, CARRY,                                 // ____001_
+        CARRY | TOO_LARGE,                            // ____0100
+        LARGE, LARGE, LARGE,                          // ____0101 to ____0111
+        LARGE, LARGE, LARGE, LARGE, LARGE,            // ____1000 to ____1100
+        LARGE | SURROGATE,                            // ____1101
+        LARGE, LARGE,                                 // ____111_
+    },
+    { // Second byte's high nibble
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, // 0_______
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,           // 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,                             // 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,                              // 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,                                             // 11______
+    },
+};
+
+// Whether a block may hold invalid UTF-8, given last, the final four bytes
+// of the block before, which passed. A character left unfinished at the
+// end is not counted: the next block's check sees it.
+__attribute__((target("ssse3"))) static int utf8_invalid_ssse3(const char *block, uint32_t last) {
+    const __m128i first_high = _mm_loadu_si128((const __m128i *)utf8_tables[0]);
+    const __m128i first_low = _mm_loadu_si128((const __m128i *)utf8_tables[1]);
+    const __m128i second_high = _mm_loadu_si128((const __m128i *)utf8_tables[2]);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i previous = _mm_slli_si128(_mm_cvtsi32_si128((int)last), 12);
+    __m128i error = _mm_setzero_si128();
+    for (int i = 0; i < JSON_INDEX_BLOCK; i += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(block + i));
+        __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+        __m128i prev2 = _mm_alignr_epi8(input, previous, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, previous, 13);
+        __m128i special = _mm_and_si128(
+            _mm_and_si128(_mm_shuffle_epi8(first_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                          _mm_shuffle_epi8(first_low, _mm_and_si128(prev1, nibble))),
+            _mm_shuffle_epi8(second_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+        // 0x80 where two back is 111_____ or three back is 1111____
+        __m128i continuation = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+                                                          _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80))),
+                                             _mm_set1_epi8((char)0x80));
+        error = _mm_or_si128(error, _mm_xor_si128(continuation, special));
+        previous = input;
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF;
+}
+
+// The same on 32 bytes at a time; alignr shifts within 16-byte lanes, so
+// the bytes before each lane come from a permute first
+__attribute__((target("avx2"))) static int utf8_invalid_avx2(const char *block, uint32_t last) {
+    const __m256i first_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)utf8_tables[0]));
+    const __m256i first_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)utf8_tables[1]));
+    const __m256i second_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)utf8_tables[2]));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i previous = _mm256_insert_epi32(_mm256_setzero_si256(), (int)last, 7);
+    __m256i error = _mm256_setzero_si256();
+    for (int i = 0; i < JSON_INDEX_BLOCK; i += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i *)(block + i));
+        __m256i straddle = _mm256_permute2x128_si256(previous, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, straddle, 15);
+        __m256i prev2 = _mm256_alignr_epi8(input, straddle, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, straddle, 13);
+        __m256i special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(first_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(first_low, _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(second_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+        __m256i continuation = _mm256_and_si256(
+            _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80)),
+                            _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80))),
+            _mm256_set1_epi8((char)0x80));
+        error = _mm256_or_si256(error, _mm256_xor_si256(continuation, special));
+        previous = input;
+    }
+    return !_mm256_testz_si256(error, error);
+}
+#undef TOO_SHORT
+#undef TOO_LONG
+#undef OVERLONG_3
+#undef TOO_LARGE
+#undef SURROGATE
+#undef OVERLONG_2
+#undef TOO_LARGE_1000
+#undef OVERLONG_4
+#undef TWO_CONTS
+#undef CARRY
+#undef LARGE
+#endif
+
+static void (*classify)(const char *, JSONBlock *) = classify_scalar;
+static const char *classify_isa = "scalar";
+
+// Whether a block may hold invalid UTF-8, as a vector pass finds it; NULL
+// to go straight to utf8_error, which is exact
+static int (*utf8_invalid)(const char *, uint32_t) = NULL;
+
+// Fills the byte table and picks the widest classifier the CPU supports
+// before main() runs
+__attribute__((constructor)) static void select_classifier(void) {
+    for (int c = 0; c < 0x20; c++) byte_class[c] = CLASS_CONTROL;
+    byte_class[' '] = byte_class['\t'] = byte_class['\n'] = byte_class['\r'] = CLASS_WHITESPACE;
+    byte_class['\t'] |= CLASS_CONTROL;
+    byte_class['\n'] |= CLASS_CONTROL;
+    byte_class['\r'] |= CLASS_CONTROL;
+    byte_class['{'] = byte_class['}'] = byte_class['['] = byte_class[']'] = CLASS_STRUCTURAL;
+    byte_class[':'] = byte_class[','] = CLASS_STRUCTURAL;
+    byte_class['"'] = CLASS_QUOTE;
+    byte_class['\\'] = CLASS_BACKSLASH;
+
+#ifdef JSON_INDEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) json_index_select("avx2");
+    else if (__builtin_cpu_supports("sse2")) json_index_select("sse2");
+#endif
+}
+
+const char *json_index_isa(void) {
+    return classify_isa;
+}
+
+int json_index_select(const char *isa) {
+    if (strcmp(isa, "scalar") == 0) {
+        classify = classify_scalar;
+        classify_isa = "scalar";
+        utf8_invalid = NULL;
+        return 0;
+    }
+#ifdef JSON_INDEX_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        classify = classify_sse2;
+        classify_isa = "sse2";
+        utf8_invalid = __builtin_cpu_supports("ssse3") ? utf8_invalid_ssse3 : NULL;
+        return 0;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        classify = classify_avx2;
+        classify_isa = "avx2";
+        utf8_invalid = utf8_invalid_avx2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+// Bytes preceded by an odd number of backslashes. A run of backslashes that
+// starts on an even bit and has odd length ends on an even bit, so adding
+// each run's start to the run carries past its end onto the escaped byte,
+// and the parity of where runs start sorts out which of those ends count.
+// *carry holds whether the next block's first byte is escaped.
+static uint64_t find_escaped(uint64_t backslash, uint64_t *carry) {
+    const uint64_t even = 0x5555555555555555ULL;
+    if (!backslash) {
+        uint64_t escaped = *carry;
+        *carry = 0;
+        return escaped;
+    }
+    backslash &= ~*carry;  // An escaped backslash starts no run
+    uint64_t follows_escape = backslash << 1 | *carry;
+    uint64_t odd_starts = backslash & ~even & ~follows_escape;
+    uint64_t even_runs;
+    *carry = __builtin_add_overflow(odd_starts, backslash, &even_runs);
+    return (even ^ even_runs << 1) & follows_escape;
+}
+
+// Bit i becomes the XOR of bits 0 to i: from each opening quote up to (not
+// including) its closing one
+static uint64_t prefix_xor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+#define UTF8_VALID ((size_t)-1)
+
+// Checks the UTF-8 of a block byte by byte, given last, the final four
+// bytes of the block before, which passed. Returns the offset in the input
+// where the first invalid character starts, or UTF8_VALID. A character the
+// block leaves unfinished is the next one's to check; after the input come
+// spaces, which finish none. The second byte's range rules out overlong
+// forms, surrogates and code points past U+10FFFF (RFC 3629).
+static size_t utf8_error(uint32_t last, const char *block, size_t offset) {
+    unsigned char bytes[3 + JSON_INDEX_BLOCK];
+    memcpy(bytes, (const char *)&last + 1, 3);
+    memcpy(bytes + 3, block, JSON_INDEX_BLOCK);
+
+    // Start with the character the block before left unfinished, if any
+    size_t i = bytes[0] >= 0xF0 ? 0 : bytes[1] >= 0xE0 ? 1 : bytes[2] >= 0xC0 ? 2 : 3;
+    while (i < sizeof(bytes)) {
+        unsigned c = bytes[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        if (c < 0xC2 || c > 0xF4) return offset + i - 3;
+        size_t n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+        unsigned low = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+        unsigned high = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+        for (size_t k = 1; k < n; k++) {
+            if (i + k == sizeof(bytes)) return UTF8_VALID;
+            unsigned next = bytes[i + k];
+            if (k == 1 ? next < low || next > high : (next & 0xC0) != 0x80) return offset + i - 3;
+        }
+        i += n;
+    }
+    return UTF8_VALID;
+}
+
+void json_index_init(JSONIndex *index, const char *json, size_t length) {
+    index->json = json;
+    index->length = length;
+    index->offset = 0;
+    index->escaped = 0;
+    index->in_string = 0;
+    index->scalar = 0;
+    index->last = 0;
+    index->utf8_open = 0;
+    index->count = 0;
+    index->next = 0;
+    index->error = NULL;
+    index->error_position = 0;
+}
+
+size_t json_index_fill(JSONIndex *index) {
+    // The state lives in locals while the batch is built: stores through
+    // out could alias the struct's size_t fields and force reloads
+    const char *json = index->json;
+    size_t length = index->length, offset = index->offset;
+    uint64_t escaped = index->escaped, prev_in_string = index->in_string, prev_scalar = index->scalar;
+    uint32_t last = index->last;
+    int utf8_open = index->utf8_open;
+    size_t *out = index->positions;
+    size_t *full = index->positions + JSON_INDEX_BATCH;
+
+    while (out < full && offset < length) {
+        // Step 1: Classify a block. The last one is padded with spaces.
+        const char *block = json + offset;
+        char tail[JSON_INDEX_BLOCK];
+        if (length - offset < JSON_INDEX_BLOCK) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - offset);
+            block = tail;
+        }
+        JSONBlock masks;
+        classify(block, &masks);
+
+        // Step 2: Find the strings. Escaped quotes are content; the rest
+        // toggle in and out of a string.
+        uint64_t quote = masks.quote & ~find_escaped(masks.backslash, &escaped);
+        uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+        // Step 3: Tokens other than strings and punctuation start where a
+        // byte of theirs follows anything else
+        uint64_t scalar = ~(masks.structural | masks.whitespace | quote | in_string);
+        uint64_t starts = scalar & ~(scalar << 1 | prev_scalar);
+        prev_scalar = scalar >> 63;
+        uint64_t bits = (masks.structural & ~in_string) | quote | starts;
+
+        // Step 4: Stop at a control character inside a string or at the
+        // first invalid UTF-8, keeping the positions before it. A block of
+        // ASCII needs no UTF-8 check unless a character runs into it.
+        const char *error = NULL;
+        uint64_t bad = masks.control & in_string;
+        if (bad | masks.non_ascii | (uint64_t)utf8_open) {
+            size_t at = 0;
+            if (bad) {
+                error = "Control character in string";
+                at = offset + __builtin_ctzll(bad);
+            }
+            if (masks.non_ascii || utf8_open) {
+                if (!utf8_invalid || utf8_invalid(block, last)) {
+                    size_t invalid = utf8_error(last, block, offset);
+                    if (invalid != UTF8_VALID && (!error || invalid < at)) {
+                        error = "Invalid UTF-8";
+                        at = invalid;
+                    }
+                }
+                const unsigned char *end = (const unsigned char *)block + JSON_INDEX_BLOCK;
+                utf8_open = end[-1] >= 0xC0 || end[-2] >= 0xE0 || end[-3] >= 0xF0;
+                // Blocks of ASCII in between leave it be: a block that
+                // ends with no character open reads the same as ASCII
+                memcpy(&last, end - 4, 4);
+            }
+            if (error) {
+                bits &= at > offset ? ((uint64_t)1 << (at - offset)) - 1 : 0;
+                index->error = error;
+                index->error_position = at;
+            }
+        }
+
+        // Step 5: List the positions
+        while (bits) {
+            *out++ = offset + __builtin_ctzll(bits);
+            bits &= bits - 1;
+        }
+        offset = error ? length : offset + JSON_INDEX_BLOCK;
+    }
+
+    // The input ends in the middle of a character
+    if (offset == length && utf8_open && !index->error) {
+        char spaces[JSON_INDEX_BLOCK];
+        memset(spaces, ' ', sizeof(spaces));
+        index->error = "Invalid UTF-8";
+        index->error_position = utf8_error(last, spaces, offset);
+        utf8_open = 0;
+    }
+
+    index->offset = offset;
+    index->escaped = escaped;
+    index->in_string = prev_in_string;
+    index->scalar = prev_scalar;
+    index->last = last;
+    index->utf8_open = utf8_open;
+    index->count = out - index->positions;
+    index->next = 0;
+    return index->count;
+}
@@ -0,0 +1,72 @@
+// Stage 1 of JSON parsing: the structural index.
+//
+// A JSONIndex classifies its input 64 bytes at a time into bitmasks with
+// SIMD compares: structural characters, quotes, backslashes, whitespace and
+// control characters. From those it works out which quotes are escaped
+// (odd runs of backslashes) and, with a prefix XOR over the quotes, which
+// bytes lie inside strings. What it hands out are the positions stage 2
+// (the tokenizer in json.c) has to look at, in order:
+//   - every { } [ ] : , outside strings;
+//   - every unescaped quote, the opening and the closing one of a string;
+//   - the first byte of any other token (number, literal or garbage).
+// Whitespace and string contents are never looked at byte by byte again.
+//
+// Blocks with bytes of 0x80 and up are also checked for valid UTF-8;
+// blocks of ASCII, the common case, cost one movemask.
+//
+// Positions come in batches of JSON_INDEX_BATCH, so the index stays in L1
+// and a large document needs no index the size of its input. Indexing stops
+// at a control character inside a string or at invalid UTF-8; the positions
+// before it are still handed out, so an earlier syntax error is reported
+// first.
+//
+// The classifier is picked for the CPU when the program starts: AVX2 or
+// SSE2 on x86, a table lookup elsewhere. UTF-8 is checked with AVX2 along
+// with the AVX2 classifier, with SSSE3 along with the SSE2 one when the CPU
+// has it, and byte by byte otherwise.
+
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_INDEX_BLOCK 64   // Bytes classified per step, one bit each
+#define JSON_INDEX_BATCH 512  // Positions collected per refill
+
+typedef struct {
+    const char *json;
+    size_t length;
+    size_t offset;         // Start of the next block to classify
+    uint64_t escaped;      // 1 if the next block starts with an escaped byte
+    uint64_t in_string;    // All ones if the last block ended inside a string
+    uint64_t scalar;       // 1 if the last block ended inside a token
+    uint32_t last;         // Final four bytes of the last block whose UTF-8 was checked
+    int utf8_open;         // The last block may have ended inside a UTF-8 character
+    size_t count, next;    // Positions held, and the next one to hand out
+    const char *error;     // Why indexing stopped before the end, or NULL
+    size_t error_position;
+    size_t positions[JSON_INDEX_BATCH + JSON_INDEX_BLOCK];
+} JSONIndex;
+
+void json_index_init(JSONIndex *index, const char *json, size_t length);
+
+// Classifies blocks until a batch of positions is collected. Returns how
+// many there are, 0 at the end of the input or when indexing has stopped.
+size_t json_index_fill(JSONIndex *index);
+
+// The next position, refilling as needed. Returns 0 when there is none.
+static inline int json_index_next(JSONIndex *index, size_t *position) {
+    if (index->next == index->count && json_index_fill(index) == 0) return 0;
+    *position = index->positions[index->next++];
+    return 1;
+}
+
+// Name of the classifier in use ("avx2", "sse2", "scalar")
+const char *json_index_isa(void);
+
+// Switches to the named classifier, for benchmarks. Returns -1 if the CPU
+// or the build does not have it.
+int json_index_select(const char *isa);
+
+#endif
@@ -0,0 +1,37 @@
+// Number conversion for the JSON parser, without strtod.
+//
+// json_parse_number checks the RFC 8259 grammar and converts in the same
+// pass. A number written without a fraction or exponent that fits 64 bits
+// comes out as an exact int64_t, or uint64_t above INT64_MAX, so IDs keep
+// every digit. Anything else becomes the nearest double:
+//   - up to 2^53 with a power of ten up to 22, by one exact multiply or
+//     divide (Clinger's fast path);
+//   - otherwise by the Eisel-Lemire method: the first 19 significant
+//     digits times a 128-bit approximation of the power of ten, which
+//     decides the rounding except for inputs of more than 19 digits that
+//     lie too close to a halfway point;
+//   - those few go to strtod_l in the "C" locale, which is correctly
+//     rounded and immune to the process's LC_NUMERIC.
+
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "json.h"
+
+typedef struct {
+    JSONNumberKind kind;
+    union {
+        double number;
+        int64_t integer;
+        uint64_t unsigned_integer;
+    };
+} JSONNumber;
+
+// Parses the number at text, which ends at the first byte that cannot
+// continue it (a NUL will do). Returns its length, or 0 if it does not
+// follow the grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+size_t json_parse_number(const char *text, JSONNumber *number);
+
+#endif
@@ -18,6 +18,130 @@ char *trim_whitespace(char *str)
     return str;
 }
 
+// Value of one hex digit, or -1
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Reads the four hex digits after a \u, or returns -1
+static long read_hex4(const char *p)
+{
+    long code = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int digit = hex_digit(p[i]);
+        if (digit < 0)
+            return -1;
+        code = code * 16 + digit;
+    }
+    return code;
+}
+
+// Function to copy a string value, decoding its escapes. p is just past the
+// opening quote. \uXXXX becomes UTF-8, a surrogate pair one four-byte
+// character. Returns the closing quote, or NULL if the string is malformed
+// or does not fit value_size.
+static const char *copy_json_string(const char *p, char *value, int value_size)
+{
+    int length = 0;
+    while (*p != '"')
+    {
+        char decoded[4];
+        int count = 1;
+        if (*p == '\0' || (unsigned char)*p < 0x20)
+        {
+            printf("Malformed JSON (missing closing quote for string).\n");
+            return NULL;
+        }
+        if (*p != '\\')
+        {
+            decoded[0] = *p++;
+        }
+        else
+        {
+            p++;
+            switch (*p++)
+            {
+            case '"': decoded[0] = '"'; break;
+            case '\\': decoded[0] = '\\'; break;
+            case '/': decoded[0] = '/'; break;
+            case 'b': decoded[0] = '\b'; break;
+            case 'f': decoded[0] = '\f'; break;
+            case 'n': decoded[0] = '\n'; break;
+            case 'r': decoded[0] = '\r'; break;
+            case 't': decoded[0] = '\t'; break;
+            case 'u':
+            {
+                long code = read_hex4(p);
+                if (code < 0)
+                {
+                    printf("Malformed JSON (bad \\u escape).\n");
+                    return NULL;
+                }
+                p += 4;
+                if (code >= 0xD800 && code <= 0xDFFF)
+                {
+                    // A high surrogate must be followed by \u and a low one
+                    long low = code <= 0xDBFF && p[0] == '\\' && p[1] == 'u' ? read_hex4(p + 2) : -1;
+                    if (low < 0xDC00 || low > 0xDFFF)
+                    {
+                        printf("Malformed JSON (unpaired surrogate).\n");
+                        return NULL;
+                    }
+                    p += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                if (code < 0x80)
+                {
+                    decoded[0] = (char)code;
+                }
+                else if (code < 0x800)
+                {
+                    decoded[0] = (char)(0xC0 | code >> 6);
+                    decoded[1] = (char)(0x80 | (code & 0x3F));
+                    count = 2;
+                }
+                else if (code < 0x10000)
+                {
+                    decoded[0] = (char)(0xE0 | code >> 12);
+                    decoded[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    decoded[2] = (char)(0x80 | (code & 0x3F));
+                    count = 3;
+                }
+                else
+                {
+                    decoded[0] = (char)(0xF0 | code >> 18);
+                    decoded[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+                    decoded[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    decoded[3] = (char)(0x80 | (code & 0x3F));
+                    count = 4;
+                }
+                break;
+            }
+            default:
+                printf("Malformed JSON (bad escape).\n");
+                return NULL;
+            }
+        }
+        if (length + count >= value_size)
+        {
+            printf("Value buffer too small.\n");
+            return NULL;
+        }
+        memcpy(value + length, decoded, count);
+        length += count;
+    }
+    value[length] = '\0';
+    return p;
+}
+
 // Function to find a value by key in a simple JSON string
 char *find_json_value(const char *json, const char *key, char *value, int value_size)
 {
@@ -40,28 +164,18 @@ char *find_json_value(const char *json, const char *key, char *value, int value_
         return NULL;
     }
 
-    // Move past the colon and trim whitespace
-    char *value_start = trim_whitespace(colon_pos + 1);
+    // Move past the colon and the whitespace after it. json is the
+    // caller's and may be read-only, so nothing is written to it.
+    const char *value_start = colon_pos + 1;
+    while (isspace((unsigned char)*value_start))
+        value_start++;
 
     // Determine the value type
     if (*value_start == '"')
     {
-        // String value
-        value_start++; // Skip the opening quote
-        char *end_quote = strchr(value_start, '"');
-        if (!end_quote)
-        {
-            printf("Malformed JSON (missing closing quote for string).\n");
-            return NULL;
-        }
-        int length = end_quote - value_start;
-        if (length >= value_size)
-        {
-            printf("Value buffer too small.\n");
+        // String value, up to the first quote that is not escaped
+        if (!copy_json_string(value_start + 1, value, value_size))
             return NULL;
-        }
-        strncpy(value, value_start, length);
-        value[length] = '\0';
     }
     else if (isdigit(*value_start) || *value_start == '-')
     {
@@ -94,7 +208,7 @@ char *find_json_value(const char *json, const char *key, char *value, int value_
 int main()
 {
     // Example JSON string
-    const char *json = "{\"name\": \"John\", \"age\": 30, \"isStudent\": false}";
+    const char *json = "{\"name\": \"John \\\"Jack\\\" Doe \\u00e9\\ud83d\\ude00\", \"age\": 30, \"isStudent\": false}";
 
     char value[BUFFER_SIZE];
 
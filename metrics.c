@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+
+Metrics *metrics_create(void)
+{
+    Metrics *metrics = aligned_alloc(_Alignof(Metrics), sizeof(Metrics));
+    if (metrics)
+        memset(metrics, 0, sizeof(*metrics));
+    return metrics;
+}
+
+void metrics_free(Metrics *metrics)
+{
+    free(metrics);
+}
+
+// Index of the smallest bucket bound (1 us << index) that is >= latency
+static int latency_bucket(uint64_t latency_ns)
+{
+    uint64_t us = (latency_ns + 999) / 1000;
+    if (us <= 1)
+        return 0;
+    int bucket = 64 - __builtin_clzll(us - 1);
+    return bucket < METRICS_LATENCY_BUCKETS ? bucket : METRICS_LATENCY_BUCKETS;
+}
+
+void metrics_record_request(Metrics *metrics, int route, int status, uint64_t latency_ns)
+{
+    if (route < 0 || route >= METRICS_MAX_ROUTES)
+        route = METRICS_MAX_ROUTES;
+    int class = status / 100 - 1;
+    if (class < 0 || class >= METRICS_STATUS_CLASSES)
+        class = METRICS_STATUS_CLASSES - 1;
+
+    RouteMetrics *counters = &metrics->routes[route];
+    metrics_add(&counters->requests[class], 1);
+    metrics_add(&counters->latency[latency_bucket(latency_ns)], 1);
+    metrics_add(&counters->latency_sum_ns, latency_ns);
+}
+
+static uint64_t load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Sums one counter, at offset bytes into Metrics, over all blocks
+static uint64_t sum(Metrics *const *blocks, int count, size_t offset)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += load((const uint64_t *)((const char *)blocks[i] + offset));
+    return total;
+}
+
+#define SUM(field) sum(blocks, count, offsetof(Metrics, field))
+
+static void print_counter(FILE *out, const char *name, const char *help, const char *type, uint64_t value)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type, name,
+            (unsigned long long)value);
+}
+
+char *metrics_format(Metrics *const *blocks, int count, const Router *router, size_t *length)
+{
+    char *text;
+    FILE *out = open_memstream(&text, length);
+    if (!out)
+        return NULL;
+
+    // Step 1: Connection and byte counters
+    uint64_t accepts = SUM(accepts);
+    uint64_t closes = SUM(closes);
+    print_counter(out, "http_connections_accepted_total", "Connections accepted.", "counter", accepts);
+    print_counter(out, "http_connections_open", "Connections currently open.", "gauge",
+                  accepts > closes ? accepts - closes : 0);
+    print_counter(out, "http_received_bytes_total", "Bytes read from clients.", "counter", SUM(bytes_in));
+    print_counter(out, "http_sent_bytes_total", "Bytes written to clients.", "counter", SUM(bytes_out));
+    print_counter(out, "http_parse_errors_total", "Requests rejected as malformed.", "counter",
+                  SUM(parse_errors));
+    print_counter(out, "http_access_log_dropped_total", "Access log records dropped because the ring was full.",
+                  "counter", SUM(log_drops));
+    fputs("# HELP http_timeouts_total Connections closed because a deadline passed.\n"
+          "# TYPE http_timeouts_total counter\n", out);
+    for (int kind = 0; kind < TIMEOUT_KINDS; kind++)
+        fprintf(out, "http_timeouts_total{kind=\"%s\"} %llu\n", timeout_names[kind],
+                (unsigned long long)SUM(timeouts[kind]));
+
+    // Step 2: Requests and latency per route, for the routes that saw any
+    int routes = router_route_count(router);
+    if (routes > METRICS_MAX_ROUTES)
+        routes = METRICS_MAX_ROUTES;
+    fputs("# HELP http_requests_total Requests answered, by route and status class.\n"
+          "# TYPE http_requests_total counter\n", out);
+    for (int route = 0; route <= METRICS_MAX_ROUTES; route++)
+    {
+        if (route >= routes && route < METRICS_MAX_ROUTES)
+            continue;
+        const char *method = "", *pattern = "(unmatched)";
+        if (route < METRICS_MAX_ROUTES)
+            router_route_info(router, route, &method, &pattern);
+        for (int class = 0; class < METRICS_STATUS_CLASSES; class++)
+        {
+            uint64_t requests = SUM(routes[route].requests[class]);
+            if (requests > 0)
+                fprintf(out, "http_requests_total{method=\"%s\",route=\"%s\",code=\"%dxx\"} %llu\n", method,
+                        pattern, class + 1, (unsigned long long)requests);
+        }
+    }
+
+    fputs("# HELP http_request_duration_seconds Time from a request's arrival to its queued response.\n"
+          "# TYPE http_request_duration_seconds histogram\n", out);
+    for (int route = 0; route <= METRICS_MAX_ROUTES; route++)
+    {
+        if (route >= routes && route < METRICS_MAX_ROUTES)
+            continue;
+        const char *method = "", *pattern = "(unmatched)";
+        if (route < METRICS_MAX_ROUTES)
+            router_route_info(router, route, &method, &pattern);
+
+        uint64_t cumulative = 0;
+        for (int bucket = 0; bucket <= METRICS_LATENCY_BUCKETS; bucket++)
+            cumulative += SUM(routes[route].latency[bucket]);
+        if (cumulative == 0)
+            continue;
+
+        cumulative = 0;
+        for (int bucket = 0; bucket <= METRICS_LATENCY_BUCKETS; bucket++)
+        {
+            cumulative += SUM(routes[route].latency[bucket]);
+            if (bucket < METRICS_LATENCY_BUCKETS)
+                fprintf(out, "http_request_duration_seconds_bucket{method=\"%s\",route=\"%s\",le=\"%g\"} %llu\n",
+                        method, pattern, (double)(1ULL << bucket) / 1e6, (unsigned long long)cumulative);
+            else
+                fprintf(out, "http_request_duration_seconds_bucket{method=\"%s\",route=\"%s\",le=\"+Inf\"} %llu\n",
+                        method, pattern, (unsigned long long)cumulative);
+        }
+        fprintf(out, "http_request_duration_seconds_sum{method=\"%s\",route=\"%s\"} %.9f\n", method, pattern,
+                SUM(routes[route].latency_sum_ns) / 1e9);
+        fprintf(out, "http_request_duration_seconds_count{method=\"%s\",route=\"%s\"} %llu\n", method, pattern,
+                (unsigned long long)cumulative);
+    }
+
+    if (fclose(out) != 0)
+    {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
@@ -0,0 +1,61 @@
+// Server metrics kept per worker thread and exported in the Prometheus
+// text format.
+//
+// Every worker owns one Metrics block and is the only thread that writes
+// it; a scrape sums all blocks. Counters are updated with relaxed atomic
+// stores of a plain increment, which costs no more than an ordinary add on
+// the hot path, and read with relaxed atomic loads, so a scrape sees each
+// counter whole but may see two counters at slightly different moments.
+// Blocks are allocated on their own cache lines so workers never share one.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "router.h"
+#include "server.h"
+
+#define METRICS_MAX_ROUTES 64      // Further routes are counted as unmatched requests
+#define METRICS_LATENCY_BUCKETS 24 // Upper bounds 1 us, 2 us, 4 us ... 8.4 s, then +Inf
+#define METRICS_STATUS_CLASSES 5   // 1xx to 5xx
+
+// Requests answered under one route
+typedef struct
+{
+    uint64_t requests[METRICS_STATUS_CLASSES];
+    uint64_t latency[METRICS_LATENCY_BUCKETS + 1]; // Not cumulative; the last is +Inf
+    uint64_t latency_sum_ns;
+} RouteMetrics;
+
+typedef struct Metrics
+{
+    uint64_t accepts;
+    uint64_t closes;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t parse_errors;
+    uint64_t timeouts[TIMEOUT_KINDS];
+    uint64_t log_drops; // Access log records lost to a full ring
+    RouteMetrics routes[METRICS_MAX_ROUTES + 1]; // The last one: no route matched
+} __attribute__((aligned(64))) Metrics;
+
+// Returns a zeroed block, or NULL if memory is exhausted
+Metrics *metrics_create(void);
+void metrics_free(Metrics *metrics);
+
+// Adds to a counter of the calling thread's own block
+static inline void metrics_add(uint64_t *counter, uint64_t amount)
+{
+    __atomic_store_n(counter, *counter + amount, __ATOMIC_RELAXED);
+}
+
+// Counts one answered request. route is RouteMatch.route, or -1 if none
+// matched; latency runs from the request's arrival to its queued response.
+void metrics_record_request(Metrics *metrics, int route, int status, uint64_t latency_ns);
+
+// Sums the blocks of count workers and formats them, with routes labelled
+// from router. Returns a malloc'd string of *length bytes, or NULL.
+char *metrics_format(Metrics *const *blocks, int count, const Router *router, size_t *length);
+
+#endif
@@ -0,0 +1,350 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include "response_builder.h"
+
+#define CHUNK_SIZE 4096
+
+struct ResponseChunk
+{
+    ResponseChunk *next;
+    size_t capacity;
+    size_t used;
+    char data[];
+};
+
+void response_init(ResponseBuilder *builder, Arena *arena)
+{
+    memset(builder, 0, sizeof(*builder));
+    builder->arena = arena;
+}
+
+static void *allocate(ResponseBuilder *builder, size_t size)
+{
+    return builder->arena ? arena_alloc(builder->arena, size) : malloc(size);
+}
+
+// Grows an array to capacity elements, keeping the first count
+static void *grow(ResponseBuilder *builder, void *array, size_t count, size_t capacity, size_t element)
+{
+    if (!builder->arena)
+        return realloc(array, capacity * element);
+    void *grown = arena_alloc(builder->arena, capacity * element);
+    if (grown && count > 0)
+        memcpy(grown, array, count * element);
+    return grown;
+}
+
+static void release_files(ResponseBuilder *builder)
+{
+    for (int i = 0; i < builder->file_count; i++)
+    {
+        if (builder->files[i].release)
+            builder->files[i].release(builder->files[i].context);
+    }
+    builder->file_count = 0;
+    builder->file_sent = 0;
+}
+
+void response_reset(ResponseBuilder *builder)
+{
+    release_files(builder);
+    for (ResponseChunk *chunk = builder->chunks; chunk; chunk = chunk->next)
+        chunk->used = 0;
+    builder->current = builder->chunks;
+    builder->iov_count = 0;
+    builder->iov_sent = 0;
+    builder->pending = 0;
+}
+
+void response_release(ResponseBuilder *builder)
+{
+    release_files(builder);
+    if (!builder->arena)
+    {
+        free(builder->files);
+        ResponseChunk *chunk = builder->chunks;
+        while (chunk)
+        {
+            ResponseChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(builder->iov);
+    }
+    response_init(builder, builder->arena);
+}
+
+// Returns 0, or -1 if the iovec list could not grow and the builder failed
+static int push_iovec(ResponseBuilder *builder, const void *data, size_t length)
+{
+    if (builder->iov_count == builder->iov_capacity)
+    {
+        int capacity = builder->iov_capacity ? builder->iov_capacity * 2 : 16;
+        struct iovec *iov = grow(builder, builder->iov, builder->iov_count, capacity, sizeof(struct iovec));
+        if (!iov)
+        {
+            builder->failed = 1;
+            return -1;
+        }
+        builder->iov = iov;
+        builder->iov_capacity = capacity;
+    }
+    builder->iov[builder->iov_count].iov_base = (void *)data;
+    builder->iov[builder->iov_count].iov_len = length;
+    builder->iov_count++;
+    return 0;
+}
+
+void response_add(ResponseBuilder *builder, const void *data, size_t length)
+{
+    if (length == 0 || push_iovec(builder, data, length) != 0)
+        return;
+    builder->pending += length;
+}
+
+void response_add_file(ResponseBuilder *builder, int fd, off_t offset, size_t length,
+                       void (*release)(void *context), void *context)
+{
+    if (length == 0)
+    {
+        if (release)
+            release(context);
+        return;
+    }
+    if (builder->file_count == builder->file_capacity)
+    {
+        int capacity = builder->file_capacity ? builder->file_capacity * 2 : 4;
+        ResponseFile *files = grow(builder, builder->files, builder->file_count, capacity, sizeof(ResponseFile));
+        if (!files)
+        {
+            builder->failed = 1;
+            if (release)
+                release(context);
+            return;
+        }
+        builder->files = files;
+        builder->file_capacity = capacity;
+    }
+    if (push_iovec(builder, NULL, length) != 0)
+    {
+        if (release)
+            release(context);
+        return;
+    }
+    ResponseFile *file = &builder->files[builder->file_count++];
+    file->fd = fd;
+    file->offset = offset;
+    file->release = release;
+    file->context = context;
+    builder->pending += length;
+}
+
+// Returns space for at least length bytes at the end of the current chunk,
+// moving on to a reused or new chunk when it does not fit, or NULL if a new
+// one cannot be had and the builder failed.
+static char *reserve(ResponseBuilder *builder, size_t length)
+{
+    ResponseChunk *chunk = builder->current;
+    while (chunk && chunk->capacity - chunk->used < length)
+    {
+        chunk = chunk->next;
+        if (chunk && chunk->used != 0)
+            chunk = NULL; // Only chunks rewound by response_reset are reusable
+    }
+
+    if (!chunk)
+    {
+        size_t capacity = length > CHUNK_SIZE ? length : CHUNK_SIZE;
+        chunk = allocate(builder, sizeof(ResponseChunk) + capacity);
+        if (!chunk)
+        {
+            builder->failed = 1;
+            return NULL;
+        }
+        chunk->capacity = capacity;
+        chunk->used = 0;
+        // Splice in after the current chunk so reuse order stays sequential
+        if (builder->current)
+        {
+            chunk->next = builder->current->next;
+            builder->current->next = chunk;
+        }
+        else
+        {
+            chunk->next = builder->chunks;
+            builder->chunks = chunk;
+        }
+    }
+
+    builder->current = chunk;
+    return chunk->data + chunk->used;
+}
+
+// Records length bytes just written at the end of the current chunk,
+// extending the previous iovec when the bytes directly follow it.
+static void commit(ResponseBuilder *builder, char *start, size_t length)
+{
+    builder->current->used += length;
+    if (builder->iov_count > builder->iov_sent)
+    {
+        struct iovec *last = &builder->iov[builder->iov_count - 1];
+        if ((char *)last->iov_base + last->iov_len == start)
+        {
+            last->iov_len += length;
+            builder->pending += length;
+            return;
+        }
+    }
+    if (push_iovec(builder, start, length) == 0)
+        builder->pending += length;
+}
+
+void response_add_copy(ResponseBuilder *builder, const void *data, size_t length)
+{
+    if (length == 0)
+        return;
+    char *start = reserve(builder, length);
+    if (!start)
+        return;
+    memcpy(start, data, length);
+    commit(builder, start, length);
+}
+
+void response_addf(ResponseBuilder *builder, const char *format, ...)
+{
+    va_list args;
+    size_t space = builder->current ? builder->current->capacity - builder->current->used : 0;
+    char *start = builder->current ? builder->current->data + builder->current->used : NULL;
+
+    va_start(args, format);
+    int length = vsnprintf(start, space, format, args);
+    va_end(args);
+    if (length <= 0)
+        return;
+
+    if ((size_t)length >= space)
+    {
+        // Did not fit: format again into a chunk with room for the terminator
+        start = reserve(builder, length + 1);
+        if (!start)
+            return;
+        va_start(args, format);
+        vsnprintf(start, length + 1, format, args);
+        va_end(args);
+    }
+    commit(builder, start, length);
+}
+
+// Sends the file range at the front of the queue
+static ssize_t send_file_range(ResponseBuilder *builder, int fd)
+{
+    struct iovec *iov = &builder->iov[builder->iov_sent];
+    ResponseFile *file = &builder->files[builder->file_sent];
+
+    ssize_t sent = sendfile(fd, file->fd, &file->offset, iov->iov_len);
+    if (sent == 0)
+    {
+        errno = EIO; // File shrank underneath us; the response can't be finished
+        return -1;
+    }
+    if (sent > 0)
+    {
+        builder->pending -= sent;
+        iov->iov_len -= sent;
+        if (iov->iov_len == 0)
+        {
+            builder->iov_sent++;
+            builder->file_sent++;
+        }
+    }
+    return sent;
+}
+
+size_t response_prepare_send(ResponseBuilder *builder, struct msghdr *message, int *more)
+{
+    if (builder->failed)
+    {
+        // Left to response_flush to report
+        memset(message, 0, sizeof(*message));
+        *more = 0;
+        return 0;
+    }
+    int first = builder->iov_sent;
+    int count = 0;
+    size_t length = 0;
+    while (first + count < builder->iov_count && count < IOV_MAX &&
+           builder->iov[first + count].iov_base != NULL)
+        length += builder->iov[first + count++].iov_len;
+    *more = first + count < builder->iov_count;
+
+    memset(message, 0, sizeof(*message));
+    message->msg_iov = &builder->iov[first];
+    message->msg_iovlen = count;
+    return length;
+}
+
+void response_advance(ResponseBuilder *builder, size_t sent)
+{
+    // Step past fully sent iovecs and trim the one the write stopped in
+    builder->pending -= sent;
+    while (sent > 0)
+    {
+        struct iovec *iov = &builder->iov[builder->iov_sent];
+        if (sent >= iov->iov_len)
+        {
+            sent -= iov->iov_len;
+            builder->iov_sent++;
+        }
+        else
+        {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+            sent = 0;
+        }
+    }
+}
+
+// Sends the run of in-memory pieces at the front of the queue
+static ssize_t send_iovecs(ResponseBuilder *builder, int fd)
+{
+    struct msghdr message;
+    int more;
+    response_prepare_send(builder, &message, &more);
+
+    ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    if (sent > 0)
+        response_advance(builder, sent);
+    return sent;
+}
+
+int response_flush(ResponseBuilder *builder, int fd)
+{
+    if (builder->failed)
+    {
+        errno = ENOMEM;
+        return RESPONSE_ERROR;
+    }
+    while (builder->pending > 0)
+    {
+        builder->syscalls++;
+        ssize_t sent = builder->iov[builder->iov_sent].iov_base == NULL
+                           ? send_file_range(builder, fd)
+                           : send_iovecs(builder, fd);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return RESPONSE_PENDING;
+            return RESPONSE_ERROR;
+        }
+    }
+    return RESPONSE_DONE;
+}
@@ -0,0 +1,116 @@
+// Vectored response assembly.
+//
+// A ResponseBuilder collects the pieces of one or more responses (status
+// lines, header blocks, bodies) as an iovec list and sends them with a single
+// sendmsg(). Long-lived bytes such as prebuilt responses are referenced in
+// place; bytes produced on the fly are copied or formatted into chunk storage
+// that never moves, so the iovecs stay valid until the batch is sent. File
+// ranges can be queued between them and go out with sendfile(), never passing
+// through user space. A flush that only gets part of the batch out remembers
+// where it stopped and resumes on the next call.
+//
+// Given an Arena, the builder takes all of its memory from it and never
+// frees anything itself; the arena's owner resets both together. When
+// memory runs out, what could not be queued is dropped and the builder is
+// marked failed: response_flush then reports RESPONSE_ERROR, since the
+// batch can no longer go out whole, and the connection should be closed.
+
+#ifndef RESPONSE_BUILDER_H
+#define RESPONSE_BUILDER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "arena.h"
+
+// response_flush results
+#define RESPONSE_ERROR -1   // Socket error; close the connection
+#define RESPONSE_PENDING 0  // Socket buffer full; call again when writable
+#define RESPONSE_DONE 1     // Everything queued has been sent
+
+typedef struct ResponseChunk ResponseChunk;
+
+// A file range queued with response_add_file. Its iovec slot has a NULL base.
+typedef struct
+{
+    int fd;
+    off_t offset;
+    void (*release)(void *context); // Called once the range is sent or dropped
+    void *context;
+} ResponseFile;
+
+typedef struct
+{
+    Arena *arena;          // Where the memory below comes from, or NULL for malloc
+    struct iovec *iov;
+    int iov_count;
+    int iov_capacity;
+    int iov_sent;          // First iovec not completely sent yet
+    size_t pending;        // Bytes queued and not sent yet
+    ResponseChunk *chunks; // Storage for copied and formatted bytes
+    ResponseChunk *current;
+    ResponseFile *files;   // File ranges, in queue order
+    int file_count;
+    int file_capacity;
+    int file_sent;         // First file range not completely sent yet
+    int failed;            // An allocation failed; cleared by response_release
+    unsigned long syscalls; // sendmsg()/sendfile() calls made by response_flush
+} ResponseBuilder;
+
+void response_init(ResponseBuilder *builder, Arena *arena);
+
+// Forgets everything queued but keeps the chunk storage for the next batch.
+// Release callbacks of queued file ranges run here and in response_release.
+void response_reset(ResponseBuilder *builder);
+
+// Runs the release callbacks and frees all memory not owned by the arena.
+// The builder is empty afterwards and can be used again.
+void response_release(ResponseBuilder *builder);
+
+// Queues bytes by reference; they must stay unchanged until the flush is done
+void response_add(ResponseBuilder *builder, const void *data, size_t length);
+
+// Queues a private copy of the bytes
+void response_add_copy(ResponseBuilder *builder, const void *data, size_t length);
+
+// Queues printf-style output, formatted straight into chunk storage
+void response_addf(ResponseBuilder *builder, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Queues length bytes of fd starting at offset. fd must stay open until
+// release(context) is called.
+void response_add_file(ResponseBuilder *builder, int fd, off_t offset, size_t length,
+                       void (*release)(void *context), void *context);
+
+// Writes as much of the batch as the socket takes: one sendmsg() per run of
+// up to IOV_MAX in-memory pieces and one sendfile() per file range. Every
+// sendmsg() that has more of the batch behind it passes MSG_MORE, so headers
+// share packets with the body as if the socket were corked.
+int response_flush(ResponseBuilder *builder, int fd);
+
+// For callers that submit sends themselves, e.g. through io_uring. Points
+// message at the run of in-memory pieces at the front of the batch and
+// returns its length in bytes, or 0 if a file range is at the front or the
+// builder failed (send it, or get the error, with response_flush). *more
+// is set if anything is queued behind the run. The builder must not be
+// changed until the send completes.
+size_t response_prepare_send(ResponseBuilder *builder, struct msghdr *message, int *more);
+
+// Accounts for sent bytes of the run from response_prepare_send
+void response_advance(ResponseBuilder *builder, size_t sent);
+
+static inline size_t response_pending(const ResponseBuilder *builder)
+{
+    return builder->pending;
+}
+
+// Returns and clears the syscall count
+static inline unsigned long response_take_syscalls(ResponseBuilder *builder)
+{
+    unsigned long syscalls = builder->syscalls;
+    builder->syscalls = 0;
+    return syscalls;
+}
+
+#endif
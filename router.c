@@ -0,0 +1,421 @@
+#include <stdlib.h>
+#include <string.h>
+#include "router.h"
+
+// Methods with their own handler slot; "*" registers all of them
+enum
+{
+    METHOD_GET,
+    METHOD_HEAD,
+    METHOD_POST,
+    METHOD_PUT,
+    METHOD_DELETE,
+    METHOD_PATCH,
+    METHOD_OPTIONS,
+    METHOD_COUNT
+};
+
+static const struct
+{
+    const char *name;
+    size_t length;
+} methods[METHOD_COUNT] = {
+    {"GET", 3}, {"HEAD", 4}, {"POST", 4}, {"PUT", 3}, {"DELETE", 6}, {"PATCH", 5}, {"OPTIONS", 7}};
+
+// A node either matches a fixed run of characters (prefix) or, for a
+// parameter node, one path segment. Static children are told apart by their
+// first character, which is mirrored in indices so choosing a child is a scan
+// of a few bytes instead of a pointer chase per child.
+typedef struct RouteNode
+{
+    char *prefix;
+    size_t prefix_length;
+    char *param_name; // Set on parameter nodes only
+    size_t param_name_length;
+    int catch_all;    // Parameter that takes the rest of the path ("*name")
+
+    struct RouteNode **children;
+    char *indices;
+    int child_count;
+    struct RouteNode *param_child;
+
+    RouteHandler handlers[METHOD_COUNT];
+    int routes[METHOD_COUNT]; // Registration of each handler
+    int has_handler;
+} RouteNode;
+
+struct Router
+{
+    RouteNode root;
+    struct
+    {
+        char *method;
+        char *pattern;
+    } *routes;
+    int route_count;
+};
+
+static int method_index(const char *data, size_t length)
+{
+    for (int i = 0; i < METHOD_COUNT; i++)
+    {
+        if (methods[i].length == length && memcmp(methods[i].name, data, length) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static RouteNode *new_node(const char *prefix, size_t length)
+{
+    RouteNode *node = calloc(1, sizeof(RouteNode));
+    node->prefix = malloc(length + 1);
+    memcpy(node->prefix, prefix, length);
+    node->prefix[length] = '\0';
+    node->prefix_length = length;
+    return node;
+}
+
+static void free_node(RouteNode *node, int free_self)
+{
+    for (int i = 0; i < node->child_count; i++)
+        free_node(node->children[i], 1);
+    if (node->param_child)
+        free_node(node->param_child, 1);
+    free(node->children);
+    free(node->indices);
+    free(node->prefix);
+    free(node->param_name);
+    if (free_self)
+        free(node);
+}
+
+static void add_child(RouteNode *node, RouteNode *child)
+{
+    node->children = realloc(node->children, (node->child_count + 1) * sizeof(RouteNode *));
+    node->indices = realloc(node->indices, node->child_count + 1);
+    node->children[node->child_count] = child;
+    node->indices[node->child_count] = child->prefix[0];
+    node->child_count++;
+}
+
+// Splits node so that it keeps only the first keep characters of its prefix;
+// the rest, with all of node's children and handlers, moves into a new child.
+static void split_node(RouteNode *node, size_t keep)
+{
+    RouteNode *tail = new_node(node->prefix + keep, node->prefix_length - keep);
+    tail->children = node->children;
+    tail->indices = node->indices;
+    tail->child_count = node->child_count;
+    tail->param_child = node->param_child;
+    memcpy(tail->handlers, node->handlers, sizeof(node->handlers));
+    memcpy(tail->routes, node->routes, sizeof(node->routes));
+    tail->has_handler = node->has_handler;
+
+    node->children = NULL;
+    node->indices = NULL;
+    node->child_count = 0;
+    node->param_child = NULL;
+    memset(node->handlers, 0, sizeof(node->handlers));
+    node->has_handler = 0;
+    node->prefix_length = keep;
+    node->prefix[keep] = '\0';
+    add_child(node, tail);
+}
+
+Router *router_create(void)
+{
+    Router *router = calloc(1, sizeof(Router));
+    router->root.prefix = calloc(1, 1);
+    return router;
+}
+
+void router_free(Router *router)
+{
+    if (!router)
+        return;
+    free_node(&router->root, 0);
+    for (int i = 0; i < router->route_count; i++)
+    {
+        free(router->routes[i].method);
+        free(router->routes[i].pattern);
+    }
+    free(router->routes);
+    free(router);
+}
+
+static RouteNode *find_child(const RouteNode *node, char c)
+{
+    for (int i = 0; i < node->child_count; i++)
+    {
+        if (node->indices[i] == c)
+            return node->children[i];
+    }
+    return NULL;
+}
+
+// Returns 0 if pattern can be added under root, else -1: a parameter name is
+// empty, a catch-all is not the last segment, there are more than
+// ROUTER_MAX_PARAMS parameters (a match has no room for the rest), or a
+// parameter differs from the one the tree already has at its position
+// ("/users/:id" and "/users/:name" cannot coexist). Walks the tree as
+// router_add will without changing it, so a rejected pattern leaves nothing
+// behind; node becomes NULL where the pattern leaves the existing tree.
+static int check_pattern(const RouteNode *node, const char *pattern)
+{
+    const char *p = pattern;
+    int params = 0;
+    while (*p)
+    {
+        if (*p == ':' || *p == '*')
+        {
+            int catch_all = *p == '*';
+            const char *name = p + 1;
+            size_t name_length = strcspn(name, "/");
+            if (name_length == 0 || (catch_all && name[name_length] != '\0') || ++params > ROUTER_MAX_PARAMS)
+                return -1;
+            if (node && node->param_child)
+            {
+                const RouteNode *param = node->param_child;
+                if (param->param_name_length != name_length || memcmp(param->param_name, name, name_length) != 0 ||
+                    param->catch_all != catch_all)
+                    return -1;
+            }
+            node = node ? node->param_child : NULL;
+            p = name + name_length;
+            continue;
+        }
+
+        size_t length = strcspn(p, ":*");
+        const RouteNode *child = node ? find_child(node, *p) : NULL;
+        size_t common = 0;
+        while (child && common < length && common < child->prefix_length && child->prefix[common] == p[common])
+            common++;
+        // A partial match splits child, and what follows is new
+        node = child && common == child->prefix_length ? child : NULL;
+        p += child ? common : length;
+    }
+    return 0;
+}
+
+int router_add(Router *router, const char *method, const char *pattern, RouteHandler handler)
+{
+    int any_method = strcmp(method, "*") == 0;
+    int slot = any_method ? 0 : method_index(method, strlen(method));
+    if (slot < 0)
+        return -1;
+
+    if (check_pattern(&router->root, pattern) != 0)
+        return -1;
+
+    RouteNode *node = &router->root;
+    const char *p = pattern;
+
+    while (*p)
+    {
+        if (*p == ':' || *p == '*')
+        {
+            // Step 1: Parameter segment, up to the next '/', or a catch-all;
+            // check_pattern made sure an existing one has the same name
+            const char *name = p + 1;
+            size_t name_length = strcspn(name, "/");
+            if (!node->param_child)
+            {
+                node->param_child = new_node("", 0);
+                node->param_child->param_name = strndup(name, name_length);
+                node->param_child->param_name_length = name_length;
+                node->param_child->catch_all = *p == '*';
+            }
+            node = node->param_child;
+            p = name + name_length;
+            continue;
+        }
+
+        // Step 2: Static text, up to the next parameter
+        size_t length = strcspn(p, ":*");
+        RouteNode *child = find_child(node, *p);
+
+        if (!child)
+        {
+            child = new_node(p, length);
+            add_child(node, child);
+            node = child;
+            p += length;
+            continue;
+        }
+
+        size_t common = 0;
+        while (common < length && common < child->prefix_length && child->prefix[common] == p[common])
+            common++;
+        if (common < child->prefix_length)
+            split_node(child, common);
+        node = child;
+        p += common;
+    }
+
+    // Step 3: Attach the handler to the node the pattern ended on
+    int route = router->route_count++;
+    router->routes = realloc(router->routes, router->route_count * sizeof(*router->routes));
+    router->routes[route].method = strdup(method);
+    router->routes[route].pattern = strdup(pattern);
+    for (int i = 0; i < METHOD_COUNT; i++)
+    {
+        if (any_method || i == slot)
+        {
+            node->handlers[i] = handler;
+            node->routes[i] = route;
+        }
+    }
+    node->has_handler = 1;
+    return 0;
+}
+
+int router_route_count(const Router *router)
+{
+    return router->route_count;
+}
+
+void router_route_info(const Router *router, int route, const char **method, const char **pattern)
+{
+    *method = router->routes[route].method;
+    *pattern = router->routes[route].pattern;
+}
+
+// The slot whose handler answers method slot at node, or -1: a HEAD request
+// goes to the GET handler when no HEAD one is registered
+static int handler_slot(const RouteNode *node, int slot)
+{
+    if (slot < 0)
+        return -1;
+    if (node->handlers[slot])
+        return slot;
+    return slot == METHOD_HEAD && node->handlers[METHOD_GET] ? METHOD_GET : -1;
+}
+
+// Depth-first match of path against node and its subtree, for the method in
+// slot (-1 for a method with no slot). Static children are tried before the
+// parameter child, and a node that matches the path but has no handler for
+// the method sends the search on to the next candidate, so "POST /users/new"
+// still reaches "POST /users/:id" beside "GET /users/new"; the methods such
+// a node does answer are added to match->allowed. Parameters captured on a
+// branch that fails are dropped again.
+static const RouteNode *match_node(const RouteNode *node, const char *path, size_t length, int slot,
+                                   RouteMatch *match)
+{
+    int captured = 0;
+
+    if (node->param_name)
+    {
+        const char *slash = node->catch_all ? NULL : memchr(path, '/', length);
+        size_t segment = slash ? (size_t)(slash - path) : length;
+        if (segment == 0)
+            return NULL;
+        if (match->param_count < ROUTER_MAX_PARAMS)
+        {
+            RouteParam *param = &match->params[match->param_count++];
+            param->name.data = node->param_name;
+            param->name.length = node->param_name_length;
+            param->value.data = path;
+            param->value.length = segment;
+            captured = 1;
+        }
+        path += segment;
+        length -= segment;
+    }
+    else
+    {
+        if (length < node->prefix_length || memcmp(path, node->prefix, node->prefix_length) != 0)
+            return NULL;
+        path += node->prefix_length;
+        length -= node->prefix_length;
+    }
+
+    if (length == 0 && node->has_handler)
+    {
+        if (handler_slot(node, slot) >= 0)
+            return node;
+        for (int i = 0; i < METHOD_COUNT; i++)
+        {
+            if (handler_slot(node, i) >= 0)
+                match->allowed |= 1u << i;
+        }
+    }
+
+    if (length > 0)
+    {
+        for (int i = 0; i < node->child_count; i++)
+        {
+            if (node->indices[i] == *path)
+            {
+                const RouteNode *found = match_node(node->children[i], path, length, slot, match);
+                if (found)
+                    return found;
+                break;
+            }
+        }
+        if (node->param_child)
+        {
+            const RouteNode *found = match_node(node->param_child, path, length, slot, match);
+            if (found)
+                return found;
+        }
+    }
+
+    if (captured)
+        match->param_count--;
+    return NULL;
+}
+
+RouteResult router_lookup(const Router *router, HttpSlice method, HttpSlice path, RouteMatch *match)
+{
+    const char *query = memchr(path.data, '?', path.length);
+    size_t length = query ? (size_t)(query - path.data) : path.length;
+
+    match->handler = NULL;
+    match->route = -1;
+    match->param_count = 0;
+    match->allowed = 0;
+
+    int slot = method_index(method.data, method.length);
+    const RouteNode *node = match_node(&router->root, path.data, length, slot, match);
+    if (!node)
+        return match->allowed ? ROUTE_METHOD_NOT_ALLOWED : ROUTE_NOT_FOUND;
+
+    slot = handler_slot(node, slot);
+    match->handler = node->handlers[slot];
+    match->route = node->routes[slot];
+    return ROUTE_FOUND;
+}
+
+size_t route_allow(const RouteMatch *match, char *buffer, size_t size)
+{
+    size_t length = 0;
+    for (int i = 0; i < METHOD_COUNT; i++)
+    {
+        if (!(match->allowed & 1u << i))
+            continue;
+        size_t needed = (length ? 2 : 0) + methods[i].length;
+        if (length + needed >= size)
+            break;
+        if (length)
+        {
+            memcpy(buffer + length, ", ", 2);
+            length += 2;
+        }
+        memcpy(buffer + length, methods[i].name, methods[i].length);
+        length += methods[i].length;
+    }
+    if (size > 0)
+        buffer[length] = '\0';
+    return length;
+}
+
+HttpSlice route_param(const RouteMatch *match, const char *name)
+{
+    for (int i = 0; i < match->param_count; i++)
+    {
+        if (http_slice_equals(match->params[i].name, name))
+            return match->params[i].value;
+    }
+    HttpSlice empty = {"", 0};
+    return empty;
+}
@@ -0,0 +1,82 @@
+// Method-aware request router backed by a radix tree.
+//
+// Routes are registered once at startup; after that the tree is read-only and
+// can be shared by every worker. A lookup walks the path once, comparing whole
+// node prefixes, so its cost depends on the path length rather than on the
+// number of routes, and it never allocates. Patterns may contain parameter
+// segments such as "/users/:id" and may end in a catch-all such as
+// "/static/*path" that takes the rest of the path; a static segment wins over
+// a parameter when both match the path and the method.
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "http_parser.h"
+
+#define ROUTER_MAX_PARAMS 8
+#define ROUTER_ALLOW_MAX 64
+
+struct Connection;
+typedef struct RouteMatch RouteMatch;
+
+typedef void (*RouteHandler)(struct Connection *conn, const HttpRequest *request, const RouteMatch *match);
+
+typedef struct
+{
+    HttpSlice name;  // Parameter name from the pattern, without the ':'
+    HttpSlice value; // Matching path segment (a view into the request)
+} RouteParam;
+
+struct RouteMatch
+{
+    RouteHandler handler;
+    int route; // Registration the handler came from, numbered from 0 in router_add order
+    RouteParam params[ROUTER_MAX_PARAMS];
+    int param_count;
+    unsigned allowed; // On ROUTE_METHOD_NOT_ALLOWED, the methods the path does take (see route_allow)
+};
+
+// router_lookup results
+typedef enum
+{
+    ROUTE_FOUND,
+    ROUTE_NOT_FOUND,         // No pattern matches the path (404)
+    ROUTE_METHOD_NOT_ALLOWED // The path matches, but not for this method (405)
+} RouteResult;
+
+typedef struct Router Router;
+
+Router *router_create(void);
+void router_free(Router *router);
+
+// Registers handler for method ("GET", "POST", ... or "*" for any) and
+// pattern. Returns 0, or -1 if the method is unknown, a parameter has no
+// name, a catch-all is not the last segment, the pattern has more than
+// ROUTER_MAX_PARAMS parameters, or it conflicts with an existing one (two
+// parameter names at the same position); a rejected pattern leaves the
+// router as it was.
+int router_add(Router *router, const char *method, const char *pattern, RouteHandler handler);
+
+// Number of successful router_add calls so far, and the method and pattern
+// the route-th of them registered (valid until router_free)
+int router_route_count(const Router *router);
+void router_route_info(const Router *router, int route, const char **method, const char **pattern);
+
+// Matches a request. Anything after a '?' in the path is ignored. Only
+// patterns with a handler for the method take part, so a static segment
+// registered for other methods leaves the request to the parameter beside
+// it; a HEAD request without a handler of its own goes to the GET one.
+// ROUTE_METHOD_NOT_ALLOWED means some pattern matched the path but none of
+// them for this method. On ROUTE_FOUND, match holds the handler and the
+// parameter values.
+RouteResult router_lookup(const Router *router, HttpSlice method, HttpSlice path, RouteMatch *match);
+
+// Writes the methods in match->allowed to buffer as the value of an Allow
+// header ("GET, HEAD, POST"), NUL-terminated; returns its length.
+// ROUTER_ALLOW_MAX bytes hold every method.
+size_t route_allow(const RouteMatch *match, char *buffer, size_t size);
+
+// Returns the value of a named parameter, or an empty slice
+HttpSlice route_param(const RouteMatch *match, const char *name);
+
+#endif
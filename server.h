@@ -0,0 +1,249 @@
+// Pieces of the HTTP server shared by its I/O backends.
+//
+// http_server_test.c owns the protocol side (parsing, routing, building
+// responses into a connection's ResponseBuilder) and the epoll event loop;
+// uring_backend.c drives the same connections from io_uring completions.
+// A backend only moves bytes: it fills conn->buffer, calls process_requests
+// and sends whatever that queued on conn->output. Handlers that would block
+// run on a shared thread pool and come back through the worker's completion
+// queue, whose eventfd the backend watches next to its sockets.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include "arena.h"
+#include "http_parser.h"
+#include "response_builder.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+
+#define BUFFER_SIZE 4096
+#define TIMER_TICK_MS 100 // Resolution of connection deadlines
+
+// Deadlines a connection can be under, one at a time
+typedef enum
+{
+    TIMEOUT_NONE = -1,
+    TIMEOUT_HEADER, // Receiving a request head, counted from its first byte
+    TIMEOUT_BODY,   // Receiving a request body
+    TIMEOUT_IDLE,   // Keep-alive connection waiting for its next request
+    TIMEOUT_WRITE,  // Sending responses, counted from the last progress
+    TIMEOUT_KINDS
+} TimeoutKind;
+
+extern const char *const timeout_names[TIMEOUT_KINDS]; // "header", "body", ...
+
+typedef enum
+{
+    BACKEND_EPOLL,
+    BACKEND_IO_URING
+} Backend;
+
+// Command-line tunables
+typedef struct
+{
+    int port;
+    int workers;           // Number of event loop threads (0 = one per online CPU)
+    int backlog;           // listen() backlog of each worker's socket
+    int pin_workers;       // Pin worker i to CPU i % cpu_count
+    int timeouts[TIMEOUT_KINDS]; // Seconds per deadline kind; -k sets TIMEOUT_IDLE
+    const char *static_root; // Directory served under /static/, or NULL
+    int open_file_cache;   // Open files cached per worker
+    Backend backend;
+    int print_stats;       // Print requests and syscalls per second and worker
+    int pool_threads;      // Threads running offloaded handlers (0 = run them inline)
+    int pool_queue;        // Offloaded requests queued before connections stop reading
+    int access_log_level;  // LogLevel; SIGUSR1 cycles it while running
+    const char *access_log_path; // NULL logs to stdout
+    uint64_t max_body;     // Largest request body accepted, in bytes
+    int compression_level; // zlib level for dynamic bodies, 1-9; 0 turns compression off
+    int drain_seconds;     // How long a stopping server waits for its connections to finish
+} ServerConfig;
+
+extern ServerConfig config;
+
+// Where a connection is in its request/response cycle
+typedef enum
+{
+    CONN_READING, // Collecting requests until the blank line after the headers
+    CONN_WRITING, // Responses are built and being drained to the socket
+    CONN_WAITING, // A handler's task is queued or running on the thread pool;
+                  // nothing more is read or sent until it completes
+    CONN_CLOSING  // Finished (or failed); the socket is about to be closed
+} ConnectionState;
+
+// Per-client state. Buffers come from the connection's arena on demand and
+// go back to the worker's pool whenever the connection goes idle, so a parked
+// keep-alive connection costs only this struct.
+typedef struct Connection
+{
+    Arena arena;            // Everything below that lives until the connection idles
+    int fd;
+    ConnectionState state;
+    int keep_alive;         // Cleared once a request asks for (or forces) a close
+    char *buffer;           // Request bytes received so far (BUFFER_SIZE)
+    size_t buffer_length;
+    HttpRequest *request;   // Parse state of the request at the front of buffer
+    ResponseBuilder output; // Responses queued for the client, in request order
+    Timer timer;            // The deadline below, armed on the worker's wheel
+    TimeoutKind timer_kind;
+    size_t consumed;        // Bytes of buffer answered but kept in place: while CONN_WAITING,
+                            // or up to the end of the head whose body is arriving
+    struct OffloadTask *task; // Offloaded request not completed yet
+    struct Connection *blocked_next; // On the worker's blocked list
+    uint64_t request_start; // When the request being answered arrived (ns)
+    int route;              // Its RouteMatch.route, -1 if none matched
+    int status;             // Status code of the response its handler queued
+    size_t response_start;  // Bytes already queued on output when its handler ran
+    HttpBody body;          // Framing of its body
+    int body_pending;       // The body has not fully arrived; its head stays in buffer
+    int body_progress;      // Body bytes arrived since the deadline was last armed
+    struct BodyReader *body_reader; // Where the body goes, or NULL to drop it
+    int encoding;           // Encoding negotiated for the request being answered
+    int head_only;          // It is a HEAD request: its response carries no body
+} Connection;
+
+// True while more bytes are expected from the client: the connection
+// persists, or the body of its last request is still arriving
+static inline int connection_wants_input(const Connection *conn)
+{
+    return conn->keep_alive || conn->body_pending;
+}
+
+struct UringWorker;
+struct Worker;
+struct Metrics;
+struct LogRing;
+struct BodyReader;
+
+// Streams a request body to its handler. data gets every run of body bytes
+// as it arrives, already decoded from any chunked framing; the bytes stay
+// valid only until it returns. end is called once: with complete set after
+// the last byte, when it queues the response as a handler would (or
+// offloads it), or with complete clear when the body is rejected (the
+// server answers) or the connection closes, just to release what the
+// reader holds.
+typedef struct BodyReader
+{
+    void (*data)(struct BodyReader *reader, struct Connection *conn, const char *data, size_t length);
+    void (*end)(struct BodyReader *reader, struct Connection *conn, int complete);
+} BodyReader;
+
+// Called by a route handler instead of queueing a response: hands the
+// request's body to reader as it arrives. The request stays valid until
+// end. A request without a body gets end right after the handler returns.
+// Bodies of requests whose handler does not call this are read and dropped.
+void read_body(Connection *conn, BodyReader *reader);
+
+// A request handed to the thread pool. A handler that would block embeds
+// this first in a task of its own, sets pool.run to the blocking part and
+// finish to the part that queues the response, and calls offload_request.
+// finish runs back on the connection's worker, also when the connection
+// closed meanwhile (conn->state == CONN_CLOSING) or, in that case, when run
+// never did, so it can always release what the task holds.
+typedef struct OffloadTask
+{
+    PoolTask pool;
+    void (*finish)(struct OffloadTask *task, struct Connection *conn);
+    struct Worker *worker;
+    struct Connection *conn;
+} OffloadTask;
+
+// One event loop thread with its own SO_REUSEPORT listener
+typedef struct Worker
+{
+    int id;
+    int cpu; // CPU the thread is pinned to, or -1
+    int server_socket;
+    int epoll_fd;              // BACKEND_EPOLL
+    struct UringWorker *uring; // BACKEND_IO_URING
+    pthread_t thread;
+    TimerWheel timers;        // Deadlines of the open connections
+    ArenaPool arena_pool;     // Chunks for the connections' arenas
+    ObjectPool connections;   // Connection structs of the backend's size
+    CompletionQueue completions; // Offloaded requests back from the thread pool
+    Connection *blocked, *blocked_tail; // Waiting for room in the pool's queue, oldest first
+    void (*resume)(struct Worker *, Connection *); // Backend: carry on after a completion
+    struct Metrics *metrics;  // Written by this worker only, read by /metrics
+    struct LogRing *access_log; // Pushed to by this worker only
+    // Counted since the last stats line, like arena_pool.stats
+    unsigned long requests;
+    unsigned long syscalls;
+    unsigned long offloaded;        // Requests handed to the thread pool
+    unsigned long blocked_requests; // ... that had to wait for room in its queue
+} Worker;
+
+// Returns a zeroed connection struct from the worker's pool, set up for an
+// accepted socket, or NULL if memory is exhausted
+Connection *connection_open(Worker *worker, int fd);
+
+// Frees the connection's buffers, takes it off the idle list and returns the
+// struct to the pool. Closing the socket is up to the backend.
+void connection_close(Worker *worker, Connection *conn);
+
+// Allocates the read buffer and parser state if the connection has none.
+// Returns 0, or -1 if its arena is out of memory: close the connection.
+int connection_prepare_read(Connection *conn);
+
+// Drops the buffers of a connection with nothing buffered or queued
+void connection_park(Connection *conn);
+
+// Answers every complete request in conn->buffer, in order, and keeps
+// whatever partial request follows them for the next read. Moves the
+// connection to CONN_WRITING when responses are queued.
+void process_requests(Worker *worker, Connection *conn);
+
+// Called by a route handler instead of queueing a response: runs task on
+// the thread pool and puts the connection in CONN_WAITING until its finish
+// has queued the response. The request stays valid until then. When the
+// pool's queue is full the connection joins the worker's blocked list and
+// reads nothing, so the backlog builds up in the clients' socket buffers
+// rather than in the server. Without a pool the task runs inline.
+void offload_request(Connection *conn, OffloadTask *task);
+
+// Hands the completed tasks to their finish functions and worker->resume,
+// then retries the blocked connections. Backends call this when the
+// completion eventfd is readable.
+void worker_complete_tasks(Worker *worker);
+
+// Retries the blocked connections; backends call this once per loop
+// iteration, since room in the queue may come from another worker's tasks
+void worker_submit_blocked(Worker *worker);
+
+// Puts the connection under the deadline its state calls for: keep-alive
+// idle with nothing buffered, header while a request head is incomplete,
+// body while its body arrives, write while responses are queued, none
+// while a task runs. A header deadline runs from the request's first byte
+// and is never extended, so a client trickling bytes cannot hold a
+// connection forever; a body deadline restarts whenever body bytes arrive,
+// and a write deadline whenever sent is set (the socket took more bytes).
+// Backends call this after every event.
+void connection_update_timer(Worker *worker, Connection *conn, int sent);
+
+// Closes, with close_connection, every connection whose deadline has passed.
+// close_connection must disarm conn->timer (connection_close does).
+void expire_connections(Worker *worker, void (*close_connection)(Worker *, Connection *));
+
+// How long the event loop may sleep, in milliseconds
+int worker_wait_ms(const Worker *worker);
+
+// True once SIGTERM, SIGINT or a hot restart (SIGHUP) has begun the drain.
+// From then on backends close their listeners, every response carries
+// "Connection: close", and a loop ends when worker_drained says so.
+int server_draining(void);
+
+// True when the worker's event loop should exit: the drain has begun and
+// either its last connection is gone or the drain deadline has passed
+int worker_drained(const Worker *worker);
+
+// Per-thread setup and teardown around a backend's event loop, and the work
+// due once per loop iteration (clock refresh, stats). connection_size is the
+// size of the backend's connection struct, which starts with a Connection.
+void worker_start(Worker *worker, size_t connection_size);
+void worker_tick(Worker *worker);
+void worker_stop(Worker *worker);
+
+#endif
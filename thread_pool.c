@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "thread_pool.h"
+
+struct MpmcCell
+{
+    size_t sequence;
+    void *data;
+};
+
+struct ThreadPool
+{
+    MpmcQueue queue;
+    sem_t queued; // Counts tasks in the queue; idle threads sleep on it
+    int stopping;
+    int thread_count;
+    pthread_t *threads;
+    ThreadPoolStats stats; // Updated with atomics, from any thread
+};
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Bounded MPMC queue after Dmitry Vyukov's design: every cell carries a
+// sequence number that says whose turn it is, so producers and consumers
+// claim cells with one CAS on tail or head and never wait for each other.
+static int queue_init(MpmcQueue *queue, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+    queue->cells = malloc(size * sizeof(struct MpmcCell));
+    if (!queue->cells)
+        return -1;
+    for (size_t i = 0; i < size; i++)
+        queue->cells[i].sequence = i;
+    queue->mask = size - 1;
+    queue->head = queue->tail = 0;
+    return 0;
+}
+
+static int queue_push(MpmcQueue *queue, void *data)
+{
+    size_t position = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    struct MpmcCell *cell;
+    while (1)
+    {
+        cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0)
+        {
+            if (__atomic_compare_exchange_n(&queue->tail, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (difference < 0)
+        {
+            return -1; // Full
+        }
+        else
+        {
+            position = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->data = data;
+    __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void *queue_pop(MpmcQueue *queue)
+{
+    size_t position = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    struct MpmcCell *cell;
+    while (1)
+    {
+        cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (difference == 0)
+        {
+            if (__atomic_compare_exchange_n(&queue->head, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (difference < 0)
+        {
+            return NULL; // Empty
+        }
+        else
+        {
+            position = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+    void *data = cell->data;
+    __atomic_store_n(&cell->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+static void complete(CompletionQueue *completions, PoolTask *task)
+{
+    // Cannot fail: thread_pool_submit keeps outstanding within the capacity
+    queue_push(&completions->queue, task);
+    if (!__atomic_exchange_n(&completions->signaled, 1, __ATOMIC_ACQ_REL))
+    {
+        uint64_t one = 1;
+        ssize_t written = write(completions->event_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+static void *pool_thread(void *arg)
+{
+    ThreadPool *pool = arg;
+    while (1)
+    {
+        while (sem_wait(&pool->queued) == -1 && errno == EINTR)
+            ;
+        if (__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE))
+            break;
+        // The semaphore guarantees a task, though another producer may not
+        // have finished publishing the cell in front of it yet
+        PoolTask *task;
+        while ((task = queue_pop(&pool->queue)) == NULL)
+            sched_yield();
+
+        uint64_t wait = monotonic_ns() - task->submitted_ns;
+        __atomic_fetch_add(&pool->stats.started, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pool->stats.wait_ns_total, wait, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&pool->stats.wait_ns_max, __ATOMIC_RELAXED);
+        while (wait > max && !__atomic_compare_exchange_n(&pool->stats.wait_ns_max, &max, wait, 1,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+
+        task->run(task);
+        __atomic_fetch_add(&pool->stats.completed, 1, __ATOMIC_RELAXED);
+        complete(task->completions, task);
+    }
+    return NULL;
+}
+
+ThreadPool *thread_pool_create(int threads, size_t capacity)
+{
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool)
+        return NULL;
+    if (queue_init(&pool->queue, capacity) == -1)
+    {
+        free(pool);
+        return NULL;
+    }
+    sem_init(&pool->queued, 0, 0);
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    for (int i = 0; i < threads; i++)
+    {
+        int error = pthread_create(&pool->threads[i], NULL, pool_thread, pool);
+        if (error != 0)
+        {
+            thread_pool_destroy(pool);
+            errno = error;
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool *pool)
+{
+    __atomic_store_n(&pool->stopping, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < pool->thread_count; i++)
+        sem_post(&pool->queued);
+    for (int i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+    sem_destroy(&pool->queued);
+    free(pool->threads);
+    free(pool->queue.cells);
+    free(pool);
+}
+
+int thread_pool_submit(ThreadPool *pool, PoolTask *task, CompletionQueue *completions)
+{
+    if (completions->outstanding > completions->queue.mask)
+        return -1;
+    task->completions = completions;
+    task->submitted_ns = monotonic_ns();
+    if (queue_push(&pool->queue, task) == -1)
+        return -1;
+    completions->outstanding++;
+    __atomic_fetch_add(&pool->stats.submitted, 1, __ATOMIC_RELAXED);
+    sem_post(&pool->queued);
+    return 0;
+}
+
+size_t thread_pool_capacity(const ThreadPool *pool)
+{
+    return pool->queue.mask + 1 + pool->thread_count;
+}
+
+void thread_pool_take_stats(ThreadPool *pool, ThreadPoolStats *stats)
+{
+    size_t tail = __atomic_load_n(&pool->queue.tail, __ATOMIC_RELAXED);
+    size_t head = __atomic_load_n(&pool->queue.head, __ATOMIC_RELAXED);
+    stats->depth = tail > head ? tail - head : 0;
+    stats->submitted = __atomic_exchange_n(&pool->stats.submitted, 0, __ATOMIC_RELAXED);
+    stats->started = __atomic_exchange_n(&pool->stats.started, 0, __ATOMIC_RELAXED);
+    stats->completed = __atomic_exchange_n(&pool->stats.completed, 0, __ATOMIC_RELAXED);
+    stats->wait_ns_total = __atomic_exchange_n(&pool->stats.wait_ns_total, 0, __ATOMIC_RELAXED);
+    stats->wait_ns_max = __atomic_exchange_n(&pool->stats.wait_ns_max, 0, __ATOMIC_RELAXED);
+}
+
+int completion_queue_init(CompletionQueue *queue, size_t capacity)
+{
+    if (queue_init(&queue->queue, capacity) == -1)
+        return -1;
+    queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->event_fd == -1)
+    {
+        free(queue->queue.cells);
+        return -1;
+    }
+    queue->signaled = 0;
+    queue->outstanding = 0;
+    return 0;
+}
+
+void completion_queue_destroy(CompletionQueue *queue)
+{
+    close(queue->event_fd);
+    free(queue->queue.cells);
+}
+
+size_t completion_queue_drain(CompletionQueue *queue)
+{
+    uint64_t value;
+    ssize_t result = read(queue->event_fd, &value, sizeof(value));
+    (void)result;
+    // Re-enable signalling before popping, so a completion pushed after the
+    // last pop always writes the eventfd again
+    __atomic_store_n(&queue->signaled, 0, __ATOMIC_RELEASE);
+
+    size_t count = 0;
+    PoolTask *task;
+    while ((task = queue_pop(&queue->queue)) != NULL)
+    {
+        queue->outstanding--;
+        task->complete(task);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,83 @@
+// Fixed-size thread pool for work that must not run on an event loop.
+//
+// Tasks go through a bounded lock-free MPMC queue to a set of pool threads
+// and come back, once run, through the CompletionQueue named at submission:
+// another bounded queue whose eventfd becomes readable when completions are
+// waiting, so an event loop can poll it next to its sockets. The pool never
+// grows its queue. thread_pool_submit fails when it is full and the caller
+// decides how to push back.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct PoolTask PoolTask;
+
+struct PoolTask
+{
+    void (*run)(PoolTask *task);      // On a pool thread
+    void (*complete)(PoolTask *task); // Back on the thread that drains the completions
+    struct CompletionQueue *completions;
+    uint64_t submitted_ns;            // Set by thread_pool_submit
+};
+
+typedef struct
+{
+    struct MpmcCell *cells;
+    size_t mask;
+    _Alignas(64) size_t head; // Next cell to pop
+    _Alignas(64) size_t tail; // Next cell to push
+} MpmcQueue;
+
+typedef struct CompletionQueue
+{
+    MpmcQueue queue;
+    int event_fd;
+    int signaled; // eventfd written and not drained yet; saves redundant writes
+    size_t outstanding; // Submitted and not drained yet; only the owner touches it
+} CompletionQueue;
+
+typedef struct
+{
+    size_t depth;             // Tasks queued and not picked up yet
+    unsigned long submitted;
+    unsigned long started;    // Picked up by a pool thread
+    unsigned long completed;
+    uint64_t wait_ns_total;   // Time the started tasks spent queued, summed
+    uint64_t wait_ns_max;
+} ThreadPoolStats;
+
+typedef struct ThreadPool ThreadPool;
+
+// Starts threads pool threads with a queue of capacity tasks (rounded up to
+// a power of two). Returns NULL with errno set.
+ThreadPool *thread_pool_create(int threads, size_t capacity);
+
+// Stops the threads once they finish their current task. Tasks still
+// queued are not run.
+void thread_pool_destroy(ThreadPool *pool);
+
+// Queues task; its completion is pushed to completions, which must be
+// owned by the calling thread. Returns 0, or -1 if the queue is full or
+// completions has no room left for another task.
+int thread_pool_submit(ThreadPool *pool, PoolTask *task, CompletionQueue *completions);
+
+// Tasks that can be in the pool at once: queued plus running
+size_t thread_pool_capacity(const ThreadPool *pool);
+
+// Copies the counters and resets all but depth
+void thread_pool_take_stats(ThreadPool *pool, ThreadPoolStats *stats);
+
+// A completion queue holds the tasks its owner has submitted until it
+// drains them; with capacity thread_pool_capacity() the pool itself is the
+// only limit. Returns 0, or -1 with errno.
+int completion_queue_init(CompletionQueue *queue, size_t capacity);
+void completion_queue_destroy(CompletionQueue *queue);
+
+// Clears the eventfd and calls complete() on every waiting task. Returns
+// how many there were.
+size_t completion_queue_drain(CompletionQueue *queue);
+
+#endif
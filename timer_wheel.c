@@ -0,0 +1,123 @@
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define MAX_DELAY ((1ULL << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1)
+
+void timer_list_init(Timer *list)
+{
+    list->next = list->prev = list;
+}
+
+static void list_append(Timer *list, Timer *timer)
+{
+    timer->prev = list->prev;
+    timer->next = list;
+    list->prev->next = timer;
+    list->prev = timer;
+}
+
+static void list_unlink(Timer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+}
+
+// Moves every timer of from to the end of to
+static void list_splice(Timer *from, Timer *to)
+{
+    if (from->next == from)
+        return;
+    from->next->prev = to->prev;
+    from->prev->next = to;
+    to->prev->next = from->next;
+    to->prev = from->prev;
+    timer_list_init(from);
+}
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t now)
+{
+    for (int level = 0; level < TIMER_LEVELS; level++)
+    {
+        for (int slot = 0; slot < TIMER_SLOTS; slot++)
+            timer_list_init(&wheel->slots[level][slot]);
+    }
+    wheel->base = now;
+    wheel->count = 0;
+}
+
+// Picks the slot for a timer from how far ahead of base it is due
+static void place(TimerWheel *wheel, Timer *timer)
+{
+    uint64_t expires = timer->expires;
+    if (expires < wheel->base)
+        expires = wheel->base;
+    uint64_t delay = expires - wheel->base;
+
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delay >= 1ULL << ((level + 1) * TIMER_SLOT_BITS))
+        level++;
+    if (delay > MAX_DELAY)
+        expires = wheel->base + MAX_DELAY;
+    list_append(&wheel->slots[level][(expires >> (level * TIMER_SLOT_BITS)) & SLOT_MASK], timer);
+}
+
+void timer_arm(TimerWheel *wheel, Timer *timer, uint64_t expires)
+{
+    if (timer_armed(timer))
+        list_unlink(timer);
+    else
+        wheel->count++;
+    timer->expires = expires;
+    place(wheel, timer);
+}
+
+void timer_cancel(TimerWheel *wheel, Timer *timer)
+{
+    if (!timer_armed(timer))
+        return;
+    list_unlink(timer);
+    wheel->count--;
+}
+
+// Redistributes one slot of a higher level over the levels below it and
+// returns the slot index, so the caller knows whether this level wrapped too
+static int cascade(TimerWheel *wheel, int level)
+{
+    int index = (wheel->base >> (level * TIMER_SLOT_BITS)) & SLOT_MASK;
+    Timer pending;
+    timer_list_init(&pending);
+    list_splice(&wheel->slots[level][index], &pending);
+    while (pending.next != &pending)
+    {
+        Timer *timer = pending.next;
+        list_unlink(timer);
+        place(wheel, timer);
+    }
+    return index;
+}
+
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now, Timer *expired)
+{
+    while (wheel->base <= now)
+    {
+        int index = wheel->base & SLOT_MASK;
+        if (index == 0)
+        {
+            for (int level = 1; level < TIMER_LEVELS && cascade(wheel, level) == 0; level++)
+                ;
+        }
+        list_splice(&wheel->slots[0][index], expired);
+        wheel->base++;
+    }
+}
+
+Timer *timer_list_pop(TimerWheel *wheel, Timer *list)
+{
+    if (list->next == list)
+        return NULL;
+    Timer *timer = list->next;
+    list_unlink(timer);
+    wheel->count--;
+    return timer;
+}
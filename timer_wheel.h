@@ -0,0 +1,67 @@
+// Hierarchical timing wheel.
+//
+// Timers are kept in four levels of 64 slots. Level 0 holds timers due in
+// the next 64 ticks, one slot per tick; each higher level covers 64 times the
+// span of the one below with slots 64 times as wide, and its timers cascade
+// down a level whenever the level below wraps around. Arming, re-arming and
+// cancelling are O(1) list operations, there is no per-timer allocation, and
+// advancing the wheel touches only the slots that come due, so it does not
+// matter whether ten or a hundred thousand timers are pending.
+//
+// Times are in caller-defined ticks. A wheel is not thread-safe.
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+
+// Embedded in the object it times out. A timer is linked into a wheel slot
+// or an expired list while armed and unlinked otherwise.
+typedef struct Timer
+{
+    struct Timer *next, *prev;
+    uint64_t expires; // Tick the timer is due
+} Timer;
+
+typedef struct
+{
+    Timer slots[TIMER_LEVELS][TIMER_SLOTS]; // List heads
+    uint64_t base;  // Next tick to process
+    size_t count;   // Armed timers, including expired ones not yet popped
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t now);
+
+static inline void timer_init(Timer *timer)
+{
+    timer->next = timer->prev = NULL;
+}
+
+static inline int timer_armed(const Timer *timer)
+{
+    return timer->next != NULL;
+}
+
+// Arms the timer to expire at the given tick, moving it if it is armed
+// already. Ticks in the past expire on the next advance; ticks beyond the
+// wheel's range (about 16.7 million) are clamped to it.
+void timer_arm(TimerWheel *wheel, Timer *timer, uint64_t expires);
+
+// Disarms the timer. Safe on a timer that is not armed.
+void timer_cancel(TimerWheel *wheel, Timer *timer);
+
+// Expired timers are handed out through a list. timer_list_init prepares its
+// head; timer_wheel_advance appends every timer due at or before now;
+// timer_list_pop removes and returns the first one, or NULL. Popping one at a
+// time lets a handler cancel or re-arm any other timer, including ones still
+// on the list.
+void timer_list_init(Timer *list);
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now, Timer *expired);
+Timer *timer_list_pop(TimerWheel *wheel, Timer *list);
+
+#endif
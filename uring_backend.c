@@ -0,0 +1,752 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include "metrics.h"
+#include "uring_backend.h"
+
+#define RING_ENTRIES 1024      // Submission queue size; the CQ is four times larger
+#define RECV_BUFFERS 256       // Provided receive buffers per worker (a power of two)
+#define RECV_BUFFER_GROUP 0
+#define SPILL_LIMIT BUFFER_SIZE // Bytes held for a busy connection before its recv is paused
+#define SPILL_CAPACITY (SPILL_LIMIT + BUFFER_SIZE) // Room for the recv that crosses the limit
+
+// The low bits of user_data say which operation completed; the rest is the
+// UringConnection (or NULL for the listener and for cancellations).
+enum
+{
+    OP_IGNORE,
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND, // sendmsg of an in-memory run
+    OP_POLL, // Waiting for room to sendfile() a file range
+    OP_CLOSE,
+    OP_WAKE  // The completion eventfd became readable
+};
+#define OP_MASK 7
+
+typedef struct
+{
+    Connection base;   // First, so the shared code's Connection * is this too
+    int inflight;      // Submitted operations whose last completion is outstanding
+    int recv_armed;    // The multishot recv is still producing completions
+    int recv_paused;   // ... but has been cancelled to stop reading for now
+    int peer_closed;   // recv saw end of stream; close once the batch is out
+    int sending;       // OP_SEND or OP_POLL in flight, else 0; the builder is frozen
+    int send_cancelled;
+    int send_linked;   // The send in flight is followed by a linked close
+    size_t send_length;
+    struct msghdr message; // Read by the kernel until the send completes
+    int closing;
+    int close_submitted;
+    int fd_closed;
+    char *spill;       // Bytes received while responses were being sent, in the arena;
+    size_t spill_length; // dropped with it when the connection is parked
+    size_t spill_capacity;
+} UringConnection;
+
+struct UringWorker
+{
+    int ring_fd;
+    void *ring;        // SQ and CQ rings, one mapping (IORING_FEAT_SINGLE_MMAP)
+    size_t ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_array;
+    unsigned sq_mask, sq_entries;
+    unsigned sq_local_tail; // SQEs filled in, published on the next enter
+    unsigned *cq_head, *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buffers;          // RECV_BUFFERS * BUFFER_SIZE bytes
+    unsigned short buf_tail;
+
+    int accept_armed;
+    int wake_armed;
+};
+
+typedef struct UringWorker UringWorker;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                              const void *arg, size_t arg_size)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static uint64_t tag(void *pointer, int op)
+{
+    return (uint64_t)(uintptr_t)pointer | op;
+}
+
+// Hands a receive buffer (back) to the kernel
+static void recycle_buffer(UringWorker *ring, unsigned short id)
+{
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (RECV_BUFFERS - 1)];
+    buf->addr = (uintptr_t)(ring->buffers + (size_t)id * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = id;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void ring_free(UringWorker *ring)
+{
+    if (ring->buf_ring)
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    free(ring->buffers);
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->ring)
+        munmap(ring->ring, ring->ring_size);
+    if (ring->ring_fd >= 0)
+        close(ring->ring_fd);
+    free(ring);
+}
+
+// Sets up a ring and its provided buffers. Returns NULL with errno set.
+static UringWorker *ring_create(unsigned entries)
+{
+    UringWorker *ring = calloc(1, sizeof(UringWorker));
+    if (!ring)
+        return NULL;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 4;
+    ring->ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring->ring_fd == -1 && errno == EINVAL)
+    {
+        params.flags = IORING_SETUP_CQSIZE; // Kernels before 5.19 reject the others
+        ring->ring_fd = sys_io_uring_setup(entries, &params);
+    }
+    if (ring->ring_fd == -1)
+        goto fail;
+
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required)
+    {
+        errno = EOPNOTSUPP;
+        goto fail;
+    }
+
+    // Step 1: Map the rings
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->ring == MAP_FAILED)
+    {
+        ring->ring = NULL;
+        goto fail;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    char *base = ring->ring;
+    ring->sq_head = (unsigned *)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->sq_array = (unsigned *)(base + params.sq_off.array);
+    ring->sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+    // Step 2: Register the receive buffers the multishot recvs pick from
+    ring->buf_ring_size = RECV_BUFFERS * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        goto fail;
+    }
+    ring->buffers = malloc((size_t)RECV_BUFFERS * BUFFER_SIZE);
+    if (!ring->buffers)
+        goto fail;
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uintptr_t)ring->buf_ring;
+    registration.ring_entries = RECV_BUFFERS;
+    registration.bgid = RECV_BUFFER_GROUP;
+    if (sys_io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) == -1)
+        goto fail;
+    for (int i = 0; i < RECV_BUFFERS; i++)
+        recycle_buffer(ring, i);
+    return ring;
+
+fail:;
+    int error = errno;
+    ring_free(ring);
+    errno = error;
+    return NULL;
+}
+
+// Submits the queued SQEs and, if wait is set, sleeps until at least one
+// completion is ready or worker_wait_ms has passed (for deadlines).
+static int ring_enter(Worker *worker, UringWorker *ring, int wait)
+{
+    unsigned to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    int wait_ms = worker_wait_ms(worker);
+    struct __kernel_timespec timeout = {wait_ms / 1000, (wait_ms % 1000) * 1000000LL};
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uintptr_t)&timeout;
+
+    worker->syscalls++;
+    int result = sys_io_uring_enter(ring->ring_fd, to_submit, wait ? 1 : 0,
+                                    IORING_ENTER_EXT_ARG | (wait ? IORING_ENTER_GETEVENTS : 0),
+                                    &arg, sizeof(arg));
+    if (result == -1 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        return -1;
+    return 0;
+}
+
+static struct io_uring_sqe *get_sqe(Worker *worker)
+{
+    UringWorker *ring = worker->uring;
+    if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries)
+        ring_enter(worker, ring, 0); // Full: push this batch out early
+
+    unsigned index = ring->sq_local_tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+static void arm_accept(Worker *worker)
+{
+    struct io_uring_sqe *sqe = get_sqe(worker);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = worker->server_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    // Non-blocking, because file ranges are sent with sendfile() directly
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = tag(NULL, OP_ACCEPT);
+    worker->uring->accept_armed = 1;
+}
+
+static void arm_recv(Worker *worker, UringConnection *c)
+{
+    struct io_uring_sqe *sqe = get_sqe(worker);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->base.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = tag(c, OP_RECV);
+    c->recv_armed = 1;
+    c->recv_paused = 0;
+    c->inflight++;
+}
+
+// Asks the kernel to cancel c's operation of the given kind. The operation
+// still completes (with -ECANCELED) before c may be freed.
+static void cancel(Worker *worker, UringConnection *c, int op)
+{
+    struct io_uring_sqe *sqe = get_sqe(worker);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = tag(c, op);
+    sqe->user_data = tag(NULL, OP_IGNORE);
+}
+
+static void submit_close(UringConnection *c, struct io_uring_sqe *sqe)
+{
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = c->base.fd;
+    sqe->user_data = tag(c, OP_CLOSE);
+    c->close_submitted = 1;
+    c->inflight++;
+}
+
+static void free_connection(Worker *worker, UringConnection *c)
+{
+    connection_close(worker, &c->base);
+}
+
+// Cancels the multishot accept and closes this process's descriptor for the
+// listener; the accept completes with -ECANCELED and is not armed again
+static void stop_accepting(Worker *worker)
+{
+    struct io_uring_sqe *sqe = get_sqe(worker);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = tag(NULL, OP_ACCEPT);
+    sqe->user_data = tag(NULL, OP_IGNORE);
+    close(worker->server_socket);
+    worker->server_socket = -1;
+}
+
+// Watches the thread pool's completion eventfd with a multishot poll
+static void arm_wake(Worker *worker)
+{
+    struct io_uring_sqe *sqe = get_sqe(worker);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = worker->completions.event_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = tag(NULL, OP_WAKE);
+    worker->uring->wake_armed = 1;
+}
+
+// Tears the connection down: cancels what is still running, closes the
+// socket, and frees everything once the last completion is in (and the
+// thread pool has handed back a task the connection offloaded).
+static void begin_close(Worker *worker, UringConnection *c)
+{
+    if (!c->closing)
+    {
+        c->closing = 1;
+        c->base.state = CONN_CLOSING;
+        timer_cancel(&worker->timers, &c->base.timer);
+    }
+    if (c->recv_armed && !c->recv_paused)
+    {
+        cancel(worker, c, OP_RECV);
+        c->recv_paused = 1;
+    }
+    if (c->sending && !c->send_cancelled && !c->send_linked)
+    {
+        cancel(worker, c, c->sending);
+        c->send_cancelled = 1;
+    }
+    if (!c->sending && !c->close_submitted && !c->fd_closed)
+        submit_close(c, get_sqe(worker));
+    if (c->inflight == 0 && !c->base.task)
+        free_connection(worker, c);
+}
+
+static void expire_connection(Worker *worker, Connection *conn)
+{
+    begin_close(worker, (UringConnection *)conn);
+}
+
+// Keeps bytes that arrived while the connection was busy sending; they are
+// parsed once the batch is out. Reading pauses when too much piles up. The
+// buffer comes from the connection's arena and is reused until the
+// connection is parked; it only grows for recv completions that were
+// already queued when reading paused. data may point into the buffer
+// itself, when feed spills the rest of what it is replaying. Returns 0, or
+// -1 if the arena is out of memory: close the connection.
+static int spill(Worker *worker, UringConnection *c, const char *data, size_t length)
+{
+    if (c->spill_length + length > c->spill_capacity)
+    {
+        size_t capacity = c->spill_capacity ? c->spill_capacity : SPILL_CAPACITY;
+        while (capacity < c->spill_length + length)
+            capacity *= 2;
+        char *grown = arena_alloc(&c->base.arena, capacity);
+        if (!grown)
+            return -1;
+        if (c->spill_length > 0)
+            memcpy(grown, c->spill, c->spill_length);
+        c->spill = grown;
+        c->spill_capacity = capacity;
+    }
+    memmove(c->spill + c->spill_length, data, length);
+    c->spill_length += length;
+    if (c->spill_length > SPILL_LIMIT && c->recv_armed && !c->recv_paused)
+    {
+        cancel(worker, c, OP_RECV);
+        c->recv_paused = 1;
+    }
+    return 0;
+}
+
+// Appends received bytes to the request buffer and answers what they complete
+static void feed(Worker *worker, UringConnection *c, const char *data, size_t length)
+{
+    Connection *conn = &c->base;
+    while (length > 0 && conn->state != CONN_CLOSING)
+    {
+        if (conn->state == CONN_WRITING || conn->state == CONN_WAITING)
+        {
+            if (connection_wants_input(conn) && spill(worker, c, data, length) != 0)
+                conn->state = CONN_CLOSING;
+            return; // Anything after "Connection: close" is ignored
+        }
+
+        if (connection_prepare_read(conn) != 0)
+        {
+            conn->state = CONN_CLOSING;
+            return;
+        }
+        size_t space = BUFFER_SIZE - conn->buffer_length;
+        if (space == 0)
+        {
+            // Headers do not fit in the buffer; give up on this client
+            conn->state = CONN_CLOSING;
+            metrics_add(&worker->metrics->parse_errors, 1);
+            return;
+        }
+        size_t n = length < space ? length : space;
+        memcpy(conn->buffer + conn->buffer_length, data, n);
+        conn->buffer_length += n;
+        data += n;
+        length -= n;
+        process_requests(worker, conn);
+    }
+}
+
+// Starts sending the front of the batch. In-memory runs go out as one
+// sendmsg SQE; MSG_WAITALL makes the kernel finish it before completing, so
+// the last run of a closing connection can be linked to the close. File
+// ranges are rare enough to go through response_flush's sendfile() here.
+// Returns whether that sent anything.
+static int start_send(Worker *worker, UringConnection *c)
+{
+    Connection *conn = &c->base;
+    int more;
+    size_t length = response_prepare_send(&conn->output, &c->message, &more);
+
+    if (length == 0)
+    {
+        size_t pending = response_pending(&conn->output);
+        int result = response_flush(&conn->output, conn->fd);
+        worker->syscalls += response_take_syscalls(&conn->output);
+        metrics_add(&worker->metrics->bytes_out, pending - response_pending(&conn->output));
+        if (result == RESPONSE_ERROR)
+        {
+            conn->state = CONN_CLOSING;
+        }
+        else if (result == RESPONSE_PENDING)
+        {
+            struct io_uring_sqe *sqe = get_sqe(worker);
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = conn->fd;
+            sqe->poll32_events = POLLOUT;
+            sqe->user_data = tag(c, OP_POLL);
+            c->sending = OP_POLL;
+            c->inflight++;
+        }
+        return response_pending(&conn->output) < pending;
+    }
+
+    struct io_uring_sqe *sqe = get_sqe(worker);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t)&c->message;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (more ? MSG_MORE : 0);
+    sqe->user_data = tag(c, OP_SEND);
+    c->sending = OP_SEND;
+    c->send_length = length;
+    c->send_linked = !more && !connection_wants_input(conn);
+    c->inflight++;
+
+    if (c->send_linked)
+    {
+        // Step 5 without a round trip: the close runs right after the send
+        // succeeds and is cancelled if it fails
+        sqe->flags |= IOSQE_IO_LINK;
+        submit_close(c, get_sqe(worker));
+    }
+    return 0;
+}
+
+// Moves the connection along after a completion, like handle_client does
+// for epoll events. sent says whether the completion sent bytes.
+static void advance(Worker *worker, UringConnection *c, int sent)
+{
+    Connection *conn = &c->base;
+    while (!c->closing)
+    {
+        if (conn->state == CONN_READING && c->spill_length > 0)
+        {
+            size_t length = c->spill_length;
+            c->spill_length = 0;
+            feed(worker, c, c->spill, length);
+        }
+        if (conn->state == CONN_READING && c->peer_closed)
+            conn->state = CONN_CLOSING; // Everything the client sent is answered
+        if (conn->state != CONN_WRITING || c->sending)
+            break;
+
+        if (response_pending(&conn->output) > 0)
+        {
+            sent |= start_send(worker, c);
+            continue;
+        }
+        response_reset(&conn->output);
+        conn->state = connection_wants_input(conn) ? CONN_READING : CONN_CLOSING;
+    }
+
+    if (conn->state == CONN_CLOSING)
+    {
+        begin_close(worker, c);
+        return;
+    }
+    connection_update_timer(worker, conn, sent);
+    if (conn->state == CONN_READING)
+    {
+        if (!c->recv_armed)
+            arm_recv(worker, c);
+        if (conn->buffer_length == 0)
+        {
+            // The arena goes, and the spill buffer with it
+            c->spill = NULL;
+            c->spill_capacity = 0;
+            connection_park(conn);
+        }
+    }
+}
+
+// Carries on after an offloaded request completed
+static void resume_connection(Worker *worker, Connection *conn)
+{
+    UringConnection *c = (UringConnection *)conn;
+    if (c->closing)
+        begin_close(worker, c);
+    else
+        advance(worker, c, 0);
+}
+
+static void accept_completion(Worker *worker, const struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+        worker->uring->accept_armed = 0; // Re-armed at the top of the loop
+
+    if (cqe->res < 0)
+    {
+        if (cqe->res != -ECONNABORTED && cqe->res != -EINTR && cqe->res != -ECANCELED)
+            fprintf(stderr, "accept: %s\n", strerror(-cqe->res));
+        return;
+    }
+
+    UringConnection *c = (UringConnection *)connection_open(worker, cqe->res);
+    if (!c)
+    {
+        close(cqe->res);
+        return;
+    }
+    arm_recv(worker, c);
+}
+
+static void recv_completion(Worker *worker, UringConnection *c, const struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        c->recv_armed = 0;
+        c->inflight--;
+    }
+
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !c->closing)
+        {
+            metrics_add(&worker->metrics->bytes_in, cqe->res);
+            feed(worker, c, worker->uring->buffers + (size_t)id * BUFFER_SIZE, cqe->res);
+        }
+        recycle_buffer(worker->uring, id);
+    }
+    else if (cqe->res == 0)
+    {
+        c->peer_closed = 1; // Client hung up, maybe after its last request
+    }
+    else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+    {
+        c->base.state = CONN_CLOSING;
+    }
+    // -ENOBUFS: every buffer was in use; advance re-arms once they are back
+}
+
+static void send_completion(Worker *worker, UringConnection *c, const struct io_uring_cqe *cqe)
+{
+    Connection *conn = &c->base;
+    int op = c->sending;
+    c->sending = 0;
+    c->send_cancelled = 0;
+    c->inflight--;
+    if (c->closing)
+        return;
+
+    if (cqe->res < 0 || (c->send_linked && (size_t)cqe->res != c->send_length))
+    {
+        conn->state = CONN_CLOSING;
+        return;
+    }
+    if (op == OP_SEND && cqe->res > 0)
+    {
+        response_advance(&conn->output, cqe->res);
+        metrics_add(&worker->metrics->bytes_out, cqe->res);
+    }
+}
+
+static void handle_completion(Worker *worker, const struct io_uring_cqe *cqe)
+{
+    int op = cqe->user_data & OP_MASK;
+    UringConnection *c = (UringConnection *)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+
+    switch (op)
+    {
+    case OP_ACCEPT:
+        accept_completion(worker, cqe);
+        return;
+    case OP_WAKE:
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            worker->uring->wake_armed = 0; // Re-armed at the top of the loop
+        worker_complete_tasks(worker);
+        return;
+    case OP_RECV:
+        recv_completion(worker, c, cqe);
+        break;
+    case OP_SEND:
+    case OP_POLL:
+        send_completion(worker, c, cqe);
+        break;
+    case OP_CLOSE:
+        c->inflight--;
+        if (cqe->res == -ECANCELED)
+            c->close_submitted = 0; // The linked send failed; close again below
+        else
+            c->fd_closed = 1;
+        break;
+    default:
+        return;
+    }
+
+    if (c->closing)
+        begin_close(worker, c);
+    else
+        advance(worker, c, op == OP_SEND && cqe->res > 0);
+}
+
+int uring_supported(char *reason, size_t size)
+{
+    struct utsname name;
+    int major = 0, minor = 0;
+    if (uname(&name) == 0 && sscanf(name.release, "%d.%d", &major, &minor) == 2 &&
+        major < 6)
+    {
+        snprintf(reason, size, "kernel %s has no multishot recv (needs 6.0)", name.release);
+        return 0;
+    }
+
+    UringWorker *ring = ring_create(8);
+    if (!ring)
+    {
+        snprintf(reason, size, "%s", strerror(errno));
+        return 0;
+    }
+
+    static const struct
+    {
+        int opcode;
+        const char *name;
+    } required[] = {
+        {IORING_OP_ACCEPT, "accept"},   {IORING_OP_RECV, "recv"},
+        {IORING_OP_SENDMSG, "sendmsg"}, {IORING_OP_POLL_ADD, "poll"},
+        {IORING_OP_CLOSE, "close"},     {IORING_OP_ASYNC_CANCEL, "cancel"},
+    };
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    int supported = sys_io_uring_register(ring->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    if (!supported)
+        snprintf(reason, size, "opcode probe failed: %s", strerror(errno));
+    for (size_t i = 0; supported && i < sizeof(required) / sizeof(required[0]); i++)
+    {
+        if (required[i].opcode > probe->last_op ||
+            !(probe->ops[required[i].opcode].flags & IO_URING_OP_SUPPORTED))
+        {
+            snprintf(reason, size, "no %s operation", required[i].name);
+            supported = 0;
+        }
+    }
+    free(probe);
+    ring_free(ring);
+    return supported;
+}
+
+int uring_worker_init(Worker *worker)
+{
+    worker->uring = ring_create(RING_ENTRIES);
+    return worker->uring ? 0 : -1;
+}
+
+void uring_worker_free(Worker *worker)
+{
+    if (worker->uring)
+        ring_free(worker->uring);
+    worker->uring = NULL;
+}
+
+void *uring_worker_main(void *arg)
+{
+    Worker *worker = arg;
+    UringWorker *ring = worker->uring;
+
+    worker_start(worker, sizeof(UringConnection));
+    worker->resume = resume_connection;
+    while (!worker_drained(worker))
+    {
+        if (worker->server_socket != -1 && server_draining())
+            stop_accepting(worker);
+        else if (!ring->accept_armed && worker->server_socket != -1)
+            arm_accept(worker);
+        if (!ring->wake_armed && worker->completions.event_fd != -1)
+            arm_wake(worker);
+
+        // One syscall submits everything the last round queued and waits
+        // for the next completions (or the next deadline tick)
+        if (ring_enter(worker, ring, 1) == -1)
+        {
+            perror("io_uring_enter");
+            break;
+        }
+        worker_tick(worker);
+
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            // Copy the CQE and release its slot first: handling it may
+            // submit, and the kernel may then post more completions
+            struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            handle_completion(worker, &cqe);
+        }
+        if (worker->blocked)
+            worker_submit_blocked(worker);
+        expire_connections(worker, expire_connection);
+    }
+    worker_stop(worker);
+    return NULL;
+}
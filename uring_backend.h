@@ -0,0 +1,32 @@
+// io_uring event loop.
+//
+// An alternative to the epoll reactor that runs the same connection logic
+// (server.h) from completions instead of readiness: one multishot accept per
+// listener, one multishot recv per connection drawing from a ring of
+// provided buffers, and sends submitted straight from the ResponseBuilder's
+// iovecs. A response that ends the connection is linked to its close, so the
+// last batch costs no extra round trip. Everything a loop iteration queued
+// goes to the kernel in the same io_uring_enter() that waits for more work.
+//
+// Needs Linux 6.0 or newer (multishot recv); uring_supported tells main()
+// when to fall back to epoll.
+
+#ifndef URING_BACKEND_H
+#define URING_BACKEND_H
+
+#include <stddef.h>
+#include "server.h"
+
+// Returns 1 if this kernel can run the backend, or 0 with the reason in
+// reason (io_uring disabled, kernel too old, operation not supported, ...)
+int uring_supported(char *reason, size_t size);
+
+// Creates worker->uring for the worker's listener. Returns 0, or -1 with
+// errno set.
+int uring_worker_init(Worker *worker);
+void uring_worker_free(Worker *worker);
+
+// Thread entry point: the event loop of one worker
+void *uring_worker_main(void *arg);
+
+#endif